@@ -0,0 +1,162 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::AESInputStreambuf.
+ *
+ * This file implements the stage which decrypts the data of a WinZip
+ * AES encrypted entry before it gets decompressed.
+ */
+
+#include "aesinputstreambuf.hpp"
+
+#include "zipios/zipiosexceptions.hpp"
+
+#include <algorithm>
+
+
+namespace zipios
+{
+
+
+/** \class AESInputStreambuf
+ * \brief An input stream buffer decrypting WinZip AES data.
+ *
+ * This filter reads the encrypted data of one entry from the input
+ * streambuf and returns it decrypted. The input streambuf must be
+ * positioned right after the salt and the password verifier.
+ *
+ * Once all the encrypted data was read, the authentication code saved
+ * after it gets verified. A mismatch means that the data was modified
+ * or corrupted and the filter throws instead of returning the last
+ * block of data.
+ */
+
+
+/** \brief Initialize an AESInputStreambuf object.
+ *
+ * When the entry has no data, the authentication code gets verified
+ * immediately.
+ *
+ * \exception IOException
+ * This exception is raised if \p size is zero and the authentication
+ * code cannot be read or does not match.
+ *
+ * \param[in,out] inbuf  The streambuf to read the encrypted data from.
+ * \param[in] aes  The keys of the entry.
+ * \param[in] size  The number of bytes of encrypted data, not including
+ *                  the salt, the password verifier, and the
+ *                  authentication code.
+ */
+AESInputStreambuf::AESInputStreambuf(std::streambuf * inbuf, WinZipAES::pointer_t aes, offset_t size)
+    : FilterInputStreambuf(inbuf)
+    , m_aes(std::move(aes))
+    , m_remain(size)
+    , m_buffer(getBufferSize())
+{
+    // force an underflow on the first read
+    setg(&m_buffer[0], &m_buffer[0], &m_buffer[0]);
+
+    if(m_remain == 0)
+    {
+        verifyMac();
+    }
+}
+
+
+/** \brief Clean up the object.
+ *
+ * The input streambuf is not owned by this object.
+ */
+AESInputStreambuf::~AESInputStreambuf()
+{
+}
+
+
+/** \brief Read and decrypt the next block of data.
+ *
+ * \exception IOException
+ * This exception is raised if the encrypted data is truncated or if
+ * its authentication code does not match.
+ *
+ * \return The value of the next character or
+ *         std::streambuf::traits_type::eof() at the end of the data.
+ */
+std::streambuf::int_type AESInputStreambuf::underflow()
+{
+    if(gptr() < egptr())
+    {
+        return traits_type::to_int_type(*gptr()); // LCOV_EXCL_LINE
+    }
+
+    if(m_remain == 0)
+    {
+        return traits_type::eof();
+    }
+
+    std::streamsize const amount(std::min(m_remain, static_cast<offset_t>(m_buffer.size())));
+    if(m_inbuf->sgetn(&m_buffer[0], amount) != amount)
+    {
+        throw IOException("AESInputStreambuf::underflow(): the encrypted data is truncated.");
+    }
+    m_aes->decrypt(&m_buffer[0], amount);
+    m_remain -= amount;
+
+    if(m_remain == 0)
+    {
+        verifyMac();
+    }
+
+    setg(&m_buffer[0], &m_buffer[0], &m_buffer[0] + amount);
+    return traits_type::to_int_type(*gptr());
+}
+
+
+/** \brief Verify the authentication code of the data.
+ *
+ * \exception IOException
+ * This exception is raised if the code cannot be read or does not
+ * match the code computed from the encrypted data.
+ */
+void AESInputStreambuf::verifyMac()
+{
+    WinZipAES::mac_t mac;
+    if(m_inbuf->sgetn(reinterpret_cast<char *>(mac.data()), mac.size()) != static_cast<std::streamsize>(mac.size()))
+    {
+        throw IOException("AESInputStreambuf::verifyMac(): the authentication code is missing.");
+    }
+    if(mac != m_aes->getMac())
+    {
+        throw IOException("AESInputStreambuf::verifyMac(): the authentication code does not match, the encrypted data was modified.");
+    }
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
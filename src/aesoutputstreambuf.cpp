@@ -0,0 +1,136 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::AESOutputStreambuf.
+ *
+ * This file implements the stage which encrypts the data of a WinZip
+ * AES encrypted entry after it was compressed.
+ */
+
+#include "aesoutputstreambuf.hpp"
+
+#include "zipios/zipiosexceptions.hpp"
+
+
+namespace zipios
+{
+
+
+/** \class AESOutputStreambuf
+ * \brief An output stream buffer encrypting WinZip AES data.
+ *
+ * This filter encrypts the data written to it and writes the result
+ * to the output streambuf. The caller writes the salt and the password
+ * verifier before the first byte of data and calls finish() after the
+ * last one to write the authentication code.
+ */
+
+
+/** \brief Initialize an AESOutputStreambuf object.
+ *
+ * \param[in,out] outbuf  The streambuf receiving the encrypted data.
+ * \param[in] aes  The keys of the entry.
+ */
+AESOutputStreambuf::AESOutputStreambuf(std::streambuf * outbuf, WinZipAES::pointer_t aes)
+    : FilterOutputStreambuf(outbuf)
+    , m_aes(std::move(aes))
+    , m_buffer(getBufferSize())
+{
+    setp(&m_buffer[0], &m_buffer[0] + m_buffer.size());
+}
+
+
+/** \brief Clean up the object.
+ *
+ * The data not yet written is lost if finish() was not called.
+ */
+AESOutputStreambuf::~AESOutputStreambuf()
+{
+}
+
+
+/** \brief Write the pending data and the authentication code.
+ *
+ * \exception IOException
+ * This exception is raised if the data cannot be written.
+ */
+void AESOutputStreambuf::finish()
+{
+    overflow();
+
+    WinZipAES::mac_t const mac(m_aes->getMac());
+    if(m_outbuf->sputn(reinterpret_cast<char const *>(mac.data()), mac.size()) != static_cast<std::streamsize>(mac.size()))
+    {
+        throw IOException("AESOutputStreambuf::finish(): write to buffer failed."); // LCOV_EXCL_LINE
+    }
+}
+
+
+/** \brief Encrypt and write the buffered data.
+ *
+ * \exception IOException
+ * This exception is raised if the data cannot be written.
+ *
+ * \param[in] c  The character that did not fit in the buffer, or EOF.
+ *
+ * \return EOF if the function fails, 0 otherwise.
+ */
+int AESOutputStreambuf::overflow(int c)
+{
+    std::streamsize const size(pptr() - pbase());
+    m_aes->encrypt(pbase(), size);
+    if(m_outbuf->sputn(pbase(), size) != size)
+    {
+        throw IOException("AESOutputStreambuf::overflow(): write to buffer failed."); // LCOV_EXCL_LINE
+    }
+    setp(&m_buffer[0], &m_buffer[0] + m_buffer.size());
+
+    if(c != EOF)
+    {
+        *pptr() = c;
+        pbump(1);
+    }
+
+    return 0;
+}
+
+
+/** \brief Encrypt and write the buffered data.
+ *
+ * \return 0 on success.
+ */
+int AESOutputStreambuf::sync()
+{
+    return overflow();
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
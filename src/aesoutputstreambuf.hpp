@@ -0,0 +1,73 @@
+#pragma once
+#ifndef ZIPIOS_AESOUTPUTSTREAMBUF_HPP
+#define ZIPIOS_AESOUTPUTSTREAMBUF_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Header file that defines zipios::AESOutputStreambuf.
+ *
+ * The zipios::AESOutputStreambuf class encrypts the data of a WinZip
+ * AES encrypted entry.
+ */
+
+#include "filteroutputstreambuf.hpp"
+#include "winzipaes.hpp"
+
+#include <vector>
+
+
+namespace zipios
+{
+
+
+class AESOutputStreambuf : public FilterOutputStreambuf
+{
+public:
+                            AESOutputStreambuf(std::streambuf * outbuf, WinZipAES::pointer_t aes);
+                            AESOutputStreambuf(AESOutputStreambuf const & src) = delete;
+    AESOutputStreambuf &    operator = (AESOutputStreambuf const & rhs) = delete;
+    virtual                 ~AESOutputStreambuf() override;
+
+    void                    finish();
+
+protected:
+    virtual int             overflow(int c = EOF) override;
+    virtual int             sync() override;
+
+private:
+    WinZipAES::pointer_t    m_aes;
+    std::vector<char>       m_buffer;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
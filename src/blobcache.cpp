@@ -0,0 +1,332 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::BlobCache.
+ *
+ * This file defines the functions of the zipios::BlobCache class
+ * used to share compressed data between archive builds.
+ */
+
+#include "blobcache.hpp"
+
+#include "zipios/zipiosexceptions.hpp"
+
+#include "deflateoutputstreambuf.hpp"
+#include "sha256.hpp"
+#include "zipios_common.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+
+namespace zipios
+{
+
+
+namespace
+{
+
+
+/** \brief The signature at the start of each blob file.
+ *
+ * The signature is "ZBC1" (Zipios Blob Cache, version 1.)
+ */
+uint32_t const g_signature = 0x3143425A;
+
+
+/** \brief A counter used to create unique temporary filenames.
+ */
+std::atomic<uint32_t> g_temporary_counter(0);
+
+
+/** \brief A deflate stream buffer which counts its input.
+ *
+ * The DeflateOutputStreambuf expects its derived class to count the
+ * number of bytes it compresses, like the ZipOutputStreambuf does.
+ */
+class BlobDeflateStreambuf : public DeflateOutputStreambuf
+{
+public:
+    BlobDeflateStreambuf(std::streambuf * outbuf)
+        : DeflateOutputStreambuf(outbuf)
+    {
+    }
+
+protected:
+    virtual int overflow(int c = EOF) override
+    {
+        m_overflown_bytes += pptr() - pbase();
+        return DeflateOutputStreambuf::overflow(c);
+    }
+};
+
+
+} // no name namespace
+
+
+/** \class BlobCache
+ * \brief A cache of compressed files shared between archive builds.
+ *
+ * When many archives get created from overlapping sets of files, the
+ * same files get compressed over and over again. The BlobCache saves
+ * the compressed data of each file in a directory, so the next archive
+ * which includes the same data can copy it instead.
+ *
+ * The blobs are content addressed: the key is the SHA-256 digest of
+ * the uncompressed data along the storage method and compression level.
+ * Two files with the same content share the same blob, whatever their
+ * name, and a file which changed automatically gets a new blob.
+ *
+ * Each blob file starts with a small header (signature, CRC, size, and
+ * compressed size) followed by the raw deflate data, ready to be copied
+ * in a Zip archive.
+ *
+ * New blobs are first written in a temporary file which gets renamed
+ * once complete, so several processes can share the same cache
+ * directory. Nothing is ever removed from the cache by the library.
+ */
+
+
+/** \brief Initialize a blob cache.
+ *
+ * The \p directory is created on the first store() if it does not
+ * exist yet.
+ *
+ * When \p rsyncable is true, the blobs are compressed in the rsyncable
+ * mode (see DeflateOutputStreambuf::setRsyncable()) and get a different
+ * key than the blobs of the same data compressed normally.
+ *
+ * \param[in] directory  The directory where the blobs are saved.
+ * \param[in] rsyncable  Whether the blobs are compressed in the
+ *                       rsyncable mode.
+ */
+BlobCache::BlobCache(std::string const & directory, bool rsyncable)
+    : m_directory(directory)
+    , m_rsyncable(rsyncable)
+{
+}
+
+
+/** \brief Compute the key of some data.
+ *
+ * This function reads \p is to the end and computes the SHA-256 digest
+ * of its content. The key is that digest, in hexadecimal, followed by
+ * the \p method and \p level, and a flag for the rsyncable mode.
+ *
+ * \param[in,out] is  The stream with the data to compress.
+ * \param[in] method  The storage method used to compress the data.
+ * \param[in] level  The compression level used to compress the data.
+ *
+ * \return The key of the blob.
+ */
+std::string BlobCache::computeKey(std::istream & is, StorageMethod method, FileEntry::CompressionLevel level) const
+{
+    SHA256 sha;
+    std::vector<char> buffer(getBufferSize());
+    while(is)
+    {
+        is.read(&buffer[0], buffer.size());
+        sha.update(&buffer[0], is.gcount());
+    }
+
+    return sha.hexDigest()
+         + "-m" + std::to_string(static_cast<int>(method))
+         + "-l" + std::to_string(level)
+         + (m_rsyncable ? "-r" : "");
+}
+
+
+/** \brief Open a blob.
+ *
+ * This function opens the blob named \p key and reads its header.
+ * On success, the returned stream is positioned at the start of the
+ * compressed data.
+ *
+ * A blob which is missing or looks invalid (i.e. truncated) is viewed
+ * as a cache miss.
+ *
+ * \param[in] key  The key of the blob as returned by computeKey().
+ * \param[out] blob  The CRC and sizes of the blob.
+ *
+ * \return The stream to read the blob or a null pointer.
+ */
+FileCollection::stream_pointer_t BlobCache::open(std::string const & key, blob_t & blob) const
+{
+    std::shared_ptr<std::ifstream> is(new std::ifstream(getFilename(key), std::ios::in | std::ios::binary));
+    if(!*is)
+    {
+        return FileCollection::stream_pointer_t();
+    }
+
+    try
+    {
+        uint32_t signature(0);
+        uint32_t crc(0);
+        uint32_t size(0);
+        uint32_t compressed_size(0);
+        zipRead(*is, signature);
+        zipRead(*is, crc);
+        zipRead(*is, size);
+        zipRead(*is, compressed_size);
+        if(signature != g_signature)
+        {
+            return FileCollection::stream_pointer_t();
+        }
+
+        is->seekg(0, std::ios::end);
+        if(static_cast<size_t>(is->tellg()) != g_header_size + compressed_size)
+        {
+            return FileCollection::stream_pointer_t();
+        }
+        is->seekg(g_header_size);
+
+        blob.m_crc = crc;
+        blob.m_size = size;
+        blob.m_compressed_size = compressed_size;
+    }
+    catch(IOException const &)
+    {
+        return FileCollection::stream_pointer_t();
+    }
+
+    return is;
+}
+
+
+/** \brief Compress data and save it in the cache.
+ *
+ * This function compresses the data read from \p is at the specified
+ * \p level and saves the result as the blob named \p key.
+ *
+ * \exception IOException
+ * This exception is raised if the blob cannot be written.
+ *
+ * \param[in] key  The key of the blob as returned by computeKey().
+ * \param[in,out] is  The stream with the data to compress.
+ * \param[in] level  The compression level.
+ */
+void BlobCache::store(std::string const & key, std::istream & is, FileEntry::CompressionLevel level) const
+{
+    std::string const filename(getFilename(key));
+
+    // errors are ignored, the open() below fails if the directories
+    // could not be created
+    //
+    mkdir(m_directory.c_str(), 0777);
+    mkdir(filename.substr(0, filename.rfind(g_separator)).c_str(), 0777);
+
+    std::string const temporary(filename
+                              + "." + std::to_string(getpid())
+                              + "." + std::to_string(g_temporary_counter++)
+                              + ".tmp");
+
+    blob_t blob;
+    try
+    {
+        std::ofstream out(temporary, std::ios::out | std::ios::binary | std::ios::trunc);
+        if(!out)
+        {
+            throw IOException("BlobCache::store(): could not create \"" + temporary + "\".");
+        }
+
+        // the header is rewritten once the sizes are known
+        zipWrite(out, g_signature);
+        zipWrite(out, blob.m_crc);
+        zipWrite(out, static_cast<uint32_t>(blob.m_size));
+        zipWrite(out, static_cast<uint32_t>(blob.m_compressed_size));
+
+        {
+            BlobDeflateStreambuf deflate(out.rdbuf());
+            deflate.setRsyncable(m_rsyncable);
+            deflate.init(level);
+            std::vector<char> buffer(getBufferSize());
+            while(is)
+            {
+                is.read(&buffer[0], buffer.size());
+                std::streamsize const size(is.gcount());
+                if(size > 0
+                && deflate.sputn(&buffer[0], size) != size)
+                {
+                    throw IOException("BlobCache::store(): write to buffer failed."); // LCOV_EXCL_LINE
+                }
+            }
+            deflate.closeStream();
+            blob.m_crc = deflate.getCrc32();
+            blob.m_size = deflate.getSize();
+        }
+        blob.m_compressed_size = static_cast<size_t>(out.tellp()) - g_header_size;
+
+        out.seekp(0);
+        zipWrite(out, g_signature);
+        zipWrite(out, blob.m_crc);
+        zipWrite(out, static_cast<uint32_t>(blob.m_size));
+        zipWrite(out, static_cast<uint32_t>(blob.m_compressed_size));
+        out.close();
+        if(!out)
+        {
+            throw IOException("BlobCache::store(): could not write \"" + temporary + "\".");
+        }
+    }
+    catch(...)
+    {
+        unlink(temporary.c_str());
+        throw;
+    }
+
+    if(rename(temporary.c_str(), filename.c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        throw IOException("BlobCache::store(): could not rename \"" + temporary + "\" to \"" + filename + "\".");
+    }
+}
+
+
+/** \brief Get the name of the file of a blob.
+ *
+ * The blobs are saved in sub-directories named after the first two
+ * digits of their key so no one directory gets too large.
+ *
+ * \param[in] key  The key of the blob.
+ *
+ * \return The filename of the blob.
+ */
+std::string BlobCache::getFilename(std::string const & key) const
+{
+    return m_directory + g_separator + key.substr(0, 2) + g_separator + key;
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,79 @@
+#pragma once
+#ifndef BLOBCACHE_HPP
+#define BLOBCACHE_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Header file that defines zipios::BlobCache.
+ *
+ * This file declares the zipios::BlobCache class which saves the
+ * compressed data of files on disk so it can be reused by later
+ * archive builds.
+ */
+
+#include "zipios/filecollection.hpp"
+
+
+namespace zipios
+{
+
+
+class BlobCache
+{
+public:
+    struct blob_t
+    {
+        FileEntry::crc32_t  m_crc = 0;
+        size_t              m_size = 0;
+        size_t              m_compressed_size = 0;
+    };
+
+    // magic, CRC, size, compressed size
+    static size_t const     g_header_size = 4 * 4;
+
+                            BlobCache(std::string const & directory, bool rsyncable = false);
+
+    std::string             computeKey(std::istream & is, StorageMethod method, FileEntry::CompressionLevel level) const;
+    FileCollection::stream_pointer_t
+                            open(std::string const & key, blob_t & blob) const;
+    void                    store(std::string const & key, std::istream & is, FileEntry::CompressionLevel level) const;
+
+private:
+    std::string             getFilename(std::string const & key) const;
+
+    std::string             m_directory;
+    bool                    m_rsyncable = false;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
@@ -0,0 +1,203 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::CompressionBudget.
+ *
+ * This file defines the functions of the zipios::CompressionBudget
+ * class which adjusts the zlib level to the measured throughput.
+ */
+
+#include "compressionbudget.hpp"
+
+#include <zlib.h>
+
+
+namespace zipios
+{
+
+
+namespace
+{
+
+
+/** \brief How much faster than the target before trying a higher level.
+ *
+ * Each level up costs some speed, so the level only goes up when the
+ * measured throughput leaves that much room. Otherwise the level would
+ * keep going up and down around the target.
+ */
+double const g_headroom = 1.5;
+
+
+/** \brief The ratio over which the data is considered incompressible.
+ *
+ * A higher level does not make such data any smaller, the budget then
+ * goes for the fastest level instead.
+ */
+double const g_incompressible_ratio = 0.95;
+
+
+} // no name namespace
+
+
+/** \class CompressionBudget
+ * \brief Select the compression level from a throughput target.
+ *
+ * Instead of a fixed compression level, a CompressionBudget starts
+ * with the zlib default level and gets told how long it took to
+ * compress each block of data and how small the result was. Once per
+ * window of WINDOW_SIZE input bytes, it adjusts the level:
+ *
+ * \li when the throughput was under the target, the level goes down;
+ * \li when the data does not compress, the level goes down too since
+ *     a higher level would only waste time;
+ * \li when the throughput was well over the target (see g_headroom),
+ *     the level goes up to get a better ratio.
+ *
+ * The result is the best level that keeps up with the target. The
+ * throughput is the one of one thread, so the target of a writer
+ * using N threads is its total throughput divided by N.
+ */
+
+
+/** \brief The number of input bytes measured between adjustments.
+ */
+size_t const CompressionBudget::WINDOW_SIZE;
+
+
+/** \brief Initialize a compression budget.
+ *
+ * \param[in] throughput  The target in bytes per second, 0 to disable
+ *                        the budget.
+ */
+CompressionBudget::CompressionBudget(double throughput)
+    : m_throughput(throughput)
+    //, m_level(6) -- auto-init
+    //, m_input(0) -- auto-init
+    //, m_output(0) -- auto-init
+    //, m_seconds(0.0) -- auto-init
+{
+}
+
+
+/** \brief Check whether a throughput target was defined.
+ *
+ * \return true when the level is to be selected by this budget.
+ */
+bool CompressionBudget::isEnabled() const
+{
+    return m_throughput > 0.0;
+}
+
+
+/** \brief Retrieve the throughput target.
+ *
+ * \return The target in bytes per second, 0 if disabled.
+ */
+double CompressionBudget::getThroughput() const
+{
+    return m_throughput;
+}
+
+
+/** \brief Change the throughput target.
+ *
+ * The current level and measurements are kept.
+ *
+ * \param[in] throughput  The target in bytes per second, 0 to disable
+ *                        the budget.
+ */
+void CompressionBudget::setThroughput(double throughput)
+{
+    m_throughput = throughput;
+}
+
+
+/** \brief Retrieve the zlib level to use for the next block.
+ *
+ * \return A zlib level from Z_BEST_SPEED to Z_BEST_COMPRESSION.
+ */
+int CompressionBudget::getLevel() const
+{
+    return m_level;
+}
+
+
+/** \brief Account for a block of compressed data.
+ *
+ * This function adds the measurements of one block to the current
+ * window. When the window is full, the level gets adjusted and the
+ * window restarts.
+ *
+ * \param[in] input  The number of bytes given to zlib.
+ * \param[in] output  The number of compressed bytes.
+ * \param[in] seconds  The time it took to compress the block.
+ *
+ * \return true if the level changed.
+ */
+bool CompressionBudget::update(size_t input, size_t output, double seconds)
+{
+    m_input += input;
+    m_output += output;
+    m_seconds += seconds;
+    if(m_input < WINDOW_SIZE
+    || !isEnabled())
+    {
+        return false;
+    }
+
+    double const ratio(static_cast<double>(m_output) / static_cast<double>(m_input));
+    bool const too_slow(m_seconds > 0.0
+                     && static_cast<double>(m_input) / m_seconds < m_throughput);
+    bool const fast_enough(m_seconds <= 0.0
+                        || static_cast<double>(m_input) / m_seconds >= m_throughput * g_headroom);
+    m_input = 0;
+    m_output = 0;
+    m_seconds = 0.0;
+
+    int const level(m_level);
+    if((too_slow || ratio >= g_incompressible_ratio)
+    && m_level > Z_BEST_SPEED)
+    {
+        --m_level;
+    }
+    else if(fast_enough
+         && ratio < g_incompressible_ratio
+         && m_level < Z_BEST_COMPRESSION)
+    {
+        ++m_level;
+    }
+
+    return m_level != level;
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
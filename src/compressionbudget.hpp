@@ -0,0 +1,72 @@
+#pragma once
+#ifndef COMPRESSIONBUDGET_HPP
+#define COMPRESSIONBUDGET_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Header file that defines zipios::CompressionBudget.
+ *
+ * This file declares the zipios::CompressionBudget class which selects
+ * the zlib level used to reach a target compression throughput.
+ */
+
+#include <cstddef>
+
+
+namespace zipios
+{
+
+
+class CompressionBudget
+{
+public:
+    static size_t const     WINDOW_SIZE = 1024 * 1024;
+
+                            CompressionBudget(double throughput = 0.0);
+
+    bool                    isEnabled() const;
+    double                  getThroughput() const;
+    void                    setThroughput(double throughput);
+    int                     getLevel() const;
+    bool                    update(size_t input, size_t output, double seconds);
+
+private:
+    double                  m_throughput = 0.0;
+    int                     m_level = 6;
+    size_t                  m_input = 0;
+    size_t                  m_output = 0;
+    double                  m_seconds = 0.0;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
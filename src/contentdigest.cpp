@@ -0,0 +1,404 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::ContentDigest.
+ *
+ * This file includes the implementation of the zipios::ContentDigest
+ * class, which runs a set of digest functions over the data of an entry.
+ */
+
+#include "zipios/contentdigest.hpp"
+
+#include "zipios/zipiosexceptions.hpp"
+
+#include "sha256.hpp"
+#include "xxhash64.hpp"
+
+#include <algorithm>
+
+
+namespace zipios
+{
+
+
+/** \class ContentDigest
+ * \brief Compute digests of the data of an entry.
+ *
+ * The ZipOutputStreambuf computes the CRC32 of the uncompressed data
+ * of each entry as it compresses it. A CRC32 is too weak to identify
+ * the content of a file in a manifest, and reading the files a second
+ * time to hash them doubles the I/O. This class runs any number of
+ * stronger digest functions over the same bytes in the same pass.
+ *
+ * The digests can be saved in a private extra field of the entry (see
+ * writeExtraField()) so a reader can verify the data of the entry
+ * against them while decompressing it.
+ *
+ * The extra field is composed of one record per digest: one byte with
+ * the DigestAlgorithm, one byte with the size of the digest, and the
+ * bytes of the digest.
+ */
+
+
+/** \brief Initialize a ContentDigest object.
+ *
+ * \exception InvalidException
+ * This exception is raised if one of the \p algorithms is not known.
+ *
+ * \param[in] algorithms  The digests to compute, possibly none.
+ */
+ContentDigest::ContentDigest(algorithm_vector_t const & algorithms)
+    //: m_algorithms() -- auto-init
+    //, m_sha256() -- auto-init
+    //, m_xxh64() -- auto-init
+{
+    setAlgorithms(algorithms);
+}
+
+
+/** \brief Clean up a ContentDigest object.
+ *
+ * The destructor is defined here since the header only declares the
+ * digest classes.
+ */
+ContentDigest::~ContentDigest()
+{
+}
+
+
+/** \brief Retrieve the digests being computed.
+ *
+ * \return The list of algorithms, without duplicates.
+ */
+ContentDigest::algorithm_vector_t const & ContentDigest::getAlgorithms() const
+{
+    return m_algorithms;
+}
+
+
+/** \brief Define the digests to compute.
+ *
+ * The digests restart from scratch. An algorithm appearing more than
+ * once gets computed once.
+ *
+ * \exception InvalidException
+ * This exception is raised if one of the \p algorithms is not known.
+ *
+ * \param[in] algorithms  The digests to compute, possibly none.
+ */
+void ContentDigest::setAlgorithms(algorithm_vector_t const & algorithms)
+{
+    algorithm_vector_t list;
+    std::unique_ptr<SHA256> sha256;
+    std::unique_ptr<XXHash64> xxh64;
+    for(auto const a : algorithms)
+    {
+        switch(a)
+        {
+        case DigestAlgorithm::SHA256:
+            if(sha256 != nullptr)
+            {
+                continue;
+            }
+            sha256.reset(new SHA256);
+            break;
+
+        case DigestAlgorithm::XXH64:
+            if(xxh64 != nullptr)
+            {
+                continue;
+            }
+            xxh64.reset(new XXHash64);
+            break;
+
+        default:
+            throw InvalidException("ContentDigest::setAlgorithms(): unknown digest algorithm.");
+
+        }
+        list.push_back(a);
+    }
+
+    m_algorithms.swap(list);
+    m_sha256.swap(sha256);
+    m_xxh64.swap(xxh64);
+}
+
+
+/** \brief Check whether any digest gets computed.
+ *
+ * \return true if no digest gets computed.
+ */
+bool ContentDigest::empty() const
+{
+    return m_algorithms.empty();
+}
+
+
+/** \brief Restart the computation of the digests.
+ *
+ * This function is called at the start of each entry.
+ */
+void ContentDigest::reset()
+{
+    if(m_sha256 != nullptr)
+    {
+        m_sha256->reset();
+    }
+    if(m_xxh64 != nullptr)
+    {
+        m_xxh64->reset();
+    }
+}
+
+
+/** \brief Add data to the digests.
+ *
+ * \param[in] data  The uncompressed data to add.
+ * \param[in] size  The number of bytes in \p data.
+ */
+void ContentDigest::update(void const * data, size_t size)
+{
+    if(m_sha256 != nullptr)
+    {
+        m_sha256->update(data, size);
+    }
+    if(m_xxh64 != nullptr)
+    {
+        m_xxh64->update(data, size);
+    }
+}
+
+
+/** \brief Retrieve the digests of the data added so far.
+ *
+ * The state of the digests is not modified, so more data can be
+ * added afterward.
+ *
+ * \return A map of the digests, one per algorithm.
+ */
+ContentDigest::digest_map_t ContentDigest::digests() const
+{
+    digest_map_t result;
+    if(m_sha256 != nullptr)
+    {
+        SHA256 sha(*m_sha256);
+        SHA256::digest_t const d(sha.digest());
+        result[DigestAlgorithm::SHA256] = FileEntry::buffer_t(d.begin(), d.end());
+    }
+    if(m_xxh64 != nullptr)
+    {
+        XXHash64::digest_t const d(m_xxh64->digest());
+        result[DigestAlgorithm::XXH64] = FileEntry::buffer_t(d.begin(), d.end());
+    }
+    return result;
+}
+
+
+/** \brief Retrieve the name of an algorithm.
+ *
+ * \param[in] algorithm  The algorithm to name.
+ *
+ * \return The name in lowercase, "sha256" or "xxh64", or an empty
+ *         string if the algorithm is not known.
+ */
+std::string ContentDigest::getName(DigestAlgorithm algorithm)
+{
+    switch(algorithm)
+    {
+    case DigestAlgorithm::SHA256:
+        return "sha256";
+
+    case DigestAlgorithm::XXH64:
+        return "xxh64";
+
+    }
+
+    return std::string();
+}
+
+
+/** \brief Retrieve the size of the digest of an algorithm.
+ *
+ * \param[in] algorithm  The algorithm.
+ *
+ * \return The number of bytes of its digests, or 0 if the algorithm
+ *         is not known.
+ */
+size_t ContentDigest::getDigestSize(DigestAlgorithm algorithm)
+{
+    switch(algorithm)
+    {
+    case DigestAlgorithm::SHA256:
+        return std::tuple_size<SHA256::digest_t>::value;
+
+    case DigestAlgorithm::XXH64:
+        return std::tuple_size<XXHash64::digest_t>::value;
+
+    }
+
+    return 0;
+}
+
+
+/** \brief Convert a digest to hexadecimal.
+ *
+ * \param[in] digest  The digest to convert.
+ *
+ * \return The digest as a string of lowercase hexadecimal digits.
+ */
+std::string ContentDigest::toHex(FileEntry::buffer_t const & digest)
+{
+    static char const hex[] = "0123456789abcdef";
+
+    std::string result;
+    result.reserve(digest.size() * 2);
+    for(auto const b : digest)
+    {
+        result += hex[b >> 4];
+        result += hex[b & 15];
+    }
+    return result;
+}
+
+
+/** \brief Read the digests saved in an extra field.
+ *
+ * Records of unknown algorithms are ignored.
+ *
+ * \param[in] extra  The extra field of an entry.
+ * \param[out] digests  The map receiving the digests.
+ *
+ * \return true if the digest extra field was found and valid.
+ */
+bool ContentDigest::readExtraField(FileEntry::buffer_t const & extra, digest_map_t & digests)
+{
+    size_t pos(0);
+    while(pos + 4 <= extra.size())
+    {
+        uint16_t const id(extra[pos] | (extra[pos + 1] << 8));
+        size_t const size(extra[pos + 2] | (extra[pos + 3] << 8));
+        if(pos + 4 + size > extra.size())
+        {
+            break;
+        }
+        if(id == EXTRA_FIELD_ID)
+        {
+            digest_map_t result;
+            size_t p(pos + 4);
+            size_t const end(pos + 4 + size);
+            while(p + 2 <= end)
+            {
+                DigestAlgorithm const algorithm(static_cast<DigestAlgorithm>(extra[p]));
+                size_t const digest_size(extra[p + 1]);
+                if(p + 2 + digest_size > end)
+                {
+                    return false;
+                }
+                size_t const expected_size(getDigestSize(algorithm));
+                if(expected_size != 0
+                && expected_size == digest_size)
+                {
+                    result[algorithm] = FileEntry::buffer_t(extra.begin() + p + 2, extra.begin() + p + 2 + digest_size);
+                }
+                p += 2 + digest_size;
+            }
+            if(p != end)
+            {
+                return false;
+            }
+            digests.swap(result);
+            return true;
+        }
+        pos += 4 + size;
+    }
+
+    return false;
+}
+
+
+/** \brief Add the digest extra field.
+ *
+ * Any existing digest extra field gets replaced.
+ *
+ * \exception InvalidException
+ * This exception is raised if a digest is larger than 255 bytes.
+ *
+ * \param[in,out] extra  The extra field of an entry.
+ * \param[in] digests  The digests to save.
+ */
+void ContentDigest::writeExtraField(FileEntry::buffer_t & extra, digest_map_t const & digests)
+{
+    removeExtraField(extra);
+
+    FileEntry::buffer_t data;
+    for(auto const & d : digests)
+    {
+        if(d.second.size() > 255)
+        {
+            throw InvalidException("ContentDigest::writeExtraField(): digest too large.");
+        }
+        data.push_back(static_cast<unsigned char>(d.first));
+        data.push_back(static_cast<unsigned char>(d.second.size()));
+        data.insert(data.end(), d.second.begin(), d.second.end());
+    }
+
+    extra.push_back(static_cast<unsigned char>(EXTRA_FIELD_ID & 255));
+    extra.push_back(static_cast<unsigned char>(EXTRA_FIELD_ID >> 8));
+    extra.push_back(static_cast<unsigned char>(data.size() & 255));
+    extra.push_back(static_cast<unsigned char>(data.size() >> 8));
+    extra.insert(extra.end(), data.begin(), data.end());
+}
+
+
+/** \brief Remove the digest extra field.
+ *
+ * \param[in,out] extra  The extra field of an entry.
+ */
+void ContentDigest::removeExtraField(FileEntry::buffer_t & extra)
+{
+    size_t pos(0);
+    while(pos + 4 <= extra.size())
+    {
+        uint16_t const id(extra[pos] | (extra[pos + 1] << 8));
+        size_t const size(std::min(static_cast<size_t>(extra[pos + 2] | (extra[pos + 3] << 8)), extra.size() - pos - 4));
+        if(id == EXTRA_FIELD_ID)
+        {
+            extra.erase(extra.begin() + pos, extra.begin() + pos + 4 + size);
+        }
+        else
+        {
+            pos += 4 + size;
+        }
+    }
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
@@ -31,10 +31,72 @@
 
 #include "zipios_common.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
 
 namespace zipios
 {
 
+
+namespace
+{
+
+
+/** \brief Mask of the rolling hash bits defining a block boundary.
+ *
+ * In the rsyncable mode, a block ends when these bits of the rolling
+ * hash are all zero, which happens on average once every 8Kb.
+ */
+uint32_t const g_rsync_mask = 0xFFF80000;
+
+
+/** \brief Minimum size of a block in the rsyncable mode.
+ *
+ * Data such as a run of zeroes could otherwise end a block at each
+ * byte, and each flush costs a few bytes of output.
+ */
+size_t const g_rsync_minimum_block = 2048;
+
+
+/** \brief Compute the gear table of the rolling hash.
+ *
+ * The rolling hash of the rsyncable mode is a gear hash: each byte
+ * shifts the hash left by one bit and adds a random value selected by
+ * that byte, so the top bits depend on the last 32 bytes of data.
+ *
+ * The values are generated with a fixed seed so the boundaries, and
+ * thus the compressed data, are the same on all systems.
+ *
+ * \return A pointer to the 256 values of the gear table.
+ */
+uint32_t const * gearTable()
+{
+    static struct gear_t
+    {
+        gear_t()
+        {
+            uint32_t seed(0x9E3779B9);
+            for(auto & value : m_values)
+            {
+                // xorshift32
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                value = seed;
+            }
+        }
+
+        uint32_t m_values[256];
+    } const gear;
+
+    return gear.m_values;
+}
+
+
+} // no name namespace
+
 /** \class DeflateOutputStreambuf
  * \brief A class to handle stream deflate on the fly.
  *
@@ -62,6 +124,11 @@ DeflateOutputStreambuf::DeflateOutputStreambuf(std::streambuf *outbuf)
     //, m_zs_initialized(false) -- auto-init
     , m_outvec(getBufferSize())
     //, m_crc32(0) -- auto-init
+    //, m_digest() -- auto-init
+    //, m_rsyncable(false) -- auto-init
+    //, m_rsync_hash(0) -- auto-init
+    //, m_rsync_distance(0) -- auto-init
+    //, m_budget() -- auto-init
 {
     // NOTICE: It is important that this constructor and the methods it
     //         calls does not do anything with the output streambuf m_outbuf.
@@ -90,31 +157,18 @@ DeflateOutputStreambuf::~DeflateOutputStreambuf()
 }
 
 
-/** \brief Initialize the zlib library.
+/** \brief Convert a compression level to a zlib level.
  *
- * This method is called in the constructor, so it must not write
- * anything to the output streambuf m_outbuf (see notice in
- * constructor.)
+ * This function converts one of the zipios compression levels, as
+ * defined in zipios/fileentry.hpp, to the level passed to zlib.
  *
- * It will initialize the output stream as required to accept data
- * to be compressed using the zlib library. The compression level
- * is expected to come from the FileEntry which is about to be
- * saved in the file.
+ * \param[in] compression_level  The zipios compression level, it cannot
+ *                               be COMPRESSION_LEVEL_NONE.
  *
- * \return true if the initialization succeeded, false otherwise.
+ * \return The zlib compression level.
  */
-bool DeflateOutputStreambuf::init(FileEntry::CompressionLevel compression_level)
+int DeflateOutputStreambuf::getZlibLevel(FileEntry::CompressionLevel compression_level)
 {
-    if(m_zs_initialized)
-    {
-        // This is excluded from the coverage since if we reach this
-        // line there is an internal error that needs to be fixed.
-        throw std::logic_error("DeflateOutputStreambuf::init(): initialization function called when the class is already initialized. This is not supported."); // LCOV_EXCL_LINE
-    }
-    m_zs_initialized = true;
-
-    int const default_mem_level(8);
-
     int zlevel(Z_NO_COMPRESSION);
     switch(compression_level)
     {
@@ -131,7 +185,7 @@ bool DeflateOutputStreambuf::init(FileEntry::CompressionLevel compression_level)
         break;
 
     case FileEntry::COMPRESSION_LEVEL_NONE:
-        throw std::logic_error("the compression level NONE is not supported in DeflateOutputStreambuf::init()"); // LCOV_EXCL_LINE
+        throw std::logic_error("the compression level NONE is not supported in DeflateOutputStreambuf::getZlibLevel()"); // LCOV_EXCL_LINE
 
     default:
         if(compression_level < FileEntry::COMPRESSION_LEVEL_MINIMUM
@@ -157,6 +211,39 @@ bool DeflateOutputStreambuf::init(FileEntry::CompressionLevel compression_level)
 
     }
 
+    return zlevel;
+}
+
+
+/** \brief Initialize the zlib library.
+ *
+ * This method is called in the constructor, so it must not write
+ * anything to the output streambuf m_outbuf (see notice in
+ * constructor.)
+ *
+ * It will initialize the output stream as required to accept data
+ * to be compressed using the zlib library. The compression level
+ * is expected to come from the FileEntry which is about to be
+ * saved in the file.
+ *
+ * \return true if the initialization succeeded, false otherwise.
+ */
+bool DeflateOutputStreambuf::init(FileEntry::CompressionLevel compression_level)
+{
+    if(m_zs_initialized)
+    {
+        // This is excluded from the coverage since if we reach this
+        // line there is an internal error that needs to be fixed.
+        throw std::logic_error("DeflateOutputStreambuf::init(): initialization function called when the class is already initialized. This is not supported."); // LCOV_EXCL_LINE
+    }
+    m_zs_initialized = true;
+
+    int const default_mem_level(8);
+
+    int const zlevel(m_budget.isEnabled()
+                        ? m_budget.getLevel()
+                        : getZlibLevel(compression_level));
+
     // m_zs.next_in and avail_in must be set according to
     // zlib.h (inline doc).
     m_zs.next_in  = reinterpret_cast<unsigned char *>(&m_invec[0]);
@@ -184,7 +271,11 @@ bool DeflateOutputStreambuf::init(FileEntry::CompressionLevel compression_level)
     // streambuf init:
     setp(&m_invec[0], &m_invec[0] + getBufferSize());
 
-    m_crc32 = crc32(0, Z_NULL, 0);
+    resetCrc32();
+
+    // each file starts a new set of content-defined blocks
+    m_rsync_hash = 0;
+    m_rsync_distance = 0;
 
     return err == Z_OK;
 }
@@ -224,6 +315,42 @@ void DeflateOutputStreambuf::closeStream()
 }
 
 
+/** \brief Restart the computation of the CRC32.
+ *
+ * This function resets the CRC32 and the digests so the next call to
+ * updateCrc32() or deflateData() starts the CRC of a new file.
+ */
+void DeflateOutputStreambuf::resetCrc32()
+{
+    m_crc32 = crc32(0, Z_NULL, 0);
+    m_digest.reset();
+}
+
+
+/** \brief Add data to the CRC32.
+ *
+ * The deflateData() function updates the CRC32 and the digests of the
+ * data it compresses. A derived class which saves data without
+ * compressing it calls this function instead so getCrc32() and
+ * getDigests() remain valid.
+ *
+ * \param[in] data  The data being saved.
+ * \param[in] size  The number of bytes in \p data.
+ */
+void DeflateOutputStreambuf::updateCrc32(char const * data, size_t size)
+{
+    // crc32() takes 32 bit sizes
+    while(size > 0)
+    {
+        uInt const amount(static_cast<uInt>(std::min(size, static_cast<size_t>(std::numeric_limits<uInt>::max()))));
+        m_crc32 = crc32(m_crc32, reinterpret_cast<Bytef const *>(data), amount);
+        m_digest.update(data, amount);
+        data += amount;
+        size -= amount;
+    }
+}
+
+
 /** \brief Get the CRC32 of the file.
  *
  * This function returns the CRC32 for the current file.
@@ -242,6 +369,48 @@ uint32_t DeflateOutputStreambuf::getCrc32() const
 }
 
 
+/** \brief Retrieve the digests computed over the data.
+ *
+ * \return The list of digest algorithms run along the CRC32.
+ */
+ContentDigest::algorithm_vector_t const & DeflateOutputStreambuf::getDigestAlgorithms() const
+{
+    return m_digest.getAlgorithms();
+}
+
+
+/** \brief Define the digests computed over the data.
+ *
+ * The digests are computed over the uncompressed data in the same
+ * pass as the CRC32, so the data does not have to be read a second
+ * time to hash it. By default no digest gets computed.
+ *
+ * The new list takes effect with the next file.
+ *
+ * \exception InvalidException
+ * This exception is raised if one of the \p algorithms is not known.
+ *
+ * \param[in] algorithms  The digest algorithms to run.
+ */
+void DeflateOutputStreambuf::setDigestAlgorithms(ContentDigest::algorithm_vector_t const & algorithms)
+{
+    m_digest.setAlgorithms(algorithms);
+}
+
+
+/** \brief Get the digests of the file.
+ *
+ * Like getCrc32(), the digests are only complete once closeStream()
+ * was called.
+ *
+ * \return The digests of the last file that was passed through.
+ */
+ContentDigest::digest_map_t DeflateOutputStreambuf::getDigests() const
+{
+    return m_digest.digests();
+}
+
+
 /** \brief Retrieve the size of the file deflated.
  *
  * This function returns the number of bytes written to the
@@ -274,35 +443,101 @@ size_t DeflateOutputStreambuf::getSize() const
  */
 int DeflateOutputStreambuf::overflow(int c)
 {
-    int err(Z_OK);
+    deflateData(&m_invec[0], pptr() - pbase());
 
-    m_zs.avail_in = pptr() - pbase();
-    m_zs.next_in = reinterpret_cast<unsigned char *>(&m_invec[0]);
+    // Update 'put' pointers
+    setp(&m_invec[0], &m_invec[0] + getBufferSize());
 
-    if(m_zs.avail_in > 0)
+    if(c != EOF)
     {
-        m_crc32 = crc32(m_crc32, m_zs.next_in, m_zs.avail_in); // update crc32
+        *pptr() = c;
+        pbump(1);
+    }
 
-        m_zs.next_out = reinterpret_cast<unsigned char *>(&m_outvec[0]);
-        m_zs.avail_out = getBufferSize();
+    return 0;
+}
 
-        // Deflate until m_invec is empty.
-        while((m_zs.avail_in > 0 || m_zs.avail_out == 0) && err == Z_OK)
+
+/** \brief Compress a block of data.
+ *
+ * This function updates the CRC32 with \p data and sends it to zlib.
+ * The compressed data is written to the output streambuf.
+ *
+ * The data does not have to be in m_invec. A derived class can call
+ * this function with the buffer of its caller to avoid a copy. Note
+ * that this function does not update m_overflown_bytes.
+ *
+ * \exception IOException
+ * This exception is raised whenever a zlib library function returns
+ * an error.
+ *
+ * \param[in] data  The data to compress.
+ * \param[in] size  The number of bytes in \p data.
+ */
+void DeflateOutputStreambuf::deflateData(char const * data, size_t size)
+{
+    if(m_budget.isEnabled()
+    && size > CompressionBudget::WINDOW_SIZE)
+    {
+        // measure large blocks in pieces so the level can change
+        // within them too
+        for(size_t pos(0); pos < size; pos += CompressionBudget::WINDOW_SIZE)
         {
-            if(m_zs.avail_out == 0)
+            deflateData(data + pos, std::min(size - pos, CompressionBudget::WINDOW_SIZE));
+        }
+        return;
+    }
+
+    int err(Z_OK);
+
+    std::chrono::steady_clock::time_point const budget_start(m_budget.isEnabled()
+                            ? std::chrono::steady_clock::now()
+                            : std::chrono::steady_clock::time_point());
+    uLong const total_out(m_zs.total_out);
+
+    if(m_rsyncable)
+    {
+        // end a block each time the rolling hash hits a boundary
+        uint32_t const * gear(gearTable());
+        unsigned char const * bytes(reinterpret_cast<unsigned char const *>(data));
+        size_t start(0);
+        for(size_t idx(0); idx < size && err == Z_OK; ++idx)
+        {
+            m_rsync_hash = (m_rsync_hash << 1) + gear[bytes[idx]];
+            ++m_rsync_distance;
+            if(m_rsync_distance >= g_rsync_minimum_block
+            && (m_rsync_hash & g_rsync_mask) == 0)
             {
-                flushOutvec();
+                err = compressBlock(data + start, idx + 1 - start, Z_FULL_FLUSH);
+                start = idx + 1;
+                m_rsync_distance = 0;
             }
-
-            err = deflate(&m_zs, Z_NO_FLUSH);
+        }
+        if(err == Z_OK)
+        {
+            err = compressBlock(data + start, size - start, Z_NO_FLUSH);
         }
     }
+    else
+    {
+        err = compressBlock(data, size, Z_NO_FLUSH);
+    }
+
+    // do not keep a pointer to the caller's buffer
+    m_zs.next_in = reinterpret_cast<unsigned char *>(&m_invec[0]);
+    m_zs.avail_in = 0;
 
     // somehow we need this flush here or it fails
     flushOutvec();
 
-    // Update 'put' pointers
-    setp(&m_invec[0], &m_invec[0] + getBufferSize());
+    if(m_budget.isEnabled()
+    && err == Z_OK
+    && m_budget.update(size
+                     , m_zs.total_out - total_out
+                     , std::chrono::duration<double>(std::chrono::steady_clock::now() - budget_start).count()))
+    {
+        applyBudgetLevel();
+    }
 
     if(err != Z_OK && err != Z_STREAM_END)
     {
@@ -316,14 +551,143 @@ int DeflateOutputStreambuf::overflow(int c)
         msgs << "Deflation failed:" << zError(err); // LCOV_EXCL_LINE
         throw IOException(msgs.str()); // LCOV_EXCL_LINE
     }
+}
 
-    if(c != EOF)
+
+/** \brief Check whether the rsyncable mode is on.
+ *
+ * \return true if the compressed data is made rsync friendly.
+ *
+ * \sa setRsyncable()
+ */
+bool DeflateOutputStreambuf::isRsyncable() const
+{
+    return m_rsyncable;
+}
+
+
+/** \brief Make the compressed data rsync friendly.
+ *
+ * A change in the input of deflate generally changes all the compressed
+ * data that follows, which defeats delta transfer tools such as rsync.
+ *
+ * In the rsyncable mode, the compressor computes a rolling hash of the
+ * input and does a full flush each time that hash hits a boundary, as
+ * gzip --rsyncable does, on average once every 8Kb. A full flush
+ * resets the compressor state, so the compressed data of a block only
+ * depends on the content of that block and the boundaries only depend
+ * on the content around them. Unchanged regions of a file therefore
+ * produce the same compressed bytes from one version to the next. The
+ * cost is a larger output since each block starts with an empty
+ * dictionary: a few percent on typical data, more on highly
+ * compressible data.
+ *
+ * The mode takes effect with the next call to init().
+ *
+ * \param[in] rsyncable  Whether the compressed data is rsync friendly.
+ */
+void DeflateOutputStreambuf::setRsyncable(bool rsyncable)
+{
+    m_rsyncable = rsyncable;
+}
+
+
+/** \brief Retrieve the compression budget.
+ *
+ * \return The target throughput in bytes per second, 0 when the
+ *         compression level of the entries is used.
+ *
+ * \sa setCompressionBudget()
+ */
+double DeflateOutputStreambuf::getCompressionBudget() const
+{
+    return m_budget.getThroughput();
+}
+
+
+/** \brief Select the compression level from a target throughput.
+ *
+ * When \p throughput is not zero, the compression level of the entries
+ * is ignored. Instead the time it takes to compress the data gets
+ * measured and the level is adjusted, within an entry and from one
+ * entry to the next, to the best level which keeps up with
+ * \p throughput (see CompressionBudget).
+ *
+ * The level reached at the end of an entry is kept for the next one.
+ *
+ * \param[in] throughput  The target in bytes per second of input, 0 to
+ *                        use the compression level of each entry.
+ */
+void DeflateOutputStreambuf::setCompressionBudget(double throughput)
+{
+    m_budget.setThroughput(throughput);
+}
+
+
+/** \brief Switch zlib to the level selected by the budget.
+ *
+ * deflateParams() ends the current deflate block with the previous
+ * level before switching, so the output buffer may have to be flushed
+ * a few times for the call to succeed. If it still fails, the previous
+ * level remains in effect, which is harmless.
+ */
+void DeflateOutputStreambuf::applyBudgetLevel()
+{
+    int err(Z_BUF_ERROR);
+    for(int retry(0); retry < 8 && err == Z_BUF_ERROR; ++retry)
     {
-        *pptr() = c;
-        pbump(1);
+        err = deflateParams(&m_zs, m_budget.getLevel(), Z_DEFAULT_STRATEGY);
+        flushOutvec();
     }
+}
 
-    return 0;
+
+/** \brief Send a block of data to zlib.
+ *
+ * This function updates the CRC32 with \p data and compresses it.
+ * The \p flush parameter is applied once all the data was given to
+ * zlib.
+ *
+ * \param[in] data  The data to compress.
+ * \param[in] size  The number of bytes in \p data.
+ * \param[in] flush  The zlib flush mode applied at the end of the block.
+ *
+ * \return The last zlib error code.
+ */
+int DeflateOutputStreambuf::compressBlock(char const * data, size_t size, int flush)
+{
+    int err(Z_OK);
+
+    // zlib and crc32() take 32 bit sizes
+    while(size > 0 && err == Z_OK)
+    {
+        uInt const amount(static_cast<uInt>(std::min(size, static_cast<size_t>(std::numeric_limits<uInt>::max()))));
+        int const block_flush(amount == size ? flush : Z_NO_FLUSH);
+
+        m_zs.avail_in = amount;
+        m_zs.next_in = reinterpret_cast<unsigned char *>(const_cast<char *>(data));
+
+        m_crc32 = crc32(m_crc32, m_zs.next_in, m_zs.avail_in); // update crc32
+        m_digest.update(m_zs.next_in, m_zs.avail_in);
+
+        // the output buffer is only written and reset by flushOutvec()
+
+        // Deflate until the data is consumed.
+        while((m_zs.avail_in > 0 || m_zs.avail_out == 0) && err == Z_OK)
+        {
+            if(m_zs.avail_out == 0)
+            {
+                flushOutvec();
+            }
+
+            err = deflate(&m_zs, block_flush);
+        }
+
+        data += amount;
+        size -= amount;
+    }
+
+    return err;
 }
 
 
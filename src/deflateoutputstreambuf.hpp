@@ -32,9 +32,10 @@
  * The counter part is the class zipios::InflateInputStreambuf.
  */
 
+#include "compressionbudget.hpp"
 #include "filteroutputstreambuf.hpp"
 
-#include "zipios/fileentry.hpp"
+#include "zipios/contentdigest.hpp"
 
 #include <cstdint>
 
@@ -52,21 +53,38 @@ public:
     DeflateOutputStreambuf& operator = (DeflateOutputStreambuf const & rhs) = delete;
     virtual                 ~DeflateOutputStreambuf();
 
+    static int              getZlibLevel(FileEntry::CompressionLevel compression_level);
+
     bool                    init(FileEntry::CompressionLevel compression_level);
     void                    closeStream();
     uint32_t                getCrc32() const;
+    ContentDigest::algorithm_vector_t const &
+                            getDigestAlgorithms() const;
+    void                    setDigestAlgorithms(ContentDigest::algorithm_vector_t const & algorithms);
+    ContentDigest::digest_map_t
+                            getDigests() const;
     size_t                  getSize() const;
+    bool                    isRsyncable() const;
+    void                    setRsyncable(bool rsyncable);
+    double                  getCompressionBudget() const;
+    void                    setCompressionBudget(double throughput);
 
 protected:
     virtual int             overflow(int c = EOF);
     virtual int             sync();
 
+    void                    deflateData(char const * data, size_t size);
+    void                    resetCrc32();
+    void                    updateCrc32(char const * data, size_t size);
+
     uint32_t                m_overflown_bytes = 0;
     std::vector<char>       m_invec;
 
 private:
+    void                    applyBudgetLevel();
     void                    endDeflation();
     void                    flushOutvec();
+    int                     compressBlock(char const * data, size_t size, int flush);
 
     z_stream                m_zs = z_stream();
     bool                    m_zs_initialized = false;
@@ -74,6 +92,13 @@ private:
     std::vector<char>       m_outvec;
 
     uint32_t                m_crc32 = 0;
+    ContentDigest           m_digest;
+
+    bool                    m_rsyncable = false;
+    uint32_t                m_rsync_hash = 0;
+    size_t                  m_rsync_distance = 0;
+
+    CompressionBudget       m_budget;
 };
 
 
@@ -0,0 +1,270 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::DeflateThreadPool.
+ *
+ * This file defines the functions of the zipios::DeflateThreadPool
+ * class which compresses chunks of data with several threads.
+ */
+
+#include "deflatethreadpool.hpp"
+
+#include "deflateoutputstreambuf.hpp"
+
+#include "zipios/zipiosexceptions.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#include <zlib.h>
+
+
+namespace zipios
+{
+
+
+/** \class DeflateThreadPool
+ * \brief Compress chunks of data in parallel.
+ *
+ * The DeflateThreadPool class runs a set of threads compressing
+ * chunks of data with zlib. The data of a file gets cut in chunks
+ * (see CHUNK_SIZE) which are compressed independently and saved one
+ * after the other, the same way pigz does it:
+ *
+ * \li each chunk but the last ends with a sync flush, so its output
+ *     ends on a byte boundary and does not terminate the deflate
+ *     stream;
+ * \li each chunk but the first is primed with the last 32Kb of the
+ *     previous chunk, so the matches can still reach back in the
+ *     previous data and the compression ratio barely changes;
+ * \li the CRC32 of each chunk is computed by the thread compressing
+ *     it and the caller combines them with crc32_combine().
+ *
+ * The concatenated output is one valid raw deflate stream.
+ */
+
+
+/** \brief The size of the chunks of data compressed by each thread.
+ */
+size_t const DeflateThreadPool::CHUNK_SIZE;
+
+
+/** \brief The size of the dictionary given to each chunk.
+ *
+ * This is the size of the deflate window, no match can go further back.
+ */
+size_t const DeflateThreadPool::DICTIONARY_SIZE;
+
+
+/** \brief Initialize the pool and start its threads.
+ *
+ * \param[in] thread_count  The number of threads, at least one thread
+ *                          gets started.
+ */
+DeflateThreadPool::DeflateThreadPool(size_t thread_count)
+    //: m_queue() -- auto-init
+    //, m_stop(false) -- auto-init
+    //, m_threads() -- initialized below
+{
+    thread_count = std::max(thread_count, static_cast<size_t>(1));
+    m_threads.reserve(thread_count);
+    for(size_t idx(0); idx < thread_count; ++idx)
+    {
+        m_threads.push_back(std::thread(&DeflateThreadPool::worker, this));
+    }
+}
+
+
+/** \brief Stop the threads.
+ *
+ * The chunks still in the queue are not compressed.
+ */
+DeflateThreadPool::~DeflateThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_cond.notify_all();
+    }
+    for(auto & t : m_threads)
+    {
+        t.join();
+    }
+}
+
+
+/** \brief Queue a chunk to be compressed.
+ *
+ * The \p chunk must not be modified until wait() returns.
+ *
+ * \param[in] chunk  The chunk to compress.
+ */
+void DeflateThreadPool::submit(chunk_t::pointer_t chunk)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_queue.push_back(chunk);
+    m_cond.notify_one();
+}
+
+
+/** \brief Wait until a chunk is compressed.
+ *
+ * \exception IOException
+ * This exception is raised if the compression of \p chunk failed.
+ *
+ * \param[in] chunk  The chunk to wait on.
+ */
+void DeflateThreadPool::wait(chunk_t::pointer_t chunk)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done_cond.wait(lock, [&chunk]{ return chunk->m_done; });
+    if(!chunk->m_error.empty())
+    {
+        throw IOException(chunk->m_error);
+    }
+}
+
+
+/** \brief Compress one chunk.
+ *
+ * This function compresses the input of \p chunk in its output and
+ * computes the CRC32 of the input. The time it took gets saved in
+ * the chunk so a CompressionBudget can be updated.
+ *
+ * The zlib level is m_zlib_level, when not zero, or the one matching
+ * the compression level of the entry.
+ *
+ * \exception IOException
+ * This exception is raised if zlib fails.
+ *
+ * \param[in,out] chunk  The chunk to compress.
+ */
+void DeflateThreadPool::compress(chunk_t & chunk)
+{
+    std::chrono::steady_clock::time_point const start(std::chrono::steady_clock::now());
+
+    chunk.m_crc32 = crc32(0L, Z_NULL, 0);
+    chunk.m_crc32 = crc32(chunk.m_crc32, reinterpret_cast<Bytef const *>(chunk.m_input.data()), chunk.m_input.size());
+
+    z_stream zs = z_stream();
+    int const level(chunk.m_zlib_level != 0
+                        ? chunk.m_zlib_level
+                        : DeflateOutputStreambuf::getZlibLevel(chunk.m_level));
+    int err(deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY));
+    if(err != Z_OK)
+    {
+        throw IOException(std::string("DeflateThreadPool::compress(): error while initializing zlib, ") + zError(err)); // LCOV_EXCL_LINE
+    }
+
+    if(!chunk.m_dictionary.empty())
+    {
+        deflateSetDictionary(&zs, reinterpret_cast<Bytef const *>(chunk.m_dictionary.data()), chunk.m_dictionary.size());
+    }
+
+    // the bound is enough for Z_FINISH, the sync flush adds a few bytes
+    chunk.m_output.resize(deflateBound(&zs, chunk.m_input.size()) + 16);
+    zs.next_in = reinterpret_cast<Bytef *>(chunk.m_input.data());
+    zs.avail_in = chunk.m_input.size();
+    zs.next_out = reinterpret_cast<Bytef *>(chunk.m_output.data());
+    zs.avail_out = chunk.m_output.size();
+
+    int const flush(chunk.m_last ? Z_FINISH : Z_SYNC_FLUSH);
+    for(;;)
+    {
+        err = deflate(&zs, flush);
+        if(err != Z_OK
+        && err != Z_STREAM_END
+        && err != Z_BUF_ERROR)
+        {
+            deflateEnd(&zs); // LCOV_EXCL_LINE
+            throw IOException(std::string("DeflateThreadPool::compress(): error while compressing, ") + zError(err)); // LCOV_EXCL_LINE
+        }
+        if(err == Z_STREAM_END
+        || (flush == Z_SYNC_FLUSH && zs.avail_out != 0))
+        {
+            break;
+        }
+
+        // LCOV_EXCL_START
+        size_t const used(chunk.m_output.size() - zs.avail_out);
+        chunk.m_output.resize(chunk.m_output.size() * 2);
+        zs.next_out = reinterpret_cast<Bytef *>(chunk.m_output.data() + used);
+        zs.avail_out = chunk.m_output.size() - used;
+        // LCOV_EXCL_STOP
+    }
+    chunk.m_output.resize(chunk.m_output.size() - zs.avail_out);
+
+    deflateEnd(&zs);
+
+    chunk.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+/** \brief Compress the chunks of the queue.
+ *
+ * Each thread of the pool runs this function until the pool gets
+ * destroyed.
+ */
+void DeflateThreadPool::worker()
+{
+    for(;;)
+    {
+        chunk_t::pointer_t chunk;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this]{ return m_stop || !m_queue.empty(); });
+            if(m_stop)
+            {
+                return;
+            }
+            chunk = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        std::string error;
+        try
+        {
+            compress(*chunk);
+        }
+        catch(std::exception const & e) // LCOV_EXCL_LINE
+        {
+            error = e.what(); // LCOV_EXCL_LINE
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        chunk->m_error = error;
+        chunk->m_done = true;
+        m_done_cond.notify_all();
+    }
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
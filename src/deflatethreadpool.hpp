@@ -0,0 +1,103 @@
+#pragma once
+#ifndef DEFLATETHREADPOOL_HPP
+#define DEFLATETHREADPOOL_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Header file that defines zipios::DeflateThreadPool.
+ *
+ * This file declares the zipios::DeflateThreadPool class which is
+ * used to compress the data of a Zip archive with several threads.
+ */
+
+#include "zipios/fileentry.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace zipios
+{
+
+
+class DeflateThreadPool
+{
+public:
+    struct chunk_t
+    {
+        typedef std::shared_ptr<chunk_t>    pointer_t;
+
+        std::vector<char>           m_input;
+        std::vector<char>           m_dictionary;
+        FileEntry::CompressionLevel m_level = FileEntry::COMPRESSION_LEVEL_DEFAULT;
+        int                         m_zlib_level = 0;
+        bool                        m_last = false;
+        std::vector<char>           m_output;
+        uint32_t                    m_crc32 = 0;
+        double                      m_seconds = 0.0;
+        bool                        m_done = false;
+        std::string                 m_error;
+    };
+
+    static size_t const     CHUNK_SIZE = 1024 * 1024;
+    static size_t const     DICTIONARY_SIZE = 32 * 1024;
+
+                            DeflateThreadPool(size_t thread_count);
+                            DeflateThreadPool(DeflateThreadPool const & src) = delete;
+    DeflateThreadPool &     operator = (DeflateThreadPool const & rhs) = delete;
+                            ~DeflateThreadPool();
+
+    void                    submit(chunk_t::pointer_t chunk);
+    void                    wait(chunk_t::pointer_t chunk);
+
+    static void             compress(chunk_t & chunk);
+
+private:
+    void                    worker();
+
+    std::deque<chunk_t::pointer_t>
+                            m_queue;
+    bool                    m_stop = false;
+    std::mutex              m_mutex;
+    std::condition_variable m_cond;
+    std::condition_variable m_done_cond;
+    std::vector<std::thread>
+                            m_threads;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
@@ -0,0 +1,158 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::DirectFileOutputStream.
+ *
+ * This file defines the functions of the zipios::DirectFileOutputStream
+ * class.
+ */
+
+#include "zipios/directfileoutputstream.hpp"
+
+#include "directfilestreambuf.hpp"
+
+
+namespace zipios
+{
+
+
+/** \class DirectFileOutputStream
+ * \brief An output file stream bypassing the page cache.
+ *
+ * Writing an archive of many gigabytes through an std::ofstream fills
+ * the page cache with data which is not going to be read again and
+ * evicts the data of every other process running on that computer.
+ *
+ * The DirectFileOutputStream writes the file with direct I/O
+ * instead (O_DIRECT.) It can be used anywhere an std::ostream is
+ * expected, in particular with ZipFile::saveCollectionToArchive():
+ *
+ * \code
+ *      zipios::DirectFileOutputStream out("huge.zip");
+ *      zipios::ZipFile::saveCollectionToArchive(out, collection);
+ *      out.close();
+ * \endcode
+ *
+ * When saving a collection to such a stream, the
+ * ZipFile::saveCollectionToArchive() function preallocates the space
+ * it expects the archive to use.
+ *
+ * Seeking is supported, although seeking backward requires reading
+ * back one or two blocks since direct I/O only writes whole blocks.
+ */
+
+
+/** \brief Create a file to be written with direct I/O.
+ *
+ * The constructor creates \p filename, truncating it if it already
+ * exists.
+ *
+ * A large buffer is preferable with direct I/O since each time the
+ * buffer is full the stream waits for the data to reach the disk.
+ *
+ * \param[in] filename  The name of the file to create.
+ * \param[in] buffer_size  The size of the write buffer.
+ *
+ * \exception IOException
+ * This exception is raised if the file cannot be created.
+ */
+DirectFileOutputStream::DirectFileOutputStream(std::string const & filename, size_t buffer_size)
+    //: std::ostream()
+    : m_dfsb(new DirectFileStreambuf(filename, buffer_size))
+{
+    init(m_dfsb.get());
+}
+
+
+/** \brief Clean up the stream.
+ *
+ * The destructor closes the file if close() was not called.
+ *
+ * \warning
+ * Errors cannot be reported from the destructor. Call close() first
+ * to make sure the file was properly written.
+ */
+DirectFileOutputStream::~DirectFileOutputStream()
+{
+}
+
+
+/** \brief Check whether the file gets written with direct I/O.
+ *
+ * When the file system does not support direct I/O, the stream still
+ * works but the data goes through the page cache. The pages get
+ * dropped from the cache once written, though.
+ *
+ * \return true if the page cache is bypassed.
+ */
+bool DirectFileOutputStream::isDirect() const
+{
+    return m_dfsb->isDirect();
+}
+
+
+/** \brief Reserve disk space for the file.
+ *
+ * This function is a hint. It reserves \p size bytes on disk so the
+ * file does not get fragmented. If the file ends up smaller, the extra
+ * space is released by close().
+ *
+ * \param[in] size  The expected size of the file.
+ */
+void DirectFileOutputStream::preallocate(offset_t size)
+{
+    m_dfsb->preallocate(size);
+}
+
+
+/** \brief Write the remaining data and close the file.
+ *
+ * This function writes the data still in the buffer and truncates
+ * the file to its exact size.
+ *
+ * \exception IOException
+ * This exception is raised if the data cannot be written.
+ */
+void DirectFileOutputStream::close()
+{
+    try
+    {
+        m_dfsb->close();
+    }
+    catch(...)
+    {
+        setstate(std::ios::badbit);
+        throw;
+    }
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,583 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::DirectFileStreambuf.
+ *
+ * This file defines the functions of the zipios::DirectFileStreambuf
+ * class which writes a file without going through the page cache.
+ */
+
+#include "directfilestreambuf.hpp"
+
+#include "zipios/zipiosexceptions.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include <errno.h>
+
+#if !defined(ZIPIOS_WINDOWS) && (defined(_WINDOWS) || defined(WIN32) || defined(_WIN32) || defined(__WIN32))
+#define ZIPIOS_WINDOWS
+#endif
+
+#ifndef ZIPIOS_WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+namespace zipios
+{
+
+
+/** \class DirectFileStreambuf
+ * \brief An output stream buffer writing a file with direct I/O.
+ *
+ * The DirectFileStreambuf class writes a file opened with O_DIRECT
+ * (F_NOCACHE on macOS.) The data goes straight from the buffer of
+ * this object to the disk so writing a very large file does not evict
+ * everything else from the page cache.
+ *
+ * Direct I/O requires the buffer address, the file offset, and the
+ * size of each write to be aligned. This object buffers a window of
+ * the file which always starts on an aligned offset and it always
+ * writes whole blocks. The last block of a window gets padded with
+ * zeroes and the file is truncated to its real size on close().
+ *
+ * Seeking backward, as done to rewrite the Zip local headers, is
+ * supported. When a window gets loaded at an offset where the file
+ * already has data, the first block is read back so the bytes which
+ * are not rewritten are preserved. Similarly, the last block of a
+ * window gets read back before being written if the file has more
+ * data after it. In the usual sequential case, nothing gets read.
+ *
+ * If the file system does not support direct I/O, the file is opened
+ * normally and the pages just written are dropped from the cache with
+ * posix_fadvise().
+ *
+ * \note
+ * This buffer uses 64 bit offsets but the Zip archives written through
+ * it are still limited by the format: Zipios does not write Zip64
+ * records so an archive cannot have more than 65535 entries, each
+ * entry must be smaller than 4Gb, and the entries and the central
+ * directory must start within the first 4Gb of the archive. The
+ * Zip writer throws an InvalidStateException or FileCollectionException
+ * when these limits are reached instead of saving truncated values.
+ */
+
+
+/** \brief Open a file for direct output.
+ *
+ * The constructor creates the file, or truncates it if it already
+ * exists, and allocates an aligned buffer of \p buffer_size bytes.
+ * The size gets rounded up to a multiple of the alignment.
+ *
+ * \param[in] filename  The name of the file to create.
+ * \param[in] buffer_size  The size of the write buffer.
+ *
+ * \exception IOException
+ * This exception is raised if the file cannot be created or the
+ * platform does not support this class.
+ */
+DirectFileStreambuf::DirectFileStreambuf(std::string const & filename, size_t buffer_size)
+    //: m_fd(-1) -- auto-init
+    //, m_direct(false) -- auto-init
+    //, m_alignment(4096) -- auto-init
+    //, m_storage() -- initialized below
+    //, m_block_storage() -- initialized below
+    //, m_buffer(nullptr) -- initialized below
+    //, m_block(nullptr) -- initialized below
+    //, m_capacity(0) -- initialized below
+    //, m_buffer_offset(0) -- auto-init
+    //, m_valid(0) -- auto-init
+    //, m_clean_pptr(nullptr) -- auto-init
+    //, m_dirty(false) -- auto-init
+    //, m_file_size(0) -- auto-init
+{
+#ifdef ZIPIOS_WINDOWS
+    static_cast<void>(filename);
+    static_cast<void>(buffer_size);
+    throw IOException("DirectFileStreambuf::DirectFileStreambuf(): direct I/O is not supported on this platform.");
+#else
+    int const flags(O_RDWR | O_CREAT | O_TRUNC);
+#ifdef O_DIRECT
+    m_fd = ::open(filename.c_str(), flags | O_DIRECT, 0666);
+    m_direct = m_fd >= 0;
+#endif
+    if(m_fd < 0)
+    {
+        // the file system may not support O_DIRECT (EINVAL)
+        m_fd = ::open(filename.c_str(), flags, 0666);
+        if(m_fd < 0)
+        {
+            throw IOException("DirectFileStreambuf::DirectFileStreambuf(): could not open \"" + filename + "\": " + strerror(errno) + ".");
+        }
+#ifdef F_NOCACHE
+        m_direct = fcntl(m_fd, F_NOCACHE, 1) == 0;
+#endif
+    }
+#endif
+
+    m_capacity = std::max(buffer_size, m_alignment);
+    m_capacity += m_alignment - 1;
+    m_capacity -= m_capacity % m_alignment;
+
+    m_storage.resize(m_capacity + m_alignment);
+    m_buffer = alignedBuffer(m_storage);
+    m_block_storage.resize(m_alignment * 2);
+    m_block = alignedBuffer(m_block_storage);
+
+    loadWindow(0);
+}
+
+
+/** \brief Clean up the stream buffer.
+ *
+ * The destructor calls close() if it was not yet called.
+ *
+ * \warning
+ * Errors cannot be reported from the destructor. Call close() first
+ * to make sure the file was properly written.
+ */
+DirectFileStreambuf::~DirectFileStreambuf()
+{
+    try
+    {
+        close();
+    }
+    catch(IOException const &)
+    {
+    }
+}
+
+
+/** \brief Check whether the page cache is bypassed.
+ *
+ * This function returns true if the file was opened with O_DIRECT
+ * (or F_NOCACHE.) If false, the file system did not support direct
+ * I/O and the file is written through the page cache.
+ *
+ * \return true if the file is written with direct I/O.
+ */
+bool DirectFileStreambuf::isDirect() const
+{
+    return m_direct;
+}
+
+
+/** \brief Retrieve the alignment of the writes.
+ *
+ * All the writes happen at an offset and with a size which are
+ * multiples of this alignment.
+ *
+ * \return The alignment in bytes.
+ */
+size_t DirectFileStreambuf::getAlignment() const
+{
+    return m_alignment;
+}
+
+
+/** \brief Reserve disk space for the file.
+ *
+ * This function calls fallocate() to reserve \p size bytes for the
+ * file. This avoids fragmentation and lets the file system write
+ * directly to already allocated blocks. If more space gets reserved
+ * than necessary, close() releases it.
+ *
+ * This is only a hint. Errors are ignored and the function does
+ * nothing on systems without fallocate().
+ *
+ * \param[in] size  The expected size of the file.
+ */
+void DirectFileStreambuf::preallocate(offset_t size)
+{
+#if defined(__linux__)
+    if(m_fd >= 0
+    && size > 0)
+    {
+        static_cast<void>(::fallocate(m_fd, 0, 0, size));
+    }
+#else
+    static_cast<void>(size);
+#endif
+}
+
+
+/** \brief Write the remaining data and close the file.
+ *
+ * This function writes the current window and then truncates the
+ * file to its exact size, which removes the padding of the last
+ * block and any extra preallocated space.
+ *
+ * Calling close() more than once has no effect.
+ *
+ * \exception IOException
+ * This exception is raised if writing, truncating, or closing the file
+ * fails.
+ */
+void DirectFileStreambuf::close()
+{
+    if(m_fd < 0)
+    {
+        return;
+    }
+
+#ifndef ZIPIOS_WINDOWS
+    try
+    {
+        flushWindow();
+    }
+    catch(IOException const &)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+        throw;
+    }
+
+    int const truncated(ftruncate(m_fd, m_file_size));
+    int const closed(::close(m_fd));
+    m_fd = -1;
+    if(truncated != 0
+    || closed != 0)
+    {
+        throw IOException("DirectFileStreambuf::close(): could not truncate or close the output file.");
+    }
+#endif
+}
+
+
+/** \brief Write the current window and move to the next one.
+ *
+ * This function is called when the buffer is full.
+ *
+ * \param[in] c  The character that did not fit in the buffer or EOF.
+ *
+ * \return Always 0.
+ */
+int DirectFileStreambuf::overflow(int c)
+{
+    if(pptr() == epptr())
+    {
+        flushWindow();
+        loadWindow(m_buffer_offset + m_capacity);
+    }
+
+    if(c != EOF)
+    {
+        *pptr() = c;
+        pbump(1);
+    }
+
+    return 0;
+}
+
+
+/** \brief Change or retrieve the current position.
+ *
+ * The tellp() function calls this function with an offset of zero
+ * from the current position, which does not require any I/O.
+ *
+ * \param[in] off  The offset to seek to.
+ * \param[in] dir  The position \p off is relative to.
+ * \param[in] which  The side of the stream to seek, ignored.
+ *
+ * \return The new position.
+ */
+DirectFileStreambuf::pos_type DirectFileStreambuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+    offset_t base(0);
+    switch(dir)
+    {
+    case std::ios::beg:
+        break;
+
+    case std::ios::cur:
+        base = m_buffer_offset + (pptr() - pbase());
+        if(off == 0)
+        {
+            return base;
+        }
+        break;
+
+    default:
+        base = std::max(m_file_size, static_cast<offset_t>(m_buffer_offset + updateValid()));
+        break;
+
+    }
+
+    return seekpos(base + off, which);
+}
+
+
+/** \brief Change the current position.
+ *
+ * If the new position is within the current window, only the put
+ * pointer gets moved. Otherwise the current window is written and
+ * a new window gets loaded at the new position.
+ *
+ * \param[in] pos  The new position.
+ * \param[in] which  The side of the stream to seek, ignored.
+ *
+ * \return The new position or -1 if \p pos is negative.
+ */
+DirectFileStreambuf::pos_type DirectFileStreambuf::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    static_cast<void>(which);
+
+    offset_t const position(pos);
+    if(position < 0)
+    {
+        return pos_type(off_type(-1));
+    }
+
+    updateValid();
+    if(position >= m_buffer_offset
+    && position <= m_buffer_offset + static_cast<offset_t>(m_valid)
+    && position < m_buffer_offset + static_cast<offset_t>(m_capacity))
+    {
+        m_dirty = isDirty();
+        setp(m_buffer, m_buffer + m_capacity);
+        pbump(static_cast<int>(position - m_buffer_offset));
+        m_clean_pptr = pptr();
+        return pos;
+    }
+
+    flushWindow();
+    loadWindow(position - position % m_alignment);
+
+    size_t const in_window(position - m_buffer_offset);
+    if(in_window > m_valid)
+    {
+        // seeking past the end of the file leaves a hole of zeroes
+        memset(m_buffer + m_valid, 0, in_window - m_valid);
+        m_valid = in_window;
+        m_dirty = true;
+    }
+    pbump(static_cast<int>(in_window));
+    m_clean_pptr = pptr();
+
+    return pos;
+}
+
+
+/** \brief Write the data buffered so far.
+ *
+ * The current window gets written, including its last partial block,
+ * which gets rewritten once more data is available.
+ *
+ * \return 0 on success, -1 on failure.
+ */
+int DirectFileStreambuf::sync()
+{
+    try
+    {
+        flushWindow();
+    }
+    catch(IOException const &)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/** \brief Get an aligned pointer within a buffer.
+ *
+ * The \p buffer must be at least one alignment larger than the size
+ * required by the caller.
+ *
+ * \param[in] buffer  The buffer to align.
+ *
+ * \return A pointer within \p buffer aligned for direct I/O.
+ */
+char * DirectFileStreambuf::alignedBuffer(std::vector<char> & buffer) const
+{
+    std::uintptr_t const address(reinterpret_cast<std::uintptr_t>(&buffer[0]));
+    return &buffer[0] + (m_alignment - address % m_alignment) % m_alignment;
+}
+
+
+/** \brief Update the number of valid bytes in the window.
+ *
+ * The characters written by the ostream go directly to the buffer.
+ * This function takes them in account in the valid size.
+ *
+ * \return The number of valid bytes in the window.
+ */
+size_t DirectFileStreambuf::updateValid()
+{
+    size_t const used(pptr() - pbase());
+    if(used > m_valid)
+    {
+        m_valid = used;
+    }
+    return m_valid;
+}
+
+
+/** \brief Check whether the window needs to be written.
+ *
+ * \return true if the window was modified since it was last written.
+ */
+bool DirectFileStreambuf::isDirty() const
+{
+    return m_dirty || pptr() != m_clean_pptr;
+}
+
+
+/** \brief Load the window starting at \p offset.
+ *
+ * If the file already has data at \p offset, the first block gets
+ * read so a write in the middle of it does not lose the rest.
+ *
+ * \param[in] offset  The aligned offset of the new window.
+ */
+void DirectFileStreambuf::loadWindow(offset_t offset)
+{
+    m_buffer_offset = offset;
+    m_valid = 0;
+    m_dirty = false;
+    if(offset < m_file_size)
+    {
+        m_valid = readBlock(offset, m_buffer);
+    }
+
+    setp(m_buffer, m_buffer + m_capacity);
+    m_clean_pptr = pptr();
+}
+
+
+/** \brief Write the current window to the file.
+ *
+ * The valid bytes of the window get written as whole blocks. If the
+ * file has data past the end of the window, the last block gets
+ * completed with that data first.
+ *
+ * \exception IOException
+ * This exception is raised if reading or writing fails.
+ */
+void DirectFileStreambuf::flushWindow()
+{
+    updateValid();
+    if(!isDirty()
+    || m_fd < 0)
+    {
+        return;
+    }
+
+#ifndef ZIPIOS_WINDOWS
+    size_t const tail(m_valid % m_alignment);
+    if(tail != 0
+    && m_buffer_offset + static_cast<offset_t>(m_valid) < m_file_size)
+    {
+        size_t const tail_block(m_valid - tail);
+        size_t const available(readBlock(m_buffer_offset + tail_block, m_block));
+        if(available > tail)
+        {
+            memcpy(m_buffer + m_valid, m_block + tail, available - tail);
+            m_valid = tail_block + available;
+        }
+    }
+
+    size_t const size((m_valid + m_alignment - 1) / m_alignment * m_alignment);
+    memset(m_buffer + m_valid, 0, size - m_valid);
+
+    size_t written(0);
+    while(written < size)
+    {
+        ssize_t const r(pwrite(m_fd, m_buffer + written, size - written, m_buffer_offset + written));
+        if(r < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            throw IOException(std::string("DirectFileStreambuf::flushWindow(): write failed: ") + strerror(errno) + ".");
+        }
+        written += r;
+    }
+
+#ifdef POSIX_FADV_DONTNEED
+    if(!m_direct)
+    {
+        static_cast<void>(posix_fadvise(m_fd, m_buffer_offset, size, POSIX_FADV_DONTNEED));
+    }
+#endif
+#endif
+
+    m_file_size = std::max(m_file_size, static_cast<offset_t>(m_buffer_offset + m_valid));
+    m_dirty = false;
+    m_clean_pptr = pptr();
+}
+
+
+/** \brief Read one block from the file.
+ *
+ * The file may include padding after its real end. This function only
+ * counts the bytes before m_file_size as read.
+ *
+ * \param[in] offset  The aligned offset of the block.
+ * \param[out] block  An aligned buffer of at least one block.
+ *
+ * \return The number of valid bytes read.
+ *
+ * \exception IOException
+ * This exception is raised if reading fails.
+ */
+size_t DirectFileStreambuf::readBlock(offset_t offset, char * block)
+{
+    size_t size(0);
+#ifndef ZIPIOS_WINDOWS
+    // a short read only happens at the end of the file; a second read
+    // would not be aligned anymore
+    ssize_t r(0);
+    do
+    {
+        r = pread(m_fd, block, m_alignment, offset);
+    }
+    while(r < 0 && errno == EINTR);
+    if(r < 0)
+    {
+        throw IOException(std::string("DirectFileStreambuf::readBlock(): read failed: ") + strerror(errno) + ".");
+    }
+    size = r;
+#else
+    static_cast<void>(block);
+#endif
+
+    return std::min(size, static_cast<size_t>(m_file_size - offset));
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,97 @@
+#pragma once
+#ifndef DIRECTFILESTREAMBUF_HPP
+#define DIRECTFILESTREAMBUF_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Header file that defines zipios::DirectFileStreambuf.
+ *
+ * This file declares the zipios::DirectFileStreambuf class which is
+ * used to write a file with O_DIRECT, bypassing the page cache.
+ */
+
+#include "zipios/zipios-config.hpp"
+
+#include <streambuf>
+#include <string>
+#include <vector>
+
+
+namespace zipios
+{
+
+
+class DirectFileStreambuf : public std::streambuf
+{
+public:
+                            DirectFileStreambuf(std::string const & filename, size_t buffer_size);
+                            DirectFileStreambuf(DirectFileStreambuf const & src) = delete;
+    DirectFileStreambuf &   operator = (DirectFileStreambuf const & rhs) = delete;
+    virtual                 ~DirectFileStreambuf() override;
+
+    bool                    isDirect() const;
+    size_t                  getAlignment() const;
+    void                    preallocate(offset_t size);
+    void                    close();
+
+protected:
+    virtual int             overflow(int c = EOF) override;
+    virtual pos_type        seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::out) override;
+    virtual pos_type        seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::out) override;
+    virtual int             sync() override;
+
+private:
+    char *                  alignedBuffer(std::vector<char> & buffer) const;
+    size_t                  updateValid();
+    bool                    isDirty() const;
+    void                    loadWindow(offset_t offset);
+    void                    flushWindow();
+    size_t                  readBlock(offset_t offset, char * block);
+
+    int                     m_fd = -1;
+    bool                    m_direct = false;
+    size_t                  m_alignment = 4096;
+    std::vector<char>       m_storage;
+    std::vector<char>       m_block_storage;
+    char *                  m_buffer = nullptr;
+    char *                  m_block = nullptr;
+    size_t                  m_capacity = 0;
+    offset_t                m_buffer_offset = 0;
+    size_t                  m_valid = 0;
+    char *                  m_clean_pptr = nullptr;
+    bool                    m_dirty = false;
+    offset_t                m_file_size = 0;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
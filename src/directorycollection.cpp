@@ -35,6 +35,8 @@
 
 #include "zipios/zipiosexceptions.hpp"
 
+#include "memorymappedinputstream.hpp"
+
 #include <fstream>
 
 #ifdef ZIPIOS_WINDOWS
@@ -65,6 +67,8 @@ namespace zipios
 DirectoryCollection::DirectoryCollection()
     //: m_entries_loaded(false) -- auto-init
     //, m_recursive(true) -- auto-init
+    //, m_memory_mapped(false) -- auto-init
+    //, m_memory_mapped_minimum_size(64 * 1024) -- auto-init
     //, m_filepath("") -- auto-init
 {
 }
@@ -95,6 +99,8 @@ DirectoryCollection::DirectoryCollection()
 DirectoryCollection::DirectoryCollection(std::string const & path, bool recursive)
     //: m_entries_loaded(false) -- auto-init
     : m_recursive(recursive)
+    //, m_memory_mapped(false) -- auto-init
+    //, m_memory_mapped_minimum_size(64 * 1024) -- auto-init
     , m_filepath(path)
 {
     m_filename = m_filepath;
@@ -210,11 +216,67 @@ DirectoryCollection::stream_pointer_t DirectoryCollection::getInputStream(std::s
         return DirectoryCollection::stream_pointer_t();
     }
 
+    if(m_memory_mapped
+    && ent->getSize() >= m_memory_mapped_minimum_size)
+    {
+        std::shared_ptr<MemoryMappedInputStream> mm(new MemoryMappedInputStream(ent->getName()));
+        if(mm->isOpen())
+        {
+            return mm;
+        }
+    }
+
     DirectoryCollection::stream_pointer_t p(new std::ifstream(ent->getName(), std::ios::in | std::ios::binary));
     return p;
 }
 
 
+/** \brief Check whether input streams are memory mapped.
+ *
+ * \return true if setMemoryMapped() turned memory mapped streams on.
+ *
+ * \sa setMemoryMapped()
+ */
+bool DirectoryCollection::isMemoryMapped() const
+{
+    return m_memory_mapped;
+}
+
+
+/** \brief Retrieve the smallest file that gets memory mapped.
+ *
+ * \return The minimum size of a file returned as a memory mapped stream.
+ *
+ * \sa setMemoryMapped()
+ */
+size_t DirectoryCollection::getMemoryMappedMinimumSize() const
+{
+    return m_memory_mapped_minimum_size;
+}
+
+
+/** \brief Read the files through a memory mapping.
+ *
+ * When turned on, getInputStream() returns a stream which reads the
+ * file from a read-only memory mapping instead of an std::ifstream.
+ * When such a stream is saved in a Zip archive, the data goes from
+ * the mapping straight to zlib and the CRC computation, avoiding the
+ * copies to the std::ifstream buffer and the compressor input buffer.
+ *
+ * Mapping a file has a cost of its own, so small files, those under
+ * \p minimum_size bytes, are still read with an std::ifstream. Files
+ * which cannot be mapped also fall back to an std::ifstream.
+ *
+ * \param[in] memory_mapped  Whether memory mapped streams are returned.
+ * \param[in] minimum_size  The size under which files are not mapped.
+ */
+void DirectoryCollection::setMemoryMapped(bool memory_mapped, size_t minimum_size)
+{
+    m_memory_mapped = memory_mapped;
+    m_memory_mapped_minimum_size = minimum_size;
+}
+
+
 /** \brief Create another DirectoryCollection.
  *
  * This function creates a clone of this DirectoryCollection. This is
@@ -0,0 +1,507 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::EmbeddedCollection.
+ *
+ * This file includes the implementation of the zipios::EmbeddedCollection
+ * class, which serves the entries of a Zip archive compiled in the
+ * program.
+ */
+
+#include "zipios/embeddedcollection.hpp"
+
+#include "zipios/zipiosexceptions.hpp"
+
+#include "inflateinputstreambuf.hpp"
+#include "memorystreambuf.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+
+namespace zipios
+{
+
+
+namespace
+{
+
+
+/** \brief An entry of an embedded archive.
+ *
+ * This FileEntry is created from an EmbeddedArchiveEntry, which holds
+ * all the information found in the Zip central directory.
+ */
+class EmbeddedEntry : public FileEntry
+{
+public:
+    EmbeddedEntry(EmbeddedArchiveEntry const & entry)
+        : FileEntry(FilePath(std::string(entry.m_name, entry.m_name_length)))
+        , m_compressed_size(entry.m_compressed_size)
+        , m_is_directory(entry.m_is_directory)
+    {
+        m_uncompressed_size = entry.m_size;
+        m_compress_method = static_cast<StorageMethod>(entry.m_method);
+        m_crc_32 = entry.m_crc32;
+        m_has_crc_32 = true;
+        setTime(entry.m_dosdatetime);
+    }
+
+    virtual pointer_t clone() const override
+    {
+        return pointer_t(new EmbeddedEntry(*this));
+    }
+
+    virtual size_t getCompressedSize() const override
+    {
+        return m_compressed_size;
+    }
+
+    virtual bool isDirectory() const override
+    {
+        return m_is_directory;
+    }
+
+private:
+    size_t                  m_compressed_size = 0;
+    bool                    m_is_directory = false;
+};
+
+
+/** \brief An input stream reading an entry of an embedded archive.
+ *
+ * The stream reads the data of the entry straight from the array
+ * compiled in the program. Deflated entries get inflated on the fly.
+ */
+class EmbeddedInputStream : public std::istream
+{
+public:
+    EmbeddedInputStream(EmbeddedArchive const & archive, EmbeddedArchiveEntry const & entry)
+        : std::istream(nullptr)
+        , m_data(new MemoryStreambuf(reinterpret_cast<char const *>(archive.m_data) + entry.m_offset, entry.m_compressed_size))
+    {
+        if(static_cast<StorageMethod>(entry.m_method) == StorageMethod::DEFLATED)
+        {
+            m_inflate.reset(new InflateInputStreambuf(m_data.get()));
+            init(m_inflate.get());
+        }
+        else
+        {
+            init(m_data.get());
+        }
+    }
+
+private:
+    std::unique_ptr<MemoryStreambuf>        m_data;
+    std::unique_ptr<InflateInputStreambuf>  m_inflate;
+};
+
+
+} // no name namespace
+
+
+
+/** \class EmbeddedCollection
+ * \brief A collection compiled in the program.
+ *
+ * The zipembed tool transforms a Zip archive in a C++ source file. That
+ * file defines an EmbeddedArchive with the bytes of the archive and a
+ * table describing each entry (offset of the data, sizes, method, CRC,
+ * and date.) The table is indexed with a perfect hash of the entry
+ * names, computed by the tool.
+ *
+ * An EmbeddedCollection serves the entries of such an archive. Since
+ * everything was computed at compile time, creating the collection
+ * costs nothing: the end of central directory is not searched and
+ * the central directory is not parsed. Looking up an entry by its
+ * full name is one hash and one string comparison.
+ *
+ * The collection is read-only.
+ *
+ * \code
+ *      // generated with: zipembed resources.zip g_resources resources.cpp
+ *      extern zipios::EmbeddedArchive const g_resources;
+ *
+ *      zipios::EmbeddedCollection resources(g_resources);
+ *      zipios::FileCollection::stream_pointer_t is(resources.getInputStream("images/logo.png"));
+ * \endcode
+ */
+
+
+/** \brief The index returned when an entry is not found.
+ *
+ * This value is returned by findEntry() when the name is not found in
+ * the embedded archive.
+ */
+size_t const EmbeddedCollection::npos;
+
+
+/** \brief Initialize an EmbeddedCollection object.
+ *
+ * The \p archive is expected to be defined by a source file generated
+ * by the zipembed tool. It must remain valid for the lifetime of the
+ * collection, which is always the case of such a definition.
+ *
+ * \param[in] archive  The embedded archive.
+ * \param[in] name  The name of the collection.
+ */
+EmbeddedCollection::EmbeddedCollection(EmbeddedArchive const & archive, std::string const & name)
+    : FileCollection(name)
+    , m_archive(&archive)
+{
+}
+
+
+/** \brief Create another EmbeddedCollection.
+ *
+ * \return A shared pointer to a copy of this EmbeddedCollection.
+ */
+FileCollection::pointer_t EmbeddedCollection::clone() const
+{
+    return FileCollection::pointer_t(new EmbeddedCollection(*this));
+}
+
+
+/** \brief Clean up an EmbeddedCollection object.
+ *
+ * The embedded data is not owned by the collection so nothing
+ * gets released.
+ */
+EmbeddedCollection::~EmbeddedCollection()
+{
+}
+
+
+/** \brief Prevent adding entries to the collection.
+ *
+ * An embedded collection is read-only.
+ *
+ * \exception InvalidStateException
+ * This exception is always raised.
+ *
+ * \param[in] entry  The entry which is not added.
+ */
+void EmbeddedCollection::addEntry(FileEntry const & entry)
+{
+    static_cast<void>(entry);
+    throw InvalidStateException("EmbeddedCollection::addEntry(): an embedded collection is read-only.");
+}
+
+
+/** \brief Close the collection.
+ *
+ * Once closed, the collection is marked invalid.
+ */
+void EmbeddedCollection::close()
+{
+    m_archive = nullptr;
+    FileCollection::close();
+}
+
+
+/** \brief Retrieve a vector to the collection entries.
+ *
+ * The FileEntry objects are created the first time this function
+ * gets called. Lookups with getEntry() do not require them.
+ *
+ * \return A copy of the vector of entries.
+ */
+FileEntry::vector_t EmbeddedCollection::entries() const
+{
+    mustBeValid();
+
+    if(m_entries.empty() && m_archive->m_entry_count > 0)
+    {
+        FileEntry::vector_t v;
+        v.reserve(m_archive->m_entry_count);
+        for(size_t idx(0); idx < m_archive->m_entry_count; ++idx)
+        {
+            v.push_back(createEntry(idx));
+        }
+        const_cast<EmbeddedCollection *>(this)->m_entries.swap(v);
+    }
+
+    return FileCollection::entries();
+}
+
+
+/** \brief Get an entry from the collection.
+ *
+ * When \p matchpath is MatchPath::MATCH, the entry is found with the
+ * perfect hash table. Otherwise all the names get checked.
+ *
+ * \param[in] name  The name of the entry to search.
+ * \param[in] matchpath  Whether the full path or just the filename is matched.
+ *
+ * \return A shared pointer to the entry or nullptr if not found.
+ */
+FileEntry::pointer_t EmbeddedCollection::getEntry(std::string const & name, MatchPath matchpath) const
+{
+    mustBeValid();
+
+    size_t const index(findIndex(name, matchpath));
+    if(index == npos)
+    {
+        return FileEntry::pointer_t();
+    }
+
+    // once created, always return the same objects
+    if(!m_entries.empty())
+    {
+        return m_entries[index];
+    }
+
+    return createEntry(index);
+}
+
+
+/** \brief Retrieve a pointer to an istream.
+ *
+ * The returned stream reads the data straight from the embedded
+ * archive. Deflated entries get inflated transparently.
+ *
+ * Directories do not have an input stream so nullptr is returned
+ * for them.
+ *
+ * \param[in] entry_name  The name of the entry to read.
+ * \param[in] matchpath  Whether the full path or just the filename is matched.
+ *
+ * \return A shared pointer to an istream or nullptr.
+ */
+EmbeddedCollection::stream_pointer_t EmbeddedCollection::getInputStream(std::string const & entry_name, MatchPath matchpath)
+{
+    mustBeValid();
+
+    size_t const index(findIndex(entry_name, matchpath));
+    if(index == npos
+    || m_archive->m_entries[index].m_is_directory)
+    {
+        return stream_pointer_t();
+    }
+
+    return stream_pointer_t(new EmbeddedInputStream(*m_archive, m_archive->m_entries[index]));
+}
+
+
+/** \brief Return the number of entries.
+ *
+ * \return The number of entries in the embedded archive.
+ */
+size_t EmbeddedCollection::size() const
+{
+    mustBeValid();
+
+    return m_archive->m_entry_count;
+}
+
+
+/** \brief Search an entry in the perfect hash table.
+ *
+ * The first hash of \p name selects a displacement. A negative
+ * displacement is the index of the entry, minus one. Otherwise the
+ * name is hashed again using the displacement as the seed to get the
+ * index. Since the hash is perfect only for the names in the archive,
+ * the name of the entry found is compared against \p name.
+ *
+ * The tool generating the table uses the same embeddedHash() function.
+ *
+ * \param[in] archive  The archive to search.
+ * \param[in] name  The full name of the entry.
+ *
+ * \return The index of the entry in the archive or npos.
+ */
+size_t EmbeddedCollection::findEntry(EmbeddedArchive const & archive, std::string const & name)
+{
+    if(archive.m_entry_count == 0)
+    {
+        return npos;
+    }
+
+    uint32_t const bucket(embeddedHash(name.c_str(), name.length(), 0) % archive.m_entry_count);
+    int32_t const displacement(archive.m_displacements[bucket]);
+    size_t const index(displacement < 0
+                        ? static_cast<size_t>(-displacement - 1)
+                        : embeddedHash(name.c_str(), name.length(), displacement) % archive.m_entry_count);
+    if(index >= archive.m_entry_count)
+    {
+        return npos; // LCOV_EXCL_LINE
+    }
+
+    EmbeddedArchiveEntry const & entry(archive.m_entries[index]);
+    if(entry.m_name_length != name.length()
+    || memcmp(entry.m_name, name.c_str(), name.length()) != 0)
+    {
+        return npos;
+    }
+
+    return index;
+}
+
+
+/** \brief Compute the perfect hash table of the entry names.
+ *
+ * The names are distributed in buckets using their hash with seed 0.
+ * Starting with the largest bucket, a displacement is searched so
+ * the names of the bucket, hashed with that displacement as the seed,
+ * all land in free slots. Buckets of one name are assigned one of the
+ * remaining free slots directly, saved as a negative displacement.
+ *
+ * The zipembed tool uses this function to generate the table and
+ * findEntry() does the lookup.
+ *
+ * \param[in] names  The names of the entries, all distinct.
+ * \param[out] displacements  The displacement of each bucket.
+ * \param[out] slots  The index in the table of each name.
+ *
+ * \return true if the table could be computed.
+ */
+bool EmbeddedCollection::computePerfectHash(std::vector<std::string> const & names, std::vector<int32_t> & displacements, std::vector<size_t> & slots)
+{
+    size_t const count(names.size());
+    displacements.assign(count, 0);
+    slots.assign(count, 0);
+    if(count == 0)
+    {
+        return true;
+    }
+
+    std::vector<std::vector<size_t>> buckets(count);
+    for(size_t idx(0); idx < count; ++idx)
+    {
+        buckets[embeddedHash(names[idx].c_str(), names[idx].length(), 0) % count].push_back(idx);
+    }
+
+    std::vector<size_t> order(count);
+    for(size_t idx(0); idx < count; ++idx)
+    {
+        order[idx] = idx;
+    }
+    std::stable_sort(order.begin(), order.end(), [&buckets](size_t lhs, size_t rhs)
+        {
+            return buckets[lhs].size() > buckets[rhs].size();
+        });
+
+    std::vector<bool> used(count, false);
+    size_t pos(0);
+    for(; pos < count && buckets[order[pos]].size() > 1; ++pos)
+    {
+        std::vector<size_t> const & bucket(buckets[order[pos]]);
+        std::vector<size_t> bucket_slots(bucket.size());
+        int32_t displacement(1);
+        for(;; ++displacement)
+        {
+            if(displacement == std::numeric_limits<int32_t>::max())
+            {
+                return false;
+            }
+            size_t found(0);
+            for(; found < bucket.size(); ++found)
+            {
+                std::string const & name(names[bucket[found]]);
+                size_t const slot(embeddedHash(name.c_str(), name.length(), displacement) % count);
+                if(used[slot]
+                || std::find(bucket_slots.begin(), bucket_slots.begin() + found, slot) != bucket_slots.begin() + found)
+                {
+                    break;
+                }
+                bucket_slots[found] = slot;
+            }
+            if(found == bucket.size())
+            {
+                break;
+            }
+        }
+        displacements[order[pos]] = displacement;
+        for(size_t idx(0); idx < bucket.size(); ++idx)
+        {
+            used[bucket_slots[idx]] = true;
+            slots[bucket[idx]] = bucket_slots[idx];
+        }
+    }
+
+    size_t free_slot(0);
+    for(; pos < count && buckets[order[pos]].size() == 1; ++pos)
+    {
+        while(used[free_slot])
+        {
+            ++free_slot;
+        }
+        used[free_slot] = true;
+        displacements[order[pos]] = -static_cast<int32_t>(free_slot) - 1;
+        slots[buckets[order[pos]][0]] = free_slot;
+    }
+
+    return true;
+}
+
+
+/** \brief Search an entry by name.
+ *
+ * \param[in] name  The name of the entry.
+ * \param[in] matchpath  Whether the full path or just the filename is matched.
+ *
+ * \return The index of the entry or npos.
+ */
+size_t EmbeddedCollection::findIndex(std::string const & name, MatchPath matchpath) const
+{
+    if(matchpath == MatchPath::MATCH)
+    {
+        return findEntry(*m_archive, name);
+    }
+
+    for(size_t idx(0); idx < m_archive->m_entry_count; ++idx)
+    {
+        EmbeddedArchiveEntry const & entry(m_archive->m_entries[idx]);
+        std::string const full_name(entry.m_name, entry.m_name_length);
+        if(FilePath(full_name).filename() == name)
+        {
+            return idx;
+        }
+    }
+
+    return npos;
+}
+
+
+/** \brief Create the FileEntry of an embedded entry.
+ *
+ * \param[in] index  The index of the entry in the archive.
+ *
+ * \return A new FileEntry describing the entry.
+ */
+FileEntry::pointer_t EmbeddedCollection::createEntry(size_t index) const
+{
+    return FileEntry::pointer_t(new EmbeddedEntry(m_archive->m_entries[index]));
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
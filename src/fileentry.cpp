@@ -102,6 +102,7 @@ FileEntry::FileEntry(FilePath const& filename, std::string const& comment)
     //, m_uncompressed_size(0) -- auto-init
     //, m_unix_time(0) -- auto-init
     //, m_entry_offset(0) -- auto-init
+    //, m_data_offset(0) -- auto-init
     //, m_compress_method(StorageMethod::STORED) -- auto-init
     //, m_compression_level(COMPRESSION_LEVEL_DEFAULT) -- auto-init
     //, m_crc_32(0) -- auto-init
@@ -187,6 +188,24 @@ FileEntry::crc32_t FileEntry::getCrc() const
 }
 
 
+/** \brief Get the offset of the data of this entry in a Zip archive.
+ *
+ * This function retrieves the offset at which the data of this
+ * FileEntry starts in the Zip archive it is attached to, which is
+ * right after its local header.
+ *
+ * Like the entry offset, the offset is virtual when the archive is
+ * embedded in another file.
+ *
+ * \return The position of the data in the Zip archive, or 0 if it
+ *         is not known yet.
+ */
+std::streampos FileEntry::getDataOffset() const
+{
+    return m_data_offset;
+}
+
+
 /** \brief Get the offset of this entry in a Zip archive.
  *
  * This function retrieves the offset at which this FileEntry
@@ -501,6 +520,21 @@ void FileEntry::setCrc(crc32_t crc)
 }
 
 
+/** \brief Set the offset of the data of this entry in a Zip archive.
+ *
+ * The ZipFile computes this offset once, while it verifies the local
+ * headers, so opening the entry later does not require reading its
+ * local header again.
+ *
+ * \param[in] offset  The offset of the data, right after the local
+ *                    header of the entry.
+ */
+void FileEntry::setDataOffset(std::streampos offset)
+{
+    m_data_offset = offset;
+}
+
+
 /** \brief Defines the position of the entry in a Zip archive.
  *
  * This function defines the position of the FileEntry in a
@@ -614,6 +648,7 @@ void FileEntry::setMethod(StorageMethod method)
     //case StorageMethod::LZ77:
     //case StorageMethod::WAVPACK:
     //case StorageMethod::PPMD_I_1:
+    //case StorageMethod::AES: -- set by the ZipOutputStreambuf when encrypting
         break;
 
     default:
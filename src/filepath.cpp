@@ -491,6 +491,43 @@ std::time_t FilePath::lastModificationTime() const
 }
 
 
+/** \brief Get the identifier of the device holding the file.
+ *
+ * Together with the inode number, the device identifier uniquely
+ * identifies a file. Two paths with the same device and inode are
+ * hard links to the same file.
+ *
+ * \note
+ * If the file is not considered valid, the identifier returned is zero.
+ *
+ * \return The device identifier (st_dev).
+ *
+ * \sa inodeNumber()
+ */
+uint64_t FilePath::deviceID() const
+{
+    check();
+    return m_stat.st_dev;
+}
+
+
+/** \brief Get the inode number of the file.
+ *
+ * \note
+ * If the file is not considered valid, the inode number returned is zero.
+ * On some file systems (i.e. under MS-Windows) it is always zero.
+ *
+ * \return The inode number (st_ino).
+ *
+ * \sa deviceID()
+ */
+uint64_t FilePath::inodeNumber() const
+{
+    check();
+    return m_stat.st_ino;
+}
+
+
 /** \brief Print out a FilePath.
  *
  * This function prints out the name of the file that this FilePath
@@ -33,6 +33,8 @@
 
 #include "zipios_common.hpp"
 
+#include <algorithm>
+
 
 namespace zipios
 {
@@ -48,6 +50,16 @@ namespace zipios
  * inflation, this class only wraps the functionality in an input
  * stream filter.
  *
+ * When the read-ahead is turned on with setReadAhead(), a background
+ * thread reads the next chunk of compressed data while the current
+ * chunk gets inflated. The I/O and the decompression then overlap
+ * instead of strictly alternating.
+ *
+ * The zlib state and the buffers are only allocated on the first read
+ * and they are released as soon as the end of the compressed data is
+ * reached. A stream which is open but idle, or already fully read,
+ * uses very little memory.
+ *
  * \todo
  * Add support for bzip2, lzma compressions.
  */
@@ -56,9 +68,9 @@ namespace zipios
 
 /** \brief Initialize a InflateInputStreambuf.
  *
- * The constructor initializes the various stream buffers and
- * setup the stream start position using the \p start_pos
- * parameter.
+ * The constructor setups the stream start position using the
+ * \p start_pos parameter. The buffers and the zlib state get
+ * allocated on the first read.
  *
  * Data will be inflated (decompressed using zlib) before being
  * returned.
@@ -69,10 +81,13 @@ namespace zipios
  */
 InflateInputStreambuf::InflateInputStreambuf(std::streambuf *inbuf, offset_t start_pos)
     : FilterInputStreambuf(inbuf)
-    , m_outvec(getBufferSize())
-    , m_invec(getBufferSize())
+    //, m_outvec() -- allocated on the first underflow()
+    //, m_invec() -- allocated on the first underflow()
+    //, m_input_size(getBufferSize()) -- auto-init
+    //, m_output_size(getBufferSize()) -- auto-init
     //, m_zs() -- auto-init
     //, m_zs_initialized(false) -- auto-init
+    //, m_stream_ended(false) -- auto-init
 {
     // NOTICE: It is important that this constructor and the methods it
     // calls doesn't do anything with the input streambuf inbuf, other
@@ -98,19 +113,24 @@ InflateInputStreambuf::InflateInputStreambuf(std::streambuf *inbuf, offset_t sta
  */
 InflateInputStreambuf::~InflateInputStreambuf()
 {
+    stopReadAhead();
+
     // Dealloc z_stream stuff
-    int const err(inflateEnd(&m_zs));
-    if(err != Z_OK)
+    if(m_zs_initialized)
     {
-        // in a destructor we cannot throw...
-        OutputStringStream msgs; // LCOV_EXCL_LINE
-        msgs << "InflateInputStreambuf::~InflateInputStreambuf(): inflateEnd() failed" // LCOV_EXCL_LINE
-             << ": " << zError(err); // LCOV_EXCL_LINE
-        /** \TODO
-         * Write an error callback interface and call that instead of
-         * using std::cerr...
-         */
-        std::cerr << msgs.str() << std::endl; // LCOV_EXCL_LINE
+        int const err(inflateEnd(&m_zs));
+        if(err != Z_OK)
+        {
+            // in a destructor we cannot throw...
+            OutputStringStream msgs; // LCOV_EXCL_LINE
+            msgs << "InflateInputStreambuf::~InflateInputStreambuf(): inflateEnd() failed" // LCOV_EXCL_LINE
+                 << ": " << zError(err); // LCOV_EXCL_LINE
+            /** \TODO
+             * Write an error callback interface and call that instead of
+             * using std::cerr...
+             */
+            std::cerr << msgs.str() << std::endl; // LCOV_EXCL_LINE
+        }
     }
 }
 
@@ -124,6 +144,15 @@ InflateInputStreambuf::~InflateInputStreambuf()
  * This function actually passes the data through the zlib library
  * to decompress it.
  *
+ * The first call allocates the buffers and initializes zlib. Once
+ * the end of the compressed data is reached, zlib and the input
+ * buffer get released, and the output buffer follows once its
+ * content was read.
+ *
+ * \exception IOException
+ * This exception is raised if zlib cannot be initialized or the
+ * compressed data is invalid.
+ *
  * \return The value of that character on success or
  *         std::streambuf::traits_type::eof() on failure.
  */
@@ -136,8 +165,39 @@ std::streambuf::int_type InflateInputStreambuf::underflow()
         return traits_type::to_int_type(*gptr()); // LCOV_EXCL_LINE
     }
 
+    if(m_stream_ended)
+    {
+        // the last inflated bytes were read, release the output buffer
+        std::vector<char>().swap(m_outvec);
+        setg(nullptr, nullptr, nullptr);
+        return traits_type::eof();
+    }
+
+    if(!m_zs_initialized)
+    {
+        int const err(inflateInit2(&m_zs, -MAX_WBITS));
+        /* windowBits is passed < 0 to tell that there is no zlib header.
+           Note that in this case inflate *requires* an extra "dummy" byte
+           after the compressed stream in order to complete decompression
+           and return Z_STREAM_END.  We always have an extra "dummy" byte,
+           because there is always some trailing data after the compressed
+           data (either the next entry or the central directory.  */
+        if(err != Z_OK)
+        {
+            OutputStringStream msgs; // LCOV_EXCL_LINE
+            msgs << "InflateInputStreambuf::underflow(): inflateInit2() failed" // LCOV_EXCL_LINE
+                 << ": " << zError(err); // LCOV_EXCL_LINE
+            throw IOException(msgs.str()); // LCOV_EXCL_LINE
+        }
+        m_zs_initialized = true;
+    }
+    if(m_outvec.empty())
+    {
+        m_outvec.resize(m_output_size);
+    }
+
     // Prepare _outvec and get array pointers
-    m_zs.avail_out = getBufferSize();
+    m_zs.avail_out = m_outvec.size();
     m_zs.next_out = reinterpret_cast<unsigned char *>(&m_outvec[0]);
 
     // Inflate until _outvec is full
@@ -148,7 +208,7 @@ std::streambuf::int_type InflateInputStreambuf::underflow()
         if(m_zs.avail_in == 0)
         {
             // fill m_invec
-            std::streamsize const bc(m_inbuf->sgetn(&m_invec[0], getBufferSize()));
+            std::streamsize const bc(fillInvec());
             /** \FIXME
              * Add I/O error handling while inflating data from a file.
              */
@@ -167,7 +227,7 @@ std::streambuf::int_type InflateInputStreambuf::underflow()
     // full length of the output buffer, but if we can't read
     // more input from the _inbuf streambuf, we end up with
     // less.
-    offset_t const inflated_bytes = getBufferSize() - m_zs.avail_out;
+    offset_t const inflated_bytes = m_outvec.size() - m_zs.avail_out;
     setg(&m_outvec[0], &m_outvec[0], &m_outvec[0] + inflated_bytes);
 
     /** \FIXME
@@ -187,11 +247,24 @@ std::streambuf::int_type InflateInputStreambuf::underflow()
         throw IOException(msgs.str());
     }
 
+    if(err == Z_STREAM_END)
+    {
+        // we do not need zlib nor the input buffers anymore
+        releaseInflate();
+        m_stream_ended = true;
+    }
+
     if(inflated_bytes > 0)
     {
         return traits_type::to_int_type(*gptr());
     }
 
+    if(m_stream_ended)
+    {
+        std::vector<char>().swap(m_outvec);
+        setg(nullptr, nullptr, nullptr);
+    }
+
     return traits_type::eof();
 }
 
@@ -214,6 +287,10 @@ std::streambuf::int_type InflateInputStreambuf::underflow()
  */
 bool InflateInputStreambuf::reset(offset_t stream_position)
 {
+    // the reader thread has to be stopped before we can reposition the
+    // input buffer; any data it read ahead is lost
+    stopReadAhead();
+
     if(stream_position >= 0)
     {
         // reposition m_inbuf
@@ -222,39 +299,232 @@ bool InflateInputStreambuf::reset(offset_t stream_position)
 
     // m_zs.next_in and avail_in must be set according to
     // zlib.h (inline doc).
-    m_zs.next_in = reinterpret_cast<Bytef *>(&m_invec[0]);
+    m_zs.next_in = Z_NULL;
     m_zs.avail_in = 0;
+    m_stream_ended = false;
 
+    // if zlib is not yet initialized, underflow() does it
     int err(Z_OK);
     if(m_zs_initialized)
     {
         // just reset it
         err = inflateReset(&m_zs);
     }
-    else
-    {
-        // initialize it
-        err = inflateInit2(&m_zs, -MAX_WBITS);
-        /* windowBits is passed < 0 to tell that there is no zlib header.
-           Note that in this case inflate *requires* an extra "dummy" byte
-           after the compressed stream in order to complete decompression
-           and return Z_STREAM_END.  We always have an extra "dummy" byte,
-           because there is always some trailing data after the compressed
-           data (either the next entry or the central directory.  */
-        m_zs_initialized = true;
-    }
 
     // streambuf init:
-    // The important thing here, is that
-    // - the pointers are not NULL (which would mean unbuffered)
-    // - and that gptr() is not less than egptr() (so we trigger underflow
-    //   the first time data is read).
-    setg(&m_outvec[0], &m_outvec[0] + getBufferSize(), &m_outvec[0] + getBufferSize());
+    // with an empty get area, the first read calls underflow() which
+    // allocates the buffers
+    setg(nullptr, nullptr, nullptr);
 
     return err == Z_OK;
 }
 
 
+/** \brief Limit the size of the buffers.
+ *
+ * By default, the input and output buffers are getBufferSize() bytes.
+ * When the sizes of the compressed and uncompressed data are known
+ * and smaller, there is no need for such large buffers. This function
+ * reduces them accordingly. A size of zero is ignored.
+ *
+ * \warning
+ * This function must be called before the data gets read.
+ *
+ * \param[in] input_size  The size of the compressed data.
+ * \param[in] output_size  The size of the uncompressed data.
+ */
+void InflateInputStreambuf::limitBufferSizes(size_t input_size, size_t output_size)
+{
+    // inflate() needs one byte after the compressed data
+    if(input_size > 0)
+    {
+        m_input_size = std::min(input_size + 1, getBufferSize());
+    }
+    if(output_size > 0)
+    {
+        m_output_size = std::min(output_size, getBufferSize());
+    }
+}
+
+
+/** \brief Release zlib and the input buffers.
+ *
+ * This function is called once the end of the compressed data was
+ * reached. The output buffer is kept since it may still hold data
+ * to be read.
+ */
+void InflateInputStreambuf::releaseInflate()
+{
+    stopReadAhead();
+
+    if(m_zs_initialized)
+    {
+        inflateEnd(&m_zs);
+        m_zs_initialized = false;
+    }
+    m_zs.next_in = Z_NULL;
+    m_zs.avail_in = 0;
+
+    std::vector<char>().swap(m_invec);
+    std::vector<char>().swap(m_next_invec);
+}
+
+
+/** \brief Turn on the read-ahead of compressed data.
+ *
+ * By default, the underflow() function reads a chunk of compressed
+ * data and then inflates it, so the I/O and the decompression strictly
+ * alternate. With the read-ahead turned on, a background thread reads
+ * the next chunk of compressed data in a second buffer while the
+ * current chunk gets inflated. Decompressing a large entry then takes
+ * about the longest of the I/O and the inflate time instead of their sum.
+ *
+ * The thread gets started on the first underflow() and it is stopped
+ * by reset() and the destructor. While it runs, it is the only one
+ * reading from the input streambuf.
+ *
+ * \warning
+ * This function must be called before the data gets read.
+ *
+ * \param[in] buffer_size  The size of each one of the two input buffers.
+ *                         Use 0 to turn off the read-ahead.
+ */
+void InflateInputStreambuf::setReadAhead(size_t buffer_size)
+{
+    stopReadAhead();
+
+    // the buffers get allocated with the new size by fillInvec()
+    m_read_ahead_size = buffer_size;
+    std::vector<char>().swap(m_invec);
+    std::vector<char>().swap(m_next_invec);
+
+    // m_zs.next_in may point to the buffer we just released
+    m_zs.next_in = Z_NULL;
+    m_zs.avail_in = 0;
+}
+
+
+/** \brief Read the next chunk of compressed data in m_invec.
+ *
+ * Without read-ahead, this function reads the data directly from the
+ * input streambuf. The buffers get allocated on the first call.
+ *
+ * With read-ahead, the function waits for the background thread to be
+ * done with the buffer it is reading, then swaps that buffer with
+ * m_invec and lets the thread start reading the following chunk.
+ *
+ * \exception std::exception
+ * If the background thread failed with an exception, it is rethrown here.
+ *
+ * \return The number of bytes now available in m_invec.
+ */
+std::streamsize InflateInputStreambuf::fillInvec()
+{
+    if(m_read_ahead_size == 0)
+    {
+        if(m_invec.empty())
+        {
+            m_invec.resize(m_input_size);
+        }
+        return m_inbuf->sgetn(&m_invec[0], m_invec.size());
+    }
+
+    if(!m_reader.joinable())
+    {
+        if(m_invec.empty())
+        {
+            m_invec.resize(m_read_ahead_size);
+            m_next_invec.resize(m_read_ahead_size);
+        }
+        m_next_ready = false;
+        m_stop_reader = false;
+        m_reader_error = nullptr;
+        m_reader = std::thread(&InflateInputStreambuf::readAhead, this);
+    }
+
+    std::unique_lock<std::mutex> lock(m_reader_mutex);
+    m_reader_cond.wait(lock, [this]{ return m_next_ready; });
+    if(m_reader_error)
+    {
+        std::rethrow_exception(m_reader_error);
+    }
+
+    m_invec.swap(m_next_invec);
+    std::streamsize const bc(m_next_size);
+    m_next_ready = false;
+    m_reader_cond.notify_all();
+
+    return bc;
+}
+
+
+/** \brief The body of the read-ahead thread.
+ *
+ * This function reads one chunk of data in m_next_invec each time the
+ * buffer gets swapped by fillInvec(). It stops once requested to by
+ * stopReadAhead() or when an error occurs.
+ */
+void InflateInputStreambuf::readAhead()
+{
+    std::unique_lock<std::mutex> lock(m_reader_mutex);
+    for(;;)
+    {
+        m_reader_cond.wait(lock, [this]{ return m_stop_reader || !m_next_ready; });
+        if(m_stop_reader)
+        {
+            return;
+        }
+
+        // the consumer does not touch m_next_invec until m_next_ready
+        // is true so we can release the lock while reading
+        char * buffer(&m_next_invec[0]);
+        std::streamsize const size(m_next_invec.size());
+        lock.unlock();
+
+        std::streamsize bc(0);
+        std::exception_ptr error;
+        try
+        {
+            bc = m_inbuf->sgetn(buffer, size);
+        }
+        catch(...)
+        {
+            error = std::current_exception(); // LCOV_EXCL_LINE
+        }
+
+        lock.lock();
+        m_next_size = bc;
+        m_reader_error = error;
+        m_next_ready = true;
+        m_reader_cond.notify_all();
+
+        if(error)
+        {
+            return; // LCOV_EXCL_LINE
+        }
+    }
+}
+
+
+/** \brief Stop the read-ahead thread.
+ *
+ * If the read-ahead thread is running, this function asks it to stop
+ * and waits for it. Any data that was read ahead is lost.
+ */
+void InflateInputStreambuf::stopReadAhead()
+{
+    if(m_reader.joinable())
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_reader_mutex);
+            m_stop_reader = true;
+            m_reader_cond.notify_all();
+        }
+        m_reader.join();
+    }
+}
+
+
 } // zipios namespace
 
 // Local Variables:
@@ -35,6 +35,10 @@
 
 #include "zipios/zipios-config.hpp"
 
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <zlib.h>
@@ -53,19 +57,40 @@ public:
     virtual                 ~InflateInputStreambuf();
 
     bool                    reset(offset_t stream_position = -1);
+    void                    setReadAhead(size_t buffer_size);
 
 protected:
     virtual std::streambuf::int_type             underflow() override;
+    void                    limitBufferSizes(size_t input_size, size_t output_size);
+    void                    stopReadAhead();
 
     /** \FIXME Consider design?
      */
     std::vector<char>       m_outvec;
 
 private:
+    std::streamsize         fillInvec();
+    void                    readAhead();
+    void                    releaseInflate();
+
     std::vector<char>       m_invec;
+    size_t                  m_input_size = getBufferSize();
+    size_t                  m_output_size = getBufferSize();
 
     z_stream                m_zs;
     bool                    m_zs_initialized = false;
+    bool                    m_stream_ended = false;
+
+    // read-ahead (double buffering) support
+    size_t                  m_read_ahead_size = 0;
+    std::vector<char>       m_next_invec;
+    std::streamsize         m_next_size = 0;
+    bool                    m_next_ready = false;
+    bool                    m_stop_reader = false;
+    std::exception_ptr      m_reader_error;
+    std::thread             m_reader;
+    std::mutex              m_reader_mutex;
+    std::condition_variable m_reader_cond;
 };
 
 
@@ -0,0 +1,91 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::MemoryMappedInputStream.
+ *
+ * This file defines the functions of the zipios::MemoryMappedInputStream
+ * class.
+ */
+
+#include "memorymappedinputstream.hpp"
+
+
+namespace zipios
+{
+
+
+/** \class MemoryMappedInputStream
+ * \brief An input stream reading a file from a memory mapping.
+ *
+ * This istream reads a file with a MemoryMappedStreambuf. It is
+ * returned by DirectoryCollection::getInputStream() when memory mapped
+ * input streams were requested with DirectoryCollection::setMemoryMapped().
+ */
+
+
+/** \brief Map a file and attach the stream to the mapping.
+ *
+ * If the file cannot be mapped, the failbit of the stream is set.
+ *
+ * \param[in] filename  The name of the file to read.
+ */
+MemoryMappedInputStream::MemoryMappedInputStream(std::string const & filename)
+    : std::istream(nullptr)
+    , m_mmsb(new MemoryMappedStreambuf(filename))
+{
+    init(m_mmsb.get());
+    if(!m_mmsb->isOpen())
+    {
+        setstate(std::ios_base::failbit);
+    }
+}
+
+
+/** \brief Clean up the input stream.
+ *
+ * The destructor unmaps the file.
+ */
+MemoryMappedInputStream::~MemoryMappedInputStream()
+{
+}
+
+
+/** \brief Check whether the file was mapped.
+ *
+ * \return true if the file is mapped in memory.
+ */
+bool MemoryMappedInputStream::isOpen() const
+{
+    return m_mmsb->isOpen();
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
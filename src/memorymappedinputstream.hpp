@@ -0,0 +1,68 @@
+#pragma once
+#ifndef MEMORYMAPPEDINPUTSTREAM_HPP
+#define MEMORYMAPPEDINPUTSTREAM_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Define zipios::MemoryMappedInputStream.
+ *
+ * This file declares the zipios::MemoryMappedInputStream class which
+ * reads a file through a read-only memory mapping.
+ */
+
+#include "memorymappedstreambuf.hpp"
+
+#include <istream>
+#include <memory>
+
+
+namespace zipios
+{
+
+
+class MemoryMappedInputStream : public std::istream
+{
+public:
+                            MemoryMappedInputStream(std::string const & filename);
+                            MemoryMappedInputStream(MemoryMappedInputStream const & src) = delete;
+    MemoryMappedInputStream & operator = (MemoryMappedInputStream const & rhs) = delete;
+    virtual                 ~MemoryMappedInputStream() override;
+
+    bool                    isOpen() const;
+
+private:
+    std::unique_ptr<MemoryMappedStreambuf>  m_mmsb;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
@@ -0,0 +1,144 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::MemoryMappedStreambuf.
+ *
+ * This file defines the functions of the zipios::MemoryMappedStreambuf
+ * class which reads a file through a read-only memory mapping.
+ */
+
+#include "memorymappedstreambuf.hpp"
+
+#include <errno.h>
+
+#if !defined(ZIPIOS_WINDOWS) && (defined(_WINDOWS) || defined(WIN32) || defined(_WIN32) || defined(__WIN32))
+#define ZIPIOS_WINDOWS
+#endif
+
+#ifndef ZIPIOS_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace zipios
+{
+
+
+/** \class MemoryMappedStreambuf
+ * \brief An input stream buffer reading a file from a memory mapping.
+ *
+ * The MemoryMappedStreambuf class maps a whole file in memory, read
+ * only, and reads it as a MemoryStreambuf. A reader which accesses
+ * the get area directly, such as a ZipOutputStream fed with
+ * `os << is.rdbuf()`, reads the bytes straight from the kernel page
+ * cache.
+ *
+ * The kernel is told that the file is going to be read sequentially
+ * so it reads ahead as much as it sees fit.
+ *
+ * When the file cannot be mapped (it cannot be opened, it is empty,
+ * or the platform does not support mappings) isOpen() returns false
+ * and the buffer behaves as an empty file.
+ */
+
+
+/** \brief Map a file in memory.
+ *
+ * The constructor opens the file, maps it in memory, and closes it
+ * again. The mapping remains valid until the buffer gets destroyed.
+ *
+ * \param[in] filename  The name of the file to map.
+ */
+MemoryMappedStreambuf::MemoryMappedStreambuf(std::string const & filename)
+    //: m_open(false) -- auto-init
+    //, m_map(nullptr) -- auto-init
+    //, m_size(0) -- auto-init
+{
+#ifdef ZIPIOS_WINDOWS
+    static_cast<void>(filename);
+#else
+    int const fd(::open(filename.c_str(), O_RDONLY));
+    if(fd < 0)
+    {
+        return;
+    }
+
+    struct stat s;
+    if(fstat(fd, &s) == 0
+    && S_ISREG(s.st_mode)
+    && s.st_size > 0)
+    {
+        void * map(mmap(nullptr, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+        if(map != MAP_FAILED)
+        {
+            m_map = reinterpret_cast<char *>(map);
+            m_size = s.st_size;
+            m_open = true;
+            static_cast<void>(madvise(map, m_size, MADV_SEQUENTIAL));
+            setBuffer(m_map, m_size);
+        }
+    }
+
+    // the mapping keeps a reference to the file
+    ::close(fd);
+#endif
+}
+
+
+/** \brief Unmap the file.
+ *
+ * The destructor releases the memory mapping.
+ */
+MemoryMappedStreambuf::~MemoryMappedStreambuf()
+{
+#ifndef ZIPIOS_WINDOWS
+    if(m_map != nullptr)
+    {
+        munmap(m_map, m_size);
+    }
+#endif
+}
+
+
+/** \brief Check whether the file was mapped.
+ *
+ * \return true if the file is mapped in memory.
+ */
+bool MemoryMappedStreambuf::isOpen() const
+{
+    return m_open;
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
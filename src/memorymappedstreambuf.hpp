@@ -0,0 +1,69 @@
+#pragma once
+#ifndef MEMORYMAPPEDSTREAMBUF_HPP
+#define MEMORYMAPPEDSTREAMBUF_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Header file that defines zipios::MemoryMappedStreambuf.
+ *
+ * This file declares the zipios::MemoryMappedStreambuf class which is
+ * used to read a file through a read-only memory mapping.
+ */
+
+#include "memorystreambuf.hpp"
+
+#include <string>
+
+
+namespace zipios
+{
+
+
+class MemoryMappedStreambuf : public MemoryStreambuf
+{
+public:
+                            MemoryMappedStreambuf(std::string const & filename);
+                            MemoryMappedStreambuf(MemoryMappedStreambuf const & src) = delete;
+    MemoryMappedStreambuf & operator = (MemoryMappedStreambuf const & rhs) = delete;
+    virtual                 ~MemoryMappedStreambuf() override;
+
+    bool                    isOpen() const;
+
+private:
+    bool                    m_open = false;
+    char *                  m_map = nullptr;
+    size_t                  m_size = 0;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
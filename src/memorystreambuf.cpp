@@ -0,0 +1,164 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::MemoryStreambuf.
+ *
+ * This file defines the functions of the zipios::MemoryStreambuf
+ * class which reads a block of memory without copying it.
+ */
+
+#include "memorystreambuf.hpp"
+
+
+namespace zipios
+{
+
+
+/** \class MemoryStreambuf
+ * \brief An input stream buffer reading a block of memory.
+ *
+ * The MemoryStreambuf class uses a block of memory as its get area.
+ * No data gets copied in an intermediate buffer. A reader which
+ * accesses the get area directly, such as a ZipOutputStream fed with
+ * `os << is.rdbuf()`, reads the bytes straight from that memory.
+ *
+ * The memory is never modified and it must remain valid for as long
+ * as the buffer exists.
+ */
+
+
+/** \brief Initialize the buffer with a block of memory.
+ *
+ * \param[in] data  The data to read.
+ * \param[in] size  The number of bytes in \p data.
+ */
+MemoryStreambuf::MemoryStreambuf(char const * data, size_t size)
+{
+    setBuffer(data, size);
+}
+
+
+/** \brief Clean up the buffer.
+ *
+ * The memory is not owned by this object so nothing gets released.
+ */
+MemoryStreambuf::~MemoryStreambuf()
+{
+}
+
+
+/** \brief Change the block of memory being read.
+ *
+ * The read position is moved to the start of the new block.
+ *
+ * \param[in] data  The data to read.
+ * \param[in] size  The number of bytes in \p data.
+ */
+void MemoryStreambuf::setBuffer(char const * data, size_t size)
+{
+    // the get area is never written to
+    char * start(const_cast<char *>(data));
+    setg(start, start, start + size);
+}
+
+
+/** \brief Return the number of bytes left to read.
+ *
+ * The whole block is always available so this is the number of bytes
+ * between the current position and the end of the block. Once at the
+ * end, the function returns -1 to signal that no more data will ever
+ * be available.
+ *
+ * \return The number of bytes left or -1.
+ */
+std::streamsize MemoryStreambuf::showmanyc()
+{
+    std::streamsize const left(egptr() - gptr());
+    return left > 0 ? left : -1;
+}
+
+
+/** \brief Seek to a position relative to the start, current, or end.
+ *
+ * The function moves the read position within the block. Positions
+ * outside of the block are refused.
+ *
+ * \param[in] off  The offset to add to the position defined by \p dir.
+ * \param[in] dir  The position \p off is relative to.
+ * \param[in] which  Must include std::ios_base::in.
+ *
+ * \return The new position or -1 on failure.
+ */
+MemoryStreambuf::pos_type MemoryStreambuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+    off_type base(0);
+    switch(dir)
+    {
+    case std::ios_base::cur:
+        base = gptr() - eback();
+        break;
+
+    case std::ios_base::end:
+        base = egptr() - eback();
+        break;
+
+    default:
+        break;
+
+    }
+
+    return seekpos(base + off, which);
+}
+
+
+/** \brief Seek to an absolute position.
+ *
+ * \param[in] pos  The new position.
+ * \param[in] which  Must include std::ios_base::in.
+ *
+ * \return The new position or -1 on failure.
+ */
+MemoryStreambuf::pos_type MemoryStreambuf::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    off_type const offset(pos);
+    if((which & std::ios_base::in) == 0
+    || offset < 0
+    || offset > egptr() - eback())
+    {
+        return pos_type(off_type(-1));
+    }
+
+    setg(eback(), eback() + offset, egptr());
+    return pos;
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
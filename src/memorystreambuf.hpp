@@ -0,0 +1,69 @@
+#pragma once
+#ifndef MEMORYSTREAMBUF_HPP
+#define MEMORYSTREAMBUF_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Header file that defines zipios::MemoryStreambuf.
+ *
+ * This file declares the zipios::MemoryStreambuf class which is
+ * used to read a block of memory without copying it.
+ */
+
+#include "zipios/zipios-config.hpp"
+
+#include <streambuf>
+
+
+namespace zipios
+{
+
+
+class MemoryStreambuf : public std::streambuf
+{
+public:
+                            MemoryStreambuf(char const * data = nullptr, size_t size = 0);
+                            MemoryStreambuf(MemoryStreambuf const & src) = delete;
+    MemoryStreambuf &       operator = (MemoryStreambuf const & rhs) = delete;
+    virtual                 ~MemoryStreambuf() override;
+
+protected:
+    void                    setBuffer(char const * data, size_t size);
+
+    virtual std::streamsize showmanyc() override;
+    virtual pos_type        seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::in) override;
+    virtual pos_type        seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in) override;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
@@ -0,0 +1,553 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::SHA1.
+ *
+ * This file defines the functions of the zipios::SHA1 class, a
+ * straightforward implementation of FIPS 180-4. SHA-1 is only used
+ * where a file format requires it, such as the HMAC of WinZip AES
+ * encrypted entries.
+ *
+ * When the processor offers the SHA extensions (x86), they get used
+ * instead. The choice is made at run time.
+ */
+
+#include "sha1.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ZIPIOS_SHA1_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+
+namespace zipios
+{
+
+
+namespace
+{
+
+
+/** \brief Rotate a 32 bit value to the left.
+ *
+ * \param[in] value  The value to rotate.
+ * \param[in] count  The number of bits to rotate, 1 to 31.
+ *
+ * \return The rotated value.
+ */
+inline uint32_t rotl(uint32_t value, int count)
+{
+    return (value << count) | (value >> (32 - count));
+}
+
+
+#if defined(ZIPIOS_SHA1_X86)
+/** \brief Check whether the processor has the SHA extensions.
+ *
+ * The check is done once.
+ *
+ * \return true if processBlocksHardware() can be used.
+ */
+bool hasShaExtensions()
+{
+    static bool const g_supported([]()
+        {
+            unsigned int eax(0);
+            unsigned int ebx(0);
+            unsigned int ecx(0);
+            unsigned int edx(0);
+            if(__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0
+            || (ecx & bit_SSE4_1) == 0
+            || (ecx & bit_SSSE3) == 0)
+            {
+                return false;
+            }
+            return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) != 0
+                && (ebx & bit_SHA) != 0;
+        }());
+    return g_supported;
+}
+
+
+/** \brief Process blocks with the SHA extensions.
+ *
+ * Each group of four rounds is one SHA1RNDS4 instruction. The message
+ * schedule of the following groups is computed in between with the
+ * SHA1MSG1, SHA1MSG2, and XOR instructions.
+ *
+ * \param[in,out] state  The five words of the state.
+ * \param[in] data  The blocks of 64 bytes.
+ * \param[in] count  The number of blocks.
+ */
+__attribute__((target("sha,sse4.1,ssse3")))
+void processBlocksHardware(uint32_t * state, uint8_t const * data, size_t count)
+{
+    __m128i const mask(_mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL));
+
+    __m128i abcd(_mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const *>(state)), 0x1B));
+    __m128i e0(_mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0));
+    __m128i e1;
+
+    for(; count > 0; --count, data += 64)
+    {
+        __m128i const abcd_save(abcd);
+        __m128i const e0_save(e0);
+
+        __m128i m0(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const *>(data) + 0), mask));
+        __m128i m1(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const *>(data) + 1), mask));
+        __m128i m2(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const *>(data) + 2), mask));
+        __m128i m3(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const *>(data) + 3), mask));
+
+        // rounds 0 to 3
+        e0 = _mm_add_epi32(e0, m0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+        // rounds 4 to 7
+        e1 = _mm_sha1nexte_epu32(e1, m1);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+
+        // rounds 8 to 11
+        e0 = _mm_sha1nexte_epu32(e0, m2);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        m1 = _mm_sha1msg1_epu32(m1, m2);
+        m0 = _mm_xor_si128(m0, m2);
+
+        // rounds 12 to 15
+        e1 = _mm_sha1nexte_epu32(e1, m3);
+        e0 = abcd;
+        m0 = _mm_sha1msg2_epu32(m0, m3);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+        m2 = _mm_sha1msg1_epu32(m2, m3);
+        m1 = _mm_xor_si128(m1, m3);
+
+        // rounds 16 to 19
+        e0 = _mm_sha1nexte_epu32(e0, m0);
+        e1 = abcd;
+        m1 = _mm_sha1msg2_epu32(m1, m0);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        m3 = _mm_sha1msg1_epu32(m3, m0);
+        m2 = _mm_xor_si128(m2, m0);
+
+        // rounds 20 to 23
+        e1 = _mm_sha1nexte_epu32(e1, m1);
+        e0 = abcd;
+        m2 = _mm_sha1msg2_epu32(m2, m1);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+        m3 = _mm_xor_si128(m3, m1);
+
+        // rounds 24 to 27
+        e0 = _mm_sha1nexte_epu32(e0, m2);
+        e1 = abcd;
+        m3 = _mm_sha1msg2_epu32(m3, m2);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+        m1 = _mm_sha1msg1_epu32(m1, m2);
+        m0 = _mm_xor_si128(m0, m2);
+
+        // rounds 28 to 31
+        e1 = _mm_sha1nexte_epu32(e1, m3);
+        e0 = abcd;
+        m0 = _mm_sha1msg2_epu32(m0, m3);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+        m2 = _mm_sha1msg1_epu32(m2, m3);
+        m1 = _mm_xor_si128(m1, m3);
+
+        // rounds 32 to 35
+        e0 = _mm_sha1nexte_epu32(e0, m0);
+        e1 = abcd;
+        m1 = _mm_sha1msg2_epu32(m1, m0);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+        m3 = _mm_sha1msg1_epu32(m3, m0);
+        m2 = _mm_xor_si128(m2, m0);
+
+        // rounds 36 to 39
+        e1 = _mm_sha1nexte_epu32(e1, m1);
+        e0 = abcd;
+        m2 = _mm_sha1msg2_epu32(m2, m1);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+        m3 = _mm_xor_si128(m3, m1);
+
+        // rounds 40 to 43
+        e0 = _mm_sha1nexte_epu32(e0, m2);
+        e1 = abcd;
+        m3 = _mm_sha1msg2_epu32(m3, m2);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+        m1 = _mm_sha1msg1_epu32(m1, m2);
+        m0 = _mm_xor_si128(m0, m2);
+
+        // rounds 44 to 47
+        e1 = _mm_sha1nexte_epu32(e1, m3);
+        e0 = abcd;
+        m0 = _mm_sha1msg2_epu32(m0, m3);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+        m2 = _mm_sha1msg1_epu32(m2, m3);
+        m1 = _mm_xor_si128(m1, m3);
+
+        // rounds 48 to 51
+        e0 = _mm_sha1nexte_epu32(e0, m0);
+        e1 = abcd;
+        m1 = _mm_sha1msg2_epu32(m1, m0);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+        m3 = _mm_sha1msg1_epu32(m3, m0);
+        m2 = _mm_xor_si128(m2, m0);
+
+        // rounds 52 to 55
+        e1 = _mm_sha1nexte_epu32(e1, m1);
+        e0 = abcd;
+        m2 = _mm_sha1msg2_epu32(m2, m1);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+        m3 = _mm_xor_si128(m3, m1);
+
+        // rounds 56 to 59
+        e0 = _mm_sha1nexte_epu32(e0, m2);
+        e1 = abcd;
+        m3 = _mm_sha1msg2_epu32(m3, m2);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+        m1 = _mm_sha1msg1_epu32(m1, m2);
+        m0 = _mm_xor_si128(m0, m2);
+
+        // rounds 60 to 63
+        e1 = _mm_sha1nexte_epu32(e1, m3);
+        e0 = abcd;
+        m0 = _mm_sha1msg2_epu32(m0, m3);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+        m2 = _mm_sha1msg1_epu32(m2, m3);
+        m1 = _mm_xor_si128(m1, m3);
+
+        // rounds 64 to 67
+        e0 = _mm_sha1nexte_epu32(e0, m0);
+        e1 = abcd;
+        m1 = _mm_sha1msg2_epu32(m1, m0);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+        m3 = _mm_sha1msg1_epu32(m3, m0);
+        m2 = _mm_xor_si128(m2, m0);
+
+        // rounds 68 to 71
+        e1 = _mm_sha1nexte_epu32(e1, m1);
+        e0 = abcd;
+        m2 = _mm_sha1msg2_epu32(m2, m1);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+        m3 = _mm_xor_si128(m3, m1);
+
+        // rounds 72 to 75
+        e0 = _mm_sha1nexte_epu32(e0, m2);
+        e1 = abcd;
+        m3 = _mm_sha1msg2_epu32(m3, m2);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+        // rounds 76 to 79
+        e1 = _mm_sha1nexte_epu32(e1, m3);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+        // add the state of the previous block
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+}
+#endif
+
+
+} // no name namespace
+
+
+/** \class SHA1
+ * \brief Compute the SHA-1 digest of some data.
+ *
+ * This class works like the SHA256 class. It is used by the HMAC-SHA1
+ * of the WinZip AES encryption.
+ */
+
+
+/** \brief Initialize a SHA1 object.
+ *
+ * The object is ready to receive data.
+ */
+SHA1::SHA1()
+    //: m_state() -- initialized in reset()
+    //, m_block() -- no need to initialize
+    //, m_block_size(0) -- auto-init
+    //, m_total_size(0) -- auto-init
+    : m_hardware(hasHardwareSupport())
+{
+    reset();
+}
+
+
+/** \brief Check whether the processor has SHA-1 instructions.
+ *
+ * \return true if the hardware implementation can be used.
+ */
+bool SHA1::hasHardwareSupport()
+{
+#if defined(ZIPIOS_SHA1_X86)
+    return hasShaExtensions();
+#else
+    return false;
+#endif
+}
+
+
+/** \brief Check whether this object uses the SHA-1 instructions.
+ *
+ * \return true if the blocks get processed by the processor instructions.
+ */
+bool SHA1::getHardwareAcceleration() const
+{
+    return m_hardware;
+}
+
+
+/** \brief Choose between the SHA-1 instructions and the software version.
+ *
+ * The hardware implementation is used by default when available.
+ *
+ * \param[in] enable  Whether to use the SHA-1 instructions. Ignored if
+ *                    the processor does not support them.
+ */
+void SHA1::setHardwareAcceleration(bool enable)
+{
+    m_hardware = enable && hasHardwareSupport();
+}
+
+
+/** \brief Restart the computation of a digest.
+ *
+ * This function resets the object so it can be used to compute the
+ * digest of another set of data.
+ */
+void SHA1::reset()
+{
+    m_state = {{
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+    }};
+    m_block_size = 0;
+    m_total_size = 0;
+}
+
+
+/** \brief Add data to the digest.
+ *
+ * \param[in] data  The data to add.
+ * \param[in] size  The number of bytes in \p data.
+ */
+void SHA1::update(void const * data, size_t size)
+{
+    uint8_t const * d(reinterpret_cast<uint8_t const *>(data));
+    m_total_size += size;
+
+    if(m_block_size > 0)
+    {
+        size_t const amount(std::min(size, m_block.size() - m_block_size));
+        memcpy(&m_block[m_block_size], d, amount);
+        m_block_size += amount;
+        d += amount;
+        size -= amount;
+        if(m_block_size < m_block.size())
+        {
+            return;
+        }
+        processBlocks(&m_block[0], 1);
+        m_block_size = 0;
+    }
+
+    size_t const count(size / m_block.size());
+    if(count > 0)
+    {
+        processBlocks(d, count);
+        d += count * m_block.size();
+        size -= count * m_block.size();
+    }
+
+    if(size > 0)
+    {
+        memcpy(&m_block[0], d, size);
+        m_block_size = size;
+    }
+}
+
+
+/** \brief Finish the computation and return the digest.
+ *
+ * This function adds the padding and returns the resulting digest.
+ * Call reset() before reusing the object.
+ *
+ * \return The 20 bytes of the digest.
+ */
+SHA1::digest_t SHA1::digest()
+{
+    uint64_t const bits(m_total_size * 8);
+
+    uint8_t padding[72] = { 0x80 };
+    size_t const padding_size((m_block_size < 56 ? 56 : 120) - m_block_size);
+    update(padding, padding_size);
+
+    uint8_t length[8];
+    for(int idx(0); idx < 8; ++idx)
+    {
+        length[idx] = static_cast<uint8_t>(bits >> (56 - idx * 8));
+    }
+    update(length, sizeof(length));
+
+    digest_t result;
+    for(size_t idx(0); idx < m_state.size(); ++idx)
+    {
+        result[idx * 4 + 0] = static_cast<uint8_t>(m_state[idx] >> 24);
+        result[idx * 4 + 1] = static_cast<uint8_t>(m_state[idx] >> 16);
+        result[idx * 4 + 2] = static_cast<uint8_t>(m_state[idx] >>  8);
+        result[idx * 4 + 3] = static_cast<uint8_t>(m_state[idx]      );
+    }
+    return result;
+}
+
+
+/** \brief Finish the computation and return the digest in hexadecimal.
+ *
+ * \return The digest as a string of 40 lowercase hexadecimal digits.
+ */
+std::string SHA1::hexDigest()
+{
+    static char const g_hex[] = "0123456789abcdef";
+
+    digest_t const d(digest());
+    std::string result;
+    result.reserve(d.size() * 2);
+    for(auto const b : d)
+    {
+        result += g_hex[b >> 4];
+        result += g_hex[b & 15];
+    }
+    return result;
+}
+
+
+/** \brief Process blocks of 64 bytes.
+ *
+ * \param[in] data  The blocks of data to add to the digest.
+ * \param[in] count  The number of blocks.
+ */
+void SHA1::processBlocks(uint8_t const * data, size_t count)
+{
+#if defined(ZIPIOS_SHA1_X86)
+    if(m_hardware)
+    {
+        processBlocksHardware(m_state.data(), data, count);
+        return;
+    }
+#endif
+
+    for(; count > 0; --count, data += 64)
+    {
+        processBlock(data);
+    }
+}
+
+
+/** \brief Process one block of 64 bytes.
+ *
+ * \param[in] block  The block of data to add to the digest.
+ */
+void SHA1::processBlock(uint8_t const * block)
+{
+    uint32_t w[80];
+    for(int idx(0); idx < 16; ++idx)
+    {
+        w[idx] = (static_cast<uint32_t>(block[idx * 4 + 0]) << 24)
+               | (static_cast<uint32_t>(block[idx * 4 + 1]) << 16)
+               | (static_cast<uint32_t>(block[idx * 4 + 2]) <<  8)
+               | (static_cast<uint32_t>(block[idx * 4 + 3])      );
+    }
+    for(int idx(16); idx < 80; ++idx)
+    {
+        w[idx] = rotl(w[idx - 3] ^ w[idx - 8] ^ w[idx - 14] ^ w[idx - 16], 1);
+    }
+
+    uint32_t a(m_state[0]);
+    uint32_t b(m_state[1]);
+    uint32_t c(m_state[2]);
+    uint32_t d(m_state[3]);
+    uint32_t e(m_state[4]);
+
+    for(int idx(0); idx < 80; ++idx)
+    {
+        uint32_t f;
+        uint32_t k;
+        if(idx < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        }
+        else if(idx < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        }
+        else if(idx < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+
+        uint32_t const t(rotl(a, 5) + f + e + k + w[idx]);
+        e = d;
+        d = c;
+        c = rotl(b, 30);
+        b = a;
+        a = t;
+    }
+
+    m_state[0] += a;
+    m_state[1] += b;
+    m_state[2] += c;
+    m_state[3] += d;
+    m_state[4] += e;
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
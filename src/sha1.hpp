@@ -0,0 +1,84 @@
+#pragma once
+#ifndef SHA1_HPP
+#define SHA1_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Header file that defines zipios::SHA1.
+ *
+ * This file declares the zipios::SHA1 class which computes the
+ * SHA-1 digest of a stream of bytes.
+ */
+
+#include "zipios/zipios-config.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+
+namespace zipios
+{
+
+
+class SHA1
+{
+public:
+    typedef std::array<uint8_t, 20>     digest_t;
+
+                        SHA1();
+
+    static bool         hasHardwareSupport();
+    bool                getHardwareAcceleration() const;
+    void                setHardwareAcceleration(bool enable);
+
+    void                reset();
+    void                update(void const * data, size_t size);
+    digest_t            digest();
+    std::string         hexDigest();
+
+private:
+    void                processBlocks(uint8_t const * data, size_t count);
+    void                processBlock(uint8_t const * block);
+
+    std::array<uint32_t, 5>
+                        m_state;
+    std::array<uint8_t, 64>
+                        m_block;
+    size_t              m_block_size = 0;
+    uint64_t            m_total_size = 0;
+    bool                m_hardware = false;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
@@ -0,0 +1,283 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::SHA256.
+ *
+ * This file defines the functions of the zipios::SHA256 class, a
+ * straightforward implementation of FIPS 180-4.
+ */
+
+#include "sha256.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace zipios
+{
+
+
+namespace
+{
+
+
+/** \brief The SHA-256 round constants.
+ *
+ * The first 32 bits of the fractional parts of the cube roots of the
+ * first 64 prime numbers.
+ */
+uint32_t const g_round_constants[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+/** \brief Rotate a 32 bit value to the right.
+ *
+ * \param[in] value  The value to rotate.
+ * \param[in] count  The number of bits to rotate, 1 to 31.
+ *
+ * \return The rotated value.
+ */
+inline uint32_t rotr(uint32_t value, int count)
+{
+    return (value >> count) | (value << (32 - count));
+}
+
+
+} // no name namespace
+
+
+/** \class SHA256
+ * \brief Compute the SHA-256 digest of some data.
+ *
+ * This class is used to compute the SHA-256 digest of the data of a
+ * file. The data can be added in any number of calls to update().
+ *
+ * \code
+ *      SHA256 sha;
+ *      sha.update(buffer, size);
+ *      ...
+ *      std::string const hex(sha.hexDigest());
+ * \endcode
+ */
+
+
+/** \brief Initialize a SHA256 object.
+ *
+ * The object is ready to receive data.
+ */
+SHA256::SHA256()
+    //: m_state() -- initialized in reset()
+    //, m_block() -- no need to initialize
+    //, m_block_size(0) -- auto-init
+    //, m_total_size(0) -- auto-init
+{
+    reset();
+}
+
+
+/** \brief Restart the computation of a digest.
+ *
+ * This function resets the object so it can be used to compute the
+ * digest of another set of data.
+ */
+void SHA256::reset()
+{
+    m_state = {{
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    }};
+    m_block_size = 0;
+    m_total_size = 0;
+}
+
+
+/** \brief Add data to the digest.
+ *
+ * \param[in] data  The data to add.
+ * \param[in] size  The number of bytes in \p data.
+ */
+void SHA256::update(void const * data, size_t size)
+{
+    uint8_t const * d(reinterpret_cast<uint8_t const *>(data));
+    m_total_size += size;
+
+    if(m_block_size > 0)
+    {
+        size_t const amount(std::min(size, m_block.size() - m_block_size));
+        memcpy(&m_block[m_block_size], d, amount);
+        m_block_size += amount;
+        d += amount;
+        size -= amount;
+        if(m_block_size < m_block.size())
+        {
+            return;
+        }
+        processBlock(&m_block[0]);
+        m_block_size = 0;
+    }
+
+    for(; size >= m_block.size(); d += m_block.size(), size -= m_block.size())
+    {
+        processBlock(d);
+    }
+
+    if(size > 0)
+    {
+        memcpy(&m_block[0], d, size);
+        m_block_size = size;
+    }
+}
+
+
+/** \brief Finish the computation and return the digest.
+ *
+ * This function adds the padding and returns the resulting digest.
+ * Call reset() before reusing the object.
+ *
+ * \return The 32 bytes of the digest.
+ */
+SHA256::digest_t SHA256::digest()
+{
+    uint64_t const bits(m_total_size * 8);
+
+    uint8_t padding[72] = { 0x80 };
+    size_t const padding_size((m_block_size < 56 ? 56 : 120) - m_block_size);
+    update(padding, padding_size);
+
+    uint8_t length[8];
+    for(int idx(0); idx < 8; ++idx)
+    {
+        length[idx] = static_cast<uint8_t>(bits >> (56 - idx * 8));
+    }
+    update(length, sizeof(length));
+
+    digest_t result;
+    for(size_t idx(0); idx < m_state.size(); ++idx)
+    {
+        result[idx * 4 + 0] = static_cast<uint8_t>(m_state[idx] >> 24);
+        result[idx * 4 + 1] = static_cast<uint8_t>(m_state[idx] >> 16);
+        result[idx * 4 + 2] = static_cast<uint8_t>(m_state[idx] >>  8);
+        result[idx * 4 + 3] = static_cast<uint8_t>(m_state[idx]      );
+    }
+    return result;
+}
+
+
+/** \brief Finish the computation and return the digest in hexadecimal.
+ *
+ * \return The digest as a string of 64 lowercase hexadecimal digits.
+ */
+std::string SHA256::hexDigest()
+{
+    static char const g_hex[] = "0123456789abcdef";
+
+    digest_t const d(digest());
+    std::string result;
+    result.reserve(d.size() * 2);
+    for(auto const b : d)
+    {
+        result += g_hex[b >> 4];
+        result += g_hex[b & 15];
+    }
+    return result;
+}
+
+
+/** \brief Process one block of 64 bytes.
+ *
+ * \param[in] block  The block of data to add to the digest.
+ */
+void SHA256::processBlock(uint8_t const * block)
+{
+    uint32_t w[64];
+    for(int idx(0); idx < 16; ++idx)
+    {
+        w[idx] = (static_cast<uint32_t>(block[idx * 4 + 0]) << 24)
+               | (static_cast<uint32_t>(block[idx * 4 + 1]) << 16)
+               | (static_cast<uint32_t>(block[idx * 4 + 2]) <<  8)
+               | (static_cast<uint32_t>(block[idx * 4 + 3])      );
+    }
+    for(int idx(16); idx < 64; ++idx)
+    {
+        uint32_t const s0(rotr(w[idx - 15], 7) ^ rotr(w[idx - 15], 18) ^ (w[idx - 15] >> 3));
+        uint32_t const s1(rotr(w[idx - 2], 17) ^ rotr(w[idx - 2], 19) ^ (w[idx - 2] >> 10));
+        w[idx] = w[idx - 16] + s0 + w[idx - 7] + s1;
+    }
+
+    uint32_t a(m_state[0]);
+    uint32_t b(m_state[1]);
+    uint32_t c(m_state[2]);
+    uint32_t d(m_state[3]);
+    uint32_t e(m_state[4]);
+    uint32_t f(m_state[5]);
+    uint32_t g(m_state[6]);
+    uint32_t h(m_state[7]);
+
+    for(int idx(0); idx < 64; ++idx)
+    {
+        uint32_t const s1(rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25));
+        uint32_t const ch((e & f) ^ (~e & g));
+        uint32_t const t1(h + s1 + ch + g_round_constants[idx] + w[idx]);
+        uint32_t const s0(rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22));
+        uint32_t const maj((a & b) ^ (a & c) ^ (b & c));
+        uint32_t const t2(s0 + maj);
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    m_state[0] += a;
+    m_state[1] += b;
+    m_state[2] += c;
+    m_state[3] += d;
+    m_state[4] += e;
+    m_state[5] += f;
+    m_state[6] += g;
+    m_state[7] += h;
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
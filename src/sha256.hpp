@@ -0,0 +1,78 @@
+#pragma once
+#ifndef SHA256_HPP
+#define SHA256_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Header file that defines zipios::SHA256.
+ *
+ * This file declares the zipios::SHA256 class which computes the
+ * SHA-256 digest of a stream of bytes.
+ */
+
+#include "zipios/zipios-config.hpp"
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+
+namespace zipios
+{
+
+
+class SHA256
+{
+public:
+    typedef std::array<uint8_t, 32>     digest_t;
+
+                        SHA256();
+
+    void                reset();
+    void                update(void const * data, size_t size);
+    digest_t            digest();
+    std::string         hexDigest();
+
+private:
+    void                processBlock(uint8_t const * block);
+
+    std::array<uint32_t, 8>
+                        m_state;
+    std::array<uint8_t, 64>
+                        m_block;
+    size_t              m_block_size = 0;
+    uint64_t            m_total_size = 0;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
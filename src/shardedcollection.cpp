@@ -0,0 +1,510 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::ShardedCollection.
+ *
+ * This file includes the implementation of the zipios::ShardedCollection
+ * class, which writes a collection in a set of Zip archives and reads
+ * such a set back through its manifest.
+ */
+
+#include "zipios/shardedcollection.hpp"
+
+#include "zipios/zipfile.hpp"
+#include "zipios/zipiosexceptions.hpp"
+
+#include "zipios_common.hpp"
+
+#include <fstream>
+#include <iomanip>
+
+#include <zlib.h>
+
+
+namespace zipios
+{
+
+
+namespace
+{
+
+
+/** \brief The first line of a shard manifest.
+ *
+ * The manifest starts with this magic and a version so other files
+ * do not get mistaken for a manifest.
+ */
+char const g_manifest_magic[] = "zipios-shards 1";
+
+
+/** \brief The largest number of shards with ShardMode::NAME_HASH.
+ *
+ * The shard files are named "<basename>-NNNN.zip" so a set is limited
+ * to what fits in those four digits. This also prevents a mistaken
+ * limit (i.e. a size passed as a count) from allocating a huge vector.
+ */
+offset_t const g_max_name_hash_shards = 10000;
+
+
+/** \brief A subset of a collection saved in one shard.
+ *
+ * This collection lists the entries assigned to one shard. The data
+ * is read from a clone of the source collection so each shard thread
+ * has its own input streams.
+ */
+class ShardSubset : public FileCollection
+{
+public:
+    ShardSubset(FileCollection::pointer_t source, FileEntry::vector_t const & entries)
+        : FileCollection(source->getName())
+        , m_source(source)
+    {
+        // share the entries so the offsets and sizes computed while
+        // saving the shard are visible in the caller's collection
+        m_entries = entries;
+    }
+
+    virtual pointer_t clone() const override
+    {
+        return pointer_t(new ShardSubset(*this));
+    }
+
+    virtual stream_pointer_t getInputStream(std::string const & entry_name, MatchPath matchpath = MatchPath::MATCH) override
+    {
+        return m_source->getInputStream(entry_name, matchpath);
+    }
+
+private:
+    FileCollection::pointer_t   m_source = FileCollection::pointer_t();
+};
+
+
+/** \brief Compute the hash used to assign a name to a shard.
+ *
+ * This is the 32 bit FNV-1a hash. Contrary to std::hash, it gives
+ * the same result on all platforms so a given name always ends up
+ * in the same shard.
+ *
+ * \param[in] name  The name of the entry.
+ *
+ * \return The hash of \p name.
+ */
+uint32_t shardHash(std::string const & name)
+{
+    uint32_t hash(2166136261U);
+    for(auto c : name)
+    {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619U;
+    }
+    return hash;
+}
+
+
+/** \brief Compute the largest size an entry may take in an archive.
+ *
+ * This is the size of the local and central directory headers of
+ * the entry plus its data, assuming the worst case for compressed
+ * data.
+ *
+ * \param[in] entry  The entry to measure.
+ *
+ * \return The maximum number of bytes the entry adds to an archive.
+ */
+offset_t maximumEntrySize(FileEntry::pointer_t entry)
+{
+    // +1 for the '/' of directories
+    offset_t size(30 + 46 + 2 * (entry->getName().length() + 1 + entry->getExtra().size())
+                + entry->getComment().length());
+    if(!entry->isDirectory())
+    {
+        size += entry->getMethod() == StorageMethod::STORED
+                    ? entry->getSize()
+                    : compressBound(entry->getSize());
+    }
+    return size;
+}
+
+
+/** \brief Compute the name of a shard file.
+ *
+ * \param[in] basename  The basename of the shard set.
+ * \param[in] shard  The index of the shard.
+ *
+ * \return The name of the shard file, "<basename>-NNNN.zip".
+ */
+std::string shardFilename(std::string const & basename, size_t shard)
+{
+    OutputStringStream name;
+    name << basename << "-" << std::setw(4) << std::setfill('0') << shard << ".zip";
+    return name.str();
+}
+
+
+} // no name namespace
+
+
+
+/** \class ShardedCollection
+ * \brief A collection of Zip archives written as a set of shards.
+ *
+ * The saveCollectionToShards() function spreads the entries of a
+ * collection between several Zip archives, the shards, each one
+ * written by its own thread with its own compressor. This is useful
+ * to keep each archive below a size limit and to make use of all the
+ * processors and disks available while exporting a large collection.
+ *
+ * Along the shards, the function writes a manifest which lists the
+ * shards and the shard of each entry. The ShardedCollection
+ * constructor reads that manifest and opens the shards as one
+ * CollectionCollection. Requests for a specific entry are routed
+ * directly to its shard instead of searching each shard in turn.
+ */
+
+
+/** \brief Open a set of shards.
+ *
+ * This function reads the manifest written by saveCollectionToShards()
+ * and opens each shard as a ZipFile. The shard files are searched in
+ * the same directory as the manifest.
+ *
+ * \exception IOException
+ * This exception is raised if the manifest cannot be read.
+ *
+ * \exception FileCollectionException
+ * This exception is raised if the manifest is not valid or references
+ * a shard which does not exist.
+ *
+ * \param[in] manifest_filename  The name of the manifest file.
+ */
+ShardedCollection::ShardedCollection(std::string const & manifest_filename)
+    //: CollectionCollection() -- auto-init
+    //, m_routes() -- auto-init
+{
+    m_filename = manifest_filename;
+
+    std::ifstream manifest(manifest_filename);
+    if(!manifest)
+    {
+        throw IOException("ShardedCollection::ShardedCollection(): could not open manifest \"" + manifest_filename + "\".");
+    }
+
+    std::string line;
+    if(!std::getline(manifest, line)
+    || line != g_manifest_magic)
+    {
+        throw FileCollectionException("ShardedCollection::ShardedCollection(): \"" + manifest_filename + "\" is not a shard manifest.");
+    }
+
+    size_t shard_count(0);
+    if(!(manifest >> shard_count)
+    || !std::getline(manifest, line)
+    || !line.empty())
+    {
+        throw FileCollectionException("ShardedCollection::ShardedCollection(): invalid shard count in \"" + manifest_filename + "\".");
+    }
+
+    std::string::size_type const pos(manifest_filename.rfind(g_separator));
+    std::string const directory(pos == std::string::npos ? "" : manifest_filename.substr(0, pos + 1));
+    for(size_t shard(0); shard < shard_count; ++shard)
+    {
+        if(!std::getline(manifest, line)
+        || line.empty())
+        {
+            throw FileCollectionException("ShardedCollection::ShardedCollection(): missing shard filename in \"" + manifest_filename + "\".");
+        }
+        m_collections.push_back(FileCollection::pointer_t(new ZipFile(directory + line)));
+    }
+
+    while(std::getline(manifest, line))
+    {
+        std::string::size_type const space(line.find(' '));
+        if(space == std::string::npos
+        || space == 0)
+        {
+            throw FileCollectionException("ShardedCollection::ShardedCollection(): invalid entry line in \"" + manifest_filename + "\".");
+        }
+        size_t const shard(std::stoul(line.substr(0, space)));
+        if(shard >= shard_count)
+        {
+            throw FileCollectionException("ShardedCollection::ShardedCollection(): entry assigned to an unknown shard in \"" + manifest_filename + "\".");
+        }
+        m_routes[line.substr(space + 1)] = shard;
+    }
+}
+
+
+/** \brief Create a clone of this ShardedCollection.
+ *
+ * The clone gets a copy of each shard and of the routing table.
+ *
+ * \return A shared pointer to a copy of this ShardedCollection.
+ */
+FileCollection::pointer_t ShardedCollection::clone() const
+{
+    return FileCollection::pointer_t(new ShardedCollection(*this));
+}
+
+
+/** \brief Clean up the ShardedCollection.
+ *
+ * The destructor closes the shards.
+ */
+ShardedCollection::~ShardedCollection()
+{
+    close();
+}
+
+
+/** \brief Close the ShardedCollection.
+ *
+ * This function closes all the shards and forgets about the routing
+ * table. The collection becomes invalid.
+ */
+void ShardedCollection::close()
+{
+    CollectionCollection::close();
+    m_routes.clear();
+}
+
+
+/** \brief Search an entry in the shards.
+ *
+ * When \p matchpath is MatchPath::MATCH, the manifest gives the shard
+ * of the entry so only that one shard gets searched. Otherwise all the
+ * shards get searched, in order, as with a CollectionCollection.
+ *
+ * \exception InvalidStateException
+ * This exception is raised if the collection was closed.
+ *
+ * \param[in] name  The name of the entry to search.
+ * \param[in] matchpath  Whether the full path or only the filename
+ *                       has to match.
+ *
+ * \return The entry or a null pointer if not found.
+ */
+FileEntry::pointer_t ShardedCollection::getEntry(std::string const & name, MatchPath matchpath) const
+{
+    if(matchpath != MatchPath::MATCH)
+    {
+        return CollectionCollection::getEntry(name, matchpath);
+    }
+
+    mustBeValid();
+
+    auto const it(m_routes.find(name));
+    if(it == m_routes.end())
+    {
+        return FileEntry::pointer_t();
+    }
+    return m_collections[it->second]->getEntry(name, matchpath);
+}
+
+
+/** \brief Retrieve an input stream to read an entry.
+ *
+ * As with getEntry(), the manifest routes the request directly to the
+ * shard of the entry when \p matchpath is MatchPath::MATCH.
+ *
+ * \exception InvalidStateException
+ * This exception is raised if the collection was closed.
+ *
+ * \param[in] entry_name  The name of the entry to read.
+ * \param[in] matchpath  Whether the full path or only the filename
+ *                       has to match.
+ *
+ * \return A stream to read the entry or a null pointer if not found.
+ */
+FileCollection::stream_pointer_t ShardedCollection::getInputStream(std::string const & entry_name, MatchPath matchpath)
+{
+    if(matchpath != MatchPath::MATCH)
+    {
+        return CollectionCollection::getInputStream(entry_name, matchpath);
+    }
+
+    mustBeValid();
+
+    auto const it(m_routes.find(entry_name));
+    if(it == m_routes.end())
+    {
+        return stream_pointer_t();
+    }
+    return m_collections[it->second]->getInputStream(entry_name, matchpath);
+}
+
+
+/** \brief Retrieve the number of shards.
+ *
+ * \exception InvalidStateException
+ * This exception is raised if the collection was closed.
+ *
+ * \return The number of shards listed in the manifest.
+ */
+size_t ShardedCollection::getShardCount() const
+{
+    mustBeValid();
+
+    return m_collections.size();
+}
+
+
+/** \brief Save a collection in a set of shards.
+ *
+ * This function spreads the entries of \p collection between several
+ * Zip archives named "<basename>-NNNN.zip" and writes the manifest
+ * "<basename>.manifest" which a ShardedCollection uses to open the set.
+ *
+ * With ShardMode::NAME_HASH, \p limit is the number of shards and each
+ * entry goes to a shard selected by the hash of its name. The same name
+ * always lands in the same shard.
+ *
+ * With ShardMode::SIZE_BUDGET, \p limit is the maximum size of one
+ * shard in bytes. The entries are assigned in order, opening a new
+ * shard each time the next entry could make the current one go over
+ * the budget. The largest possible compressed size is used for that
+ * computation so no shard ends up larger than \p limit, unless one
+ * entry alone is larger, in which case it gets a shard of its own.
+ *
+ * Each shard is saved with saveCollectionToArchive() and \p options.
+ * The shards are saved in parallel by at most one thread per core.
+ *
+ * \exception InvalidException
+ * This exception is raised if \p limit is zero or, with
+ * ShardMode::NAME_HASH, if \p limit is larger than 10,000 shards.
+ *
+ * \exception IOException
+ * This exception is raised if a shard or the manifest cannot be written.
+ *
+ * \param[in] collection  The collection to save.
+ * \param[in] basename  The path and basename of the shard files.
+ * \param[in] mode  How the entries get assigned to the shards.
+ * \param[in] limit  The number of shards or the budget of each shard.
+ * \param[in] options  The options used to save each shard.
+ *
+ * \return The name of the manifest file.
+ */
+std::string ShardedCollection::saveCollectionToShards(FileCollection & collection, std::string const & basename, ShardMode mode, offset_t limit, ZipOutputOptions const & options)
+{
+    if(limit == 0)
+    {
+        throw InvalidException("ShardedCollection::saveCollectionToShards(): the limit cannot be zero.");
+    }
+
+    FileEntry::vector_t const entries(collection.entries());
+
+    std::vector<FileEntry::vector_t> shards;
+    switch(mode)
+    {
+    case ShardMode::NAME_HASH:
+        if(limit > g_max_name_hash_shards)
+        {
+            throw InvalidException("ShardedCollection::saveCollectionToShards(): the number of shards cannot be larger than 10000.");
+        }
+        shards.resize(limit);
+        for(auto const & entry : entries)
+        {
+            shards[shardHash(entry->getName()) % limit].push_back(entry);
+        }
+        break;
+
+    case ShardMode::SIZE_BUDGET:
+        {
+            offset_t used(0);
+            shards.resize(1);
+            for(auto const & entry : entries)
+            {
+                offset_t const size(maximumEntrySize(entry));
+                if(!shards.back().empty()
+                && used + size + 22 > limit)
+                {
+                    shards.push_back(FileEntry::vector_t());
+                    used = 0;
+                }
+                shards.back().push_back(entry);
+                used += size;
+            }
+        }
+        break;
+
+    }
+
+    // each thread reads the data from its own copy of the collection
+    //
+    std::vector<FileCollection::pointer_t> sources;
+    sources.reserve(shards.size());
+    for(size_t shard(0); shard < shards.size(); ++shard)
+    {
+        sources.push_back(collection.clone());
+    }
+
+    runJobs(shards.size(), [&basename, &shards, &sources, &options](size_t shard)
+        {
+            std::string const filename(shardFilename(basename, shard));
+            std::ofstream os(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+            if(!os)
+            {
+                throw IOException("ShardedCollection::saveCollectionToShards(): could not create \"" + filename + "\".");
+            }
+            ShardSubset subset(sources[shard], shards[shard]);
+            ZipFile::saveCollectionToArchive(os, subset, "", options);
+            os.close();
+            if(!os)
+            {
+                throw IOException("ShardedCollection::saveCollectionToShards(): could not write \"" + filename + "\".");
+            }
+        });
+
+    std::string const manifest_filename(basename + ".manifest");
+    std::ofstream manifest(manifest_filename, std::ios::out | std::ios::trunc);
+    manifest << g_manifest_magic << "\n"
+             << shards.size() << "\n";
+    for(size_t shard(0); shard < shards.size(); ++shard)
+    {
+        // the shards are searched relative to the manifest
+        manifest << FilePath(shardFilename(basename, shard)).filename() << "\n";
+    }
+    for(size_t shard(0); shard < shards.size(); ++shard)
+    {
+        for(auto const & entry : shards[shard])
+        {
+            manifest << shard << " " << entry->getName() << "\n";
+        }
+    }
+    manifest.close();
+    if(!manifest)
+    {
+        throw IOException("ShardedCollection::saveCollectionToShards(): could not write \"" + manifest_filename + "\".");
+    }
+
+    return manifest_filename;
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
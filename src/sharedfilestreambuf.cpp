@@ -0,0 +1,376 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::SharedFileStreambuf.
+ *
+ * This file defines the functions of the zipios::SharedFile and
+ * zipios::SharedFileStreambuf classes which let many input streams
+ * read the same file without each opening it.
+ */
+
+#include "sharedfilestreambuf.hpp"
+
+#include "zipios/zipiosexceptions.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <errno.h>
+
+#ifndef ZIPIOS_WINDOWS
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace zipios
+{
+
+
+/** \class SharedFile
+ * \brief A file opened once and read by many streams.
+ *
+ * A SharedFile holds the file descriptor of a file opened for reading.
+ * The read() function takes the offset to read at and does not change
+ * any state of the object, so any number of streams, in any number of
+ * threads, can read the file at the same time.
+ *
+ * On platforms without pread(), the reads are serialized with a mutex.
+ */
+
+
+/** \brief Open a file to be shared.
+ *
+ * \exception IOException
+ * This exception is raised if the file cannot be opened.
+ *
+ * \param[in] filename  The name of the file to open.
+ */
+SharedFile::SharedFile(std::string const & filename)
+    : m_filename(filename)
+    //, m_size(0) -- initialized below
+{
+#ifdef ZIPIOS_WINDOWS
+    m_file.open(m_filename, std::ios::in | std::ios::binary);
+    if(!m_file)
+    {
+        throw IOException("SharedFile::SharedFile(): could not open \"" + m_filename + "\".");
+    }
+    m_file.seekg(0, std::ios::end);
+    m_size = m_file.tellg();
+#else
+    m_fd = ::open(m_filename.c_str(), O_RDONLY);
+    if(m_fd < 0)
+    {
+        throw IOException("SharedFile::SharedFile(): could not open \"" + m_filename + "\": " + strerror(errno) + ".");
+    }
+    struct stat st;
+    if(fstat(m_fd, &st) == 0)
+    {
+        m_size = st.st_size;
+    }
+#endif
+}
+
+
+/** \brief Close the file.
+ */
+SharedFile::~SharedFile()
+{
+#ifndef ZIPIOS_WINDOWS
+    ::close(m_fd);
+#endif
+}
+
+
+/** \brief Get the name of the file.
+ *
+ * \return The filename passed to the constructor.
+ */
+std::string const & SharedFile::getFilename() const
+{
+    return m_filename;
+}
+
+
+/** \brief Get the size of the file.
+ *
+ * The size is determined when the file gets opened.
+ *
+ * \return The size of the file in bytes.
+ */
+offset_t SharedFile::getSize() const
+{
+    return m_size;
+}
+
+
+/** \brief Read data at the specified offset.
+ *
+ * The function reads up to \p size bytes. It returns less only when
+ * the end of the file is reached.
+ *
+ * \exception IOException
+ * This exception is raised if reading fails.
+ *
+ * \param[in] offset  The offset in the file to read at.
+ * \param[out] buffer  The buffer receiving the data.
+ * \param[in] size  The number of bytes to read.
+ *
+ * \return The number of bytes read.
+ */
+size_t SharedFile::read(offset_t offset, char * buffer, size_t size) const
+{
+#ifdef ZIPIOS_WINDOWS
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_file.clear();
+    m_file.seekg(offset, std::ios::beg);
+    m_file.read(buffer, size);
+    return m_file.gcount();
+#else
+    size_t total(0);
+    while(total < size)
+    {
+        ssize_t const r(pread(m_fd, buffer + total, size - total, offset + total));
+        if(r < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue; // LCOV_EXCL_LINE
+            }
+            throw IOException(std::string("SharedFile::read(): read failed: ") + strerror(errno) + "."); // LCOV_EXCL_LINE
+        }
+        if(r == 0)
+        {
+            break;
+        }
+        total += r;
+    }
+    return total;
+#endif
+}
+
+
+
+/** \brief Give the kernel a hint about how the file is going to be read.
+ *
+ * The advice goes through the descriptor of this file so the file
+ * does not get opened again each time.
+ *
+ * \param[in] ranges  The ranges of bytes the advice applies to.
+ * \param[in] advice  The advice to give the kernel.
+ *
+ * \sa adviseFile()
+ */
+void SharedFile::advise(file_range_vector_t const & ranges, FileAdvice advice) const
+{
+#ifdef ZIPIOS_WINDOWS
+    adviseFile(m_filename, ranges, advice);
+#else
+    adviseFile(m_fd, ranges, advice);
+#endif
+}
+
+
+
+/** \class SharedFileStreambuf
+ * \brief An input stream buffer reading a SharedFile.
+ *
+ * The SharedFileStreambuf class keeps its own position in a SharedFile.
+ * Its buffer is just large enough for the small reads done while
+ * parsing headers; larger reads go directly from the file to the
+ * buffer of the caller. Many of these objects can be kept around
+ * with a very small memory footprint.
+ */
+
+
+/** \brief Initialize the stream buffer.
+ *
+ * The stream starts at the beginning of the file.
+ *
+ * \param[in] file  The file to read.
+ */
+SharedFileStreambuf::SharedFileStreambuf(SharedFile::pointer_t file)
+    : m_file(file)
+    //, m_position(0) -- auto-init
+    //, m_buffer() -- not initialized
+{
+    if(m_file == nullptr)
+    {
+        throw InvalidStateException("SharedFileStreambuf::SharedFileStreambuf() was called with a null file pointer");
+    }
+}
+
+
+/** \brief Clean up the stream buffer.
+ *
+ * The file gets closed once the last object using it is gone.
+ */
+SharedFileStreambuf::~SharedFileStreambuf()
+{
+}
+
+
+/** \brief Read more data in the buffer.
+ *
+ * \return The next character or EOF at the end of the file.
+ */
+SharedFileStreambuf::int_type SharedFileStreambuf::underflow()
+{
+    if(gptr() < egptr())
+    {
+        return traits_type::to_int_type(*gptr()); // LCOV_EXCL_LINE
+    }
+
+    size_t const size(m_file->read(m_position, m_buffer, BUFFER_SIZE));
+    if(size == 0)
+    {
+        return traits_type::eof();
+    }
+    m_position += size;
+    setg(m_buffer, m_buffer, m_buffer + size);
+
+    return traits_type::to_int_type(*gptr());
+}
+
+
+/** \brief Read a block of data.
+ *
+ * The data still available in the buffer gets copied first. The rest
+ * is read directly in \p s unless it is smaller than the buffer.
+ *
+ * \param[out] s  The destination buffer.
+ * \param[in] n  The number of bytes to read.
+ *
+ * \return The number of bytes read.
+ */
+std::streamsize SharedFileStreambuf::xsgetn(char * s, std::streamsize n)
+{
+    std::streamsize total(std::min(n, static_cast<std::streamsize>(egptr() - gptr())));
+    if(total > 0)
+    {
+        memcpy(s, gptr(), total);
+        gbump(static_cast<int>(total));
+    }
+
+    while(total < n)
+    {
+        std::streamsize const left(n - total);
+        if(static_cast<size_t>(left) >= BUFFER_SIZE)
+        {
+            size_t const size(m_file->read(m_position, s + total, left));
+            m_position += size;
+            total += size;
+            setg(m_buffer, m_buffer, m_buffer);
+            break;
+        }
+
+        if(traits_type::eq_int_type(underflow(), traits_type::eof()))
+        {
+            break;
+        }
+        std::streamsize const size(std::min(left, static_cast<std::streamsize>(egptr() - gptr())));
+        memcpy(s + total, gptr(), size);
+        gbump(static_cast<int>(size));
+        total += size;
+    }
+
+    return total;
+}
+
+
+/** \brief Seek to a position relative to the start, current, or end.
+ *
+ * \param[in] off  The offset to add to the position defined by \p dir.
+ * \param[in] dir  The position \p off is relative to.
+ * \param[in] which  Must include std::ios_base::in.
+ *
+ * \return The new position or -1 on failure.
+ */
+SharedFileStreambuf::pos_type SharedFileStreambuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+    off_type base(0);
+    switch(dir)
+    {
+    case std::ios_base::cur:
+        base = m_position - (egptr() - gptr());
+        break;
+
+    case std::ios_base::end:
+        base = m_file->getSize();
+        break;
+
+    default:
+        break;
+
+    }
+
+    return seekpos(base + off, which);
+}
+
+
+/** \brief Seek to an absolute position.
+ *
+ * If the position is within the buffer, the data in the buffer is
+ * kept. Otherwise the next read happens at the new position.
+ *
+ * \param[in] pos  The new position.
+ * \param[in] which  Must include std::ios_base::in.
+ *
+ * \return The new position or -1 on failure.
+ */
+SharedFileStreambuf::pos_type SharedFileStreambuf::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    off_type const offset(pos);
+    if((which & std::ios_base::in) == 0
+    || offset < 0)
+    {
+        return pos_type(off_type(-1));
+    }
+
+    off_type const buffer_start(m_position - (egptr() - eback()));
+    if(offset >= buffer_start
+    && offset <= m_position)
+    {
+        setg(eback(), eback() + (offset - buffer_start), egptr());
+    }
+    else
+    {
+        m_position = offset;
+        setg(m_buffer, m_buffer, m_buffer);
+    }
+
+    return pos;
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,114 @@
+#pragma once
+#ifndef SHAREDFILESTREAMBUF_HPP
+#define SHAREDFILESTREAMBUF_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Header file that defines zipios::SharedFileStreambuf.
+ *
+ * This file declares the zipios::SharedFile and zipios::SharedFileStreambuf
+ * classes which are used by many input streams to read the same file
+ * through a single file descriptor.
+ */
+
+#include "zipios_common.hpp"
+
+#include <memory>
+#include <streambuf>
+#include <string>
+
+#if !defined(ZIPIOS_WINDOWS) && (defined(_WINDOWS) || defined(WIN32) || defined(_WIN32) || defined(__WIN32))
+#define ZIPIOS_WINDOWS
+#endif
+
+#ifdef ZIPIOS_WINDOWS
+#include <fstream>
+#include <mutex>
+#endif
+
+
+namespace zipios
+{
+
+
+class SharedFile
+{
+public:
+    typedef std::shared_ptr<SharedFile>     pointer_t;
+
+                            SharedFile(std::string const & filename);
+                            SharedFile(SharedFile const & src) = delete;
+    SharedFile &            operator = (SharedFile const & rhs) = delete;
+                            ~SharedFile();
+
+    std::string const &     getFilename() const;
+    offset_t                getSize() const;
+    size_t                  read(offset_t offset, char * buffer, size_t size) const;
+    void                    advise(file_range_vector_t const & ranges, FileAdvice advice) const;
+
+private:
+    std::string             m_filename;
+    offset_t                m_size = 0;
+#ifdef ZIPIOS_WINDOWS
+    mutable std::ifstream   m_file;
+    mutable std::mutex      m_mutex;
+#else
+    int                     m_fd = -1;
+#endif
+};
+
+
+class SharedFileStreambuf : public std::streambuf
+{
+public:
+    static size_t const     BUFFER_SIZE = 128;
+
+                            SharedFileStreambuf(SharedFile::pointer_t file);
+                            SharedFileStreambuf(SharedFileStreambuf const & src) = delete;
+    SharedFileStreambuf &   operator = (SharedFileStreambuf const & rhs) = delete;
+    virtual                 ~SharedFileStreambuf() override;
+
+protected:
+    virtual int_type        underflow() override;
+    virtual std::streamsize xsgetn(char * s, std::streamsize n) override;
+    virtual pos_type        seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::in) override;
+    virtual pos_type        seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in) override;
+
+private:
+    SharedFile::pointer_t   m_file;
+    offset_t                m_position = 0;
+    char                    m_buffer[BUFFER_SIZE];
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
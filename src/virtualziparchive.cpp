@@ -0,0 +1,409 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::VirtualZipArchive.
+ *
+ * This file includes the implementation of the zipios::VirtualZipArchive
+ * class, which predicts the layout of a STORED Zip archive and generates
+ * its bytes by range.
+ */
+
+#include "zipios/virtualziparchive.hpp"
+
+#include "zipios/zipiosexceptions.hpp"
+
+#include "zipcentraldirectoryentry.hpp"
+#include "zipendofcentraldirectory.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <zlib.h>
+
+
+namespace zipios
+{
+
+
+/** \class VirtualZipArchive
+ * \brief The layout and data of a STORED Zip archive not yet written.
+ *
+ * When the entries of a Zip archive are STORED, the size of the archive
+ * only depends on the names, sizes, extra fields, and comments of its
+ * entries. This class computes that layout exactly as the
+ * ZipOutputStreambuf would write it: the offset of each local header,
+ * the offset of each payload, the offset of the central directory, and
+ * the total size of the archive. A server streaming such an archive can
+ * therefore send a Content-Length before the first byte.
+ *
+ * Once a data reader is attached with setDataReader(), the read()
+ * function generates any range of bytes of the archive without
+ * generating the bytes before it, which makes it possible to resume
+ * an interrupted download.
+ *
+ * The headers include the CRC32 of each entry. When an entry does not
+ * have a CRC (see FileEntry::hasCrc()), it gets computed by reading its
+ * data the first time a header of that entry is generated. Reading any
+ * part of the central directory requires the CRC of all the entries.
+ */
+
+
+/** \brief Compute the layout of a STORED Zip archive.
+ *
+ * This function computes the layout of an archive with the specified
+ * \p entries, in that order, and \p zip_comment. The entries are copied
+ * and saved as STORED whatever their storage method. Directories have
+ * no data.
+ *
+ * \exception InvalidStateException
+ * This exception is raised if the archive cannot be saved in a 32 bit
+ * Zip archive: too many entries, or an entry, offset, or the central
+ * directory too large.
+ *
+ * \param[in] entries  The entries of the archive.
+ * \param[in] zip_comment  The comment of the archive.
+ */
+VirtualZipArchive::VirtualZipArchive(FileEntry::vector_t const & entries, std::string const & zip_comment)
+    //: m_entries() -- auto-init
+    //, m_header_offsets() -- auto-init
+    : m_zip_comment(zip_comment)
+    //, m_central_directory_offset(0) -- auto-init
+    //, m_archive_size(0) -- auto-init
+    //, m_reader() -- auto-init
+    //, m_central_directory() -- auto-init
+{
+    if(entries.size() > 65535
+    || zip_comment.length() > 65535)
+    {
+        throw InvalidStateException("VirtualZipArchive::VirtualZipArchive(): too many entries or comment too large for a Zip archive.");
+    }
+
+    m_entries.reserve(entries.size());
+    m_header_offsets.reserve(entries.size());
+
+    offset_t offset(0);
+    offset_t central_directory_size(0);
+    for(auto const & e : entries)
+    {
+        FileEntry::pointer_t entry(new ZipCentralDirectoryEntry(*e));
+        size_t const size(entry->isDirectory() ? 0 : e->getSize());
+        entry->setMethod(StorageMethod::STORED);
+        entry->setLevel(FileEntry::COMPRESSION_LEVEL_NONE);
+        entry->setSize(size);
+        entry->setCompressedSize(size);
+        entry->setEntryOffset(offset);
+        if(e->hasCrc())
+        {
+            entry->setCrc(e->getCrc());
+        }
+
+        if(offset >= 0x100000000LL
+        || size >= 0x100000000ULL)
+        {
+            throw InvalidStateException("VirtualZipArchive::VirtualZipArchive(): the archive is too large for a 32 bit Zip archive.");
+        }
+
+        m_entries.push_back(entry);
+        m_header_offsets.push_back(offset);
+
+        offset += static_cast<ZipLocalEntry *>(entry.get())->ZipLocalEntry::getHeaderSize() + size;
+        central_directory_size += entry->getHeaderSize();
+    }
+
+    if(offset >= 0x100000000LL
+    || central_directory_size >= 0x100000000LL)
+    {
+        throw InvalidStateException("VirtualZipArchive::VirtualZipArchive(): the archive is too large for a 32 bit Zip archive.");
+    }
+
+    m_central_directory_offset = offset;
+    m_archive_size = offset + central_directory_size + 22 + m_zip_comment.length();
+}
+
+
+/** \brief Retrieve the number of entries.
+ *
+ * \return The number of entries in the archive.
+ */
+size_t VirtualZipArchive::size() const
+{
+    return m_entries.size();
+}
+
+
+/** \brief Retrieve one of the entries.
+ *
+ * The entry is the copy saved in the archive, with its offset, sizes,
+ * and once known, its CRC.
+ *
+ * \exception InvalidException
+ * This exception is raised if \p index is out of bounds.
+ *
+ * \param[in] index  The index of the entry.
+ *
+ * \return A pointer to the entry.
+ */
+FileEntry::pointer_t VirtualZipArchive::getEntry(size_t index) const
+{
+    verifyIndex(index);
+
+    return m_entries[index];
+}
+
+
+/** \brief Retrieve the exact size of the archive.
+ *
+ * \return The number of bytes the archive is composed of.
+ */
+offset_t VirtualZipArchive::getArchiveSize() const
+{
+    return m_archive_size;
+}
+
+
+/** \brief Retrieve the offset of the local header of an entry.
+ *
+ * \exception InvalidException
+ * This exception is raised if \p index is out of bounds.
+ *
+ * \param[in] index  The index of the entry.
+ *
+ * \return The offset of the local header of that entry.
+ */
+offset_t VirtualZipArchive::getHeaderOffset(size_t index) const
+{
+    verifyIndex(index);
+
+    return m_header_offsets[index];
+}
+
+
+/** \brief Retrieve the offset of the data of an entry.
+ *
+ * \exception InvalidException
+ * This exception is raised if \p index is out of bounds.
+ *
+ * \param[in] index  The index of the entry.
+ *
+ * \return The offset of the first byte of data of that entry.
+ */
+offset_t VirtualZipArchive::getPayloadOffset(size_t index) const
+{
+    verifyIndex(index);
+
+    return m_header_offsets[index]
+         + static_cast<ZipLocalEntry *>(m_entries[index].get())->ZipLocalEntry::getHeaderSize();
+}
+
+
+/** \brief Retrieve the offset of the central directory.
+ *
+ * \return The offset of the first byte of the central directory.
+ */
+offset_t VirtualZipArchive::getCentralDirectoryOffset() const
+{
+    return m_central_directory_offset;
+}
+
+
+/** \brief Define the function used to read the data of the entries.
+ *
+ * The \p reader is called with the index of an entry, an offset in
+ * its data, and a buffer to fill with \p size bytes of data. It must
+ * fill the entire buffer or throw.
+ *
+ * \param[in] reader  The function reading the data of the entries.
+ */
+void VirtualZipArchive::setDataReader(data_reader_t const & reader)
+{
+    m_reader = reader;
+}
+
+
+/** \brief Generate a range of bytes of the archive.
+ *
+ * This function fills \p buffer with up to \p size bytes of the archive
+ * starting at \p offset. Only the headers and data overlapping that
+ * range are generated.
+ *
+ * \exception InvalidStateException
+ * This exception is raised if data has to be read and no data reader
+ * was defined.
+ *
+ * \param[in] offset  The offset of the first byte to generate.
+ * \param[out] buffer  The buffer receiving the bytes.
+ * \param[in] size  The number of bytes to generate.
+ *
+ * \return The number of bytes saved in \p buffer, less than \p size
+ *         only at the end of the archive.
+ */
+size_t VirtualZipArchive::read(offset_t offset, char * buffer, size_t size)
+{
+    size_t total(0);
+    while(size > 0 && offset < m_archive_size)
+    {
+        size_t amount(0);
+        if(offset >= m_central_directory_offset)
+        {
+            std::string const & central_directory(centralDirectory());
+            size_t const pos(offset - m_central_directory_offset);
+            amount = std::min(size, central_directory.length() - pos);
+            memcpy(buffer, central_directory.data() + pos, amount);
+        }
+        else
+        {
+            size_t const index(std::upper_bound(m_header_offsets.begin(), m_header_offsets.end(), offset) - m_header_offsets.begin() - 1);
+            offset_t const payload_offset(getPayloadOffset(index));
+            if(offset < payload_offset)
+            {
+                computeCrc(index);
+                OutputStringStream header;
+                static_cast<ZipLocalEntry *>(m_entries[index].get())->ZipLocalEntry::write(header);
+                size_t const pos(offset - m_header_offsets[index]);
+                amount = std::min(size, static_cast<size_t>(payload_offset - offset));
+                memcpy(buffer, header.str().data() + pos, amount);
+            }
+            else
+            {
+                size_t const pos(offset - payload_offset);
+                amount = std::min(size, m_entries[index]->getSize() - pos);
+                readData(index, pos, buffer, amount);
+            }
+        }
+
+        buffer += amount;
+        offset += amount;
+        size -= amount;
+        total += amount;
+    }
+
+    return total;
+}
+
+
+/** \brief Verify that an index is valid.
+ *
+ * \exception InvalidException
+ * This exception is raised if \p index is out of bounds.
+ *
+ * \param[in] index  The index to verify.
+ */
+void VirtualZipArchive::verifyIndex(size_t index) const
+{
+    if(index >= m_entries.size())
+    {
+        throw InvalidException("VirtualZipArchive: entry index out of bounds.");
+    }
+}
+
+
+/** \brief Read the data of an entry with the data reader.
+ *
+ * \exception InvalidStateException
+ * This exception is raised if no data reader was defined.
+ *
+ * \param[in] index  The index of the entry.
+ * \param[in] offset  The offset in the data of the entry.
+ * \param[out] buffer  The buffer receiving the data.
+ * \param[in] size  The number of bytes to read.
+ */
+void VirtualZipArchive::readData(size_t index, offset_t offset, char * buffer, size_t size)
+{
+    if(!m_reader)
+    {
+        throw InvalidStateException("VirtualZipArchive::readData(): no data reader defined.");
+    }
+
+    m_reader(index, offset, buffer, size);
+}
+
+
+/** \brief Make sure the CRC of an entry is known.
+ *
+ * If the entry was not given a CRC, this function reads all of its
+ * data to compute it.
+ *
+ * \param[in] index  The index of the entry.
+ */
+void VirtualZipArchive::computeCrc(size_t index)
+{
+    FileEntry::pointer_t entry(m_entries[index]);
+    if(entry->hasCrc())
+    {
+        return;
+    }
+
+    uLong crc(crc32(0, Z_NULL, 0));
+    std::vector<char> data(getBufferSize());
+    size_t const size(entry->getSize());
+    for(size_t pos(0); pos < size; pos += data.size())
+    {
+        size_t const amount(std::min(data.size(), size - pos));
+        readData(index, pos, &data[0], amount);
+        crc = crc32(crc, reinterpret_cast<Bytef const *>(&data[0]), amount);
+    }
+    entry->setCrc(crc);
+}
+
+
+/** \brief Generate the central directory.
+ *
+ * This function generates the central directory and the end of central
+ * directory, which requires the CRC of all the entries. The result is
+ * kept so it gets generated only once.
+ *
+ * \return A reference to the central directory.
+ */
+std::string const & VirtualZipArchive::centralDirectory()
+{
+    if(m_central_directory.empty())
+    {
+        OutputStringStream os;
+        for(size_t index(0); index < m_entries.size(); ++index)
+        {
+            computeCrc(index);
+            m_entries[index]->write(os);
+        }
+
+        ZipEndOfCentralDirectory eocd(m_zip_comment);
+        eocd.setOffset(m_central_directory_offset);
+        eocd.setCount(m_entries.size());
+        eocd.setCentralDirectorySize(os.tellp());
+        eocd.write(os);
+
+        m_central_directory = os.str();
+    }
+
+    return m_central_directory;
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
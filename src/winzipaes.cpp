@@ -0,0 +1,897 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of the WinZip AES encryption classes.
+ *
+ * The AES block cipher is a straightforward implementation of FIPS 197
+ * using lookup tables. When the processor offers AES instructions
+ * (AES-NI on x86, the cryptographic extension on ARMv8), they get used
+ * instead. The choice is made at run time so the library does not
+ * need to be compiled for a specific processor.
+ */
+
+#include "winzipaes.hpp"
+
+#include "zipios/zipiosexceptions.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ZIPIOS_AES_X86
+#include <cpuid.h>
+#include <wmmintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__) && (defined(__linux__) || defined(__APPLE__))
+#define ZIPIOS_AES_ARM
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
+
+namespace zipios
+{
+
+
+namespace
+{
+
+
+/** \brief The number of iterations of PBKDF2 used by WinZip.
+ *
+ * The WinZip AES specification uses a fixed number of iterations to
+ * derive the keys from the password.
+ */
+size_t const g_pbkdf2_iterations = 1000;
+
+
+/** \brief The lookup tables of the software AES implementation.
+ *
+ * The S-box and the four round tables are computed the first time
+ * they are needed instead of being written down as constants.
+ */
+struct aes_tables_t
+{
+                        aes_tables_t();
+
+    uint8_t             m_sbox[256];
+    uint32_t            m_round[4][256];
+};
+
+
+/** \brief Rotate an 8 bit value to the left.
+ *
+ * \param[in] value  The value to rotate.
+ * \param[in] count  The number of bits to rotate, 1 to 7.
+ *
+ * \return The rotated value.
+ */
+inline uint8_t rotl8(uint8_t value, int count)
+{
+    return static_cast<uint8_t>((value << count) | (value >> (8 - count)));
+}
+
+
+/** \brief Multiply a value by 2 in the AES finite field.
+ *
+ * \param[in] value  The value to multiply.
+ *
+ * \return The product.
+ */
+inline uint8_t xtime(uint8_t value)
+{
+    return static_cast<uint8_t>((value << 1) ^ ((value & 0x80) != 0 ? 0x1B : 0));
+}
+
+
+/** \brief Rotate a 32 bit value to the right.
+ *
+ * \param[in] value  The value to rotate.
+ * \param[in] count  The number of bits to rotate, 1 to 31.
+ *
+ * \return The rotated value.
+ */
+inline uint32_t rotr(uint32_t value, int count)
+{
+    return (value >> count) | (value << (32 - count));
+}
+
+
+/** \brief Compute the AES tables.
+ *
+ * The S-box is computed by walking the multiplicative group of the
+ * finite field with generator 3, which gives the inverse of each
+ * value, and then applying the affine transformation.
+ */
+aes_tables_t::aes_tables_t()
+{
+    uint8_t p(1);
+    uint8_t q(1);
+    do
+    {
+        // multiply p by 3
+        p = static_cast<uint8_t>(p ^ xtime(p));
+
+        // divide q by 3
+        q ^= static_cast<uint8_t>(q << 1);
+        q ^= static_cast<uint8_t>(q << 2);
+        q ^= static_cast<uint8_t>(q << 4);
+        if((q & 0x80) != 0)
+        {
+            q ^= 0x09;
+        }
+
+        m_sbox[p] = q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4) ^ 0x63;
+    }
+    while(p != 1);
+    m_sbox[0] = 0x63;
+
+    for(int idx(0); idx < 256; ++idx)
+    {
+        uint32_t const s(m_sbox[idx]);
+        uint32_t const s2(xtime(m_sbox[idx]));
+        uint32_t const value((s2 << 24) | (s << 16) | (s << 8) | (s2 ^ s));
+        m_round[0][idx] = value;
+        m_round[1][idx] = rotr(value, 8);
+        m_round[2][idx] = rotr(value, 16);
+        m_round[3][idx] = rotr(value, 24);
+    }
+}
+
+
+/** \brief Retrieve the AES tables.
+ *
+ * \return A reference to the tables, computed on the first call.
+ */
+aes_tables_t const & aesTables()
+{
+    static aes_tables_t const g_tables;
+    return g_tables;
+}
+
+
+/** \brief Load a big endian 32 bit value.
+ *
+ * \param[in] data  The 4 bytes to load.
+ *
+ * \return The value.
+ */
+inline uint32_t loadBigEndian(uint8_t const * data)
+{
+    return (static_cast<uint32_t>(data[0]) << 24)
+         | (static_cast<uint32_t>(data[1]) << 16)
+         | (static_cast<uint32_t>(data[2]) <<  8)
+         | (static_cast<uint32_t>(data[3])      );
+}
+
+
+/** \brief Save a big endian 32 bit value.
+ *
+ * \param[in] value  The value to save.
+ * \param[out] data  The 4 bytes receiving the value.
+ */
+inline void storeBigEndian(uint32_t value, uint8_t * data)
+{
+    data[0] = static_cast<uint8_t>(value >> 24);
+    data[1] = static_cast<uint8_t>(value >> 16);
+    data[2] = static_cast<uint8_t>(value >>  8);
+    data[3] = static_cast<uint8_t>(value      );
+}
+
+
+/** \brief Encrypt blocks with the lookup tables.
+ *
+ * \param[in] round_keys  The expanded key.
+ * \param[in] rounds  The number of rounds.
+ * \param[in] in  The blocks to encrypt.
+ * \param[out] out  The encrypted blocks.
+ * \param[in] count  The number of blocks.
+ */
+void encryptBlocksSoftware(uint32_t const * round_keys, int rounds, uint8_t const * in, uint8_t * out, size_t count)
+{
+    aes_tables_t const & t(aesTables());
+    uint8_t const * sbox(t.m_sbox);
+    uint32_t const * t0(t.m_round[0]);
+    uint32_t const * t1(t.m_round[1]);
+    uint32_t const * t2(t.m_round[2]);
+    uint32_t const * t3(t.m_round[3]);
+
+    for(; count > 0; --count, in += AES::BLOCK_SIZE, out += AES::BLOCK_SIZE)
+    {
+        uint32_t const * rk(round_keys);
+        uint32_t s0(loadBigEndian(in +  0) ^ rk[0]);
+        uint32_t s1(loadBigEndian(in +  4) ^ rk[1]);
+        uint32_t s2(loadBigEndian(in +  8) ^ rk[2]);
+        uint32_t s3(loadBigEndian(in + 12) ^ rk[3]);
+
+        for(int r(1); r < rounds; ++r)
+        {
+            rk += 4;
+            uint32_t const r0(t0[s0 >> 24] ^ t1[(s1 >> 16) & 255] ^ t2[(s2 >> 8) & 255] ^ t3[s3 & 255] ^ rk[0]);
+            uint32_t const r1(t0[s1 >> 24] ^ t1[(s2 >> 16) & 255] ^ t2[(s3 >> 8) & 255] ^ t3[s0 & 255] ^ rk[1]);
+            uint32_t const r2(t0[s2 >> 24] ^ t1[(s3 >> 16) & 255] ^ t2[(s0 >> 8) & 255] ^ t3[s1 & 255] ^ rk[2]);
+            uint32_t const r3(t0[s3 >> 24] ^ t1[(s0 >> 16) & 255] ^ t2[(s1 >> 8) & 255] ^ t3[s2 & 255] ^ rk[3]);
+            s0 = r0;
+            s1 = r1;
+            s2 = r2;
+            s3 = r3;
+        }
+
+        // the last round has no MixColumns
+        rk += 4;
+        storeBigEndian(((static_cast<uint32_t>(sbox[s0 >> 24]) << 24)
+                      | (static_cast<uint32_t>(sbox[(s1 >> 16) & 255]) << 16)
+                      | (static_cast<uint32_t>(sbox[(s2 >> 8) & 255]) << 8)
+                      | (static_cast<uint32_t>(sbox[s3 & 255]))) ^ rk[0], out + 0);
+        storeBigEndian(((static_cast<uint32_t>(sbox[s1 >> 24]) << 24)
+                      | (static_cast<uint32_t>(sbox[(s2 >> 16) & 255]) << 16)
+                      | (static_cast<uint32_t>(sbox[(s3 >> 8) & 255]) << 8)
+                      | (static_cast<uint32_t>(sbox[s0 & 255]))) ^ rk[1], out + 4);
+        storeBigEndian(((static_cast<uint32_t>(sbox[s2 >> 24]) << 24)
+                      | (static_cast<uint32_t>(sbox[(s3 >> 16) & 255]) << 16)
+                      | (static_cast<uint32_t>(sbox[(s0 >> 8) & 255]) << 8)
+                      | (static_cast<uint32_t>(sbox[s1 & 255]))) ^ rk[2], out + 8);
+        storeBigEndian(((static_cast<uint32_t>(sbox[s3 >> 24]) << 24)
+                      | (static_cast<uint32_t>(sbox[(s0 >> 16) & 255]) << 16)
+                      | (static_cast<uint32_t>(sbox[(s1 >> 8) & 255]) << 8)
+                      | (static_cast<uint32_t>(sbox[s2 & 255]))) ^ rk[3], out + 12);
+    }
+}
+
+
+#if defined(ZIPIOS_AES_X86)
+/** \brief Encrypt blocks with the AES-NI instructions.
+ *
+ * Four blocks are encrypted at once so the latency of the instructions
+ * gets hidden.
+ *
+ * \param[in] round_keys  The expanded key as bytes.
+ * \param[in] rounds  The number of rounds.
+ * \param[in] in  The blocks to encrypt.
+ * \param[out] out  The encrypted blocks.
+ * \param[in] count  The number of blocks.
+ */
+__attribute__((target("aes,sse2")))
+void encryptBlocksHardware(uint8_t const * round_keys, int rounds, uint8_t const * in, uint8_t * out, size_t count)
+{
+    __m128i rk[15];
+    for(int r(0); r <= rounds; ++r)
+    {
+        rk[r] = _mm_loadu_si128(reinterpret_cast<__m128i const *>(round_keys + r * AES::BLOCK_SIZE));
+    }
+
+    for(; count >= 4; count -= 4, in += 4 * AES::BLOCK_SIZE, out += 4 * AES::BLOCK_SIZE)
+    {
+        __m128i b0(_mm_xor_si128(_mm_loadu_si128(reinterpret_cast<__m128i const *>(in) + 0), rk[0]));
+        __m128i b1(_mm_xor_si128(_mm_loadu_si128(reinterpret_cast<__m128i const *>(in) + 1), rk[0]));
+        __m128i b2(_mm_xor_si128(_mm_loadu_si128(reinterpret_cast<__m128i const *>(in) + 2), rk[0]));
+        __m128i b3(_mm_xor_si128(_mm_loadu_si128(reinterpret_cast<__m128i const *>(in) + 3), rk[0]));
+        for(int r(1); r < rounds; ++r)
+        {
+            b0 = _mm_aesenc_si128(b0, rk[r]);
+            b1 = _mm_aesenc_si128(b1, rk[r]);
+            b2 = _mm_aesenc_si128(b2, rk[r]);
+            b3 = _mm_aesenc_si128(b3, rk[r]);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out) + 0, _mm_aesenclast_si128(b0, rk[rounds]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out) + 1, _mm_aesenclast_si128(b1, rk[rounds]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out) + 2, _mm_aesenclast_si128(b2, rk[rounds]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out) + 3, _mm_aesenclast_si128(b3, rk[rounds]));
+    }
+
+    for(; count > 0; --count, in += AES::BLOCK_SIZE, out += AES::BLOCK_SIZE)
+    {
+        __m128i b(_mm_xor_si128(_mm_loadu_si128(reinterpret_cast<__m128i const *>(in)), rk[0]));
+        for(int r(1); r < rounds; ++r)
+        {
+            b = _mm_aesenc_si128(b, rk[r]);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_aesenclast_si128(b, rk[rounds]));
+    }
+}
+#elif defined(ZIPIOS_AES_ARM)
+/** \brief Encrypt blocks with the ARMv8 cryptographic extension.
+ *
+ * The AESE instruction includes the AddRoundKey step at the start of
+ * a round, so the last round key gets added separately.
+ *
+ * \param[in] round_keys  The expanded key as bytes.
+ * \param[in] rounds  The number of rounds.
+ * \param[in] in  The blocks to encrypt.
+ * \param[out] out  The encrypted blocks.
+ * \param[in] count  The number of blocks.
+ */
+#if defined(__clang__)
+__attribute__((target("crypto")))
+#else
+__attribute__((target("+crypto")))
+#endif
+void encryptBlocksHardware(uint8_t const * round_keys, int rounds, uint8_t const * in, uint8_t * out, size_t count)
+{
+    uint8x16_t rk[15];
+    for(int r(0); r <= rounds; ++r)
+    {
+        rk[r] = vld1q_u8(round_keys + r * AES::BLOCK_SIZE);
+    }
+
+    for(; count > 0; --count, in += AES::BLOCK_SIZE, out += AES::BLOCK_SIZE)
+    {
+        uint8x16_t b(vld1q_u8(in));
+        for(int r(0); r < rounds - 1; ++r)
+        {
+            b = vaesmcq_u8(vaeseq_u8(b, rk[r]));
+        }
+        b = vaeseq_u8(b, rk[rounds - 1]);
+        vst1q_u8(out, veorq_u8(b, rk[rounds]));
+    }
+}
+#endif
+
+
+} // no name namespace
+
+
+/** \class AES
+ * \brief The AES block cipher, encryption only.
+ *
+ * This class encrypts 16 byte blocks with a 128, 192, or 256 bit key.
+ * The Zip encryption uses AES in CTR mode which only requires the
+ * encryption function.
+ *
+ * When the processor supports AES instructions, they are used by
+ * default. See setHardwareAcceleration().
+ */
+
+
+/** \brief Initialize an AES object with a key.
+ *
+ * This function expands the key in the round keys.
+ *
+ * \exception InvalidException
+ * This exception is raised if \p key_size is not 16, 24, or 32.
+ *
+ * \param[in] key  The key.
+ * \param[in] key_size  The size of the key in bytes.
+ */
+AES::AES(uint8_t const * key, size_t key_size)
+    //: m_round_keys() -- initialized below
+    //, m_round_key_bytes() -- initialized below
+    //, m_rounds(0) -- auto-init
+    : m_hardware(hasHardwareSupport())
+{
+    if(key_size != 16 && key_size != 24 && key_size != 32)
+    {
+        throw InvalidException("AES::AES(): the key must be 16, 24, or 32 bytes.");
+    }
+
+    size_t const nk(key_size / 4);
+    m_rounds = static_cast<int>(nk) + 6;
+    size_t const total(4 * (m_rounds + 1));
+
+    uint8_t const * sbox(aesTables().m_sbox);
+    for(size_t idx(0); idx < nk; ++idx)
+    {
+        m_round_keys[idx] = loadBigEndian(key + idx * 4);
+    }
+    uint32_t rcon(1);
+    for(size_t idx(nk); idx < total; ++idx)
+    {
+        uint32_t temp(m_round_keys[idx - 1]);
+        if(idx % nk == 0)
+        {
+            temp = (temp << 8) | (temp >> 24);
+            temp = (static_cast<uint32_t>(sbox[temp >> 24]) << 24)
+                 | (static_cast<uint32_t>(sbox[(temp >> 16) & 255]) << 16)
+                 | (static_cast<uint32_t>(sbox[(temp >> 8) & 255]) << 8)
+                 | (static_cast<uint32_t>(sbox[temp & 255]));
+            temp ^= rcon << 24;
+            rcon = xtime(static_cast<uint8_t>(rcon));
+        }
+        else if(nk > 6 && idx % nk == 4)
+        {
+            temp = (static_cast<uint32_t>(sbox[temp >> 24]) << 24)
+                 | (static_cast<uint32_t>(sbox[(temp >> 16) & 255]) << 16)
+                 | (static_cast<uint32_t>(sbox[(temp >> 8) & 255]) << 8)
+                 | (static_cast<uint32_t>(sbox[temp & 255]));
+        }
+        m_round_keys[idx] = m_round_keys[idx - nk] ^ temp;
+    }
+
+    for(size_t idx(0); idx < total; ++idx)
+    {
+        storeBigEndian(m_round_keys[idx], &m_round_key_bytes[idx * 4]);
+    }
+}
+
+
+/** \brief Check whether the processor has AES instructions.
+ *
+ * \return true if the hardware implementation can be used.
+ */
+bool AES::hasHardwareSupport()
+{
+#if defined(ZIPIOS_AES_X86)
+    unsigned int eax(0);
+    unsigned int ebx(0);
+    unsigned int ecx(0);
+    unsigned int edx(0);
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) != 0
+        && (ecx & bit_AES) != 0;
+#elif defined(ZIPIOS_AES_ARM) && defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#elif defined(ZIPIOS_AES_ARM)
+    // all the Apple ARM processors have the cryptographic extension
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+/** \brief Check whether this object uses the AES instructions.
+ *
+ * \return true if the blocks get encrypted by the processor instructions.
+ */
+bool AES::getHardwareAcceleration() const
+{
+    return m_hardware;
+}
+
+
+/** \brief Choose between the AES instructions and the software version.
+ *
+ * The hardware implementation is used by default when available.
+ * This function can be used to force the software implementation,
+ * for example to compare both.
+ *
+ * \param[in] enable  Whether to use the AES instructions. Ignored if
+ *                    the processor does not support them.
+ */
+void AES::setHardwareAcceleration(bool enable)
+{
+    m_hardware = enable && hasHardwareSupport();
+}
+
+
+/** \brief Encrypt a set of blocks.
+ *
+ * Each block of 16 bytes gets encrypted independently (ECB). The
+ * \p in and \p out buffers can be the same.
+ *
+ * \param[in] in  The blocks to encrypt.
+ * \param[out] out  The encrypted blocks.
+ * \param[in] count  The number of blocks.
+ */
+void AES::encryptBlocks(uint8_t const * in, uint8_t * out, size_t count) const
+{
+#if defined(ZIPIOS_AES_X86) || defined(ZIPIOS_AES_ARM)
+    if(m_hardware)
+    {
+        encryptBlocksHardware(m_round_key_bytes.data(), m_rounds, in, out, count);
+        return;
+    }
+#endif
+
+    encryptBlocksSoftware(m_round_keys.data(), m_rounds, in, out, count);
+}
+
+
+/** \class HMACSHA1
+ * \brief Compute the HMAC-SHA1 of some data.
+ *
+ * This class computes the keyed-hash message authentication code of
+ * RFC 2104 with SHA-1. The state after the key was processed is kept
+ * so computing many codes with the same key is fast.
+ */
+
+
+/** \brief Initialize an HMACSHA1 object with a key.
+ *
+ * \param[in] key  The key.
+ * \param[in] size  The size of the key in bytes.
+ */
+HMACSHA1::HMACSHA1(void const * key, size_t size)
+    //: m_inner_start() -- auto-init
+    //, m_outer_start() -- auto-init
+    //, m_inner() -- auto-init
+{
+    uint8_t block[64] = {};
+    if(size > sizeof(block))
+    {
+        SHA1 sha;
+        sha.update(key, size);
+        SHA1::digest_t const d(sha.digest());
+        memcpy(block, d.data(), d.size());
+    }
+    else
+    {
+        memcpy(block, key, size);
+    }
+
+    uint8_t pad[64];
+    for(size_t idx(0); idx < sizeof(block); ++idx)
+    {
+        pad[idx] = block[idx] ^ 0x36;
+    }
+    m_inner_start.update(pad, sizeof(pad));
+    for(size_t idx(0); idx < sizeof(block); ++idx)
+    {
+        pad[idx] = block[idx] ^ 0x5C;
+    }
+    m_outer_start.update(pad, sizeof(pad));
+
+    m_inner = m_inner_start;
+}
+
+
+/** \brief Restart the computation of a code.
+ *
+ * The key stays the same.
+ */
+void HMACSHA1::reset()
+{
+    m_inner = m_inner_start;
+}
+
+
+/** \brief Add data to the code.
+ *
+ * \param[in] data  The data to add.
+ * \param[in] size  The number of bytes in \p data.
+ */
+void HMACSHA1::update(void const * data, size_t size)
+{
+    m_inner.update(data, size);
+}
+
+
+/** \brief Finish the computation and return the code.
+ *
+ * The object gets reset so it is ready to compute another code.
+ *
+ * \return The 20 bytes of the code.
+ */
+HMACSHA1::digest_t HMACSHA1::digest()
+{
+    digest_t const inner(m_inner.digest());
+    SHA1 outer(m_outer_start);
+    outer.update(inner.data(), inner.size());
+    reset();
+    return outer.digest();
+}
+
+
+/** \brief Derive a key from a password with PBKDF2-HMAC-SHA1.
+ *
+ * This function implements the PBKDF2 function of RFC 2898 with
+ * HMAC-SHA1 as the pseudo-random function.
+ *
+ * \param[in] password  The password.
+ * \param[in] salt  The salt.
+ * \param[in] salt_size  The number of bytes in \p salt.
+ * \param[in] iterations  The number of iterations.
+ * \param[out] out  The buffer receiving the derived key.
+ * \param[in] out_size  The number of bytes to derive.
+ */
+void pbkdf2HmacSha1(std::string const & password, uint8_t const * salt, size_t salt_size, size_t iterations, uint8_t * out, size_t out_size)
+{
+    HMACSHA1 hmac(password.data(), password.length());
+    for(uint32_t block(1); out_size > 0; ++block)
+    {
+        uint8_t index[4];
+        storeBigEndian(block, index);
+        hmac.update(salt, salt_size);
+        hmac.update(index, sizeof(index));
+        HMACSHA1::digest_t u(hmac.digest());
+        HMACSHA1::digest_t t(u);
+        for(size_t i(1); i < iterations; ++i)
+        {
+            hmac.update(u.data(), u.size());
+            u = hmac.digest();
+            for(size_t j(0); j < t.size(); ++j)
+            {
+                t[j] ^= u[j];
+            }
+        }
+
+        size_t const amount(std::min(out_size, t.size()));
+        memcpy(out, t.data(), amount);
+        out += amount;
+        out_size -= amount;
+    }
+}
+
+
+/** \class WinZipAES
+ * \brief Encrypt and decrypt the data of an entry with WinZip AES.
+ *
+ * WinZip AES entries use the storage method 99. An extra field (ID
+ * 0x9901) gives the key strength and the real storage method of the
+ * entry. The data starts with a salt and a 2 byte password verifier,
+ * then comes the encrypted data and a 10 byte authentication code.
+ *
+ * The keys are derived from the password and the salt with
+ * PBKDF2-HMAC-SHA1. The data gets encrypted with AES in CTR mode,
+ * with a little endian counter starting at 1, and authenticated with
+ * HMAC-SHA1 computed over the encrypted data.
+ *
+ * One WinZipAES object is used for one entry.
+ */
+
+
+/** \brief Derive the keys of an entry.
+ *
+ * \exception InvalidException
+ * This exception is raised if \p strength is not 1, 2, or 3.
+ *
+ * \param[in] password  The password.
+ * \param[in] salt  The salt of the entry, of getSaltSize() bytes.
+ * \param[in] strength  The key strength: 1, 2, or 3 for a 128, 192,
+ *                      or 256 bit key.
+ */
+WinZipAES::WinZipAES(std::string const & password, uint8_t const * salt, int strength)
+    //: m_aes() -- initialized below
+    //, m_hmac() -- initialized below
+    //, m_verifier() -- initialized below
+    //, m_counter(0) -- auto-init
+    //, m_keystream() -- no need to initialize
+    //, m_keystream_pos(m_keystream.size()) -- auto-init
+{
+    size_t const salt_size(getSaltSize(strength));
+    size_t const key_size(salt_size * 2);
+
+    std::vector<uint8_t> keys(key_size * 2 + m_verifier.size());
+    pbkdf2HmacSha1(password, salt, salt_size, g_pbkdf2_iterations, &keys[0], keys.size());
+
+    m_aes.reset(new AES(&keys[0], key_size));
+    m_hmac.reset(new HMACSHA1(&keys[key_size], key_size));
+    m_verifier[0] = keys[key_size * 2 + 0];
+    m_verifier[1] = keys[key_size * 2 + 1];
+}
+
+
+/** \brief Retrieve the size of the salt for a key strength.
+ *
+ * \exception InvalidException
+ * This exception is raised if \p strength is not 1, 2, or 3.
+ *
+ * \param[in] strength  The key strength.
+ *
+ * \return The size of the salt in bytes, which is half the key size.
+ */
+size_t WinZipAES::getSaltSize(int strength)
+{
+    if(strength < 1 || strength > 3)
+    {
+        throw InvalidException("WinZipAES::getSaltSize(): unknown AES key strength.");
+    }
+
+    return 4 + strength * 4;
+}
+
+
+/** \brief Search the AES extra field.
+ *
+ * \param[in] extra  The extra field of an entry.
+ * \param[out] field  The data of the AES extra field when found.
+ *
+ * \return true if the extra field includes a valid AES extra field.
+ */
+bool WinZipAES::readExtraField(FileEntry::buffer_t const & extra, extra_field_t & field)
+{
+    size_t pos(0);
+    while(pos + 4 <= extra.size())
+    {
+        uint16_t const id(extra[pos] | (extra[pos + 1] << 8));
+        size_t const size(extra[pos + 2] | (extra[pos + 3] << 8));
+        if(pos + 4 + size > extra.size())
+        {
+            break;
+        }
+        if(id == EXTRA_FIELD_ID
+        && size >= 7
+        && extra[pos + 6] == 'A'
+        && extra[pos + 7] == 'E')
+        {
+            field.m_version = extra[pos + 4] | (extra[pos + 5] << 8);
+            field.m_strength = extra[pos + 8];
+            field.m_method = static_cast<StorageMethod>(extra[pos + 9] | (extra[pos + 10] << 8));
+            return true;
+        }
+        pos += 4 + size;
+    }
+
+    return false;
+}
+
+
+/** \brief Add the AES extra field.
+ *
+ * Any existing AES extra field gets replaced.
+ *
+ * \param[in,out] extra  The extra field of an entry.
+ * \param[in] field  The data of the AES extra field.
+ */
+void WinZipAES::writeExtraField(FileEntry::buffer_t & extra, extra_field_t const & field)
+{
+    removeExtraField(extra);
+
+    uint16_t const method(static_cast<uint8_t>(field.m_method));
+    unsigned char const data[11] =
+    {
+        static_cast<unsigned char>(EXTRA_FIELD_ID & 255),
+        static_cast<unsigned char>(EXTRA_FIELD_ID >> 8),
+        7, 0,
+        static_cast<unsigned char>(field.m_version & 255),
+        static_cast<unsigned char>(field.m_version >> 8),
+        'A', 'E',
+        static_cast<unsigned char>(field.m_strength),
+        static_cast<unsigned char>(method & 255),
+        static_cast<unsigned char>(method >> 8)
+    };
+    extra.insert(extra.end(), data, data + sizeof(data));
+}
+
+
+/** \brief Remove the AES extra field.
+ *
+ * \param[in,out] extra  The extra field of an entry.
+ */
+void WinZipAES::removeExtraField(FileEntry::buffer_t & extra)
+{
+    size_t pos(0);
+    while(pos + 4 <= extra.size())
+    {
+        uint16_t const id(extra[pos] | (extra[pos + 1] << 8));
+        size_t const size(std::min(static_cast<size_t>(extra[pos + 2] | (extra[pos + 3] << 8)), extra.size() - pos - 4));
+        if(id == EXTRA_FIELD_ID)
+        {
+            extra.erase(extra.begin() + pos, extra.begin() + pos + 4 + size);
+        }
+        else
+        {
+            pos += 4 + size;
+        }
+    }
+}
+
+
+/** \brief Retrieve the password verifier.
+ *
+ * The verifier is saved after the salt. It is used to detect a wrong
+ * password before decrypting anything.
+ *
+ * \return The 2 bytes of the verifier.
+ */
+WinZipAES::verifier_t const & WinZipAES::getVerifier() const
+{
+    return m_verifier;
+}
+
+
+/** \brief Encrypt data.
+ *
+ * The data is encrypted in place and added to the authentication code.
+ *
+ * \param[in,out] data  The data to encrypt.
+ * \param[in] size  The number of bytes in \p data.
+ */
+void WinZipAES::encrypt(char * data, size_t size)
+{
+    crypt(data, size);
+    m_hmac->update(data, size);
+}
+
+
+/** \brief Decrypt data.
+ *
+ * The data is added to the authentication code and decrypted in place.
+ *
+ * \param[in,out] data  The data to decrypt.
+ * \param[in] size  The number of bytes in \p data.
+ */
+void WinZipAES::decrypt(char * data, size_t size)
+{
+    m_hmac->update(data, size);
+    crypt(data, size);
+}
+
+
+/** \brief Retrieve the authentication code.
+ *
+ * Call this function once all the data was encrypted or decrypted.
+ *
+ * \return The first 10 bytes of the HMAC-SHA1 of the encrypted data.
+ */
+WinZipAES::mac_t WinZipAES::getMac()
+{
+    HMACSHA1::digest_t const d(m_hmac->digest());
+    mac_t result;
+    std::copy(d.begin(), d.begin() + result.size(), result.begin());
+    return result;
+}
+
+
+/** \brief XOR the data with the key stream.
+ *
+ * The key stream is the encryption of the counter. It gets generated
+ * many blocks at a time so the AES instructions can be pipelined.
+ *
+ * \param[in,out] data  The data to encrypt or decrypt.
+ * \param[in] size  The number of bytes in \p data.
+ */
+void WinZipAES::crypt(char * data, size_t size)
+{
+    while(size > 0)
+    {
+        if(m_keystream_pos == m_keystream.size())
+        {
+            size_t const count(m_keystream.size() / AES::BLOCK_SIZE);
+            uint8_t * block(m_keystream.data());
+            for(size_t idx(0); idx < count; ++idx, block += AES::BLOCK_SIZE)
+            {
+                ++m_counter;
+                for(size_t j(0); j < 8; ++j)
+                {
+                    block[j] = static_cast<uint8_t>(m_counter >> (j * 8));
+                }
+                memset(block + 8, 0, 8);
+            }
+            m_aes->encryptBlocks(m_keystream.data(), m_keystream.data(), count);
+            m_keystream_pos = 0;
+        }
+
+        size_t const amount(std::min(size, m_keystream.size() - m_keystream_pos));
+        uint8_t const * key(m_keystream.data() + m_keystream_pos);
+        size_t idx(0);
+        for(; idx + sizeof(uint64_t) <= amount; idx += sizeof(uint64_t))
+        {
+            uint64_t d;
+            uint64_t k;
+            memcpy(&d, data + idx, sizeof(d));
+            memcpy(&k, key + idx, sizeof(k));
+            d ^= k;
+            memcpy(data + idx, &d, sizeof(d));
+        }
+        for(; idx < amount; ++idx)
+        {
+            data[idx] ^= key[idx];
+        }
+        data += amount;
+        size -= amount;
+        m_keystream_pos += amount;
+    }
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
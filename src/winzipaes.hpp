@@ -0,0 +1,139 @@
+#pragma once
+#ifndef ZIPIOS_WINZIPAES_HPP
+#define ZIPIOS_WINZIPAES_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Header file that defines the WinZip AES encryption classes.
+ *
+ * This file declares the zipios::AES block cipher, the zipios::HMACSHA1
+ * message authentication code, the PBKDF2 key derivation, and the
+ * zipios::WinZipAES class which puts them together to encrypt and
+ * decrypt the data of Zip entries the way WinZip does.
+ */
+
+#include "sha1.hpp"
+
+#include "zipios/fileentry.hpp"
+
+#include <memory>
+
+
+namespace zipios
+{
+
+
+class AES
+{
+public:
+    static size_t const         BLOCK_SIZE = 16;
+
+                                AES(uint8_t const * key, size_t key_size);
+
+    static bool                 hasHardwareSupport();
+    bool                        getHardwareAcceleration() const;
+    void                        setHardwareAcceleration(bool enable);
+    void                        encryptBlocks(uint8_t const * in, uint8_t * out, size_t count) const;
+
+private:
+    std::array<uint32_t, 60>    m_round_keys;
+    std::array<uint8_t, 240>    m_round_key_bytes;
+    int                         m_rounds = 0;
+    bool                        m_hardware = false;
+};
+
+
+class HMACSHA1
+{
+public:
+    typedef SHA1::digest_t      digest_t;
+
+                                HMACSHA1(void const * key, size_t size);
+
+    void                        reset();
+    void                        update(void const * data, size_t size);
+    digest_t                    digest();
+
+private:
+    SHA1                        m_inner_start;
+    SHA1                        m_outer_start;
+    SHA1                        m_inner;
+};
+
+
+void pbkdf2HmacSha1(std::string const & password, uint8_t const * salt, size_t salt_size, size_t iterations, uint8_t * out, size_t out_size);
+
+
+class WinZipAES
+{
+public:
+    typedef std::unique_ptr<WinZipAES>  pointer_t;
+    typedef std::array<uint8_t, 2>      verifier_t;
+    typedef std::array<uint8_t, 10>     mac_t;
+
+    static uint16_t const       EXTRA_FIELD_ID = 0x9901;
+    static int const            STRENGTH_256 = 3;
+
+    struct extra_field_t
+    {
+        uint16_t                m_version = 1;
+        int                     m_strength = STRENGTH_256;
+        StorageMethod           m_method = StorageMethod::DEFLATED;
+    };
+
+                                WinZipAES(std::string const & password, uint8_t const * salt, int strength);
+
+    static size_t               getSaltSize(int strength);
+    static bool                 readExtraField(FileEntry::buffer_t const & extra, extra_field_t & field);
+    static void                 writeExtraField(FileEntry::buffer_t & extra, extra_field_t const & field);
+    static void                 removeExtraField(FileEntry::buffer_t & extra);
+
+    verifier_t const &          getVerifier() const;
+    void                        encrypt(char * data, size_t size);
+    void                        decrypt(char * data, size_t size);
+    mac_t                       getMac();
+
+private:
+    void                        crypt(char * data, size_t size);
+
+    std::unique_ptr<AES>        m_aes;
+    std::unique_ptr<HMACSHA1>   m_hmac;
+    verifier_t                  m_verifier;
+    uint64_t                    m_counter = 0;
+    std::array<uint8_t, 64 * AES::BLOCK_SIZE>
+                                m_keystream;
+    size_t                      m_keystream_pos = 64 * AES::BLOCK_SIZE;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
@@ -0,0 +1,381 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::WriteBehindStreambuf.
+ *
+ * This file defines the functions of the zipios::WriteBehindStreambuf
+ * class which writes the data of a Zip archive from a separate thread.
+ */
+
+#include "writebehindstreambuf.hpp"
+
+#include "zipios/zipiosexceptions.hpp"
+
+#include <algorithm>
+
+
+namespace zipios
+{
+
+
+/** \class WriteBehindStreambuf
+ * \brief An output stream buffer writing its data from a separate thread.
+ *
+ * The WriteBehindStreambuf class is an output stream filter which
+ * copies the data written to it in one of a ring of buffers. A
+ * dedicated I/O thread writes the full buffers to the output streambuf
+ * it is attached to. This way the thread compressing the data does
+ * not have to wait on the disk. It only waits when all the buffers
+ * are full (backpressure.)
+ *
+ * Seeking is supported so the Zip local headers can be rewritten once
+ * the size and CRC of an entry are known. The seek is not applied
+ * immediately. Instead it gets queued along the data so the I/O thread
+ * applies it after all the data written before the seek and before any
+ * data written after the seek. This keeps the writes properly ordered
+ * without having to wait for the I/O thread to be done.
+ *
+ * The current position (i.e. tellp()) is tracked by this object so it
+ * does not require any synchronization either.
+ */
+
+
+/** \brief Initialize a write-behind stream buffer.
+ *
+ * The constructor allocates the buffers and starts the I/O thread.
+ *
+ * At least two buffers are always allocated, otherwise the compressing
+ * thread would have to wait on each write.
+ *
+ * \param[in,out] outbuf  The streambuf to use for output.
+ * \param[in] buffer_count  The number of buffers in the ring.
+ * \param[in] buffer_size  The size of each buffer in bytes.
+ */
+WriteBehindStreambuf::WriteBehindStreambuf(std::streambuf * outbuf, size_t buffer_count, size_t buffer_size)
+    : FilterOutputStreambuf(outbuf)
+    , m_buffers(std::max(buffer_count, static_cast<size_t>(2)), std::vector<char>(std::max(buffer_size, static_cast<size_t>(1))))
+    //, m_free_buffers() -- initialized below
+    //, m_queue() -- auto-init
+    //, m_current(0) -- auto-init
+    //, m_position(0) -- initialized below
+    //, m_pending_seek(-1) -- auto-init
+    //, m_busy(false) -- auto-init
+    //, m_stop(false) -- auto-init
+    //, m_error("") -- auto-init
+{
+    for(size_t idx(m_buffers.size() - 1); idx > 0; --idx)
+    {
+        m_free_buffers.push_back(idx);
+    }
+
+    offset_t const pos(m_outbuf->pubseekoff(0, std::ios::cur, std::ios::out));
+    m_position = pos < 0 ? 0 : pos;
+
+    setp(&m_buffers[m_current][0], &m_buffers[m_current][0] + m_buffers[m_current].size());
+
+    m_writer = std::thread(&WriteBehindStreambuf::writer, this);
+}
+
+
+/** \brief Clean up the write-behind stream buffer.
+ *
+ * The destructor writes any data still in the buffers and then stops
+ * the I/O thread.
+ *
+ * \warning
+ * Errors cannot be reported from the destructor. Call drain() first
+ * to make sure the data was properly written.
+ */
+WriteBehindStreambuf::~WriteBehindStreambuf()
+{
+    try
+    {
+        drain();
+    }
+    catch(...)
+    {
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_cond.notify_all();
+    }
+    m_writer.join();
+}
+
+
+/** \brief Wait until all the data was written.
+ *
+ * This function sends the current buffer to the I/O thread and then
+ * waits until the I/O thread is done writing everything.
+ *
+ * \exception IOException
+ * If the I/O thread failed writing or seeking, this exception is raised.
+ */
+void WriteBehindStreambuf::drain()
+{
+    submit();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [this]{ return m_queue.empty() && !m_busy; });
+    checkError();
+}
+
+
+/** \brief Send the current buffer to the I/O thread.
+ *
+ * This function is called when the current buffer is full.
+ *
+ * \param[in] c  The character that did not fit in the buffer or EOF.
+ *
+ * \return Always 0.
+ */
+int WriteBehindStreambuf::overflow(int c)
+{
+    submit();
+
+    if(c != EOF)
+    {
+        *pptr() = c;
+        pbump(1);
+    }
+
+    return 0;
+}
+
+
+/** \brief Change or retrieve the current position.
+ *
+ * The tellp() function calls this function with an offset of zero
+ * from the current position. This is answered without synchronization
+ * since the position is tracked by this object.
+ *
+ * Seeking relative to the end requires the I/O thread to be done and
+ * then the request is forwarded to the output streambuf.
+ *
+ * \param[in] off  The offset to seek to.
+ * \param[in] dir  The position \p off is relative to.
+ * \param[in] which  The side of the stream to seek, ignored.
+ *
+ * \return The new position.
+ */
+WriteBehindStreambuf::pos_type WriteBehindStreambuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+    switch(dir)
+    {
+    case std::ios::beg:
+        return seekpos(off, which);
+
+    case std::ios::cur:
+        if(off == 0)
+        {
+            return m_position + (pptr() - pbase());
+        }
+        return seekpos(m_position + (pptr() - pbase()) + off, which);
+
+    default:
+    {
+        drain();
+
+        pos_type const pos(m_outbuf->pubseekoff(off, dir, which));
+        m_position = pos;
+        return pos;
+    }
+
+    }
+}
+
+
+/** \brief Change the current position.
+ *
+ * The data written so far is sent to the I/O thread and the seek gets
+ * queued. It is applied by the I/O thread before it writes the next
+ * block of data.
+ *
+ * \param[in] pos  The new position.
+ * \param[in] which  The side of the stream to seek, ignored.
+ *
+ * \return The new position.
+ */
+WriteBehindStreambuf::pos_type WriteBehindStreambuf::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    static_cast<void>(which);
+
+    if(pptr() > pbase())
+    {
+        submit();
+    }
+    m_pending_seek = pos;
+    m_position = pos;
+
+    return pos;
+}
+
+
+/** \brief Write all the data to the output streambuf.
+ *
+ * This function waits for the I/O thread to be done and then calls
+ * sync() on the output streambuf.
+ *
+ * \return 0 on success, -1 on failure.
+ */
+int WriteBehindStreambuf::sync()
+{
+    try
+    {
+        drain();
+    }
+    catch(IOException const &)
+    {
+        return -1;
+    }
+
+    return m_outbuf->pubsync();
+}
+
+
+/** \brief Queue the current buffer and get a free one.
+ *
+ * This function sends the current buffer, along any pending seek,
+ * to the I/O thread. Then it waits for a free buffer, which is where
+ * the backpressure happens.
+ *
+ * \exception IOException
+ * If the I/O thread failed, this exception is raised.
+ */
+void WriteBehindStreambuf::submit()
+{
+    size_t const size(pptr() - pbase());
+    if(size == 0 && m_pending_seek < 0)
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    checkError();
+
+    block_t block;
+    block.m_seek = m_pending_seek;
+    block.m_buffer = m_current;
+    block.m_size = size;
+    m_queue.push_back(block);
+    m_cond.notify_all();
+
+    m_pending_seek = -1;
+    m_position += size;
+
+    m_cond.wait(lock, [this]{ return !m_free_buffers.empty(); });
+    m_current = m_free_buffers.back();
+    m_free_buffers.pop_back();
+
+    setp(&m_buffers[m_current][0], &m_buffers[m_current][0] + m_buffers[m_current].size());
+}
+
+
+/** \brief Throw if the I/O thread failed.
+ *
+ * The m_mutex must be locked when calling this function.
+ *
+ * \exception IOException
+ * The exception is raised if an error was recorded by the I/O thread.
+ */
+void WriteBehindStreambuf::checkError()
+{
+    if(!m_error.empty())
+    {
+        throw IOException(m_error);
+    }
+}
+
+
+/** \brief The I/O thread.
+ *
+ * This function writes the queued buffers to the output streambuf,
+ * in order, and then returns them to the list of free buffers.
+ *
+ * Once an error occurs, the remaining blocks are dropped without being
+ * written. The error is reported to the writing thread the next time
+ * it submits a buffer or drains the queue.
+ */
+void WriteBehindStreambuf::writer()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(;;)
+    {
+        m_cond.wait(lock, [this]{ return m_stop || !m_queue.empty(); });
+        if(m_queue.empty())
+        {
+            return;
+        }
+
+        block_t const block(m_queue.front());
+        m_queue.pop_front();
+        m_busy = true;
+        bool const failed(!m_error.empty());
+        char const * data(&m_buffers[block.m_buffer][0]);
+        lock.unlock();
+
+        std::string error;
+        if(!failed)
+        {
+            try
+            {
+                if(block.m_seek >= 0
+                && m_outbuf->pubseekpos(block.m_seek, std::ios::out) != pos_type(block.m_seek))
+                {
+                    error = "WriteBehindStreambuf::writer(): seek in output buffer failed.";
+                }
+                else if(block.m_size > 0
+                     && m_outbuf->sputn(data, block.m_size) != static_cast<std::streamsize>(block.m_size))
+                {
+                    error = "WriteBehindStreambuf::writer(): write to buffer failed.";
+                }
+            }
+            catch(std::exception const & e) // LCOV_EXCL_LINE
+            {
+                error = e.what(); // LCOV_EXCL_LINE
+            }
+        }
+
+        lock.lock();
+        m_busy = false;
+        if(!error.empty())
+        {
+            m_error = error;
+        }
+        m_free_buffers.push_back(block.m_buffer);
+        m_cond.notify_all();
+    }
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
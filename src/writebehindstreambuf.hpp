@@ -0,0 +1,103 @@
+#pragma once
+#ifndef WRITEBEHINDSTREAMBUF_HPP
+#define WRITEBEHINDSTREAMBUF_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Header file that defines zipios::WriteBehindStreambuf.
+ *
+ * This file declares the zipios::WriteBehindStreambuf class which is
+ * used to write the output of a Zip archive from a separate thread.
+ */
+
+#include "filteroutputstreambuf.hpp"
+
+#include "zipios/zipios-config.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace zipios
+{
+
+
+class WriteBehindStreambuf : public FilterOutputStreambuf
+{
+public:
+                            WriteBehindStreambuf(std::streambuf * outbuf, size_t buffer_count, size_t buffer_size);
+                            WriteBehindStreambuf(WriteBehindStreambuf const & src) = delete;
+    WriteBehindStreambuf &  operator = (WriteBehindStreambuf const & rhs) = delete;
+    virtual                 ~WriteBehindStreambuf() override;
+
+    void                    drain();
+
+protected:
+    virtual int             overflow(int c = EOF) override;
+    virtual pos_type        seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::out) override;
+    virtual pos_type        seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::out) override;
+    virtual int             sync() override;
+
+private:
+    struct block_t
+    {
+        offset_t            m_seek = -1;
+        size_t              m_buffer = 0;
+        size_t              m_size = 0;
+    };
+
+    void                    submit();
+    void                    checkError();
+    void                    writer();
+
+    std::vector<std::vector<char>>
+                            m_buffers;
+    std::vector<size_t>     m_free_buffers;
+    std::deque<block_t>     m_queue;
+    size_t                  m_current = 0;
+    offset_t                m_position = 0;
+    offset_t                m_pending_seek = -1;
+    bool                    m_busy = false;
+    bool                    m_stop = false;
+    std::string             m_error;
+    std::mutex              m_mutex;
+    std::condition_variable m_cond;
+    std::thread             m_writer;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
@@ -0,0 +1,308 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::XXHash64.
+ *
+ * This file defines the functions of the zipios::XXHash64 class, a
+ * straightforward implementation of the XXH64 algorithm.
+ */
+
+#include "xxhash64.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace zipios
+{
+
+
+namespace
+{
+
+
+uint64_t const g_prime1 = 0x9E3779B185EBCA87ULL;
+uint64_t const g_prime2 = 0xC2B2AE3D27D4EB4FULL;
+uint64_t const g_prime3 = 0x165667B19E3779F9ULL;
+uint64_t const g_prime4 = 0x85EBCA77C2B2AE63ULL;
+uint64_t const g_prime5 = 0x27D4EB2F165667C5ULL;
+
+
+/** \brief Rotate a 64 bit value to the left.
+ *
+ * \param[in] value  The value to rotate.
+ * \param[in] count  The number of bits to rotate, 1 to 63.
+ *
+ * \return The rotated value.
+ */
+inline uint64_t rotl(uint64_t value, int count)
+{
+    return (value << count) | (value >> (64 - count));
+}
+
+
+/** \brief Read a little endian 64 bit value.
+ *
+ * \param[in] data  The bytes to read.
+ *
+ * \return The value.
+ */
+inline uint64_t read64(uint8_t const * data)
+{
+    uint64_t value(0);
+    for(int idx(7); idx >= 0; --idx)
+    {
+        value = (value << 8) | data[idx];
+    }
+    return value;
+}
+
+
+/** \brief Read a little endian 32 bit value.
+ *
+ * \param[in] data  The bytes to read.
+ *
+ * \return The value.
+ */
+inline uint64_t read32(uint8_t const * data)
+{
+    return static_cast<uint64_t>(data[0])
+         | (static_cast<uint64_t>(data[1]) << 8)
+         | (static_cast<uint64_t>(data[2]) << 16)
+         | (static_cast<uint64_t>(data[3]) << 24);
+}
+
+
+/** \brief Mix one 64 bit lane of input in an accumulator.
+ *
+ * \param[in] accumulator  The accumulator.
+ * \param[in] input  The input lane.
+ *
+ * \return The new accumulator.
+ */
+inline uint64_t mixLane(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * g_prime2;
+    accumulator = rotl(accumulator, 31);
+    return accumulator * g_prime1;
+}
+
+
+/** \brief Merge an accumulator in the hash.
+ *
+ * \param[in] hash  The hash.
+ * \param[in] accumulator  The accumulator to merge.
+ *
+ * \return The new hash.
+ */
+inline uint64_t mergeRound(uint64_t hash, uint64_t accumulator)
+{
+    hash ^= mixLane(0, accumulator);
+    return hash * g_prime1 + g_prime4;
+}
+
+
+} // no name namespace
+
+
+/** \class XXHash64
+ * \brief Compute the XXH64 hash of some data.
+ *
+ * This class is used to compute the XXH64 hash of the data of a file.
+ * It is not a cryptographic hash, but it is an order of magnitude
+ * faster than SHA-256 and good enough to detect corrupted data. The
+ * data can be added in any number of calls to update().
+ */
+
+
+/** \brief Initialize an XXHash64 object.
+ *
+ * The object is ready to receive data.
+ *
+ * \param[in] seed  The seed of the hash, usually 0.
+ */
+XXHash64::XXHash64(uint64_t seed)
+    : m_seed(seed)
+    //, m_accumulators() -- initialized in reset()
+    //, m_stripe() -- no need to initialize
+    //, m_stripe_size(0) -- auto-init
+    //, m_total_size(0) -- auto-init
+{
+    reset();
+}
+
+
+/** \brief Restart the computation of a hash.
+ *
+ * This function resets the object so it can be used to compute the
+ * hash of another set of data.
+ */
+void XXHash64::reset()
+{
+    m_accumulators = {{
+        m_seed + g_prime1 + g_prime2,
+        m_seed + g_prime2,
+        m_seed,
+        m_seed - g_prime1
+    }};
+    m_stripe_size = 0;
+    m_total_size = 0;
+}
+
+
+/** \brief Add data to the hash.
+ *
+ * \param[in] data  The data to add.
+ * \param[in] size  The number of bytes in \p data.
+ */
+void XXHash64::update(void const * data, size_t size)
+{
+    uint8_t const * d(reinterpret_cast<uint8_t const *>(data));
+    m_total_size += size;
+
+    if(m_stripe_size > 0)
+    {
+        size_t const amount(std::min(size, m_stripe.size() - m_stripe_size));
+        memcpy(&m_stripe[m_stripe_size], d, amount);
+        m_stripe_size += amount;
+        d += amount;
+        size -= amount;
+        if(m_stripe_size < m_stripe.size())
+        {
+            return;
+        }
+        processStripe(&m_stripe[0]);
+        m_stripe_size = 0;
+    }
+
+    for(; size >= m_stripe.size(); d += m_stripe.size(), size -= m_stripe.size())
+    {
+        processStripe(d);
+    }
+
+    if(size > 0)
+    {
+        memcpy(&m_stripe[0], d, size);
+        m_stripe_size = size;
+    }
+}
+
+
+/** \brief Compute the hash of the data added so far.
+ *
+ * Contrary to the SHA classes, this function does not modify the
+ * state, so more data can be added afterward.
+ *
+ * \return The 64 bit hash.
+ */
+uint64_t XXHash64::hash() const
+{
+    uint64_t h(0);
+    if(m_total_size >= m_stripe.size())
+    {
+        h = rotl(m_accumulators[0], 1)
+          + rotl(m_accumulators[1], 7)
+          + rotl(m_accumulators[2], 12)
+          + rotl(m_accumulators[3], 18);
+        for(auto const a : m_accumulators)
+        {
+            h = mergeRound(h, a);
+        }
+    }
+    else
+    {
+        h = m_seed + g_prime5;
+    }
+    h += m_total_size;
+
+    uint8_t const * d(&m_stripe[0]);
+    size_t size(m_stripe_size);
+    for(; size >= 8; d += 8, size -= 8)
+    {
+        h ^= mixLane(0, read64(d));
+        h = rotl(h, 27) * g_prime1 + g_prime4;
+    }
+    if(size >= 4)
+    {
+        h ^= read32(d) * g_prime1;
+        h = rotl(h, 23) * g_prime2 + g_prime3;
+        d += 4;
+        size -= 4;
+    }
+    for(; size > 0; ++d, --size)
+    {
+        h ^= *d * g_prime5;
+        h = rotl(h, 11) * g_prime1;
+    }
+
+    h ^= h >> 33;
+    h *= g_prime2;
+    h ^= h >> 29;
+    h *= g_prime3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+
+/** \brief Compute the hash of the data added so far as bytes.
+ *
+ * The bytes are in big endian order, the canonical representation
+ * used by the xxhsum tool.
+ *
+ * \return The 8 bytes of the hash.
+ */
+XXHash64::digest_t XXHash64::digest() const
+{
+    uint64_t const h(hash());
+    digest_t result;
+    for(size_t idx(0); idx < result.size(); ++idx)
+    {
+        result[idx] = static_cast<uint8_t>(h >> (56 - idx * 8));
+    }
+    return result;
+}
+
+
+/** \brief Process one 32 byte stripe of data.
+ *
+ * \param[in] stripe  The 32 bytes to add to the accumulators.
+ */
+void XXHash64::processStripe(uint8_t const * stripe)
+{
+    m_accumulators[0] = mixLane(m_accumulators[0], read64(stripe +  0));
+    m_accumulators[1] = mixLane(m_accumulators[1], read64(stripe +  8));
+    m_accumulators[2] = mixLane(m_accumulators[2], read64(stripe + 16));
+    m_accumulators[3] = mixLane(m_accumulators[3], read64(stripe + 24));
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,78 @@
+#pragma once
+#ifndef XXHASH64_HPP
+#define XXHASH64_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Header file that defines zipios::XXHash64.
+ *
+ * This file declares the zipios::XXHash64 class which computes the
+ * XXH64 hash of a stream of bytes.
+ */
+
+#include "zipios/zipios-config.hpp"
+
+#include <array>
+#include <cstdint>
+
+
+namespace zipios
+{
+
+
+class XXHash64
+{
+public:
+    typedef std::array<uint8_t, 8>      digest_t;
+
+                        XXHash64(uint64_t seed = 0);
+
+    void                reset();
+    void                update(void const * data, size_t size);
+    uint64_t            hash() const;
+    digest_t            digest() const;
+
+private:
+    void                processStripe(uint8_t const * stripe);
+
+    uint64_t            m_seed = 0;
+    std::array<uint64_t, 4>
+                        m_accumulators;
+    std::array<uint8_t, 32>
+                        m_stripe;
+    size_t              m_stripe_size = 0;
+    uint64_t            m_total_size = 0;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
@@ -373,7 +373,8 @@ void ZipCentralDirectoryEntry::write(std::ostream& os)
     }
 
     uint16_t compress_method(static_cast<uint8_t>(m_compress_method));
-    if(m_compression_level == COMPRESSION_LEVEL_NONE)
+    if(m_compression_level == COMPRESSION_LEVEL_NONE
+    && m_compress_method != StorageMethod::AES)
     {
         compress_method = static_cast<uint8_t>(StorageMethod::STORED);
     }
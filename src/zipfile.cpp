@@ -28,15 +28,32 @@
 
 #include "zipios/zipfile.hpp"
 
+#include "zipios/directfileoutputstream.hpp"
+#include "zipios/directorycollection.hpp"
 #include "zipios/zipiosexceptions.hpp"
 
 #include "backbuffer.hpp"
+#include "blobcache.hpp"
+#include "compressionbudget.hpp"
+#include "deflatethreadpool.hpp"
+#include "memorystreambuf.hpp"
+#include "sharedfilestreambuf.hpp"
 #include "zipendofcentraldirectory.hpp"
 #include "zipcentraldirectoryentry.hpp"
 #include "zipinputstream.hpp"
 #include "zipoutputstream.hpp"
+#include "zipios_common.hpp"
+#include "ziplocalentry.hpp"
 
+#include <algorithm>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <thread>
+#include <unordered_map>
+
+#include <zlib.h>
 
 
 /** \brief The zipios namespace includes the Zipios library definitions.
@@ -265,6 +282,647 @@ namespace zipios
  */
 
 
+namespace
+{
+
+
+/** \brief Compute the range of bytes used by one entry in the archive.
+ *
+ * This function returns the offset and size of the local header and
+ * data of the specified \p entry. This is the area of the file that
+ * gets read when the entry input stream is used.
+ *
+ * \param[in] entry  An entry of a ZipFile.
+ * \param[in] start_offset  The offset of the archive in the file.
+ *
+ * \return The range of bytes representing this entry in the file.
+ */
+file_range_t getPayloadRange(FileEntry const & entry, offset_t start_offset)
+{
+    /** \TODO
+     * Rethink the design as we have to force a call to the correct
+     * getHeaderSize() function?
+     */
+    if(entry.getDataOffset() > 0)
+    {
+        return file_range_t(start_offset + entry.getEntryOffset()
+                          , entry.getDataOffset() - entry.getEntryOffset() + entry.getCompressedSize());
+    }
+    ZipLocalEntry const & local_entry(static_cast<ZipLocalEntry const &>(entry));
+    return file_range_t(start_offset + entry.getEntryOffset()
+                      , local_entry.ZipLocalEntry::getHeaderSize() + entry.getCompressedSize());
+}
+
+
+/** \brief Estimate the size of an archive.
+ *
+ * This function computes the largest size the archive of the specified
+ * \p entries can have. Compressed entries are counted with the size
+ * zlib gives for incompressible data so the estimate is an upper bound.
+ *
+ * When the data of the stored entries gets aligned, the largest
+ * padding is counted for each of them.
+ *
+ * \param[in] entries  The entries to be saved in the archive.
+ * \param[in] zip_comment  The global comment of the archive.
+ * \param[in] stored_alignment  The alignment of the stored data or 0.
+ *
+ * \return The estimated size of the archive in bytes.
+ */
+offset_t estimateArchiveSize(FileEntry::vector_t const & entries, std::string const & zip_comment, size_t stored_alignment)
+{
+    // the End of Central Directory, then for each entry its local
+    // header and its central directory header (+1 for the '/' of
+    // directories)
+    //
+    offset_t size(22 + zip_comment.length());
+    for(auto const & entry : entries)
+    {
+        size += 30 + 46 + 2 * (entry->getName().length() + 1 + entry->getExtra().size())
+              + entry->getComment().length();
+        if(!entry->isDirectory())
+        {
+            size += entry->getMethod() == StorageMethod::STORED
+                        ? entry->getSize()
+                        : compressBound(entry->getSize());
+            if(stored_alignment != 0)
+            {
+                size += 6 + stored_alignment;
+            }
+        }
+    }
+
+    return size;
+}
+
+
+/** \brief Map the name of an entry to the entry of a previous archive.
+ */
+typedef std::map<std::string, FileEntry::pointer_t> previous_entries_t;
+
+
+/** \brief Copy an unchanged entry from a previous archive.
+ *
+ * This function searches \p entry in the \p previous_entries. If found
+ * with the same size, modification time, and storage method (and CRC
+ * if \p verify_crc is true), the compressed data of the previous entry
+ * gets copied to \p output_stream.
+ *
+ * \param[in,out] output_stream  The stream where the archive is written.
+ * \param[in] collection  The collection being saved.
+ * \param[in] entry  The entry to save.
+ * \param[in] previous_entries  The entries of the previous archive.
+ * \param[in,out] previous_is  The stream used to read the previous archive.
+ * \param[in] previous_start  The offset of the previous archive in its
+ *                            file, the entry offsets are relative to it.
+ * \param[in] verify_crc  Whether the CRC of the file gets verified.
+ *
+ * \return true if the entry was copied, false if it has to be compressed.
+ */
+bool copyPreviousEntry(ZipOutputStream & output_stream
+                     , FileCollection & collection
+                     , FileEntry::pointer_t entry
+                     , previous_entries_t const & previous_entries
+                     , std::istream & previous_is
+                     , offset_t previous_start
+                     , bool verify_crc)
+{
+    if(entry->isDirectory())
+    {
+        return false;
+    }
+
+    auto const it(previous_entries.find(entry->getName()));
+    if(it == previous_entries.end())
+    {
+        return false;
+    }
+    FileEntry const & previous(*it->second);
+
+    // a level of NONE forces the STORED method in the output
+    StorageMethod const method(entry->getLevel() == FileEntry::COMPRESSION_LEVEL_NONE
+                                    ? StorageMethod::STORED
+                                    : entry->getMethod());
+    if(previous.isDirectory()
+    || previous.getSize() != entry->getSize()
+    || previous.getTime() != entry->getTime()
+    || previous.getMethod() != method)
+    {
+        return false;
+    }
+
+    if(verify_crc)
+    {
+        FileCollection::stream_pointer_t is(collection.getInputStream(entry->getName()));
+        if(!is)
+        {
+            return false;
+        }
+        std::vector<char> buffer(getBufferSize());
+        uLong crc(crc32(0L, Z_NULL, 0));
+        while(*is)
+        {
+            is->read(&buffer[0], buffer.size());
+            crc = crc32(crc, reinterpret_cast<Bytef const *>(&buffer[0]), is->gcount());
+        }
+        if(crc != previous.getCrc())
+        {
+            return false;
+        }
+    }
+
+    // skip the local header of the previous entry, its size may
+    // differ from the one in the central directory
+    previous_is.clear();
+    if(previous.getDataOffset() > 0)
+    {
+        previous_is.seekg(previous_start + previous.getDataOffset());
+    }
+    else
+    {
+        previous_is.seekg(previous_start + previous.getEntryOffset());
+        ZipLocalEntry local_entry;
+        local_entry.read(previous_is);
+    }
+
+    output_stream.copyEntry(entry, previous, previous_is);
+
+    return true;
+}
+
+
+/** \brief Map the device and inode of a file to the key of its blob.
+ */
+typedef std::map<std::pair<uint64_t, uint64_t>, std::string> hard_links_t;
+
+
+/** \brief Copy an entry from the blob cache.
+ *
+ * This function computes the key of the data of \p entry and copies
+ * the corresponding compressed data from the \p blob_cache. On a miss,
+ * the data gets compressed in the cache first.
+ *
+ * When \p hard_links is not null, the entry name is a path on disk and
+ * the key is computed only once per inode.
+ *
+ * Only deflated entries are cached.
+ *
+ * \param[in,out] output_stream  The stream where the archive is written.
+ * \param[in] collection  The collection being saved.
+ * \param[in] entry  The entry to save.
+ * \param[in] blob_cache  The blob cache.
+ * \param[in,out] hard_links  The keys of the inodes already seen or null.
+ *
+ * \return true if the entry was copied, false if it has to be compressed.
+ */
+bool copyCachedEntry(ZipOutputStream & output_stream
+                   , FileCollection & collection
+                   , FileEntry::pointer_t entry
+                   , BlobCache const & blob_cache
+                   , hard_links_t * hard_links)
+{
+    if(entry->isDirectory()
+    || entry->getMethod() != StorageMethod::DEFLATED
+    || entry->getLevel() == FileEntry::COMPRESSION_LEVEL_NONE)
+    {
+        return false;
+    }
+
+    std::string key;
+    std::pair<uint64_t, uint64_t> inode;
+    if(hard_links != nullptr)
+    {
+        FilePath const path(entry->getName());
+        inode = std::make_pair(path.deviceID(), path.inodeNumber());
+        auto const it(hard_links->find(inode));
+        if(it != hard_links->end())
+        {
+            key = it->second;
+        }
+    }
+    if(key.empty())
+    {
+        FileCollection::stream_pointer_t is(collection.getInputStream(entry->getName()));
+        if(!is)
+        {
+            return false;
+        }
+        key = blob_cache.computeKey(*is, StorageMethod::DEFLATED, entry->getLevel());
+        if(hard_links != nullptr)
+        {
+            (*hard_links)[inode] = key;
+        }
+    }
+
+    BlobCache::blob_t blob;
+    FileCollection::stream_pointer_t blob_is(blob_cache.open(key, blob));
+    if(!blob_is)
+    {
+        FileCollection::stream_pointer_t is(collection.getInputStream(entry->getName()));
+        if(!is)
+        {
+            return false;
+        }
+        blob_cache.store(key, *is, entry->getLevel());
+        blob_is = blob_cache.open(key, blob);
+        if(!blob_is)
+        {
+            throw IOException("copyCachedEntry(): blob \"" + key + "\" could not be read back from the cache."); // LCOV_EXCL_LINE
+        }
+    }
+
+    ZipLocalEntry blob_entry(*entry);
+    blob_entry.setMethod(StorageMethod::DEFLATED);
+    blob_entry.setSize(blob.m_size);
+    blob_entry.setCompressedSize(blob.m_compressed_size);
+    blob_entry.setCrc(blob.m_crc);
+    output_stream.copyEntry(entry, blob_entry, *blob_is);
+
+    return true;
+}
+
+
+/** \brief Save the entries compressing their data with several threads.
+ *
+ * The data of the deflated files is read in chunks by the calling
+ * thread and compressed by a DeflateThreadPool. The chunks are saved
+ * in order as they get compressed, while the following chunks, possibly
+ * of the following files, are being compressed. At most a few chunks
+ * per thread are in memory at any one time.
+ *
+ * The other entries (directories and stored files) are saved by the
+ * calling thread, in order.
+ *
+ * When \p throughput is not zero, the chunks are compressed with the
+ * level selected by a CompressionBudget, updated with the time each
+ * chunk took to compress. Since a few chunks per thread are in flight,
+ * the level follows the measurements that many chunks late.
+ *
+ * \param[in,out] output_stream  The stream where the archive is written.
+ * \param[in] collection  The collection being saved.
+ * \param[in] entries  The entries to save, in order.
+ * \param[in] thread_count  The number of compression threads.
+ * \param[in] throughput  The target throughput per thread, 0 to use
+ *                        the level of each entry.
+ */
+void saveEntriesInParallel(ZipOutputStream & output_stream
+                         , FileCollection & collection
+                         , FileEntry::vector_t const & entries
+                         , size_t thread_count
+                         , double throughput)
+{
+    struct pending_t
+    {
+        FileEntry::pointer_t                    m_entry = FileEntry::pointer_t();
+        DeflateThreadPool::chunk_t::pointer_t   m_chunk = DeflateThreadPool::chunk_t::pointer_t();
+        bool                                    m_first = false;
+        bool                                    m_submitted = false;
+    };
+
+    DeflateThreadPool pool(thread_count);
+    CompressionBudget budget(throughput);
+    size_t const window(thread_count * 4);
+    size_t in_flight(0);
+    std::deque<pending_t> queue;
+
+    // the file being read
+    size_t next(0);
+    FileEntry::pointer_t reading;
+    FileCollection::stream_pointer_t is;
+    DeflateThreadPool::chunk_t::pointer_t previous;
+
+    // the file being written
+    uLong crc(0);
+    size_t size(0);
+
+    for(;;)
+    {
+        // read ahead until all the threads have enough work
+        while(in_flight < window)
+        {
+            if(reading == nullptr)
+            {
+                if(next >= entries.size())
+                {
+                    break;
+                }
+                pending_t p;
+                p.m_entry = entries[next++];
+                if(p.m_entry->isDirectory()
+                || p.m_entry->getMethod() != StorageMethod::DEFLATED
+                || p.m_entry->getLevel() == FileEntry::COMPRESSION_LEVEL_NONE)
+                {
+                    queue.push_back(p);
+                    continue;
+                }
+                reading = p.m_entry;
+                is = collection.getInputStream(reading->getName());
+                previous.reset();
+            }
+
+            pending_t p;
+            p.m_entry = reading;
+            p.m_first = previous == nullptr;
+            p.m_chunk.reset(new DeflateThreadPool::chunk_t);
+            p.m_chunk->m_level = reading->getLevel();
+            if(budget.isEnabled())
+            {
+                p.m_chunk->m_zlib_level = budget.getLevel();
+            }
+            p.m_chunk->m_input.resize(DeflateThreadPool::CHUNK_SIZE);
+            size_t amount(0);
+            if(is)
+            {
+                is->read(&p.m_chunk->m_input[0], p.m_chunk->m_input.size());
+                amount = is->gcount();
+            }
+            p.m_chunk->m_input.resize(amount);
+            p.m_chunk->m_last = !is
+                             || is->peek() == std::istream::traits_type::eof();
+            if(previous != nullptr)
+            {
+                size_t const dictionary_size(std::min(previous->m_input.size(), DeflateThreadPool::DICTIONARY_SIZE));
+                p.m_chunk->m_dictionary.assign(previous->m_input.end() - dictionary_size, previous->m_input.end());
+            }
+
+            // zipios saves empty deflated files without any compressed data
+            if(p.m_first
+            && p.m_chunk->m_last
+            && amount == 0)
+            {
+                p.m_chunk->m_done = true;
+            }
+            else
+            {
+                pool.submit(p.m_chunk);
+                p.m_submitted = true;
+                ++in_flight;
+            }
+            queue.push_back(p);
+
+            if(p.m_chunk->m_last)
+            {
+                reading.reset();
+                is.reset();
+                previous.reset();
+            }
+            else
+            {
+                previous = p.m_chunk;
+            }
+        }
+
+        if(queue.empty())
+        {
+            break;
+        }
+        pending_t const p(queue.front());
+        queue.pop_front();
+
+        if(p.m_chunk == nullptr)
+        {
+            output_stream.putNextEntry(p.m_entry);
+            if(!p.m_entry->isDirectory())
+            {
+                FileCollection::stream_pointer_t entry_is(collection.getInputStream(p.m_entry->getName()));
+                // inserting an empty file would set the failbit and
+                // the data of the following entries would be ignored
+                if(entry_is
+                && entry_is->peek() != std::istream::traits_type::eof())
+                {
+                    output_stream << entry_is->rdbuf();
+                }
+            }
+            output_stream.closeEntry();
+            continue;
+        }
+
+        if(p.m_submitted)
+        {
+            pool.wait(p.m_chunk);
+            --in_flight;
+            budget.update(p.m_chunk->m_input.size(), p.m_chunk->m_output.size(), p.m_chunk->m_seconds);
+        }
+        if(p.m_first)
+        {
+            output_stream.putDeflatedEntry(p.m_entry);
+            crc = crc32(0L, Z_NULL, 0);
+            size = 0;
+        }
+        output_stream.writeDeflatedData(p.m_chunk->m_output.data(), p.m_chunk->m_output.size());
+        crc = crc32_combine(crc, p.m_chunk->m_crc32, p.m_chunk->m_input.size());
+        size += p.m_chunk->m_input.size();
+        if(p.m_chunk->m_last)
+        {
+            output_stream.closeDeflatedEntry(crc, size);
+        }
+    }
+}
+
+
+/** \brief Sort the entries in the order of an access profile.
+ *
+ * This function moves the entries named in \p profile to the front of
+ * \p entries, in the order of the profile. The other entries keep their
+ * relative order and follow.
+ *
+ * \param[in,out] entries  The entries to reorder.
+ * \param[in] profile  The names of the entries in access order.
+ */
+void orderEntries(FileEntry::vector_t & entries, std::vector<std::string> const & profile)
+{
+    std::unordered_map<std::string, size_t> rank;
+    for(size_t idx(0); idx < profile.size(); ++idx)
+    {
+        // keep the first access of a name
+        rank.insert(std::make_pair(profile[idx], idx));
+    }
+
+    size_t const cold(profile.size());
+    std::stable_sort(
+              entries.begin()
+            , entries.end()
+            , [&rank, cold](FileEntry::pointer_t const & lhs, FileEntry::pointer_t const & rhs)
+            {
+                auto const l(rank.find(lhs->getName()));
+                auto const r(rank.find(rhs->getName()));
+                return (l == rank.end() ? cold : l->second)
+                     < (r == rank.end() ? cold : r->second);
+            });
+}
+
+
+/** \brief Number of central directory records decoded per thread.
+ *
+ * Starting threads has a cost so small archives are parsed in the
+ * calling thread and large ones use one thread per this many records.
+ */
+size_t const g_records_per_thread = 16 * 1024;
+
+
+/** \brief Signature ending the trailer written by appendzip.
+ *
+ * The trailer is the 64 bit offset of the archive followed by this
+ * signature ("ZE64"), which distinguishes it from the legacy trailer
+ * which only had a 32 bit offset.
+ */
+uint32_t const g_embedded_trailer_signature = 0x3436455A;
+
+
+/** \brief Size of the trailer written by appendzip.
+ */
+offset_t const g_embedded_trailer_size = 12;
+
+
+/** \brief Check whether a central directory record starts at \p offset.
+ *
+ * \param[in,out] is  The archive file.
+ * \param[in] vs  The virtual seeker of the archive.
+ * \param[in] offset  The position to check, relative to the archive.
+ *
+ * \return true if the central directory signature is found there.
+ */
+bool isCentralDirectoryAt(std::istream & is, VirtualSeeker const & vs, offset_t offset)
+{
+    char signature[4];
+    vs.vseekg(is, offset, std::ios::beg);
+    bool const result(is.read(signature, sizeof(signature))
+                   && signature[0] == 'P'
+                   && signature[1] == 'K'
+                   && signature[2] == 1
+                   && signature[3] == 2);
+    is.clear();
+    return result;
+}
+
+
+/** \brief Check whether the archive is a Zip64 archive.
+ *
+ * A Zip64 archive has a Zip64 End of Central Directory Locator (20
+ * bytes, signature "PK\6\7") right before its End of Central Directory.
+ * The 16 and 32 bit fields of the End of Central Directory of such an
+ * archive are not valid so it cannot be read by Zipios.
+ *
+ * \param[in,out] is  The archive file.
+ * \param[in] vs  The virtual seeker of the archive.
+ * \param[in] eocd_offset  The position of the End of Central Directory,
+ *                         relative to the archive.
+ *
+ * \return true if the Zip64 locator signature is found there.
+ */
+bool isZip64Archive(std::istream & is, VirtualSeeker const & vs, offset_t eocd_offset)
+{
+    if(eocd_offset < 20)
+    {
+        return false;
+    }
+    char signature[4];
+    vs.vseekg(is, eocd_offset - 20, std::ios::beg);
+    bool const result(is.read(signature, sizeof(signature))
+                   && signature[0] == 'P'
+                   && signature[1] == 'K'
+                   && signature[2] == 6
+                   && signature[3] == 7);
+    is.clear();
+    return result;
+}
+
+
+/** \brief Decompress one entry in its place in an arena.
+ *
+ * This function reads the local header of \p entry and its data from
+ * \p is, decompressing it if necessary, and saves the result in
+ * \p out, which must have room for exactly getSize() bytes.
+ *
+ * \exception FileCollectionException
+ * This exception is raised if the entry uses an unsupported storage
+ * method or a trailing data descriptor.
+ *
+ * \exception IOException
+ * This exception is raised if the data cannot be read or it does not
+ * decompress to the size given by the central directory.
+ *
+ * \param[in,out] is  The archive file.
+ * \param[in] start_offset  The offset of the archive in the file.
+ * \param[in] entry  The entry to decompress.
+ * \param[out] out  Where the data gets saved.
+ * \param[in,out] buffer  A buffer used to read compressed data.
+ */
+void loadArenaEntry(std::istream & is, offset_t start_offset, FileEntry const & entry, char * out, std::vector<char> & buffer)
+{
+    is.seekg(start_offset + entry.getEntryOffset());
+    ZipLocalEntry local_entry;
+    local_entry.read(is);
+    if(local_entry.hasTrailingDataDescriptor())
+    {
+        throw FileCollectionException("Trailing data descriptor in zip file not supported");
+    }
+
+    size_t const size(entry.getSize());
+    if(size == 0)
+    {
+        // zipios saves empty deflated files without any compressed data
+        return;
+    }
+
+    switch(entry.getMethod())
+    {
+    case StorageMethod::STORED:
+        if(!is.read(out, size))
+        {
+            throw IOException("ZipFile::loadArena(): could not read the data of \"" + entry.getName() + "\".");
+        }
+        return;
+
+    case StorageMethod::DEFLATED:
+        break;
+
+    default:
+        throw FileCollectionException("Unsupported compression format");
+
+    }
+
+    z_stream zs = z_stream();
+    if(inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+    {
+        throw IOException("ZipFile::loadArena(): could not initialize zlib."); // LCOV_EXCL_LINE
+    }
+
+    zs.next_out = reinterpret_cast<Bytef *>(out);
+    zs.avail_out = static_cast<uInt>(size);
+
+    size_t remain(entry.getCompressedSize());
+    int err(Z_OK);
+    while(err == Z_OK)
+    {
+        if(zs.avail_in == 0)
+        {
+            size_t const amount(std::min(remain, buffer.size()));
+            if(amount == 0
+            || !is.read(&buffer[0], amount))
+            {
+                break;
+            }
+            remain -= amount;
+            zs.next_in = reinterpret_cast<Bytef *>(&buffer[0]);
+            zs.avail_in = static_cast<uInt>(amount);
+        }
+        err = inflate(&zs, Z_NO_FLUSH);
+    }
+    bool const complete(err == Z_STREAM_END && zs.total_out == size);
+    inflateEnd(&zs);
+
+    if(!complete)
+    {
+        throw IOException("ZipFile::loadArena(): the data of \"" + entry.getName() + "\" does not inflate to its size.");
+    }
+}
+
+
+} // no name namespace
+
+
+
 /** \class ZipFile
  * \brief The ZipFile class represents a collection of files.
  *
@@ -273,17 +931,52 @@ namespace zipios
  */
 
 
+/** \enum ZipFile::AccessPattern
+ * \brief How the entries of a ZipFile are expected to be read.
+ *
+ * This enumeration is used with the setAccessPattern() function to
+ * tell the ZipFile how the input streams are going to be used so it
+ * can give the kernel hints about the data to keep in the page cache.
+ *
+ * \li NORMAL -- entries are read in any order, no hints are given
+ * \li SEQUENTIAL -- entries are read one after the other, in the order
+ *     of the entries() vector; the entries following the one being
+ *     opened get read ahead
+ * \li ONE_PASS -- like SEQUENTIAL, and the data of each entry gets
+ *     released from the page cache once its input stream is destroyed
+ *     so a full scan of the archive does not evict other data
+ */
+
+
 
 /** \brief Open a zip archive that was previously appended to another file.
  *
  * Opens a Zip archive embedded in another file, by writing the zip
- * archive to the end of the file followed by the start offset of
- * the zip file on 4 bytes. The offset must be written in zip-file
- * byte-order (little endian).
+ * archive to the end of the file followed by a trailer with the start
+ * offset of the zip file.
+ *
+ * The trailer is 12 bytes: the start offset on 8 bytes followed by
+ * the "ZE64" signature, all in zip-file byte-order (little endian).
+ * Older versions of appendzip wrote the start offset on 4 bytes
+ * without a signature; such files are still supported as long as
+ * the archive starts within the first 4Gb.
+ *
+ * \warning
+ * The 8 byte offset only lifts the limit on the size of the data
+ * preceding the archive. The archive itself is still a 32 bit Zip
+ * archive: Zipios does not support Zip64, so the entries, the offsets
+ * of the entries (relative to the start of the archive) and the
+ * central directory must all fit within 4Gb, and the archive can
+ * have at most 65535 entries.
  *
  * The program appendzip, which is part of the Zipios distribution can
  * be used to append a Zip archive to a file, e.g. a binary program.
  *
+ * \note
+ * The ZipFile constructor detects archives prefixed by other data
+ * by itself, so the trailer is not required to open such a file.
+ * It still gets used here since it also gives the end of the archive.
+ *
  * The function may throw various exception if the named file does not
  * seem to include a valid zip archive attached.
  *
@@ -292,20 +985,54 @@ namespace zipios
  * the appendzip tool can be used to append any number of files,
  * only the last one is accessible.
  *
+ * \exception IOException
+ * This exception is raised if the file cannot be opened or its
+ * trailer cannot be read.
+ *
+ * \param[in] name  The name of the file with the embedded archive.
+ *
  * \return A ZipFile that one can use to read compressed data.
  */
 ZipFile::pointer_t ZipFile::openEmbeddedZipFile(std::string const& name)
 {
-    // open zipfile, read 4 last bytes close file
-    // create ZipFile object.
-    uint32_t start_offset;
+    offset_t start_offset(0);
+    offset_t trailer_size(0);
     {
         std::ifstream ifs(name, std::ios::in | std::ios::binary);
-        ifs.seekg(-4, std::ios::end);
-        zipRead(ifs, start_offset);
-        // todo: add support for 64 bit (files of more than 4Gb)
+        if(!ifs)
+        {
+            throw IOException("ZipFile::openEmbeddedZipFile(): could not open the file.");
+        }
+        ifs.seekg(0, std::ios::end);
+        offset_t const size(ifs.tellg());
+
+        uint32_t signature(0);
+        if(size >= g_embedded_trailer_size)
+        {
+            ifs.seekg(-4, std::ios::end);
+            zipRead(ifs, signature);
+        }
+        if(signature == g_embedded_trailer_signature)
+        {
+            uint32_t low;
+            uint32_t high;
+            ifs.seekg(-g_embedded_trailer_size, std::ios::end);
+            zipRead(ifs, low);
+            zipRead(ifs, high);
+            start_offset = static_cast<offset_t>((static_cast<uint64_t>(high) << 32) | low);
+            trailer_size = g_embedded_trailer_size;
+        }
+        else
+        {
+            // legacy 32 bit trailer
+            uint32_t offset;
+            ifs.seekg(-4, std::ios::end);
+            zipRead(ifs, offset);
+            start_offset = offset;
+            trailer_size = 4;
+        }
     }
-    return ZipFile::pointer_t(new ZipFile(name, start_offset, 4));
+    return ZipFile::pointer_t(new ZipFile(name, start_offset, trailer_size));
 }
 
 
@@ -319,6 +1046,13 @@ ZipFile::pointer_t ZipFile::openEmbeddedZipFile(std::string const& name)
  */
 ZipFile::ZipFile()
     //: m_vs(...) -- auto-init
+    //, m_last_index(-1) -- auto-init
+    //, m_record_accesses(false) -- auto-init
+    //, m_access_profile() -- auto-init
+    //, m_accessed_entries() -- auto-init
+    //, m_index() -- auto-init
+    //, m_indexed_entries(0) -- auto-init
+    //, m_password() -- auto-init
 {
 }
 
@@ -327,12 +1061,21 @@ ZipFile::ZipFile()
  *
  * This constructor opens the named zip file. If the zip "file" is
  * embedded in a file that contains other data, e.g. a binary
- * program, the offset of the zip file start and end must be
+ * program, the offset of the zip file start and end can be
  * specified.
  *
+ * When the archive was simply appended to other data, the start
+ * offset does not need to be specified: the constructor compares
+ * the position of the End of Central Directory with the offset of
+ * the Central Directory it declares and skips the prefix.
+ *
  * If the file cannot be opened or the Zip directory cannot
  * be read, then the constructor throws an exception.
  *
+ * \exception FileCollectionException
+ * This exception is raised if the archive is a Zip64 archive, which
+ * Zipios does not support.
+ *
  * \param[in] filename  The filename of the zip file to open.
  * \param[in] s_off  Offset relative to the start of the file, that
  *                   indicates the beginning of the zip data in the file.
@@ -353,6 +1096,7 @@ ZipFile::ZipFile(std::string const& filename, offset_t s_off, offset_t e_off)
 
     // Find and read the End of Central Directory.
     ZipEndOfCentralDirectory eocd;
+    offset_t eocd_offset(0);
     {
         BackBuffer bb(zipfile, m_vs);
         ssize_t read_p(-1);
@@ -371,37 +1115,42 @@ ZipFile::ZipFile(std::string const& filename, offset_t s_off, offset_t e_off)
             if(eocd.read(bb, read_p))
             {
                 // found it!
+                m_vs.vseekg(zipfile, 0, std::ios::end);
+                eocd_offset = m_vs.vtellg(zipfile) - static_cast<offset_t>(bb.size() - read_p);
                 break;
             }
             --read_p;
         }
     }
 
-    // Position read pointer to start of first entry in central dir.
-    m_vs.vseekg(zipfile, eocd.getOffset(), std::ios::beg);
-
-    // TBD -- is that ", 0" still necessary? (With VC2012 and better)
-    // Give the second argument in the next line to keep Visual C++ quiet
-    //m_entries.resize(eocd.totalCount(), 0);
-    m_entries.resize(eocd.getCount());
-
-    size_t const max_entry(eocd.getCount());
-    for(size_t entry_num(0); entry_num < max_entry; ++entry_num)
+    // The number of entries and the offsets of a Zip64 archive are
+    // saved in Zip64 records which we do not support; the values found
+    // in the End of Central Directory are then truncated or 0xFFFF...
+    //
+    if(isZip64Archive(zipfile, m_vs, eocd_offset))
     {
-        m_entries[entry_num] = FileEntry::pointer_t(new ZipCentralDirectoryEntry);
-        m_entries[entry_num].get()->read(zipfile);
+        throw FileCollectionException("Zip64 archives (over 4Gb or more than 65535 entries) are not supported.");
     }
 
-    // Consistency check #1:
-    // The virtual seeker position is exactly the start offset of the
-    // Central Directory plus the Central Directory size
+    // The Central Directory ends where the End of Central Directory
+    // starts; if the archive was appended to other data (a self
+    // extracting archive, a binary with resources) the offsets saved
+    // in the archive are all off by the size of that prefix, which we
+    // can so compute and skip
     //
-    offset_t const pos(m_vs.vtellg(zipfile));
-    if(static_cast<offset_t>(eocd.getOffset() + eocd.getCentralDirectorySize()) != pos)
+    if(eocd.getCount() > 0)
     {
-        throw FileCollectionException("Zip file consistency problem. Zip file data fields are inconsistent with zip file layout.");
+        offset_t const cd_offset(eocd_offset - static_cast<offset_t>(eocd.getCentralDirectorySize()));
+        if(cd_offset > eocd.getOffset()
+        && !isCentralDirectoryAt(zipfile, m_vs, eocd.getOffset())
+        && isCentralDirectoryAt(zipfile, m_vs, cd_offset))
+        {
+            m_vs.setOffsets(m_vs.startOffset() + cd_offset - eocd.getOffset(), m_vs.endOffset());
+        }
     }
 
+    readCentralDirectory(zipfile, eocd);
+
     // Consistency check #2:
     // Are local headers consistent with CD headers?
     //
@@ -420,13 +1169,155 @@ ZipFile::ZipFile(std::string const& filename, offset_t s_off, offset_t e_off)
         {
             throw FileCollectionException("Zip file consistency problem. Zip file data fields are inconsistent with zip file layout.");
         }
+
+        // the data follows the local header, save its offset so opening
+        // the entry does not require reading that header again
+        (*it)->setDataOffset((*it)->getEntryOffset() + static_cast<std::streamoff>(zlh.getHeaderSize()));
     }
 
+    // all the entry streams read the archive through this one file
+    // descriptor instead of each opening the file
+    m_file = std::make_shared<SharedFile>(m_filename);
+
     // we are all good!
     m_valid = true;
 }
 
 
+/** \brief Read the central directory.
+ *
+ * The central directory is read in memory at once and parsed in two
+ * phases:
+ *
+ * \li A sequential pass finds the start of each record using the
+ * fixed 46 byte header and its three length fields. This is very fast
+ * since nothing gets copied.
+ *
+ * \li The records are decoded in chunks, in parallel when there are
+ * many of them. Each thread also computes the hash of the names of its
+ * records. Then the name index used by getEntry() is built, one shard
+ * per thread where each thread takes the names which hash falls in its
+ * shard.
+ *
+ * \note
+ * The parallel parsing is for archives with many entries but the
+ * number of records still comes from the 16 bit count of the End of
+ * Central Directory and the offsets are 32 bit, so an archive is
+ * limited to 65535 entries and 4Gb. Zip64 archives, which lift those
+ * limits, are rejected by the constructor before this function gets
+ * called.
+ *
+ * \exception IOException
+ * This exception is raised if the central directory cannot be read or
+ * a record does not have the central directory signature.
+ *
+ * \exception FileCollectionException
+ * This exception is raised if the records do not match the size of
+ * the central directory as defined in the End of Central Directory.
+ *
+ * \param[in,out] zipfile  The archive file.
+ * \param[in] eocd  The End of Central Directory of the archive.
+ */
+void ZipFile::readCentralDirectory(std::istream & zipfile, ZipEndOfCentralDirectory const & eocd)
+{
+    size_t const max_entry(eocd.getCount());
+    size_t const size(eocd.getCentralDirectorySize());
+
+    // make sure the size is sensible before allocating the buffer
+    m_vs.vseekg(zipfile, 0, std::ios::end);
+    offset_t const end(m_vs.vtellg(zipfile));
+    if(static_cast<offset_t>(eocd.getOffset() + size) > end)
+    {
+        throw FileCollectionException("Zip file consistency problem. Zip file data fields are inconsistent with zip file layout.");
+    }
+
+    // Position read pointer to start of first entry in central dir.
+    m_vs.vseekg(zipfile, eocd.getOffset(), std::ios::beg);
+    std::vector<char> buffer(size);
+    if(size > 0
+    && !zipfile.read(&buffer[0], size))
+    {
+        throw IOException("ZipFile::readCentralDirectory(): could not read the central directory.");
+    }
+
+    // phase 1: find the records
+    //
+    size_t const header_size(46);
+    auto read16 = [&buffer](size_t offset)
+    {
+        return static_cast<size_t>(static_cast<unsigned char>(buffer[offset]))
+             | (static_cast<size_t>(static_cast<unsigned char>(buffer[offset + 1])) << 8);
+    };
+    std::vector<size_t> offsets(max_entry);
+    size_t pos(0);
+    for(size_t entry_num(0); entry_num < max_entry; ++entry_num)
+    {
+        if(pos + header_size > size)
+        {
+            throw FileCollectionException("Zip file consistency problem. Zip file data fields are inconsistent with zip file layout.");
+        }
+        if(buffer[pos + 0] != 'P'
+        || buffer[pos + 1] != 'K'
+        || buffer[pos + 2] != 1
+        || buffer[pos + 3] != 2)
+        {
+            throw IOException("ZipFile::readCentralDirectory(): Expected Central Directory entry signature not found");
+        }
+        offsets[entry_num] = pos;
+        pos += header_size + read16(pos + 28) + read16(pos + 30) + read16(pos + 32);
+    }
+
+    // Consistency check #1:
+    // The records use exactly the size of the Central Directory
+    //
+    if(pos != size)
+    {
+        throw FileCollectionException("Zip file consistency problem. Zip file data fields are inconsistent with zip file layout.");
+    }
+
+    // phase 2: decode the records
+    //
+    size_t const thread_count(std::max(static_cast<size_t>(1)
+                            , std::min(static_cast<size_t>(std::max(std::thread::hardware_concurrency(), 1U))
+                                     , max_entry / g_records_per_thread)));
+    size_t const chunk_size((max_entry + thread_count - 1) / thread_count);
+    m_entries.resize(max_entry);
+    std::vector<size_t> hashes(max_entry);
+    runJobs(thread_count, [this, &buffer, &offsets, &hashes, max_entry, chunk_size](size_t chunk)
+        {
+            MemoryStreambuf sb(buffer.data(), buffer.size());
+            std::istream is(&sb);
+            std::hash<std::string> hash;
+            size_t const last(std::min(max_entry, (chunk + 1) * chunk_size));
+            for(size_t entry_num(chunk * chunk_size); entry_num < last; ++entry_num)
+            {
+                is.seekg(offsets[entry_num]);
+                FileEntry::pointer_t entry(new ZipCentralDirectoryEntry);
+                entry->read(is);
+                hashes[entry_num] = hash(entry->getName());
+                m_entries[entry_num] = entry;
+            }
+        });
+
+    // phase 3: build the index, one shard per thread
+    //
+    m_index.clear();
+    m_index.resize(thread_count);
+    runJobs(thread_count, [this, &hashes, thread_count](size_t shard)
+        {
+            index_shard_t & index(m_index[shard]);
+            for(size_t entry_num(0); entry_num < hashes.size(); ++entry_num)
+            {
+                if(hashes[entry_num] % thread_count == shard)
+                {
+                    index.insert(std::make_pair(hashes[entry_num], entry_num));
+                }
+            }
+        });
+    m_indexed_entries = max_entry;
+}
+
+
 /** \brief Create a clone of this ZipFile.
  *
  * This function creates a heap allocated clone of the ZipFile object.
@@ -450,6 +1341,102 @@ ZipFile::~ZipFile()
 }
 
 
+/** \brief Close the Zip archive.
+ *
+ * This function marks the collection as invalid and releases the
+ * file descriptor of the archive. Input streams that are still open
+ * keep a reference to the file and can still be read.
+ */
+void ZipFile::close()
+{
+    m_file.reset();
+
+    FileCollection::close();
+}
+
+
+/** \brief Get an entry from the archive.
+ *
+ * When searching the full name (MatchPath::MATCH), the function uses
+ * the index built while reading the central directory instead of
+ * checking each entry one after the other. Otherwise, or when entries
+ * were added to the collection, it falls back to the FileCollection
+ * implementation.
+ *
+ * \param[in] name  The name of the entry to search.
+ * \param[in] matchpath  Whether the full path or just the filename is matched.
+ *
+ * \return A shared pointer to the entry or nullptr if not found.
+ */
+FileEntry::pointer_t ZipFile::getEntry(std::string const & name, MatchPath matchpath) const
+{
+    mustBeValid();
+
+    if(matchpath != MatchPath::MATCH
+    || m_index.empty()
+    || m_indexed_entries != m_entries.size())
+    {
+        return FileCollection::getEntry(name, matchpath);
+    }
+
+    // with duplicates, the first entry is returned as with a linear search
+    size_t const hash(std::hash<std::string>()(name));
+    index_shard_t const & index(m_index[hash % m_index.size()]);
+    auto const range(index.equal_range(hash));
+    size_t found(m_entries.size());
+    for(auto it(range.first); it != range.second; ++it)
+    {
+        if(it->second < found
+        && m_entries[it->second]->getName() == name)
+        {
+            found = it->second;
+        }
+    }
+
+    return found == m_entries.size() ? FileEntry::pointer_t() : m_entries[found];
+}
+
+
+/** \brief Search the index of an entry in m_entries.
+ *
+ * When reading the entries sequentially, which is the case the access
+ * patterns are used for, the entry is the one following the entry
+ * returned last. Otherwise the index built while reading the central
+ * directory is used. Only entries added to the collection after it
+ * was read require a linear search.
+ *
+ * \param[in] entry  An entry of this ZipFile.
+ *
+ * \return The index of the entry in m_entries.
+ */
+size_t ZipFile::getEntryIndex(FileEntry::pointer_t const & entry) const
+{
+    size_t const next(m_last_index + 1);
+    if(next < m_entries.size()
+    && m_entries[next] == entry)
+    {
+        return next;
+    }
+
+    if(!m_index.empty()
+    && m_indexed_entries == m_entries.size())
+    {
+        size_t const hash(std::hash<std::string>()(entry->getName()));
+        index_shard_t const & index(m_index[hash % m_index.size()]);
+        auto const range(index.equal_range(hash));
+        for(auto it(range.first); it != range.second; ++it)
+        {
+            if(m_entries[it->second] == entry)
+            {
+                return it->second;
+            }
+        }
+    }
+
+    return std::find(m_entries.begin(), m_entries.end(), entry) - m_entries.begin();
+}
+
+
 /** \brief Retrieve a pointer to a file in the Zip archive.
  *
  * This function returns a shared pointer to an istream defined from the
@@ -475,6 +1462,10 @@ ZipFile::~ZipFile()
  * returns the uncompressed data transparently to you (outside of the
  * time it takes to decompress the data, of course.)
  *
+ * The stream starts reading at the data of the entry. Its offset was
+ * saved when the constructor verified the local headers so they do
+ * not get read again each time an entry is opened.
+ *
  * \param[in] entry_name  The name of the file to search in the collection.
  * \param[in] matchpath  Whether the full path or just the filename is matched.
  *
@@ -491,7 +1482,58 @@ ZipFile::stream_pointer_t ZipFile::getInputStream(std::string const& entry_name,
     FileEntry::pointer_t entry(getEntry(entry_name, matchpath));
     if(entry)
     {
-        stream_pointer_t zis(new ZipInputStream(m_filename, entry->getEntryOffset() + m_vs.startOffset()));
+        if(m_record_accesses
+        && m_accessed_entries.insert(entry->getName()).second)
+        {
+            m_access_profile.push_back(entry->getName());
+        }
+
+        std::shared_ptr<ZipInputStream> zis;
+        if(entry->getDataOffset() > 0)
+        {
+            ZipLocalEntry const & local_entry(static_cast<ZipLocalEntry const &>(*entry));
+            zis.reset(new ZipInputStream(m_file, local_entry, entry->getDataOffset() + m_vs.startOffset(), m_password));
+        }
+        else
+        {
+            zis.reset(new ZipInputStream(m_file, entry->getEntryOffset() + m_vs.startOffset(), m_password));
+        }
+
+        if(m_read_ahead_size > 0
+        && (entry->getMethod() == StorageMethod::DEFLATED
+            || entry->getMethod() == StorageMethod::AES))
+        {
+            zis->setReadAhead(m_read_ahead_size);
+        }
+
+        if(m_access_pattern != AccessPattern::NORMAL)
+        {
+            // ask the kernel to start reading this entry and the few
+            // that follow; when iterating sequentially, only the entries
+            // not yet advised get added to the list
+            //
+            size_t const index(getEntryIndex(entry));
+            m_last_index = index;
+            size_t const last(std::min(index + m_read_ahead_entries + 1, m_entries.size()));
+            size_t first(index);
+            if(first < m_advised_entries && m_advised_entries <= last)
+            {
+                first = m_advised_entries;
+            }
+            file_range_vector_t ranges;
+            for(size_t idx(first); idx < last; ++idx)
+            {
+                ranges.push_back(getPayloadRange(*m_entries[idx], m_vs.startOffset()));
+            }
+            m_file->advise(ranges, FileAdvice::WILLNEED);
+            m_advised_entries = last;
+
+            if(m_access_pattern == AccessPattern::ONE_PASS)
+            {
+                zis->setDropCacheOnClose(getPayloadRange(*entry, m_vs.startOffset()));
+            }
+        }
+
         return zis;
     }
 
@@ -500,34 +1542,444 @@ ZipFile::stream_pointer_t ZipFile::getInputStream(std::string const& entry_name,
 }
 
 
+/** \brief Decompress many entries at once in one buffer.
+ *
+ * This function decompresses all the entries for which \p filter
+ * returns true in a single allocation, the arena. The entries are
+ * saved one after the other in the order of the archive, without
+ * padding. The size of the arena is computed exactly from the
+ * uncompressed sizes found in the central directory.
+ *
+ * The returned arena_t includes the buffer, its size, and the offset
+ * and size of each entry in the buffer keyed by entry name. Directories
+ * are never loaded. If two entries have the same name, only the first
+ * one is loaded.
+ *
+ * The work is split in contiguous runs of entries of about the same
+ * compressed size, each decompressed by its own thread with its own
+ * file handle.
+ *
+ * \code
+ *      zipios::ZipFile::arena_t const assets(zf.loadArena(
+ *              [](zipios::FileEntry const & entry)
+ *              {
+ *                  return entry.getSize() < 64 * 1024;
+ *              }));
+ *      auto const it(assets.m_offsets.find("images/logo.png"));
+ *      char const * logo(assets.m_data.get() + it->second.first);
+ * \endcode
+ *
+ * \exception FileCollectionException
+ * This exception is raised if an entry uses an unsupported storage
+ * method.
+ *
+ * \exception IOException
+ * This exception is raised if an entry cannot be read or decompressed.
+ *
+ * \param[in] filter  The function selecting the entries to load.
+ * \param[in] thread_count  The number of threads, 0 to use one per CPU.
+ *
+ * \return The arena with the data of the selected entries.
+ */
+ZipFile::arena_t ZipFile::loadArena(entry_filter_t const & filter, size_t thread_count) const
+{
+    mustBeValid();
+
+    arena_t arena;
+    FileEntry::vector_t selected;
+    std::vector<size_t> offsets;
+    size_t total_compressed(0);
+    for(auto const & entry : m_entries)
+    {
+        if(entry->isDirectory()
+        || !filter(*entry))
+        {
+            continue;
+        }
+        if(!arena.m_offsets.insert(std::make_pair(entry->getName(), arena_t::range_t(arena.m_size, entry->getSize()))).second)
+        {
+            continue;
+        }
+        selected.push_back(entry);
+        offsets.push_back(arena.m_size);
+        arena.m_size += entry->getSize();
+        total_compressed += entry->getCompressedSize();
+    }
+    arena.m_data.reset(new char[arena.m_size]);
+
+    if(thread_count == 0)
+    {
+        thread_count = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    thread_count = std::max(static_cast<size_t>(1), std::min(thread_count, selected.size()));
+
+    // split the entries in runs of about the same compressed size
+    std::vector<size_t> runs(1, 0);
+    size_t const run_size(total_compressed / thread_count + 1);
+    size_t run_compressed(0);
+    for(size_t idx(0); idx < selected.size(); ++idx)
+    {
+        run_compressed += selected[idx]->getCompressedSize();
+        if(run_compressed >= run_size
+        && runs.size() < thread_count)
+        {
+            runs.push_back(idx + 1);
+            run_compressed = 0;
+        }
+    }
+    runs.push_back(selected.size());
+
+    offset_t const start_offset(m_vs.startOffset());
+    std::string const & filename(m_filename);
+    char * data(arena.m_data.get());
+    runJobs(runs.size() - 1, [&runs, &selected, &offsets, &filename, start_offset, data](size_t run)
+        {
+            std::ifstream is(filename, std::ios::in | std::ios::binary);
+            if(!is)
+            {
+                throw IOException("ZipFile::loadArena(): could not open \"" + filename + "\".");
+            }
+            std::vector<char> buffer(64 * 1024);
+            for(size_t idx(runs[run]); idx < runs[run + 1]; ++idx)
+            {
+                loadArenaEntry(is, start_offset, *selected[idx], data + offsets[idx], buffer);
+            }
+        });
+
+    return arena;
+}
+
+
+/** \brief Start reading the data of the specified entries.
+ *
+ * This function asks the kernel to start reading the data of all the
+ * specified entries in the page cache. The function returns immediately,
+ * the reading happens in the background. This is useful when you are
+ * about to read a large number of entries in bulk.
+ *
+ * The entries are expected to be entries of this ZipFile, as returned
+ * by the entries() or getEntry() functions.
+ *
+ * \note
+ * This is only a hint. On systems that do not support such hints,
+ * the function does nothing.
+ *
+ * \param[in] entries  The entries that are about to be read.
+ *
+ * \sa setAccessPattern()
+ */
+void ZipFile::prefetch(FileEntry::vector_t const & entries) const
+{
+    mustBeValid();
+
+    file_range_vector_t ranges;
+    ranges.reserve(entries.size());
+    for(auto it(entries.begin()); it != entries.end(); ++it)
+    {
+        ranges.push_back(getPayloadRange(**it, m_vs.startOffset()));
+    }
+    m_file->advise(ranges, FileAdvice::WILLNEED);
+}
+
+
+/** \brief Define how the entries of this ZipFile are going to be read.
+ *
+ * By default, the ZipFile does not give the kernel any hint about the
+ * data it is going to read. When you read all the entries one after
+ * the other, call this function with AccessPattern::SEQUENTIAL. Each
+ * time getInputStream() is called, the data of the entry and the data
+ * of the next \p read_ahead_entries entries is read in the background
+ * so reading the next entry does not stall on I/O.
+ *
+ * If the archive is read only once, use AccessPattern::ONE_PASS. That
+ * also releases the pages of an entry from the page cache once its
+ * input stream gets destroyed. That way, scanning a large archive does
+ * not evict more important data from the cache.
+ *
+ * \param[in] pattern  The expected access pattern.
+ * \param[in] read_ahead_entries  The number of entries to read ahead
+ *                                of the one being opened.
+ *
+ * \sa prefetch()
+ */
+void ZipFile::setAccessPattern(AccessPattern pattern, size_t read_ahead_entries)
+{
+    m_access_pattern = pattern;
+    m_read_ahead_entries = read_ahead_entries;
+    m_advised_entries = 0;
+}
+
+
+/** \brief Overlap the reading and the decompression of entries.
+ *
+ * By default, the input streams returned by getInputStream() read
+ * a small chunk of compressed data, decompress it, then read the next
+ * chunk, and so on. On slow devices (i.e. network attached volumes)
+ * the decompression spends a lot of time waiting on the I/O.
+ *
+ * When the read-ahead is turned on, the input stream of a compressed
+ * entry uses a background thread which reads the next chunk of data
+ * while the current one gets decompressed. Reading a large entry then
+ * takes about the longest of the I/O and the decompression times
+ * instead of their sum.
+ *
+ * The feature has no effect on entries that are not compressed.
+ *
+ * \note
+ * The setting only applies to input streams created after this call.
+ *
+ * \param[in] buffer_size  The size of each one of the two read buffers
+ *                         used by each input stream. A larger size
+ *                         means fewer exchanges between the threads.
+ *                         Use 0 to turn the read-ahead off (the default.)
+ */
+void ZipFile::setReadAhead(size_t buffer_size)
+{
+    m_read_ahead_size = buffer_size;
+}
+
+
+/** \brief Define the password of encrypted entries.
+ *
+ * Entries encrypted with WinZip AES (storage method 99) can only be
+ * read once the password is known. The data gets decrypted on the
+ * fly by the input streams returned by getInputStream(), and its
+ * authentication code is verified once the whole entry was read.
+ *
+ * Opening an encrypted entry without a password, or with the wrong
+ * password, raises a FileCollectionException.
+ *
+ * \note
+ * The password only applies to input streams created after this call.
+ *
+ * \param[in] password  The password of the encrypted entries.
+ */
+void ZipFile::setPassword(std::string const & password)
+{
+    m_password = password;
+}
+
+
+/** \brief Record the order in which the entries get opened.
+ *
+ * While recording is on, the name of each entry opened with
+ * getInputStream() gets appended to the access profile, the first
+ * time it gets opened only.
+ *
+ * Run a workload, such as the startup of an application, with the
+ * recording on, then pass the profile to
+ * ZipOutputOptions::setAccessProfile() when building the next version
+ * of the archive. The entries of that workload then get written one
+ * after the other at the start of the archive.
+ *
+ * Turning the recording off keeps the profile recorded so far.
+ * Turning it back on continues that same profile.
+ *
+ * \param[in] record  Whether the accesses get recorded.
+ *
+ * \sa getAccessProfile()
+ * \sa saveAccessProfile()
+ */
+void ZipFile::setAccessRecording(bool record)
+{
+    m_record_accesses = record;
+}
+
+
+/** \brief Retrieve the recorded access profile.
+ *
+ * \return The names of the entries opened while recording, in order.
+ *
+ * \sa setAccessRecording()
+ */
+std::vector<std::string> const & ZipFile::getAccessProfile() const
+{
+    return m_access_profile;
+}
+
+
+/** \brief Save the recorded access profile in a file.
+ *
+ * The file gets one entry name per line. It can be loaded back
+ * with ZipOutputOptions::loadAccessProfile().
+ *
+ * \exception IOException
+ * This exception is raised if the file cannot be written.
+ *
+ * \param[in] filename  The name of the file to create.
+ *
+ * \sa setAccessRecording()
+ */
+void ZipFile::saveAccessProfile(std::string const & filename) const
+{
+    std::ofstream out(filename, std::ios::out | std::ios::trunc);
+    for(auto const & name : m_access_profile)
+    {
+        out << name << '\n';
+    }
+    out.close();
+    if(!out)
+    {
+        throw IOException("ZipFile::saveAccessProfile(): could not save \"" + filename + "\".");
+    }
+}
+
+
 /** \brief Create a Zip archive from the specified FileCollection.
  *
  * This function is expected to be used with a DirectoryCollection
  * that you created to save the collection in an archive.
  *
+ * The \p options can be used to change the way the archive gets
+ * written. See the ZipOutputOptions class for details.
+ *
+ * When \p os is a DirectFileOutputStream, the space required by the
+ * archive is preallocated first.
+ *
+ * When the \p options name a previous archive, the files which did
+ * not change since that archive was created get their compressed data
+ * copied from it instead of being compressed again.
+ *
+ * When the \p options name a blob cache, deflated files get their
+ * compressed data copied from that cache, which gets populated on
+ * a miss.
+ *
+ * When the \p options include an access profile, the entries it names
+ * are written first, in that order.
+ *
+ * When the \p options request several compression threads, the data
+ * of the deflated files gets compressed in parallel, in chunks.
+ *
+ * When the \p options define a compression budget, in throughput or
+ * in time, the compression level gets selected to meet that budget.
+ *
+ * \exception IOException
+ * This exception is raised if the previous archive cannot be read.
+ *
  * \param[in,out] os  The output stream where the Zip archive is saed.
  * \param[in] collection  The collection to save in this output stream.
  * \param[in] zip_comment  The global comment of the Zip archive.
+ * \param[in] options  The options used to write the archive.
  */
-void ZipFile::saveCollectionToArchive(std::ostream & os, FileCollection & collection, std::string const & zip_comment)
+void ZipFile::saveCollectionToArchive(std::ostream & os, FileCollection & collection, std::string const & zip_comment, ZipOutputOptions const & options)
 {
     try
     {
-        ZipOutputStream output_stream(os);
+        FileEntry::vector_t entries(collection.entries());
+        if(!options.getAccessProfile().empty())
+        {
+            orderEntries(entries, options.getAccessProfile());
+        }
+
+        DirectFileOutputStream * direct(dynamic_cast<DirectFileOutputStream *>(&os));
+        if(direct != nullptr)
+        {
+            direct->preallocate(estimateArchiveSize(entries, zip_comment, options.getStoredAlignment()));
+        }
+
+        // when rebuilding, the unchanged entries get copied from the
+        // previous archive instead of being compressed again
+        //
+        previous_entries_t previous_entries;
+        std::ifstream previous_is;
+        offset_t previous_start(0);
+        if(!options.getPreviousArchive().empty()
+        && options.getPassword().empty()
+        && options.getDigestAlgorithms().empty())
+        {
+            ZipFile previous(options.getPreviousArchive());
+            FileEntry::vector_t const old_entries(previous.entries());
+            for(auto const & e : old_entries)
+            {
+                previous_entries[e->getName()] = e;
+            }
+            previous_is.open(options.getPreviousArchive(), std::ios::in | std::ios::binary);
+            previous_start = previous.m_vs.startOffset();
+        }
+
+        // the blob cache avoids compressing the same data again
+        //
+        std::unique_ptr<BlobCache> blob_cache;
+        hard_links_t hard_links;
+        hard_links_t * hard_links_ptr(nullptr);
+        if(!options.getBlobCache().empty()
+        && options.getPassword().empty()
+        && options.getDigestAlgorithms().empty())
+        {
+            blob_cache.reset(new BlobCache(options.getBlobCache(), options.getRsyncable()));
+            if(dynamic_cast<DirectoryCollection *>(&collection) != nullptr)
+            {
+                hard_links_ptr = &hard_links;
+            }
+        }
+
+        // a time budget gets converted in a throughput per thread
+        //
+        ZipOutputOptions effective_options(options);
+        if(options.getCompressionTimeBudget() > 0.0)
+        {
+            size_t total(0);
+            for(auto const & e : entries)
+            {
+                if(!e->isDirectory()
+                && e->getMethod() == StorageMethod::DEFLATED
+                && e->getLevel() != FileEntry::COMPRESSION_LEVEL_NONE)
+                {
+                    total += e->getSize();
+                }
+            }
+            effective_options.setCompressionBudget(static_cast<double>(total)
+                        / options.getCompressionTimeBudget()
+                        / static_cast<double>(std::max(options.getCompressionThreads(), static_cast<size_t>(1))));
+        }
+
+        ZipOutputStream output_stream(os, effective_options);
 
         output_stream.setComment(zip_comment);
 
-        FileEntry::vector_t entries(collection.entries());
-        for(auto it(entries.begin()); it != entries.end(); ++it)
+        if(options.getCompressionThreads() > 1
+        && options.getPassword().empty()
+        && options.getDigestAlgorithms().empty()
+        && !options.getRsyncable()
+        && options.getPreviousArchive().empty()
+        && blob_cache == nullptr)
         {
-            output_stream.putNextEntry(*it);
-            // get an InputStream if available (i.e. directories do not have an input stream)
-            if(!(*it)->isDirectory())
+            saveEntriesInParallel(output_stream, collection, entries, options.getCompressionThreads(), effective_options.getCompressionBudget());
+        }
+        else
+        {
+            for(auto it(entries.begin()); it != entries.end(); ++it)
             {
-                FileCollection::stream_pointer_t is(collection.getInputStream((*it)->getName()));
-                if(is)
+                if(!previous_entries.empty()
+                && copyPreviousEntry(output_stream, collection, *it, previous_entries, previous_is, previous_start, options.getVerifyPreviousCrc()))
+                {
+                    continue;
+                }
+
+                if(blob_cache != nullptr
+                && copyCachedEntry(output_stream, collection, *it, *blob_cache, hard_links_ptr))
                 {
-                    output_stream << is->rdbuf();
+                    continue;
+                }
+
+                output_stream.putNextEntry(*it);
+                // get an InputStream if available (i.e. directories do not have an input stream)
+                if(!(*it)->isDirectory())
+                {
+                    FileCollection::stream_pointer_t is(collection.getInputStream((*it)->getName()));
+                    // inserting an empty file would set the failbit and
+                    // the data of the following entries would be ignored
+                    if(is
+                    && is->peek() != std::istream::traits_type::eof())
+                    {
+                        output_stream << is->rdbuf();
+                    }
+
+                    if(options.getDigestCallback())
+                    {
+                        output_stream.closeEntry();
+                        options.getDigestCallback()(*it, output_stream.getDigests());
+                    }
                 }
             }
         }
@@ -58,11 +58,66 @@ namespace zipios
  *
  * \param[in] filename  The name of a valid zip file.
  * \param[in] pos position to reposition the istream to before reading.
+ * \param[in] password  The password of WinZip AES encrypted entries.
  */
-ZipInputStream::ZipInputStream(std::string const& filename, std::streampos pos)
+ZipInputStream::ZipInputStream(std::string const& filename, std::streampos pos, std::string const & password)
     : std::istream(nullptr)
+    , m_filename(filename)
+    //, m_drop_range(0, 0) -- auto-init
+    //, m_file() -- auto-init
     , m_ifs(new std::ifstream(filename, std::ios::in | std::ios::binary))
-    , m_izf(new ZipInputStreambuf(m_ifs->rdbuf(), pos))
+    //, m_sfb() -- auto-init
+    , m_izf(new ZipInputStreambuf(m_ifs->rdbuf(), pos, password))
+{
+    // properly initialize the stream with the newly allocated buffer
+    init(m_izf.get());
+}
+
+
+/** \brief Initialize a ZipInputStream from a shared file and position.
+ *
+ * This constructor creates a ZIP file stream which reads an already
+ * opened file. Many streams can share the same file: each one only
+ * keeps its own position and a very small buffer instead of opening
+ * the file with an std::ifstream.
+ *
+ * \param[in] file  The zip file to read.
+ * \param[in] pos position to reposition the istream to before reading.
+ * \param[in] password  The password of WinZip AES encrypted entries.
+ */
+ZipInputStream::ZipInputStream(SharedFile::pointer_t file, std::streampos pos, std::string const & password)
+    : std::istream(nullptr)
+    , m_filename(file->getFilename())
+    //, m_drop_range(0, 0) -- auto-init
+    , m_file(file)
+    //, m_ifs() -- auto-init
+    , m_sfb(new SharedFileStreambuf(file))
+    , m_izf(new ZipInputStreambuf(m_sfb.get(), pos, password))
+{
+    // properly initialize the stream with the newly allocated buffer
+    init(m_izf.get());
+}
+
+
+/** \brief Initialize a ZipInputStream at the data of an entry.
+ *
+ * This constructor is used when the position of the data of the
+ * entry is already known. The local header does not get read again,
+ * the parameters of the \p entry are used instead.
+ *
+ * \param[in] file  The zip file to read.
+ * \param[in] entry  The central directory entry to read.
+ * \param[in] data_pos  The position of the data of the entry.
+ * \param[in] password  The password of WinZip AES encrypted entries.
+ */
+ZipInputStream::ZipInputStream(SharedFile::pointer_t file, ZipLocalEntry const & entry, std::streampos data_pos, std::string const & password)
+    : std::istream(nullptr)
+    , m_filename(file->getFilename())
+    //, m_drop_range(0, 0) -- auto-init
+    , m_file(file)
+    //, m_ifs() -- auto-init
+    , m_sfb(new SharedFileStreambuf(file))
+    , m_izf(new ZipInputStreambuf(m_sfb.get(), entry, data_pos, password))
 {
     // properly initialize the stream with the newly allocated buffer
     init(m_izf.get());
@@ -73,9 +128,61 @@ ZipInputStream::ZipInputStream(std::string const& filename, std::streampos pos)
  *
  * The destructor ensures that all resources used by the class get
  * released.
+ *
+ * If a range was defined with setDropCacheOnClose(), the kernel is
+ * told that the pages of that range are not needed anymore.
  */
 ZipInputStream::~ZipInputStream()
 {
+    if(m_drop_range.second > 0)
+    {
+        // release the streams before giving the advice
+        m_izf.reset();
+        m_sfb.reset();
+        m_ifs.reset();
+
+        file_range_vector_t ranges;
+        ranges.push_back(m_drop_range);
+        if(m_file != nullptr)
+        {
+            m_file->advise(ranges, FileAdvice::DONTNEED);
+        }
+        else
+        {
+            adviseFile(m_filename, ranges, FileAdvice::DONTNEED);
+        }
+    }
+}
+
+
+/** \brief Release the data of this entry from the cache once done.
+ *
+ * When an archive is read only once, keeping its data in the page cache
+ * is a waste and it evicts data that other processes may need. This
+ * function saves the range of the file this input stream reads so
+ * the destructor can tell the kernel that it can drop those pages.
+ *
+ * \param[in] range  The range of bytes read by this input stream.
+ */
+void ZipInputStream::setDropCacheOnClose(file_range_t const & range)
+{
+    m_drop_range = range;
+}
+
+
+/** \brief Read the compressed data ahead of the decompression.
+ *
+ * This function turns on the read-ahead thread of the input
+ * stream buffer. It has to be called before reading any data.
+ *
+ * \param[in] buffer_size  The size of the read-ahead buffers, 0 turns
+ *                         the feature off.
+ *
+ * \sa InflateInputStreambuf::setReadAhead()
+ */
+void ZipInputStream::setReadAhead(size_t buffer_size)
+{
+    m_izf->setReadAhead(buffer_size);
 }
 
 
@@ -32,8 +32,11 @@
  * have been compressed using the zlib library.
  */
 
+#include "sharedfilestreambuf.hpp"
 #include "zipinputstreambuf.hpp"
 
+#include "zipios_common.hpp"
+
 
 namespace zipios
 {
@@ -43,13 +46,23 @@ namespace zipios
 class ZipInputStream : public std::istream
 {
 public:
-                    ZipInputStream(std::string const& filename, std::streampos pos = 0);
+                    ZipInputStream(std::string const& filename, std::streampos pos = 0, std::string const & password = std::string());
+                    ZipInputStream(SharedFile::pointer_t file, std::streampos pos = 0, std::string const & password = std::string());
+                    ZipInputStream(SharedFile::pointer_t file, ZipLocalEntry const & entry, std::streampos data_pos, std::string const & password = std::string());
                     ZipInputStream(ZipInputStream const& src) = delete;
                     ZipInputStream const& operator = (ZipInputStream const& src) = delete;
     virtual         ~ZipInputStream() override;
 
+    void            setDropCacheOnClose(file_range_t const & range);
+    void            setReadAhead(size_t buffer_size);
+
 private:
+    std::string                         m_filename;
+    file_range_t                        m_drop_range = file_range_t(0, 0);
+    SharedFile::pointer_t               m_file;
     std::unique_ptr<std::ifstream>      m_ifs;
+    std::unique_ptr<SharedFileStreambuf>
+                                        m_sfb;
     std::unique_ptr<ZipInputStreambuf>  m_izf;
 };
 
@@ -40,6 +40,10 @@ namespace zipios
  * The ZipInputStreambuf class is a Zip input streambuf filter that
  * automatically decompresses input data that was compressed using
  * the zlib library.
+ *
+ * STORED entries never allocate the zlib state. Their buffer gets
+ * allocated on the first read, it is not larger than the entry, and
+ * it is released once the whole entry was read.
  */
 
 
@@ -48,13 +52,22 @@ namespace zipios
  * This ZipInputStreambuf constructor initializes the buffer from the
  * user specified buffer.
  *
+ * When the entry is encrypted with WinZip AES, the \p password is
+ * used to decrypt its data.
+ *
+ * \exception FileCollectionException
+ * This exception is raised if the entry uses an unsupported storage
+ * method or is encrypted and the password is missing or wrong.
+ *
  * \param[in,out] inbuf  The streambuf to use for input.
  * \param[in] start_pos  A position to reset the inbuf to before reading.
  *                       Specify -1 to read from the current position.
+ * \param[in] password  The password of encrypted entries.
  */
-ZipInputStreambuf::ZipInputStreambuf(std::streambuf *inbuf, offset_t start_pos)
+ZipInputStreambuf::ZipInputStreambuf(std::streambuf *inbuf, offset_t start_pos, std::string const & password)
     : InflateInputStreambuf(inbuf, start_pos)
-    //, m_current_entry() -- auto-init
+    //, m_method(StorageMethod::STORED) -- auto-init
+    //, m_decrypt() -- auto-init
     //, m_remain(0) -- auto-init
 {
     // read the zip local header
@@ -62,31 +75,39 @@ ZipInputStreambuf::ZipInputStreambuf(std::streambuf *inbuf, offset_t start_pos)
     is.exceptions(std::ios::eofbit | std::ios::failbit | std::ios::badbit);
 
     // if the read fails in any way it will throw
-    m_current_entry.read(is);
-    if(m_current_entry.isValid() && m_current_entry.hasTrailingDataDescriptor())
-    {
-        throw FileCollectionException("Trailing data descriptor in zip file not supported");
-    }
-
-    switch(m_current_entry.getMethod())
-    {
-    case StorageMethod::DEFLATED:
-        reset() ; // reset inflatestream data structures
-//std::cerr << "deflated" << std::endl;
-        break;
+    ZipLocalEntry local_entry;
+    local_entry.read(is);
+    startEntry(local_entry, is, password);
+}
 
-    case StorageMethod::STORED:
-        m_remain = m_current_entry.getSize();
-        // Force underflow on first read:
-        setg(&m_outvec[0], &m_outvec[0] + getBufferSize(), &m_outvec[0] + getBufferSize());
-//std::cerr << "stored" << std::endl;
-        break;
 
-    default:
-        // file not supported... sorry!
-        throw FileCollectionException("Unsupported compression format");
+/** \brief Initialize a ZipInputStreambuf at the data of an entry.
+ *
+ * This ZipInputStreambuf constructor starts reading the data of the
+ * entry directly, without reading its local header again. The
+ * \p entry parameters, such as its storage method and sizes, are used
+ * instead. It is expected to be the central directory entry, which
+ * was already verified against the local header.
+ *
+ * \exception FileCollectionException
+ * This exception is raised if the entry uses an unsupported storage
+ * method or is encrypted and the password is missing or wrong.
+ *
+ * \param[in,out] inbuf  The streambuf to use for input.
+ * \param[in] entry  The entry to read.
+ * \param[in] data_pos  The position of the data of the entry in inbuf.
+ * \param[in] password  The password of encrypted entries.
+ */
+ZipInputStreambuf::ZipInputStreambuf(std::streambuf * inbuf, ZipLocalEntry const & entry, offset_t data_pos, std::string const & password)
+    : InflateInputStreambuf(inbuf, data_pos)
+    //, m_method(StorageMethod::STORED) -- auto-init
+    //, m_decrypt() -- auto-init
+    //, m_remain(0) -- auto-init
+{
+    std::istream is(m_inbuf); // istream does not destroy the streambuf.
+    is.exceptions(std::ios::eofbit | std::ios::failbit | std::ios::badbit);
 
-    }
+    startEntry(entry, is, password);
 }
 
 
@@ -107,6 +128,8 @@ ZipInputStreambuf::ZipInputStreambuf(std::streambuf *inbuf, offset_t start_pos)
  */
 ZipInputStreambuf::~ZipInputStreambuf()
 {
+    // the read-ahead thread may be reading from m_decrypt
+    stopReadAhead();
 }
 
 
@@ -121,7 +144,7 @@ ZipInputStreambuf::~ZipInputStreambuf()
  */
 std::streambuf::int_type ZipInputStreambuf::underflow()
 {
-    switch(m_current_entry.getMethod())
+    switch(m_method)
     {
     case StorageMethod::DEFLATED:
         // inflate class takes care of it in this case
@@ -130,17 +153,24 @@ std::streambuf::int_type ZipInputStreambuf::underflow()
     case StorageMethod::STORED:
     {
         // Ok, we are STORED, so we handle it ourselves.
-        offset_t const num_b(std::min(m_remain, static_cast<offset_t>(getBufferSize())));
-        std::streamsize const g(m_inbuf->sgetn(&m_outvec[0], num_b));
-        setg(&m_outvec[0], &m_outvec[0], &m_outvec[0] + g);
+        if(m_remain > 0 && m_outvec.empty())
+        {
+            m_outvec.resize(std::min(m_remain, static_cast<offset_t>(getBufferSize())));
+        }
+        offset_t const num_b(std::min(m_remain, static_cast<offset_t>(m_outvec.size())));
+        std::streamsize const g(num_b > 0 ? m_inbuf->sgetn(&m_outvec[0], num_b) : 0);
         m_remain -= g;
         if(g > 0)
         {
             // we got some data, return it
+            setg(&m_outvec[0], &m_outvec[0], &m_outvec[0] + g);
             return traits_type::to_int_type(*gptr());
         }
 
-        // documentation says to return EOF if no data available
+        // documentation says to return EOF if no data available;
+        // the buffer is not needed anymore
+        std::vector<char>().swap(m_outvec);
+        setg(nullptr, nullptr, nullptr);
         return traits_type::eof();
     }
 
@@ -153,6 +183,109 @@ std::streambuf::int_type ZipInputStreambuf::underflow()
 }
 
 
+/** \brief Prepare the reading of the data of an entry.
+ *
+ * This function checks that the \p entry is supported and prepares
+ * the buffer to read its data according to its storage method. The
+ * input streambuf must be positioned at the start of the data.
+ *
+ * \exception FileCollectionException
+ * This exception is raised if the entry uses an unsupported storage
+ * method or is encrypted and the password is missing or wrong.
+ *
+ * \param[in] entry  The entry to read.
+ * \param[in,out] is  The stream positioned at the start of the data.
+ * \param[in] password  The password of encrypted entries.
+ */
+void ZipInputStreambuf::startEntry(ZipLocalEntry const & entry, std::istream & is, std::string const & password)
+{
+    if(entry.isValid() && entry.hasTrailingDataDescriptor())
+    {
+        throw FileCollectionException("Trailing data descriptor in zip file not supported");
+    }
+
+    m_method = entry.getMethod();
+    if(m_method == StorageMethod::AES)
+    {
+        startDecryption(entry, is, password);
+    }
+
+    switch(m_method)
+    {
+    case StorageMethod::DEFLATED:
+        reset() ; // reset inflatestream data structures
+        limitBufferSizes(entry.getCompressedSize(), entry.getSize());
+//std::cerr << "deflated" << std::endl;
+        break;
+
+    case StorageMethod::STORED:
+        m_remain = entry.getSize();
+        // Force underflow on first read, which allocates the buffer:
+        setg(nullptr, nullptr, nullptr);
+//std::cerr << "stored" << std::endl;
+        break;
+
+    default:
+        // file not supported... sorry!
+        throw FileCollectionException("Unsupported compression format");
+
+    }
+}
+
+
+/** \brief Prepare the decryption of a WinZip AES entry.
+ *
+ * This function reads the salt and the password verifier saved before
+ * the encrypted data, derives the keys from the \p password, and
+ * inserts an AESInputStreambuf between the input streambuf and the
+ * decompression. The storage method becomes the real method of the
+ * entry as found in its AES extra field.
+ *
+ * \exception FileCollectionException
+ * This exception is raised if the AES extra field is missing or
+ * invalid, or if the password is missing or wrong.
+ *
+ * \param[in] entry  The encrypted entry.
+ * \param[in,out] is  The stream positioned after the local header.
+ * \param[in] password  The password of the entry.
+ */
+void ZipInputStreambuf::startDecryption(ZipLocalEntry const & entry, std::istream & is, std::string const & password)
+{
+    WinZipAES::extra_field_t field;
+    if(!WinZipAES::readExtraField(entry.getExtra(), field)
+    || field.m_strength < 1
+    || field.m_strength > 3)
+    {
+        throw FileCollectionException("AES encrypted entry without a valid AES extra field");
+    }
+    if(password.empty())
+    {
+        throw FileCollectionException("A password is required to read an AES encrypted entry");
+    }
+
+    std::vector<uint8_t> salt(WinZipAES::getSaltSize(field.m_strength));
+    WinZipAES::verifier_t verifier;
+    is.read(reinterpret_cast<char *>(&salt[0]), salt.size());
+    is.read(reinterpret_cast<char *>(verifier.data()), verifier.size());
+
+    size_t const overhead(salt.size() + verifier.size() + WinZipAES::mac_t().size());
+    if(entry.getCompressedSize() < overhead)
+    {
+        throw FileCollectionException("AES encrypted entry too small");
+    }
+
+    WinZipAES::pointer_t aes(new WinZipAES(password, &salt[0], field.m_strength));
+    if(aes->getVerifier() != verifier)
+    {
+        throw FileCollectionException("Wrong password for AES encrypted entry");
+    }
+
+    m_decrypt.reset(new AESInputStreambuf(m_inbuf, std::move(aes), entry.getCompressedSize() - overhead));
+    m_inbuf = m_decrypt.get();
+    m_method = field.m_method;
+}
+
+
 } // namespace
 
 // Local Variables:
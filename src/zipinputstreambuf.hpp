@@ -30,6 +30,7 @@
  * used to read the data of files found in a Zip archive.
  */
 
+#include "aesinputstreambuf.hpp"
 #include "inflateinputstreambuf.hpp"
 
 #include "ziplocalentry.hpp"
@@ -42,7 +43,8 @@ namespace zipios
 class ZipInputStreambuf : public InflateInputStreambuf
 {
 public:
-                            ZipInputStreambuf(std::streambuf * inbuf, offset_t start_pos = -1);
+                            ZipInputStreambuf(std::streambuf * inbuf, offset_t start_pos = -1, std::string const & password = std::string());
+                            ZipInputStreambuf(std::streambuf * inbuf, ZipLocalEntry const & entry, offset_t data_pos, std::string const & password = std::string());
                             ZipInputStreambuf(ZipInputStreambuf const & src) = delete;
     ZipInputStreambuf &     operator = (ZipInputStreambuf const & rhs) = delete;
     virtual                 ~ZipInputStreambuf() override;
@@ -51,7 +53,12 @@ protected:
     virtual std::streambuf::int_type    underflow() override;
 
 private:
-    ZipLocalEntry           m_current_entry;
+    void                    startEntry(ZipLocalEntry const & entry, std::istream & is, std::string const & password);
+    void                    startDecryption(ZipLocalEntry const & entry, std::istream & is, std::string const & password);
+
+    StorageMethod           m_method = StorageMethod::STORED;
+    std::unique_ptr<AESInputStreambuf>
+                            m_decrypt;
     offset_t                m_remain = 0;     // For STORED entry only. the number of bytes that
                                               // has not been put in the m_outvec yet.
 };
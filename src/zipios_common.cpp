@@ -31,6 +31,19 @@
 
 #include "zipios/zipiosexceptions.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#if !defined(ZIPIOS_WINDOWS) && (defined(_WINDOWS) || defined(WIN32) || defined(_WIN32) || defined(__WIN32))
+#define ZIPIOS_WINDOWS
+#endif
+
+#ifndef ZIPIOS_WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 
 namespace zipios
 {
@@ -71,6 +84,213 @@ char const g_separator = '/';
  */
 
 
+/** \enum FileAdvice
+ * \brief The kind of page cache hint passed to adviseFile().
+ *
+ * \li NORMAL -- no special treatment, the kernel default
+ * \li SEQUENTIAL -- the ranges are going to be read once, front to back
+ * \li WILLNEED -- the ranges are about to be read, start reading them now
+ * \li DONTNEED -- the ranges were read and are not needed anymore
+ */
+
+
+/** \typedef std::pair<offset_t, offset_t> file_range_t;
+ * \brief A range of bytes in a file.
+ *
+ * The first member is the offset of the range in the file and the second
+ * member is its length in bytes.
+ */
+
+
+/** \brief Give the kernel a hint about how a file is going to be accessed.
+ *
+ * This function opens \p filename and applies \p advice to each one
+ * of the \p ranges with posix_fadvise(). Contiguous and overlapping
+ * ranges are merged first so a large set of small entries results in
+ * a small number of system calls.
+ *
+ * The WILLNEED advice starts an asynchronous read of the ranges in the
+ * page cache. The kernel does the work in the background so the caller
+ * does not have to wait for the data and no additional thread is
+ * required. The DONTNEED advice releases the pages, which is useful
+ * to not evict other, more important, data from the cache when an
+ * archive is read only once.
+ *
+ * The advice is only a hint. Any error is ignored and on systems
+ * without posix_fadvise() this function does nothing.
+ *
+ * \note
+ * The SEQUENTIAL advice applies to the file descriptor used to give
+ * the advice. Since that descriptor is closed before the function
+ * returns, it is transformed in a WILLNEED on the specified ranges.
+ *
+ * \param[in] filename  The name of the file receiving the advice.
+ * \param[in] ranges  The ranges of bytes the advice applies to.
+ * \param[in] advice  The advice to give the kernel.
+ */
+void adviseFile(std::string const & filename, file_range_vector_t const & ranges, FileAdvice advice)
+{
+#if !defined(ZIPIOS_WINDOWS) && defined(POSIX_FADV_WILLNEED)
+    if(ranges.empty())
+    {
+        return;
+    }
+
+    int const fd(open(filename.c_str(), O_RDONLY));
+    if(fd < 0)
+    {
+        return;
+    }
+
+    adviseFile(fd, ranges, advice);
+
+    close(fd);
+#else
+    static_cast<void>(filename);
+    static_cast<void>(ranges);
+    static_cast<void>(advice);
+#endif
+}
+
+
+/** \brief Give the kernel a hint about an already opened file.
+ *
+ * This function is the same as the adviseFile() taking a filename,
+ * only it uses a file descriptor the caller already has opened, which
+ * avoids opening and closing the file each time.
+ *
+ * The SEQUENTIAL advice is transformed in a WILLNEED on the ranges
+ * since the descriptor may be shared with other readers.
+ *
+ * \param[in] fd  The file descriptor receiving the advice.
+ * \param[in] ranges  The ranges of bytes the advice applies to.
+ * \param[in] advice  The advice to give the kernel.
+ */
+void adviseFile(int fd, file_range_vector_t const & ranges, FileAdvice advice)
+{
+#if !defined(ZIPIOS_WINDOWS) && defined(POSIX_FADV_WILLNEED)
+    if(ranges.empty()
+    || fd < 0)
+    {
+        return;
+    }
+
+    int posix_advice(POSIX_FADV_NORMAL);
+    switch(advice)
+    {
+    case FileAdvice::NORMAL:
+        posix_advice = POSIX_FADV_NORMAL;
+        break;
+
+    case FileAdvice::SEQUENTIAL:
+    case FileAdvice::WILLNEED:
+        posix_advice = POSIX_FADV_WILLNEED;
+        break;
+
+    case FileAdvice::DONTNEED:
+        posix_advice = POSIX_FADV_DONTNEED;
+        break;
+
+    }
+
+    file_range_vector_t sorted(ranges);
+    std::sort(sorted.begin(), sorted.end());
+
+    offset_t start(sorted[0].first);
+    offset_t end(start + sorted[0].second);
+    for(auto it(sorted.begin() + 1); it != sorted.end(); ++it)
+    {
+        if(it->first > end)
+        {
+            posix_fadvise(fd, start, end - start, posix_advice);
+            start = it->first;
+            end = start;
+        }
+        end = std::max(end, it->first + it->second);
+    }
+    posix_fadvise(fd, start, end - start, posix_advice);
+#else
+    static_cast<void>(fd);
+    static_cast<void>(ranges);
+    static_cast<void>(advice);
+#endif
+}
+
+
+/** \brief Run a set of jobs in parallel.
+ *
+ * This function runs \p count jobs and waits for all of them. The jobs
+ * are run by a pool of at most one thread per core, each thread taking
+ * the next job index from a shared counter, so a large \p count does
+ * not start a large number of threads. A single job runs in the
+ * calling thread.
+ *
+ * If a job throws, the exception of the first job that failed, in job
+ * order, gets rethrown once all the jobs are done.
+ *
+ * \param[in] count  The number of jobs.
+ * \param[in] job  The function running one job, it receives its index.
+ */
+void runJobs(size_t count, std::function<void(size_t)> const & job)
+{
+    if(count <= 1)
+    {
+        if(count == 1)
+        {
+            job(0);
+        }
+        return;
+    }
+
+    size_t const thread_count(std::min(count, static_cast<size_t>(std::max(std::thread::hardware_concurrency(), 1U))));
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<size_t> next_job(0);
+    auto worker([count, &job, &errors, &next_job]()
+        {
+            for(size_t idx(next_job++); idx < count; idx = next_job++)
+            {
+                try
+                {
+                    job(idx);
+                }
+                catch(...)
+                {
+                    errors[idx] = std::current_exception();
+                }
+            }
+        });
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    try
+    {
+        // the calling thread is the last worker
+        for(size_t idx(1); idx < thread_count; ++idx)
+        {
+            threads.push_back(std::thread(worker));
+        }
+    }
+    catch(...)
+    {
+        // could not start a thread, the running workers and the
+        // calling thread still go through all the jobs
+    }
+    worker();
+
+    for(auto & t : threads)
+    {
+        t.join();
+    }
+    for(auto const & e : errors)
+    {
+        if(e)
+        {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+
 void zipRead(std::istream& is, uint32_t& value)
 {
     unsigned char buf[sizeof(value)];
@@ -32,8 +32,10 @@
 
 #include "zipios/zipios-config.hpp"
 
+#include <functional>
 #include <vector>
 #include <sstream>
+#include <utility>
 #include <stdint.h>
 
 #if defined( ZIPIOS_WINDOWS )
@@ -98,6 +100,24 @@ typedef std::ostringstream OutputStringStream;
 typedef std::vector<unsigned char>      buffer_t;
 
 
+enum class FileAdvice : uint32_t
+{
+    NORMAL,
+    SEQUENTIAL,
+    WILLNEED,
+    DONTNEED
+};
+
+
+typedef std::pair<offset_t, offset_t>   file_range_t;
+typedef std::vector<file_range_t>       file_range_vector_t;
+
+
+void     adviseFile(std::string const & filename, file_range_vector_t const & ranges, FileAdvice advice);
+void     adviseFile(int fd, file_range_vector_t const & ranges, FileAdvice advice);
+void     runJobs(size_t count, std::function<void(size_t)> const & job);
+
+
 void     zipRead(std::istream& is, uint32_t& value);
 void     zipRead(std::istream& is, uint16_t& value);
 void     zipRead(std::istream& is, uint8_t&  value);
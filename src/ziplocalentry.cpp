@@ -71,6 +71,23 @@ uint32_t const      g_signature = 0x04034b50;
 uint16_t const      g_trailing_data_descriptor = 1 << 3;
 
 
+/** \brief A bit in the general purpose flags.
+ *
+ * This mask is used to know whether the data of the entry is
+ * encrypted.
+ *
+ * This is bit 0. (see point 4.4.4 in doc/zip-format.txt)
+ */
+uint16_t const      g_encrypted = 1 << 0;
+
+
+/** \brief The version needed to extract WinZip AES entries.
+ *
+ * The WinZip AES specification requires version 5.1.
+ */
+uint16_t const      g_winzip_aes_version = 51;
+
+
 /** \brief ZipLocalEntry Header
  *
  * This structure shows how the header of the ZipLocalEntry is defined.
@@ -315,6 +332,58 @@ bool ZipLocalEntry::hasTrailingDataDescriptor() const
 }
 
 
+/** \brief Is the data of this entry encrypted?
+ *
+ * This function checks the encryption bit of the General Purpose Flags.
+ *
+ * \return true if the data of this entry is encrypted.
+ */
+bool ZipLocalEntry::isEncrypted() const
+{
+    return (m_general_purpose_bitfield & g_encrypted) != 0;
+}
+
+
+/** \brief Mark this entry as encrypted with WinZip AES.
+ *
+ * The storage method becomes StorageMethod::AES, the real storage
+ * method is saved in the AES extra field along with the key strength,
+ * and the encryption bit gets set.
+ *
+ * \param[in] field  The data of the AES extra field.
+ */
+void ZipLocalEntry::setWinZipAES(WinZipAES::extra_field_t const & field)
+{
+    WinZipAES::writeExtraField(m_extra_field, field);
+    m_compress_method = StorageMethod::AES;
+    m_general_purpose_bitfield |= g_encrypted;
+    m_extract_version = g_winzip_aes_version;
+}
+
+
+/** \brief Remove the WinZip AES encryption marks from this entry.
+ *
+ * An entry copied from an encrypted archive keeps its AES storage
+ * method and extra field. This function restores the real storage
+ * method and removes the AES extra field so the entry can be saved
+ * again, encrypted or not.
+ */
+void ZipLocalEntry::clearWinZipAES()
+{
+    if(m_compress_method == StorageMethod::AES)
+    {
+        WinZipAES::extra_field_t field;
+        m_compress_method = WinZipAES::readExtraField(m_extra_field, field)
+                                && field.m_method == StorageMethod::STORED
+                            ? StorageMethod::STORED
+                            : StorageMethod::DEFLATED;
+    }
+    WinZipAES::removeExtraField(m_extra_field);
+    m_general_purpose_bitfield &= ~g_encrypted;
+    m_extract_version = g_zip_format_version;
+}
+
+
 /** \brief Read one local entry from \p is.
  *
  * This function verifies that the input stream starts with a local entry
@@ -433,7 +502,8 @@ void ZipLocalEntry::write(std::ostream& os)
     }
 
     uint16_t compress_method(static_cast<uint8_t>(m_compress_method));
-    if(m_compression_level == COMPRESSION_LEVEL_NONE)
+    if(m_compression_level == COMPRESSION_LEVEL_NONE
+    && m_compress_method != StorageMethod::AES)
     {
         compress_method = static_cast<uint8_t>(StorageMethod::STORED);
     }
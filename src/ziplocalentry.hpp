@@ -32,6 +32,8 @@
  * \sa zipios::ZipCDirEntry
  */
 
+#include "winzipaes.hpp"
+
 #include "zipios/fileentry.hpp"
 
 
@@ -58,6 +60,9 @@ public:
     virtual void                setCrc(crc32_t crc) override;
 
     bool                        hasTrailingDataDescriptor() const;
+    bool                        isEncrypted() const;
+    void                        setWinZipAES(WinZipAES::extra_field_t const & field);
+    void                        clearWinZipAES();
 
     virtual void                read(std::istream& is) override;
     virtual void                write(std::ostream& os) override;
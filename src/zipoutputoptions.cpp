@@ -0,0 +1,656 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Implementation of zipios::ZipOutputOptions.
+ *
+ * This file defines the functions of the zipios::ZipOutputOptions
+ * class which are used to tweak the way a Zip archive gets written.
+ */
+
+#include "zipios/zipoutputoptions.hpp"
+
+#include "zipios/zipiosexceptions.hpp"
+
+#include <fstream>
+
+
+namespace zipios
+{
+
+
+/** \class ZipOutputOptions
+ * \brief The settings used to write a Zip archive.
+ *
+ * This class holds the various settings that can be used to change
+ * the way a Zip archive gets written by the
+ * ZipFile::saveCollectionToArchive() function.
+ *
+ * The default settings write the archive as it always was: one entry
+ * at a time, in the same thread.
+ */
+
+
+/** \brief Initialize a ZipOutputOptions object.
+ *
+ * The default options turn off all the special features.
+ */
+ZipOutputOptions::ZipOutputOptions()
+    //: m_write_behind_buffer_count(0) -- auto-init
+    //, m_write_behind_buffer_size(0) -- auto-init
+    //, m_previous_archive() -- auto-init
+    //, m_verify_previous_crc(false) -- auto-init
+    //, m_blob_cache() -- auto-init
+    //, m_access_profile() -- auto-init
+    //, m_rsyncable(false) -- auto-init
+    //, m_password() -- auto-init
+    //, m_digest_algorithms() -- auto-init
+    //, m_store_digests(false) -- auto-init
+    //, m_digest_callback() -- auto-init
+    //, m_compression_threads(0) -- auto-init
+    //, m_stored_alignment(0) -- auto-init
+    //, m_central_directory_memory_limit(0) -- auto-init
+    //, m_compression_budget(0.0) -- auto-init
+    //, m_compression_time_budget(0.0) -- auto-init
+{
+}
+
+
+/** \brief Retrieve the number of write-behind buffers.
+ *
+ * This function returns the number of buffers used by the write-behind
+ * pipeline. When zero, the write-behind pipeline is not used.
+ *
+ * \return The number of write-behind buffers.
+ *
+ * \sa setWriteBehind()
+ */
+size_t ZipOutputOptions::getWriteBehindBufferCount() const
+{
+    return m_write_behind_buffer_count;
+}
+
+
+/** \brief Retrieve the size of each write-behind buffer.
+ *
+ * This function returns the size, in bytes, of each one of the buffers
+ * used by the write-behind pipeline.
+ *
+ * \return The size of one write-behind buffer.
+ *
+ * \sa setWriteBehind()
+ */
+size_t ZipOutputOptions::getWriteBehindBufferSize() const
+{
+    return m_write_behind_buffer_size;
+}
+
+
+/** \brief Write the archive from a separate thread.
+ *
+ * By default, the thread compressing the data also writes it to the
+ * output stream and thus waits on the disk each time a buffer gets
+ * flushed.
+ *
+ * With the write-behind pipeline, the compressed data is copied to one
+ * of \p buffer_count buffers and a dedicated thread writes those buffers
+ * to the output stream. The compressing thread only waits when all
+ * the buffers are full (backpressure.)
+ *
+ * \param[in] buffer_count  The number of buffers in the pipeline, use 0
+ *                          to turn the write-behind off.
+ * \param[in] buffer_size  The size of each buffer in bytes.
+ */
+void ZipOutputOptions::setWriteBehind(size_t buffer_count, size_t buffer_size)
+{
+    if(buffer_size == 0)
+    {
+        buffer_count = 0;
+    }
+    m_write_behind_buffer_count = buffer_count;
+    m_write_behind_buffer_size = buffer_count == 0 ? 0 : buffer_size;
+}
+
+/** \brief Retrieve the name of the previous archive.
+ *
+ * This function returns the name of the archive from which unchanged
+ * entries get copied. When empty, all the entries get compressed.
+ *
+ * \return The filename of the previous archive.
+ *
+ * \sa setPreviousArchive()
+ */
+std::string const & ZipOutputOptions::getPreviousArchive() const
+{
+    return m_previous_archive;
+}
+
+
+/** \brief Check whether the CRC of unchanged entries gets verified.
+ *
+ * \return true if the CRC of the source files gets compared against
+ *         the CRC saved in the previous archive.
+ *
+ * \sa setPreviousArchive()
+ */
+bool ZipOutputOptions::getVerifyPreviousCrc() const
+{
+    return m_verify_previous_crc;
+}
+
+
+/** \brief Reuse the entries of a previous build of the archive.
+ *
+ * When rebuilding an archive from a tree where only a few files
+ * changed, most of the time is spent compressing files which were
+ * already compressed the last time around.
+ *
+ * With this option, each file of the collection is searched in the
+ * \p filename archive. If it is found with the same size, the same
+ * modification time, and the same storage method, its compressed data
+ * gets copied verbatim from that archive instead of being compressed
+ * again.
+ *
+ * Since Zip archives save the modification time with a precision of
+ * two seconds, a file modified twice within two seconds without a size
+ * change would be viewed as unchanged. Set \p verify_crc to true to
+ * also compare the CRC of the file, which requires reading it but is
+ * still much faster than compressing it.
+ *
+ * \note
+ * The compression level is not saved in a Zip archive so entries
+ * copied from the previous archive keep the level used at the time.
+ *
+ * \warning
+ * The previous archive must not be the file being written.
+ *
+ * \param[in] filename  The previous archive or an empty string to
+ *                      compress all the files.
+ * \param[in] verify_crc  Whether the CRC of the files gets verified.
+ */
+void ZipOutputOptions::setPreviousArchive(std::string const & filename, bool verify_crc)
+{
+    m_previous_archive = filename;
+    m_verify_previous_crc = verify_crc;
+}
+
+
+/** \brief Retrieve the directory of the blob cache.
+ *
+ * \return The directory where compressed blobs are cached or an empty
+ *         string if the cache is not used.
+ *
+ * \sa setBlobCache()
+ */
+std::string const & ZipOutputOptions::getBlobCache() const
+{
+    return m_blob_cache;
+}
+
+
+/** \brief Share compressed data between archive builds.
+ *
+ * When many archives are created from overlapping sets of files, the
+ * same files get compressed again for each archive.
+ *
+ * With a blob cache, the compressed data of each deflated file is
+ * saved in \p directory, keyed by the SHA-256 digest of the file
+ * content, the storage method, and the compression level. Before
+ * compressing a file, the cache is checked and on a hit the compressed
+ * data is copied from there instead.
+ *
+ * When saving a DirectoryCollection, files which are hard links to
+ * the same inode are only read once to compute their key.
+ *
+ * The directory can be shared by several processes. The library
+ * never removes anything from it.
+ *
+ * \param[in] directory  The cache directory or an empty string to
+ *                       not use a cache.
+ */
+void ZipOutputOptions::setBlobCache(std::string const & directory)
+{
+    m_blob_cache = directory;
+}
+
+
+/** \brief Retrieve the order in which the entries get written.
+ *
+ * \return The names of the entries to write first, in order.
+ *
+ * \sa setAccessProfile()
+ */
+std::vector<std::string> const & ZipOutputOptions::getAccessProfile() const
+{
+    return m_access_profile;
+}
+
+
+/** \brief Write the entries in the order they get accessed.
+ *
+ * By default, the entries are written in the order of the collection,
+ * which for a DirectoryCollection is the order in which readdir()
+ * returns the files. The entries read when an application starts are
+ * then scattered all over the archive.
+ *
+ * With an access profile, the entries named in \p names are written
+ * first, in that order, and all the other (cold) entries follow in
+ * their usual order. The startup working set becomes one contiguous
+ * region of the archive which the kernel read-ahead, or a single
+ * ZipFile::prefetch(), loads in one go.
+ *
+ * A profile is usually recorded with ZipFile::setAccessRecording()
+ * while running the workload against a previous build of the archive.
+ * Names which are not found in the collection are ignored.
+ *
+ * \param[in] names  The names of the entries in access order, an empty
+ *                   vector keeps the order of the collection.
+ *
+ * \sa loadAccessProfile()
+ */
+void ZipOutputOptions::setAccessProfile(std::vector<std::string> const & names)
+{
+    m_access_profile = names;
+}
+
+
+/** \brief Load an access profile from a file.
+ *
+ * The file is expected to include one entry name per line, as saved
+ * by ZipFile::saveAccessProfile(). Empty lines are ignored.
+ *
+ * \exception IOException
+ * This exception is raised if the file cannot be read.
+ *
+ * \param[in] filename  The name of the file with the access profile.
+ *
+ * \sa setAccessProfile()
+ */
+void ZipOutputOptions::loadAccessProfile(std::string const & filename)
+{
+    std::ifstream in(filename);
+    if(!in)
+    {
+        throw IOException("ZipOutputOptions::loadAccessProfile(): could not open \"" + filename + "\".");
+    }
+
+    std::vector<std::string> names;
+    std::string name;
+    while(std::getline(in, name))
+    {
+        if(!name.empty())
+        {
+            names.push_back(name);
+        }
+    }
+    if(in.bad())
+    {
+        throw IOException("ZipOutputOptions::loadAccessProfile(): could not read \"" + filename + "\"."); // LCOV_EXCL_LINE
+    }
+
+    m_access_profile.swap(names);
+}
+
+
+/** \brief Check whether the entries get compressed in the rsyncable mode.
+ *
+ * \return true if the deflated entries are compressed rsync friendly.
+ *
+ * \sa setRsyncable()
+ */
+bool ZipOutputOptions::getRsyncable() const
+{
+    return m_rsyncable;
+}
+
+
+/** \brief Compress the entries so deltas between builds stay small.
+ *
+ * Archives distributed with delta transfer tools such as rsync benefit
+ * from this mode: the deflated data of an unchanged region of a file
+ * remains the same even when other parts of the file change. See
+ * DeflateOutputStreambuf::setRsyncable() for details.
+ *
+ * The compressed output is a few percent larger on typical data.
+ *
+ * \param[in] rsyncable  Whether the deflated entries are compressed
+ *                       rsync friendly.
+ */
+void ZipOutputOptions::setRsyncable(bool rsyncable)
+{
+    m_rsyncable = rsyncable;
+}
+
+
+/** \brief Retrieve the password used to encrypt the entries.
+ *
+ * \return The password, empty when the entries are not encrypted.
+ *
+ * \sa setPassword()
+ */
+std::string const & ZipOutputOptions::getPassword() const
+{
+    return m_password;
+}
+
+
+/** \brief Encrypt the entries with WinZip AES-256.
+ *
+ * When a password is defined, the data of all the files gets encrypted
+ * with WinZip AES-256. Such archives can be read back with a ZipFile
+ * given the same password (see ZipFile::setPassword()) and by most
+ * Zip tools.
+ *
+ * Since the data gets encrypted with a new key, a previous archive and
+ * a blob cache cannot be used to avoid compressing the data again;
+ * these options are ignored when a password is defined.
+ *
+ * \param[in] password  The password used to encrypt the entries, empty
+ *                      to not encrypt them.
+ */
+void ZipOutputOptions::setPassword(std::string const & password)
+{
+    m_password = password;
+}
+
+
+/** \brief Retrieve the digests computed over the data of the files.
+ *
+ * \return The list of digest algorithms, empty by default.
+ *
+ * \sa setDigestAlgorithms()
+ */
+ContentDigest::algorithm_vector_t const & ZipOutputOptions::getDigestAlgorithms() const
+{
+    return m_digest_algorithms;
+}
+
+
+/** \brief Check whether the digests get saved in the archive.
+ *
+ * \return true if the digests get saved in an extra field of the entries.
+ *
+ * \sa setDigestAlgorithms()
+ */
+bool ZipOutputOptions::getStoreDigests() const
+{
+    return m_store_digests;
+}
+
+
+/** \brief Compute digests of the files while they get compressed.
+ *
+ * The digests are computed over the uncompressed data of each file in
+ * the same pass as its CRC32, so a manifest of strong hashes does not
+ * require reading the files a second time. The digests of each file
+ * are given to the digest callback (see setDigestCallback()).
+ *
+ * When \p store_digests is true, the digests also get saved in a
+ * private extra field of each entry (see ContentDigest) so a reader
+ * can verify the data while decompressing it. Encrypted entries do
+ * not get that extra field.
+ *
+ * Since the data of each file has to be read, a previous archive and
+ * a blob cache cannot be used to avoid compressing the data again;
+ * these options are ignored when digests are requested.
+ *
+ * \exception InvalidException
+ * This exception is raised if one of the \p algorithms is not known.
+ *
+ * \param[in] algorithms  The digest algorithms to run, empty for none.
+ * \param[in] store_digests  Whether the digests get saved in the archive.
+ */
+void ZipOutputOptions::setDigestAlgorithms(ContentDigest::algorithm_vector_t const & algorithms, bool store_digests)
+{
+    ContentDigest verify(algorithms);
+
+    m_digest_algorithms = verify.getAlgorithms();
+    m_store_digests = store_digests;
+}
+
+
+/** \brief Retrieve the function receiving the digests.
+ *
+ * \return The digest callback, possibly empty.
+ *
+ * \sa setDigestCallback()
+ */
+ZipOutputOptions::digest_callback_t const & ZipOutputOptions::getDigestCallback() const
+{
+    return m_digest_callback;
+}
+
+
+/** \brief Define the function receiving the digests of each file.
+ *
+ * Once a file was saved in the archive, the \p callback gets called
+ * with its entry, as found in the collection being saved, and its
+ * digests. Directories are not reported.
+ *
+ * \param[in] callback  The function receiving the digests.
+ */
+void ZipOutputOptions::setDigestCallback(digest_callback_t const & callback)
+{
+    m_digest_callback = callback;
+}
+
+
+/** \brief Retrieve the number of compression threads.
+ *
+ * \return The number of threads compressing the entries, 0 or 1 when
+ *         the entries get compressed in the calling thread.
+ *
+ * \sa setCompressionThreads()
+ */
+size_t ZipOutputOptions::getCompressionThreads() const
+{
+    return m_compression_threads;
+}
+
+
+/** \brief Compress the entries with several threads.
+ *
+ * When more than one thread is requested, the data of the deflated
+ * files gets cut in chunks of 1Mb which are compressed in parallel by
+ * a pool of \p count threads. Each chunk is primed with the last 32Kb
+ * of the previous chunk, so the compression ratio stays within a
+ * fraction of a percent of the single threaded compression. The
+ * calling thread reads the files and writes the archive.
+ *
+ * The parallel compression is not used when a password, digests, a
+ * previous archive, a blob cache, or the rsyncable mode are defined.
+ *
+ * \param[in] count  The number of compression threads, 0 or 1 to
+ *                   compress the entries in the calling thread.
+ */
+void ZipOutputOptions::setCompressionThreads(size_t count)
+{
+    m_compression_threads = count;
+}
+
+
+/** \brief Retrieve the alignment of the data of stored entries.
+ *
+ * \return The alignment in bytes, 0 when the data is not aligned.
+ *
+ * \sa setStoredAlignment()
+ */
+size_t ZipOutputOptions::getStoredAlignment() const
+{
+    return m_stored_alignment;
+}
+
+
+/** \brief Align the data of the stored entries.
+ *
+ * The data of an entry saved with the STORED method can be used in
+ * place once the archive is memory mapped. Some data (pages, SIMD
+ * vectors, native libraries loaded from an archive) has to start at
+ * an aligned offset for that to work. With an \p alignment, the local
+ * header of each stored file gets padded with an extra field (id
+ * 0xD935, as used by the Android zipalign tool) so its data starts at
+ * a multiple of \p alignment from the start of the output stream.
+ *
+ * Encrypted entries are not aligned.
+ *
+ * \exception InvalidException
+ * This exception is raised if \p alignment is not 0 or a power of two
+ * up to 32768.
+ *
+ * \param[in] alignment  The alignment in bytes, 0 or 1 to not align
+ *                       the data.
+ */
+void ZipOutputOptions::setStoredAlignment(size_t alignment)
+{
+    if(alignment > 32768
+    || (alignment & (alignment - 1)) != 0)
+    {
+        throw InvalidException("ZipOutputOptions::setStoredAlignment(): the alignment must be a power of two up to 32768.");
+    }
+
+    m_stored_alignment = alignment <= 1 ? 0 : alignment;
+}
+
+
+/** \brief Retrieve the memory limit of the central directory.
+ *
+ * \return The maximum number of bytes of central directory records
+ *         kept in memory, 0 when there is no limit.
+ *
+ * \sa setCentralDirectoryMemoryLimit()
+ */
+size_t ZipOutputOptions::getCentralDirectoryMemoryLimit() const
+{
+    return m_central_directory_memory_limit;
+}
+
+
+/** \brief Limit the memory used to build the central directory.
+ *
+ * The writer keeps the central directory record of each saved entry
+ * until the end of the archive, which is about 46 bytes plus the
+ * length of the name per entry. When building archives with many
+ * millions of entries, \p limit can be used to bound that memory:
+ * the records over the limit get moved to a temporary file and
+ * copied back at the end.
+ *
+ * \param[in] limit  The maximum number of bytes of records to keep in
+ *                   memory, 0 (the default) to keep all of them.
+ */
+void ZipOutputOptions::setCentralDirectoryMemoryLimit(size_t limit)
+{
+    m_central_directory_memory_limit = limit;
+}
+
+
+/** \brief Retrieve the compression throughput target.
+ *
+ * \return The target in bytes per second and per thread, 0 when the
+ *         compression level of each entry is used.
+ *
+ * \sa setCompressionBudget()
+ */
+double ZipOutputOptions::getCompressionBudget() const
+{
+    return m_compression_budget;
+}
+
+
+/** \brief Select the compression level from a throughput target.
+ *
+ * Instead of using the compression level of each entry, the writer
+ * measures how fast the data gets compressed and how small it gets,
+ * and moves the zlib level up or down, between entries and every
+ * megabyte within large entries, to the best level which still
+ * compresses \p throughput bytes per second. The target is per
+ * thread, e.g. 500Mb/s per core.
+ *
+ * Entries using the STORED method or COMPRESSION_LEVEL_NONE are not
+ * affected.
+ *
+ * \exception InvalidException
+ * This exception is raised if \p throughput is negative.
+ *
+ * \param[in] throughput  The target in bytes of input per second, 0 to
+ *                        use the compression level of each entry.
+ *
+ * \sa setCompressionTimeBudget()
+ */
+void ZipOutputOptions::setCompressionBudget(double throughput)
+{
+    if(throughput < 0.0)
+    {
+        throw InvalidException("ZipOutputOptions::setCompressionBudget(): the throughput cannot be negative.");
+    }
+
+    m_compression_budget = throughput;
+}
+
+
+/** \brief Retrieve the compression time budget.
+ *
+ * \return The time budget in seconds, 0 when not defined.
+ *
+ * \sa setCompressionTimeBudget()
+ */
+double ZipOutputOptions::getCompressionTimeBudget() const
+{
+    return m_compression_time_budget;
+}
+
+
+/** \brief Select the compression level from a wall-clock budget.
+ *
+ * ZipFile::saveCollectionToArchive() converts this budget into a
+ * throughput target (see setCompressionBudget()) from the total size
+ * of the deflated files of the collection and the number of
+ * compression threads. It has precedence over the throughput target.
+ *
+ * A ZipOutputStream used directly does not know the amount of data to
+ * come, so it only uses the throughput target.
+ *
+ * \exception InvalidException
+ * This exception is raised if \p seconds is negative.
+ *
+ * \param[in] seconds  The time allowed to compress the data, 0 to not
+ *                     use a time budget.
+ */
+void ZipOutputOptions::setCompressionTimeBudget(double seconds)
+{
+    if(seconds < 0.0)
+    {
+        throw InvalidException("ZipOutputOptions::setCompressionTimeBudget(): the time budget cannot be negative.");
+    }
+
+    m_compression_time_budget = seconds;
+}
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
@@ -49,12 +49,41 @@ namespace zipios
  * The ZipOutputStream constructor create an output stream that will
  * be used to save Zip data to a file.
  *
+ * When the \p options request a write-behind pipeline, the Zip data
+ * goes through a WriteBehindStreambuf so it gets written to \p os
+ * by a separate thread.
+ *
+ * When the \p options request rsyncable compression, the deflated
+ * entries are compressed in the rsyncable mode.
+ *
+ * When the \p options define a stored alignment, the data of the
+ * STORED entries gets aligned.
+ *
+ * When the \p options define a central directory memory limit, the
+ * central directory records over that limit are kept in a temporary
+ * file until the archive gets finished.
+ *
+ * When the \p options define a compression budget, the compression
+ * level of the deflated entries is selected to reach that throughput.
+ *
  * \param[in] os  The output stream to use to write the Zip archive.
+ * \param[in] options  The options used to write the archive.
  */
-ZipOutputStream::ZipOutputStream(std::ostream& os)
+ZipOutputStream::ZipOutputStream(std::ostream& os, ZipOutputOptions const & options)
     //: std::ostream()
-    : m_ozf(new ZipOutputStreambuf(os.rdbuf()))
+    //, m_ofs() -- auto-init
+    : m_write_behind(options.getWriteBehindBufferCount() == 0
+                        ? nullptr
+                        : new WriteBehindStreambuf(os.rdbuf(), options.getWriteBehindBufferCount(), options.getWriteBehindBufferSize()))
+    , m_ozf(new ZipOutputStreambuf(m_write_behind ? m_write_behind.get() : os.rdbuf()))
 {
+    m_ozf->setRsyncable(options.getRsyncable());
+    m_ozf->setPassword(options.getPassword());
+    m_ozf->setDigestAlgorithms(options.getDigestAlgorithms());
+    m_ozf->setStoreDigests(options.getStoreDigests());
+    m_ozf->setStoredAlignment(options.getStoredAlignment());
+    m_ozf->setCentralDirectoryMemoryLimit(options.getCentralDirectoryMemoryLimit());
+    m_ozf->setCompressionBudget(options.getCompressionBudget());
     init(m_ozf.get());
 }
 
@@ -79,6 +108,72 @@ void ZipOutputStream::closeEntry()
 }
 
 
+/** \brief Add an entry copying its compressed data from another archive.
+ *
+ * This function saves \p entry using the compressed data of the
+ * \p previous entry, which gets read from \p is. The data is not
+ * compressed again.
+ *
+ * The method, sizes, and CRC of \p entry are set to those of
+ * \p previous. The other fields (name, time, comment, extra field)
+ * come from \p entry.
+ *
+ * \param[in] entry  The FileEntry to add to the output stream.
+ * \param[in] previous  The entry describing the compressed data.
+ * \param[in,out] is  The input stream positioned at the start of the
+ *                    compressed data of \p previous.
+ */
+void ZipOutputStream::copyEntry(FileEntry::pointer_t entry, FileEntry const & previous, std::istream & is)
+{
+    entry.reset(new ZipCentralDirectoryEntry(*entry));
+
+    entry->setMethod(previous.getMethod());
+    entry->setSize(previous.getSize());
+    entry->setCompressedSize(previous.getCompressedSize());
+    entry->setCrc(previous.getCrc());
+
+    m_ozf->putRawEntry(entry, is);
+}
+
+
+/** \brief Start an entry which data gets compressed by the caller.
+ *
+ * The raw deflate data of the entry is then saved with
+ * writeDeflatedData() and the entry closed with closeDeflatedEntry().
+ * See ZipOutputStreambuf::putDeflatedEntry() for details.
+ *
+ * \param[in] entry  The FileEntry to add to the output stream.
+ */
+void ZipOutputStream::putDeflatedEntry(FileEntry::pointer_t entry)
+{
+    entry.reset(new ZipCentralDirectoryEntry(*entry));
+
+    m_ozf->putDeflatedEntry(entry);
+}
+
+
+/** \brief Save raw deflate data in the current deflated entry.
+ *
+ * \param[in] data  The compressed data.
+ * \param[in] size  The number of bytes in \p data.
+ */
+void ZipOutputStream::writeDeflatedData(char const * data, size_t size)
+{
+    m_ozf->writeDeflatedData(data, size);
+}
+
+
+/** \brief Close the current deflated entry.
+ *
+ * \param[in] crc  The CRC32 of the uncompressed data.
+ * \param[in] size  The size of the uncompressed data.
+ */
+void ZipOutputStream::closeDeflatedEntry(uint32_t crc, size_t size)
+{
+    m_ozf->closeDeflatedEntry(crc, size);
+}
+
+
 /** \brief Close the current stream.
  *
  * This function calls close() on the internal stream. After this
@@ -90,6 +185,10 @@ void ZipOutputStream::closeEntry()
 void ZipOutputStream::close()
 {
     m_ozf->close();
+    if(m_write_behind)
+    {
+        m_write_behind->drain();
+    }
 }
 
 
@@ -103,6 +202,24 @@ void ZipOutputStream::close()
 void ZipOutputStream::finish()
 {
     m_ozf->finish();
+    if(m_write_behind)
+    {
+        m_write_behind->drain();
+    }
+}
+
+
+/** \brief Retrieve the digests of the last entry.
+ *
+ * Once closeEntry() was called, this function returns the digests of
+ * the data of that entry, as defined by the digest algorithms of the
+ * ZipOutputOptions.
+ *
+ * \return The digests of the last entry, empty if none were requested.
+ */
+ContentDigest::digest_map_t ZipOutputStream::getDigests() const
+{
+    return m_ozf->getDigests();
 }
 
 
@@ -131,11 +248,19 @@ void ZipOutputStream::putNextEntry(FileEntry::pointer_t entry)
     // if we do not yet have a ZipCentralDirectoryEntry object, create
     // one from the input entry (the input entry is actually expected
     // to be a DirectoryEntry!)
+    //
+    // an entry of a ZipFile gets cloned since its offset, method, and
+    // extra field change while saving it, and the ZipFile still needs
+    // them to read its data
     ZipCentralDirectoryEntry * central_directory_entry(dynamic_cast<ZipCentralDirectoryEntry *>(entry.get()));
     if(central_directory_entry == nullptr)
     {
         entry.reset(new ZipCentralDirectoryEntry(*entry));
     }
+    else
+    {
+        entry = entry->clone();
+    }
 
     m_ozf->putNextEntry(entry);
 }
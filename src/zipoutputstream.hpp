@@ -31,6 +31,9 @@
  */
 
 #include "zipoutputstreambuf.hpp"
+#include "writebehindstreambuf.hpp"
+
+#include "zipios/zipoutputoptions.hpp"
 
 
 namespace zipios
@@ -41,17 +44,25 @@ class ZipOutputStreambuf;
 class ZipOutputStream : public std::ostream
 {
 public:
-                    ZipOutputStream(std::ostream & os);
+                    ZipOutputStream(std::ostream & os, ZipOutputOptions const & options = ZipOutputOptions());
     virtual         ~ZipOutputStream();
 
     void            closeEntry();
+    void            copyEntry(FileEntry::pointer_t entry, FileEntry const & previous, std::istream & is);
     void            close();
     void            finish();
+    ContentDigest::digest_map_t
+                    getDigests() const;
     void            putNextEntry(FileEntry::pointer_t entry);
+    void            putDeflatedEntry(FileEntry::pointer_t entry);
+    void            writeDeflatedData(char const * data, size_t size);
+    void            closeDeflatedEntry(uint32_t crc, size_t size);
     void            setComment(std::string const & comment);
 
 private:
     std::unique_ptr<std::ofstream>      m_ofs;
+    std::unique_ptr<WriteBehindStreambuf>
+                                        m_write_behind;
     std::unique_ptr<ZipOutputStreambuf> m_ozf;
 };
 
@@ -33,6 +33,10 @@
 #include "ziplocalentry.hpp"
 #include "zipendofcentraldirectory.hpp"
 
+#include <algorithm>
+#include <random>
+#include <sstream>
+
 
 namespace zipios
 {
@@ -42,32 +46,71 @@ namespace
 {
 
 
-/** \brief Help function used to write the central directory.
+/** \brief The identifier of the alignment extra field.
  *
- * When you create a Zip archive, it includes a central directory where
- * all the meta data about each file is saved. This function saves an
- * array of entries in an output stream to generate the Zip file
- * central directory.
+ * This is the identifier used by the Android zipalign tool. The field
+ * holds the alignment on 16 bits followed by zeroes.
+ */
+uint16_t const g_alignment_extra_field_id = 0xD935;
+
+
+/** \brief Remove the alignment extra field.
  *
- * \param[in] os  The output stream.
- * \param[in] entries  The array of entries to save in this central directory.
- * \param[in] comment  The zip archive global comment.
+ * \param[in,out] entry  The entry to clean up.
  */
-void writeZipCentralDirectory(std::ostream &os, FileEntry::vector_t& entries, std::string const& comment)
+void removeAlignmentField(FileEntry & entry)
 {
-    ZipEndOfCentralDirectory eocd(comment);
-    eocd.setOffset(os.tellp());  // start position
-    eocd.setCount(entries.size());
-
-    size_t central_directory_size(0);
-    for(auto it = entries.begin(); it != entries.end(); ++it)
+    FileEntry::buffer_t extra(entry.getExtra());
+    size_t pos(0);
+    bool found(false);
+    while(pos + 4 <= extra.size())
     {
-        (*it)->write(os);
-        central_directory_size += (*it)->getHeaderSize();
+        uint16_t const id(extra[pos] | (extra[pos + 1] << 8));
+        size_t const size(std::min(static_cast<size_t>(extra[pos + 2] | (extra[pos + 3] << 8)), extra.size() - pos - 4));
+        if(id == g_alignment_extra_field_id)
+        {
+            extra.erase(extra.begin() + pos, extra.begin() + pos + 4 + size);
+            found = true;
+        }
+        else
+        {
+            pos += 4 + size;
+        }
+    }
+    if(found)
+    {
+        entry.setExtra(extra);
     }
+}
 
-    eocd.setCentralDirectorySize(central_directory_size);
-    eocd.write(os);
+
+/** \brief Pad the local header of an entry so its data gets aligned.
+ *
+ * This function adds an alignment extra field to \p entry, sized so
+ * the data following its local header, saved at \p offset, starts at
+ * a multiple of \p alignment.
+ *
+ * \param[in,out] entry  The entry to align.
+ * \param[in] offset  The offset where the local header gets saved.
+ * \param[in] alignment  The alignment, a power of two.
+ */
+void addAlignmentField(FileEntry & entry, std::streamoff offset, size_t alignment)
+{
+    removeAlignmentField(entry);
+
+    // the field has at least 6 bytes: id, size, and the alignment
+    size_t const header_size(static_cast<ZipLocalEntry &>(entry).ZipLocalEntry::getHeaderSize() + 6);
+    size_t const padding((alignment - (offset + header_size) % alignment) % alignment);
+
+    FileEntry::buffer_t extra(entry.getExtra());
+    extra.push_back(static_cast<unsigned char>(g_alignment_extra_field_id & 255));
+    extra.push_back(static_cast<unsigned char>(g_alignment_extra_field_id >> 8));
+    extra.push_back(static_cast<unsigned char>((2 + padding) & 255));
+    extra.push_back(static_cast<unsigned char>((2 + padding) >> 8));
+    extra.push_back(static_cast<unsigned char>(alignment & 255));
+    extra.push_back(static_cast<unsigned char>(alignment >> 8));
+    extra.insert(extra.end(), padding, 0);
+    entry.setExtra(extra);
 }
 
 
@@ -92,10 +135,23 @@ void writeZipCentralDirectory(std::ostream &os, FileEntry::vector_t& entries, st
 ZipOutputStreambuf::ZipOutputStreambuf(std::streambuf * outbuf)
     : DeflateOutputStreambuf(outbuf)
     //, m_zip_comment("") -- auto-init
-    //, m_entries() -- auto-init
+    //, m_entry() -- auto-init
+    //, m_central_directory() -- auto-init
+    //, m_central_directory_count(0) -- auto-init
+    //, m_central_directory_size(0) -- auto-init
+    //, m_central_directory_memory_limit(0) -- auto-init
+    , m_central_directory_spill(nullptr, &std::fclose)
     //, m_compression_level(FileEntry::COMPRESSION_LEVEL_DEFAULT) -- auto-init
     //, m_open_entry(false) -- auto-init
     //, m_open(true) -- auto-init
+    //, m_password() -- auto-init
+    , m_archive_outbuf(outbuf)
+    //, m_encrypt() -- auto-init
+    //, m_store_digests(false) -- auto-init
+    //, m_entry_digests(false) -- auto-init
+    //, m_stored_alignment(0) -- auto-init
+    //, m_entry_aligned(false) -- auto-init
+    //, m_open_deflated_entry(false) -- auto-init
 {
 }
 
@@ -133,6 +189,11 @@ ZipOutputStreambuf::~ZipOutputStreambuf()
  */
 void ZipOutputStreambuf::closeEntry()
 {
+    if(m_open_deflated_entry)
+    {
+        throw InvalidStateException("ZipOutputStreambuf::closeEntry(): the deflated entry must be closed with closeDeflatedEntry().");
+    }
+
     if(!m_open_entry)
     {
         return;
@@ -150,6 +211,13 @@ void ZipOutputStreambuf::closeEntry()
 
     }
 
+    if(m_encrypt != nullptr)
+    {
+        m_encrypt->finish();
+        m_outbuf = m_archive_outbuf;
+        m_encrypt.reset();
+    }
+
     updateEntryHeaderInfo();
     setEntryClosedState();
 }
@@ -183,7 +251,48 @@ void ZipOutputStreambuf::finish()
 
     std::ostream os(m_outbuf);
     closeEntry();
-    writeZipCentralDirectory(os, m_entries, m_zip_comment);
+
+    ZipEndOfCentralDirectory eocd(m_zip_comment);
+    eocd.setOffset(os.tellp());  // start position
+    eocd.setCount(m_central_directory_count);
+    eocd.setCentralDirectorySize(m_central_directory_size);
+
+    // the records which were spilled come first
+    if(m_central_directory_spill != nullptr)
+    {
+        std::FILE * spill(m_central_directory_spill.get());
+        if(std::fflush(spill) != 0
+        || std::fseek(spill, 0, SEEK_SET) != 0)
+        {
+            throw IOException("ZipOutputStreambuf::finish(): could not read back the central directory.");
+        }
+        std::vector<char> buffer(getBufferSize());
+        for(;;)
+        {
+            size_t const size(std::fread(&buffer[0], 1, buffer.size(), spill));
+            if(size == 0)
+            {
+                break;
+            }
+            if(m_outbuf->sputn(&buffer[0], size) != static_cast<std::streamsize>(size))
+            {
+                throw IOException("ZipOutputStreambuf::finish(): write to buffer failed."); // LCOV_EXCL_LINE
+            }
+        }
+        if(std::ferror(spill))
+        {
+            throw IOException("ZipOutputStreambuf::finish(): could not read back the central directory.");
+        }
+        m_central_directory_spill.reset();
+    }
+    if(!m_central_directory.empty()
+    && m_outbuf->sputn(m_central_directory.data(), m_central_directory.size()) != static_cast<std::streamsize>(m_central_directory.size()))
+    {
+        throw IOException("ZipOutputStreambuf::finish(): write to buffer failed."); // LCOV_EXCL_LINE
+    }
+    std::string().swap(m_central_directory);
+
+    eocd.write(os);
 }
 
 
@@ -195,12 +304,20 @@ void ZipOutputStreambuf::finish()
  * If a previous entry was still open, the function calls closeEntry()
  * first.
  *
+ * When a password was defined with setPassword(), the data of the
+ * entry gets encrypted with WinZip AES.
+ *
  * \param[in] entry  The entry to be saved and made current.
  */
 void ZipOutputStreambuf::putNextEntry(FileEntry::pointer_t entry)
 {
     closeEntry();
 
+    // an entry copied from an encrypted archive gets saved with its
+    // real method and encrypted again only if we have a password
+    ZipLocalEntry * local_entry(static_cast<ZipLocalEntry *>(entry.get()));
+    local_entry->clearWinZipAES();
+
     // if the method is STORED force uncompressed data
     if(entry->getMethod() == StorageMethod::STORED)
     {
@@ -217,6 +334,7 @@ void ZipOutputStreambuf::putNextEntry(FileEntry::pointer_t entry)
     {
     case FileEntry::COMPRESSION_LEVEL_NONE:
         setp(&m_invec[0], &m_invec[0] + getBufferSize());
+        resetCrc32();
         break;
 
     default:
@@ -225,22 +343,218 @@ void ZipOutputStreambuf::putNextEntry(FileEntry::pointer_t entry)
 
     }
 
-    m_entries.push_back(entry);
+    bool const encrypt(!m_password.empty() && !entry->isDirectory());
+    if(encrypt)
+    {
+        WinZipAES::extra_field_t field;
+        field.m_method = m_compression_level == FileEntry::COMPRESSION_LEVEL_NONE
+                            ? StorageMethod::STORED
+                            : StorageMethod::DEFLATED;
+        local_entry->setWinZipAES(field);
+    }
+
+    // reserve the digest extra field now, the digests are saved in it
+    // once known, when the header gets written again; an encrypted
+    // entry does not get it since it would reveal the content
+    m_entry_digests = m_store_digests
+                   && !getDigestAlgorithms().empty()
+                   && !entry->isDirectory()
+                   && !encrypt;
+    if(m_entry_digests)
+    {
+        ContentDigest::digest_map_t placeholder;
+        for(auto const a : getDigestAlgorithms())
+        {
+            placeholder[a].resize(ContentDigest::getDigestSize(a));
+        }
+        FileEntry::buffer_t extra(entry->getExtra());
+        ContentDigest::writeExtraField(extra, placeholder);
+        entry->setExtra(extra);
+    }
+
+    m_entry = entry;
 
     std::ostream os(m_outbuf);
 
     // Update entry header info
     entry->setEntryOffset(os.tellp());
+    m_entry_aligned = m_stored_alignment != 0
+                   && m_compression_level == FileEntry::COMPRESSION_LEVEL_NONE
+                   && !entry->isDirectory()
+                   && !encrypt;
+    if(m_entry_aligned)
+    {
+        addAlignmentField(*entry, entry->getEntryOffset(), m_stored_alignment);
+    }
     /** \TODO
      * Rethink the design as we have to force a call to the correct
      * write() function?
      */
-    static_cast<ZipLocalEntry *>(entry.get())->ZipLocalEntry::write(os);
+    local_entry->ZipLocalEntry::write(os);
+
+    if(encrypt)
+    {
+        startEncryption();
+    }
 
     m_open_entry = true;
 }
 
 
+/** \brief Save an entry which is already compressed.
+ *
+ * This function saves the header of \p entry followed by the data
+ * read from \p is as is. The data is expected to already be compressed
+ * with the method of \p entry.
+ *
+ * The size, compressed size, and CRC of \p entry must be set before
+ * this call. Since they are known, the header does not need to be
+ * rewritten and the entry is closed on return.
+ *
+ * If a previous entry was still open, the function calls closeEntry()
+ * first.
+ *
+ * \exception IOException
+ * This exception is raised if the compressed data cannot be read from
+ * \p is or written to the output.
+ *
+ * \param[in] entry  The entry to be saved.
+ * \param[in,out] is  The stream positioned at the compressed data.
+ */
+void ZipOutputStreambuf::putRawEntry(FileEntry::pointer_t entry, std::istream & is)
+{
+    closeEntry();
+
+    m_entry = entry;
+
+    std::ostream os(m_outbuf);
+    entry->setEntryOffset(os.tellp());
+    bool const aligned(m_stored_alignment != 0
+                    && entry->getMethod() == StorageMethod::STORED
+                    && !entry->isDirectory());
+    if(aligned)
+    {
+        addAlignmentField(*entry, entry->getEntryOffset(), m_stored_alignment);
+    }
+    static_cast<ZipLocalEntry *>(entry.get())->ZipLocalEntry::write(os);
+    if(aligned)
+    {
+        // the padding is only needed in the local header
+        removeAlignmentField(*entry);
+    }
+
+    std::vector<char> buffer(getBufferSize());
+    size_t size(entry->getCompressedSize());
+    while(size > 0)
+    {
+        size_t const amount(std::min(size, buffer.size()));
+        if(!is.read(&buffer[0], amount))
+        {
+            throw IOException("ZipOutputStreambuf::putRawEntry(): could not read the compressed data.");
+        }
+        if(m_outbuf->sputn(&buffer[0], amount) != static_cast<std::streamsize>(amount))
+        {
+            throw IOException("ZipOutputStreambuf::putRawEntry(): write to buffer failed."); // LCOV_EXCL_LINE
+        }
+        size -= amount;
+    }
+
+    saveCentralDirectoryRecord();
+}
+
+
+/** \brief Start saving an entry compressed by the caller.
+ *
+ * This function saves the local header of \p entry with the DEFLATED
+ * method. The raw deflate data of the entry is then written with
+ * writeDeflatedData(), as it becomes available, and the entry gets
+ * closed with closeDeflatedEntry() which rewrites the header with the
+ * sizes and CRC. This is used to save data compressed by other threads
+ * without having to hold all of it in memory.
+ *
+ * If a previous entry was still open, the function calls closeEntry()
+ * first.
+ *
+ * \param[in] entry  The entry to be saved.
+ */
+void ZipOutputStreambuf::putDeflatedEntry(FileEntry::pointer_t entry)
+{
+    closeEntry();
+
+    ZipLocalEntry * local_entry(static_cast<ZipLocalEntry *>(entry.get()));
+    local_entry->clearWinZipAES();
+    entry->setMethod(StorageMethod::DEFLATED);
+
+    m_entry = entry;
+
+    std::ostream os(m_outbuf);
+    entry->setEntryOffset(os.tellp());
+    local_entry->ZipLocalEntry::write(os);
+
+    m_open_deflated_entry = true;
+}
+
+
+/** \brief Save raw deflate data in the current deflated entry.
+ *
+ * \exception InvalidStateException
+ * This exception is raised if putDeflatedEntry() was not called first.
+ *
+ * \exception IOException
+ * This exception is raised if the data cannot be written.
+ *
+ * \param[in] data  The compressed data.
+ * \param[in] size  The number of bytes in \p data.
+ */
+void ZipOutputStreambuf::writeDeflatedData(char const * data, size_t size)
+{
+    if(!m_open_deflated_entry)
+    {
+        throw InvalidStateException("ZipOutputStreambuf::writeDeflatedData(): no deflated entry is open.");
+    }
+
+    if(m_outbuf->sputn(data, size) != static_cast<std::streamsize>(size))
+    {
+        throw IOException("ZipOutputStreambuf::writeDeflatedData(): write to buffer failed."); // LCOV_EXCL_LINE
+    }
+}
+
+
+/** \brief Close the current deflated entry.
+ *
+ * This function saves the \p crc and \p size of the uncompressed data
+ * in the entry and rewrites its local header.
+ *
+ * \exception InvalidStateException
+ * This exception is raised if putDeflatedEntry() was not called first.
+ *
+ * \param[in] crc  The CRC32 of the uncompressed data.
+ * \param[in] size  The size of the uncompressed data.
+ */
+void ZipOutputStreambuf::closeDeflatedEntry(uint32_t crc, size_t size)
+{
+    if(!m_open_deflated_entry)
+    {
+        throw InvalidStateException("ZipOutputStreambuf::closeDeflatedEntry(): no deflated entry is open.");
+    }
+    m_open_deflated_entry = false;
+
+    FileEntry::pointer_t entry(m_entry);
+    ZipLocalEntry * local_entry(static_cast<ZipLocalEntry *>(entry.get()));
+    entry->setSize(size);
+    entry->setCrc(crc);
+
+    std::ostream os(m_outbuf);
+    std::streamoff const curr_pos(os.tellp());
+    entry->setCompressedSize(curr_pos - entry->getEntryOffset() - local_entry->ZipLocalEntry::getHeaderSize());
+    os.seekp(entry->getEntryOffset());
+    local_entry->ZipLocalEntry::write(os);
+    os.seekp(curr_pos);
+
+    saveCentralDirectoryRecord();
+}
+
+
 /** \brief Set the archive comment.
  *
  * This function saves a global comment for the Zip archive.
@@ -259,6 +573,82 @@ void ZipOutputStreambuf::setComment(std::string const& comment)
 }
 
 
+/** \brief Set the password used to encrypt the entries.
+ *
+ * When a password is defined, the data of the entries that follow
+ * gets encrypted with WinZip AES-256. The entries keep their CRC
+ * (AE-1) so their data can be verified once decrypted. Directories
+ * are not encrypted since they have no data.
+ *
+ * An empty password turns the encryption off.
+ *
+ * \param[in] password  The password used to encrypt the entries.
+ */
+void ZipOutputStreambuf::setPassword(std::string const & password)
+{
+    m_password = password;
+}
+
+
+/** \brief Check whether the digests get saved in the entries.
+ *
+ * \return true if the digests get saved in an extra field.
+ */
+bool ZipOutputStreambuf::getStoreDigests() const
+{
+    return m_store_digests;
+}
+
+
+/** \brief Save the digests in an extra field of the entries.
+ *
+ * When digest algorithms are defined (see setDigestAlgorithms()) and
+ * this flag is true, the digests of each file get saved in a private
+ * extra field of its local and central directory headers. A reader
+ * can then verify the data with ContentDigest::readExtraField().
+ *
+ * Encrypted entries never get the extra field.
+ *
+ * \param[in] store  Whether the digests get saved in the entries.
+ */
+void ZipOutputStreambuf::setStoreDigests(bool store)
+{
+    m_store_digests = store;
+}
+
+
+/** \brief Align the data of the stored entries.
+ *
+ * When \p alignment is not zero, the local header of the entries that
+ * follow and use the STORED method gets padded so their data starts
+ * at a multiple of \p alignment in the output. The padding is an extra
+ * field which only appears in the local header.
+ *
+ * \param[in] alignment  The alignment, a power of two, or 0.
+ */
+void ZipOutputStreambuf::setStoredAlignment(size_t alignment)
+{
+    m_stored_alignment = alignment;
+}
+
+
+/** \brief Limit the memory used by the central directory.
+ *
+ * The central directory record of each entry is kept in memory until
+ * finish() gets called. For archives with millions of entries, that
+ * can still be a lot of memory. When \p limit is not zero and the
+ * records use more than \p limit bytes, they get moved to a temporary
+ * file, which is copied to the output by finish().
+ *
+ * \param[in] limit  The maximum number of bytes of records kept in
+ *                   memory, 0 to keep all of them in memory.
+ */
+void ZipOutputStreambuf::setCentralDirectoryMemoryLimit(size_t limit)
+{
+    m_central_directory_memory_limit = limit;
+}
+
+
 //
 // Protected and private methods
 //
@@ -283,6 +673,7 @@ int ZipOutputStreambuf::overflow(int c)
     {
         // Ok, we are STORED, so we handle it ourselves to avoid "side
         // effects" from zlib, which adds markers every now and then.
+        updateCrc32(&m_invec[0], size);
         size_t const bc(m_outbuf->sputn(&m_invec[0], size));
         if(size != bc)
         {
@@ -309,6 +700,54 @@ int ZipOutputStreambuf::overflow(int c)
 }
 
 
+/** \brief Write a block of data.
+ *
+ * Small blocks are copied to the buffer as usual. Blocks at least as
+ * large as the buffer are processed in place: the buffer gets flushed
+ * and then the block is compressed, or written as is for STORED
+ * entries, directly from \p s. This is what happens when an input
+ * stream reading from a memory mapping is saved with
+ * `os << is->rdbuf()`, so the data does not get copied in m_invec.
+ *
+ * \exception IOException
+ * This exception is raised if the data cannot be compressed or written.
+ *
+ * \param[in] s  The data to write.
+ * \param[in] n  The number of bytes in \p s.
+ *
+ * \return The number of bytes written, always \p n.
+ */
+std::streamsize ZipOutputStreambuf::xsputn(char const * s, std::streamsize n)
+{
+    if(!m_open_entry
+    || n < static_cast<std::streamsize>(getBufferSize()))
+    {
+        return DeflateOutputStreambuf::xsputn(s, n);
+    }
+
+    overflow();
+
+    m_overflown_bytes += n;
+    switch(m_compression_level)
+    {
+    case FileEntry::COMPRESSION_LEVEL_NONE:
+        updateCrc32(s, n);
+        if(m_outbuf->sputn(s, n) != n)
+        {
+            throw IOException("ZipOutputStreambuf::xsputn(): write to buffer failed."); // LCOV_EXCL_LINE
+        }
+        break;
+
+    default:
+        deflateData(s, n);
+        break;
+
+    }
+
+    return n;
+}
+
+
 
 /** \brief Implement the sync() functionality.
  *
@@ -325,6 +764,53 @@ int ZipOutputStreambuf::sync() // LCOV_EXCL_LINE
 
 
 
+/** \brief Save the central directory record of the current entry.
+ *
+ * Once an entry was written and its header is final, its central
+ * directory record gets serialized at the end of m_central_directory
+ * and the entry is released. This way the writer does not keep one
+ * FileEntry object per entry (with its name, comment, extra field,
+ * and for DirectoryEntry objects its stat buffer) until the end. Each
+ * record uses the 46 bytes of its header plus its variable fields.
+ *
+ * When a memory limit is defined and the records use more memory,
+ * they get appended to a temporary file.
+ *
+ * \exception IOException
+ * This exception is raised if the temporary file cannot be created or
+ * written to.
+ */
+void ZipOutputStreambuf::saveCentralDirectoryRecord()
+{
+    std::ostringstream record;
+    m_entry->write(record);
+    m_entry.reset();
+
+    std::string const & data(record.str());
+    m_central_directory += data;
+    ++m_central_directory_count;
+    m_central_directory_size += data.length();
+
+    if(m_central_directory_memory_limit != 0
+    && m_central_directory.size() > m_central_directory_memory_limit)
+    {
+        if(m_central_directory_spill == nullptr)
+        {
+            m_central_directory_spill.reset(std::tmpfile());
+            if(m_central_directory_spill == nullptr)
+            {
+                throw IOException("ZipOutputStreambuf::saveCentralDirectoryRecord(): could not create a temporary file.");
+            }
+        }
+        if(std::fwrite(m_central_directory.data(), 1, m_central_directory.size(), m_central_directory_spill.get()) != m_central_directory.size())
+        {
+            throw IOException("ZipOutputStreambuf::saveCentralDirectoryRecord(): could not write to the temporary file.");
+        }
+        m_central_directory.clear();
+    }
+}
+
+
 /** \brief Mark the current entry as closed.
  *
  * After the putNextEntry() call and saving of the file content, the
@@ -342,6 +828,38 @@ void ZipOutputStreambuf::setEntryClosedState()
 }
 
 
+/** \brief Start the encryption of the current entry.
+ *
+ * This function writes a new random salt and the password verifier
+ * right after the local header, then sends the data of the entry
+ * through an AESOutputStreambuf until the entry gets closed.
+ *
+ * \exception IOException
+ * This exception is raised if the salt cannot be written.
+ */
+void ZipOutputStreambuf::startEncryption()
+{
+    int const strength(WinZipAES::STRENGTH_256);
+    std::vector<uint8_t> salt(WinZipAES::getSaltSize(strength));
+    std::random_device random;
+    for(auto & b : salt)
+    {
+        b = static_cast<uint8_t>(random());
+    }
+
+    WinZipAES::pointer_t aes(new WinZipAES(m_password, &salt[0], strength));
+    WinZipAES::verifier_t const & verifier(aes->getVerifier());
+    if(m_outbuf->sputn(reinterpret_cast<char const *>(&salt[0]), salt.size()) != static_cast<std::streamsize>(salt.size())
+    || m_outbuf->sputn(reinterpret_cast<char const *>(verifier.data()), verifier.size()) != static_cast<std::streamsize>(verifier.size()))
+    {
+        throw IOException("ZipOutputStreambuf::startEncryption(): write to buffer failed."); // LCOV_EXCL_LINE
+    }
+
+    m_encrypt.reset(new AESOutputStreambuf(m_outbuf, std::move(aes)));
+    m_outbuf = m_encrypt.get();
+}
+
+
 /** \brief Save the header information.
  *
  * This function saves parameters that are now available in the header
@@ -361,12 +879,19 @@ void ZipOutputStreambuf::updateEntryHeaderInfo()
     }
 
     std::ostream os(m_outbuf);
-    int const curr_pos(os.tellp());
+    std::streamoff const curr_pos(os.tellp());
 
-    // update fields in m_entries.back()
-    FileEntry::pointer_t entry(m_entries.back());
+    // update fields in m_entry
+    FileEntry::pointer_t entry(m_entry);
     entry->setSize(getSize());
     entry->setCrc(getCrc32());
+    if(m_entry_digests)
+    {
+        // same size as the placeholder so the header size does not change
+        FileEntry::buffer_t extra(entry->getExtra());
+        ContentDigest::writeExtraField(extra, getDigests());
+        entry->setExtra(extra);
+    }
     /** \TODO
      * Rethink the design as we have to force a call to the correct
      * getHeaderSize() function?
@@ -381,6 +906,15 @@ void ZipOutputStreambuf::updateEntryHeaderInfo()
      */
     static_cast<ZipLocalEntry *>(entry.get())->ZipLocalEntry::write(os);
     os.seekp(curr_pos);
+
+    if(m_entry_aligned)
+    {
+        // the padding is only needed in the local header
+        removeAlignmentField(*entry);
+        m_entry_aligned = false;
+    }
+
+    saveCentralDirectoryRecord();
 }
 
 
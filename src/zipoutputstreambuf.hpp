@@ -29,10 +29,13 @@
  * This class is used to save files in a Zip archive.
  */
 
+#include "aesoutputstreambuf.hpp"
 #include "deflateoutputstreambuf.hpp"
 
 #include "zipios/fileentry.hpp"
 
+#include <cstdio>
+
 
 namespace zipios
 {
@@ -50,21 +53,48 @@ public:
     void                        close();
     void                        finish();
     void                        putNextEntry(FileEntry::pointer_t entry);
+    void                        putRawEntry(FileEntry::pointer_t entry, std::istream & is);
+    void                        putDeflatedEntry(FileEntry::pointer_t entry);
+    void                        writeDeflatedData(char const * data, size_t size);
+    void                        closeDeflatedEntry(uint32_t crc, size_t size);
     void                        setComment(std::string const& comment);
+    void                        setPassword(std::string const & password);
+    bool                        getStoreDigests() const;
+    void                        setStoreDigests(bool store);
+    void                        setStoredAlignment(size_t alignment);
+    void                        setCentralDirectoryMemoryLimit(size_t limit);
 
 protected:
     virtual int                 overflow(int c = EOF) override;
+    virtual std::streamsize     xsputn(char const * s, std::streamsize n) override;
     virtual int                 sync() override;
 
 private:
+    void                        saveCentralDirectoryRecord();
     void                        setEntryClosedState();
+    void                        startEncryption();
     void                        updateEntryHeaderInfo();
 
     std::string                 m_zip_comment;
-    FileEntry::vector_t         m_entries;
+    FileEntry::pointer_t        m_entry;
+    std::string                 m_central_directory;
+    size_t                      m_central_directory_count = 0;
+    size_t                      m_central_directory_size = 0;
+    size_t                      m_central_directory_memory_limit = 0;
+    std::unique_ptr<std::FILE, int (*)(std::FILE *)>
+                                m_central_directory_spill;
     FileEntry::CompressionLevel m_compression_level = FileEntry::COMPRESSION_LEVEL_DEFAULT;
     bool                        m_open_entry = false;
     bool                        m_open = true;
+    std::string                 m_password;
+    std::streambuf *            m_archive_outbuf = nullptr;
+    std::unique_ptr<AESOutputStreambuf>
+                                m_encrypt;
+    bool                        m_store_digests = false;
+    bool                        m_entry_digests = false;
+    size_t                      m_stored_alignment = 0;
+    bool                        m_entry_aligned = false;
+    bool                        m_open_deflated_entry = false;
 };
 
 
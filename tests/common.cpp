@@ -27,7 +27,11 @@
 
 #include "tests.hpp"
 
+#include "src/sha256.hpp"
+#include "src/winzipaes.hpp"
+#include "src/xxhash64.hpp"
 #include "src/zipios_common.hpp"
+#include "zipios/contentdigest.hpp"
 #include "zipios/zipiosexceptions.hpp"
 
 #include <fstream>
@@ -975,6 +979,341 @@ SCENARIO("Write to file", "[zipios_common] [io]")
 }
 
 
+TEST_CASE("SHA-256 digests", "[zipios_common]")
+{
+    SECTION("known digests")
+    {
+        zipios::SHA256 sha;
+        REQUIRE(sha.hexDigest() == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+        sha.reset();
+        sha.update("abc", 3);
+        REQUIRE(sha.hexDigest() == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+        sha.reset();
+        std::string const two_blocks("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq");
+        sha.update(two_blocks.c_str(), two_blocks.length());
+        REQUIRE(sha.hexDigest() == "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    }
+
+    SECTION("the digest does not depend on how the data is split")
+    {
+        std::string const million(1000000, 'a');
+        for(size_t chunk(1); chunk < 200; chunk += rand() % 50 + 1)
+        {
+            zipios::SHA256 sha;
+            for(size_t pos(0); pos < million.length(); pos += chunk)
+            {
+                sha.update(million.c_str() + pos, std::min(chunk, million.length() - pos));
+            }
+            REQUIRE(sha.hexDigest() == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+        }
+    }
+}
+
+
+TEST_CASE("Content digests", "[zipios_common] [ContentDigest]")
+{
+    std::string const fox("The quick brown fox jumps over the lazy dog");
+
+    SECTION("XXH64 hashes")
+    {
+        zipios::XXHash64 xxh;
+        REQUIRE(xxh.hash() == 0xef46db3751d8e999ULL);
+
+        xxh.update("abc", 3);
+        REQUIRE(xxh.hash() == 0x44bc2cf5ad770999ULL);
+
+        // hash() does not end the computation
+        xxh.reset();
+        xxh.update(fox.c_str(), 10);
+        xxh.hash();
+        xxh.update(fox.c_str() + 10, fox.length() - 10);
+        REQUIRE(xxh.hash() == 0x0b242d361fda71bcULL);
+
+        zipios::XXHash64 seeded(1);
+        seeded.update(fox.c_str(), fox.length());
+        REQUIRE(seeded.hash() == 0xdf5091b6dad2c6dbULL);
+
+        zipios::XXHash64::digest_t const d(seeded.digest());
+        REQUIRE(d[0] == 0xdf);
+        REQUIRE(d[7] == 0xdb);
+    }
+
+    SECTION("XXH64 does not depend on how the data is split")
+    {
+        std::string const million(1000000, 'a');
+        for(size_t chunk(1); chunk < 200; chunk += rand() % 50 + 1)
+        {
+            zipios::XXHash64 xxh;
+            for(size_t pos(0); pos < million.length(); pos += chunk)
+            {
+                xxh.update(million.c_str() + pos, std::min(chunk, million.length() - pos));
+            }
+            REQUIRE(xxh.hash() == 0xdc483aaa9b4fdc40ULL);
+        }
+    }
+
+    SECTION("several digests in one pass")
+    {
+        zipios::ContentDigest digest({ zipios::DigestAlgorithm::XXH64, zipios::DigestAlgorithm::SHA256, zipios::DigestAlgorithm::XXH64 });
+        REQUIRE(digest.getAlgorithms().size() == 2);
+        REQUIRE_FALSE(digest.empty());
+
+        digest.update(fox.c_str(), fox.length());
+        zipios::ContentDigest::digest_map_t digests(digest.digests());
+        REQUIRE(digests.size() == 2);
+        REQUIRE(zipios::ContentDigest::toHex(digests[zipios::DigestAlgorithm::SHA256]) == "d7a8fbb307d7809469ca9abcb0082e4f8d5651e46d3cdb762d02d0bf37c9e592");
+        REQUIRE(zipios::ContentDigest::toHex(digests[zipios::DigestAlgorithm::XXH64]) == "0b242d361fda71bc");
+
+        // digests() can be called again
+        REQUIRE(digest.digests() == digests);
+
+        digest.reset();
+        digests = digest.digests();
+        REQUIRE(zipios::ContentDigest::toHex(digests[zipios::DigestAlgorithm::SHA256]) == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        REQUIRE(zipios::ContentDigest::toHex(digests[zipios::DigestAlgorithm::XXH64]) == "ef46db3751d8e999");
+
+        REQUIRE(zipios::ContentDigest::getName(zipios::DigestAlgorithm::SHA256) == "sha256");
+        REQUIRE(zipios::ContentDigest::getName(zipios::DigestAlgorithm::XXH64) == "xxh64");
+
+        zipios::ContentDigest none;
+        REQUIRE(none.empty());
+        none.update(fox.c_str(), fox.length());
+        REQUIRE(none.digests().empty());
+
+        REQUIRE_THROWS_AS(zipios::ContentDigest({ static_cast<zipios::DigestAlgorithm>(77) }), zipios::InvalidException);
+    }
+
+    SECTION("digest extra field")
+    {
+        zipios::ContentDigest digest({ zipios::DigestAlgorithm::SHA256, zipios::DigestAlgorithm::XXH64 });
+        digest.update(fox.c_str(), fox.length());
+        zipios::ContentDigest::digest_map_t const digests(digest.digests());
+
+        // keep another field before ours
+        zipios::FileEntry::buffer_t extra{ 0x34, 0x12, 2, 0, 'a', 'b' };
+        zipios::ContentDigest::digest_map_t found;
+        REQUIRE_FALSE(zipios::ContentDigest::readExtraField(extra, found));
+
+        zipios::ContentDigest::writeExtraField(extra, digests);
+        REQUIRE(extra.size() == 6 + 4 + 2 + 32 + 2 + 8);
+        REQUIRE(zipios::ContentDigest::readExtraField(extra, found));
+        REQUIRE(found == digests);
+
+        // writing again replaces the field
+        zipios::ContentDigest::writeExtraField(extra, digests);
+        REQUIRE(extra.size() == 6 + 4 + 2 + 32 + 2 + 8);
+
+        // a truncated record is rejected
+        zipios::FileEntry::buffer_t broken(extra);
+        broken[6 + 2] -= 1;
+        broken.pop_back();
+        REQUIRE_FALSE(zipios::ContentDigest::readExtraField(broken, found));
+
+        zipios::ContentDigest::removeExtraField(extra);
+        REQUIRE(extra == zipios::FileEntry::buffer_t({ 0x34, 0x12, 2, 0, 'a', 'b' }));
+    }
+}
+
+
+TEST_CASE("WinZip AES primitives", "[zipios_common] [WinZipAES]")
+{
+    auto const hex = [](uint8_t const * data, size_t size)
+    {
+        static char const g_hex[] = "0123456789abcdef";
+        std::string result;
+        for(size_t idx(0); idx < size; ++idx)
+        {
+            result += g_hex[data[idx] >> 4];
+            result += g_hex[data[idx] & 15];
+        }
+        return result;
+    };
+
+    SECTION("SHA-1 digests")
+    {
+        for(int hardware(0); hardware < 2; ++hardware)
+        {
+            zipios::SHA1 sha;
+            sha.setHardwareAcceleration(hardware != 0);
+            REQUIRE(sha.getHardwareAcceleration() == (hardware != 0 && zipios::SHA1::hasHardwareSupport()));
+            REQUIRE(sha.hexDigest() == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+
+            sha.reset();
+            sha.update("abc", 3);
+            REQUIRE(sha.hexDigest() == "a9993e364706816aba3e25717850c26c9cd0d89d");
+
+            sha.reset();
+            std::string const two_blocks("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq");
+            sha.update(two_blocks.c_str(), two_blocks.length());
+            REQUIRE(sha.hexDigest() == "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+
+            sha.reset();
+            std::string const million(1000000, 'a');
+            for(size_t pos(0); pos < million.length(); pos += 999)
+            {
+                sha.update(million.c_str() + pos, std::min(static_cast<size_t>(999), million.length() - pos));
+            }
+            REQUIRE(sha.hexDigest() == "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+        }
+    }
+
+    SECTION("HMAC-SHA1 codes (RFC 2202)")
+    {
+        std::string const key1(20, '\x0b');
+        zipios::HMACSHA1 hmac1(key1.c_str(), key1.length());
+        hmac1.update("Hi There", 8);
+        zipios::HMACSHA1::digest_t const d1(hmac1.digest());
+        REQUIRE(hex(d1.data(), d1.size()) == "b617318655057264e28bc0b6fb378c8ef146be00");
+
+        zipios::HMACSHA1 hmac2("Jefe", 4);
+        std::string const data2("what do ya want for nothing?");
+        hmac2.update(data2.c_str(), data2.length());
+        zipios::HMACSHA1::digest_t const d2(hmac2.digest());
+        REQUIRE(hex(d2.data(), d2.size()) == "effcdf6ae5eb2fa2d27416d5f184df9c259a7c79");
+
+        // the object is ready for another code once digest() was called
+        hmac2.update(data2.c_str(), data2.length());
+        zipios::HMACSHA1::digest_t const d2b(hmac2.digest());
+        REQUIRE(d2b == d2);
+
+        std::string const key6(80, '\xaa');
+        zipios::HMACSHA1 hmac6(key6.c_str(), key6.length());
+        std::string const data6("Test Using Larger Than Block-Size Key - Hash Key First");
+        hmac6.update(data6.c_str(), data6.length());
+        zipios::HMACSHA1::digest_t const d6(hmac6.digest());
+        REQUIRE(hex(d6.data(), d6.size()) == "aa4ae5e15272d00e95705637ce8a3b55ed402112");
+    }
+
+    SECTION("PBKDF2-HMAC-SHA1 keys (RFC 6070)")
+    {
+        uint8_t const * salt(reinterpret_cast<uint8_t const *>("salt"));
+        uint8_t key[25];
+        zipios::pbkdf2HmacSha1("password", salt, 4, 1, key, 20);
+        REQUIRE(hex(key, 20) == "0c60c80f961f0e71f3a9b524af6012062fe037a6");
+        zipios::pbkdf2HmacSha1("password", salt, 4, 2, key, 20);
+        REQUIRE(hex(key, 20) == "ea6c014dc72d6f8ccd1ed92ace1d41f0d8de8957");
+        zipios::pbkdf2HmacSha1("password", salt, 4, 4096, key, 20);
+        REQUIRE(hex(key, 20) == "4b007901b765489abead49d926f721d065a429c1");
+
+        uint8_t const * long_salt(reinterpret_cast<uint8_t const *>("saltSALTsaltSALTsaltSALTsaltSALTsalt"));
+        zipios::pbkdf2HmacSha1("passwordPASSWORDpassword", long_salt, 36, 4096, key, 25);
+        REQUIRE(hex(key, 25) == "3d2eec4fe41c849b80c8d83662c0e44a8b291a964cf2f07038");
+    }
+
+    SECTION("AES block encryption (FIPS 197)")
+    {
+        uint8_t key[32];
+        for(size_t idx(0); idx < sizeof(key); ++idx)
+        {
+            key[idx] = static_cast<uint8_t>(idx);
+        }
+        uint8_t const plaintext[16] =
+        {
+            0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+            0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+        };
+        char const * expected[3] =
+        {
+            "69c4e0d86a7b0430d8cdb78070b4c55a",
+            "dda97ca4864cdfe06eaf70a0ec0d7191",
+            "8ea2b7ca516745bfeafc49904b496089"
+        };
+
+        for(int hardware(0); hardware < 2; ++hardware)
+        {
+            for(size_t k(0); k < 3; ++k)
+            {
+                zipios::AES aes(key, 16 + k * 8);
+                aes.setHardwareAcceleration(hardware != 0);
+                uint8_t ciphertext[16];
+                aes.encryptBlocks(plaintext, ciphertext, 1);
+                REQUIRE(hex(ciphertext, 16) == expected[k]);
+            }
+        }
+
+        REQUIRE_THROWS_AS(zipios::AES(key, 20), zipios::InvalidException);
+    }
+
+    SECTION("AES instructions and tables give the same results")
+    {
+        uint8_t key[32];
+        for(auto & k : key)
+        {
+            k = static_cast<uint8_t>(rand());
+        }
+        std::vector<uint8_t> blocks(16 * 37);
+        for(auto & b : blocks)
+        {
+            b = static_cast<uint8_t>(rand());
+        }
+
+        zipios::AES hardware(key, sizeof(key));
+        zipios::AES software(key, sizeof(key));
+        software.setHardwareAcceleration(false);
+        REQUIRE_FALSE(software.getHardwareAcceleration());
+        REQUIRE(hardware.getHardwareAcceleration() == zipios::AES::hasHardwareSupport());
+
+        std::vector<uint8_t> out1(blocks.size());
+        std::vector<uint8_t> out2(blocks.size());
+        hardware.encryptBlocks(&blocks[0], &out1[0], blocks.size() / 16);
+        software.encryptBlocks(&blocks[0], &out2[0], blocks.size() / 16);
+        REQUIRE(out1 == out2);
+    }
+
+    SECTION("WinZip AES data round trip")
+    {
+        uint8_t salt[16];
+        for(auto & s : salt)
+        {
+            s = static_cast<uint8_t>(rand());
+        }
+        std::string data(10000, '\0');
+        for(auto & c : data)
+        {
+            c = static_cast<char>(rand());
+        }
+
+        zipios::WinZipAES encryptor("secret", salt, zipios::WinZipAES::STRENGTH_256);
+        std::string encrypted(data);
+        encryptor.encrypt(&encrypted[0], 100);
+        encryptor.encrypt(&encrypted[100], encrypted.size() - 100);
+        REQUIRE(encrypted != data);
+
+        zipios::WinZipAES decryptor("secret", salt, zipios::WinZipAES::STRENGTH_256);
+        REQUIRE(decryptor.getVerifier() == encryptor.getVerifier());
+        std::string decrypted(encrypted);
+        decryptor.decrypt(&decrypted[0], decrypted.size());
+        REQUIRE(decrypted == data);
+        REQUIRE(decryptor.getMac() == encryptor.getMac());
+
+        zipios::WinZipAES wrong("Secret", salt, zipios::WinZipAES::STRENGTH_256);
+        REQUIRE(wrong.getVerifier() != encryptor.getVerifier());
+    }
+
+    SECTION("WinZip AES extra field")
+    {
+        zipios::FileEntry::buffer_t extra = { 0x55, 0x54, 0x01, 0x00, 0x07 };
+        zipios::WinZipAES::extra_field_t field;
+        REQUIRE_FALSE(zipios::WinZipAES::readExtraField(extra, field));
+
+        field.m_method = zipios::StorageMethod::STORED;
+        zipios::WinZipAES::writeExtraField(extra, field);
+        REQUIRE(extra.size() == 5 + 11);
+
+        zipios::WinZipAES::extra_field_t found;
+        REQUIRE(zipios::WinZipAES::readExtraField(extra, found));
+        REQUIRE(found.m_version == 1);
+        REQUIRE(found.m_strength == 3);
+        REQUIRE(found.m_method == zipios::StorageMethod::STORED);
+
+        zipios::WinZipAES::removeExtraField(extra);
+        REQUIRE(extra == zipios::FileEntry::buffer_t({ 0x55, 0x54, 0x01, 0x00, 0x07 }));
+    }
+}
+
+
 // Local Variables:
 // mode: cpp
 // indent-tabs-mode: nil
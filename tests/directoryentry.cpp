@@ -74,6 +74,7 @@ SCENARIO("DirectoryEntry with invalid paths", "[DirectoryEntry] [FileEntry]")
             REQUIRE(de.getComment().empty());
             REQUIRE(de.getCompressedSize() == 0);
             REQUIRE(de.getCrc() == 0);
+            REQUIRE(de.getDataOffset() == 0);
             REQUIRE(de.getEntryOffset() == 0);
             REQUIRE(de.getExtra().empty());
             REQUIRE(de.getHeaderSize() == 0);
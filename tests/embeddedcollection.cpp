@@ -0,0 +1,202 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ *
+ * Zipios unit tests for the EmbeddedCollection class.
+ */
+
+#include "tests.hpp"
+
+#include "zipios/directorycollection.hpp"
+#include "zipios/embeddedcollection.hpp"
+#include "zipios/zipfile.hpp"
+#include "zipios/zipiosexceptions.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+
+
+
+TEST_CASE("EmbeddedCollection perfect hash", "[EmbeddedCollection] [FileCollection]")
+{
+    static_assert(zipios::embeddedHash("abc", 3, 0) != zipios::embeddedHash("abc", 3, 1), "the seed must change the hash");
+
+    for(size_t count(0); count < 300; count += rand() % 20 + 1)
+    {
+        std::vector<std::string> names;
+        for(size_t idx(0); idx < count; ++idx)
+        {
+            names.push_back("dir/file-" + std::to_string(idx) + ".txt");
+        }
+
+        std::vector<int32_t> displacements;
+        std::vector<size_t> slots;
+        REQUIRE(zipios::EmbeddedCollection::computePerfectHash(names, displacements, slots));
+        REQUIRE(displacements.size() == count);
+        REQUIRE(slots.size() == count);
+
+        // build a table with only the names
+        std::vector<zipios::EmbeddedArchiveEntry> table(count);
+        for(size_t idx(0); idx < count; ++idx)
+        {
+            REQUIRE(slots[idx] < count);
+            REQUIRE(table[slots[idx]].m_name == nullptr);
+            table[slots[idx]].m_name = names[idx].c_str();
+            table[slots[idx]].m_name_length = names[idx].length();
+        }
+        zipios::EmbeddedArchive const archive = { nullptr, 0, table.data(), count, displacements.data() };
+
+        for(size_t idx(0); idx < count; ++idx)
+        {
+            REQUIRE(zipios::EmbeddedCollection::findEntry(archive, names[idx]) == slots[idx]);
+        }
+        REQUIRE(zipios::EmbeddedCollection::findEntry(archive, "dir/file-.txt") == zipios::EmbeddedCollection::npos);
+        REQUIRE(zipios::EmbeddedCollection::findEntry(archive, "") == zipios::EmbeddedCollection::npos);
+    }
+}
+
+
+TEST_CASE("EmbeddedCollection of an archive", "[EmbeddedCollection] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_zip("tree.zip");
+
+    zipios::DirectoryCollection dc("tree");
+    dc.setMethod(100, zipios::StorageMethod::STORED, zipios::StorageMethod::DEFLATED);
+    {
+        std::ofstream out("tree.zip", std::ios::out | std::ios::binary | std::ios::trunc);
+        zipios::ZipFile::saveCollectionToArchive(out, dc);
+    }
+
+    // generate the table the way the zipembed tool does
+    std::ifstream in("tree.zip", std::ios::in | std::ios::binary);
+    std::vector<char> const data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    zipios::ZipFile zf("tree.zip");
+    zipios::FileEntry::vector_t const v(zf.entries());
+    std::vector<std::string> names;
+    for(auto const & entry : v)
+    {
+        names.push_back(entry->getName());
+    }
+    std::vector<int32_t> displacements;
+    std::vector<size_t> slots;
+    REQUIRE(zipios::EmbeddedCollection::computePerfectHash(names, displacements, slots));
+    std::vector<zipios::EmbeddedArchiveEntry> table(v.size());
+    for(size_t idx(0); idx < v.size(); ++idx)
+    {
+        size_t const offset(v[idx]->getEntryOffset());
+        size_t const name_length(static_cast<unsigned char>(data[offset + 26]) | (static_cast<unsigned char>(data[offset + 27]) << 8));
+        size_t const extra_length(static_cast<unsigned char>(data[offset + 28]) | (static_cast<unsigned char>(data[offset + 29]) << 8));
+        zipios::EmbeddedArchiveEntry & e(table[slots[idx]]);
+        e.m_name = names[idx].c_str();
+        e.m_name_length = names[idx].length();
+        e.m_offset = offset + 30 + name_length + extra_length;
+        e.m_compressed_size = v[idx]->getCompressedSize();
+        e.m_size = v[idx]->getSize();
+        e.m_crc32 = v[idx]->getCrc();
+        e.m_dosdatetime = v[idx]->getTime();
+        e.m_method = static_cast<uint16_t>(v[idx]->getMethod());
+        e.m_is_directory = v[idx]->isDirectory();
+    }
+    zipios::EmbeddedArchive const archive =
+    {
+        reinterpret_cast<unsigned char const *>(data.data()),
+        data.size(),
+        table.data(),
+        table.size(),
+        displacements.data()
+    };
+
+    zipios::EmbeddedCollection ec(archive);
+    REQUIRE(ec.isValid());
+    REQUIRE(ec.getName() == "embedded");
+    REQUIRE(ec.size() == v.size());
+
+    for(auto const & entry : v)
+    {
+        zipios::FileEntry::pointer_t e(ec.getEntry(entry->getName()));
+        REQUIRE(e);
+        REQUIRE(e->getName() == entry->getName());
+        REQUIRE(e->isDirectory() == entry->isDirectory());
+        REQUIRE(e->getMethod() == entry->getMethod());
+        REQUIRE(e->getSize() == entry->getSize());
+        REQUIRE(e->getCompressedSize() == entry->getCompressedSize());
+        REQUIRE(e->getCrc() == entry->getCrc());
+        REQUIRE(e->getTime() == entry->getTime());
+
+        zipios::FileCollection::stream_pointer_t is(ec.getInputStream(entry->getName()));
+        if(entry->isDirectory())
+        {
+            REQUIRE_FALSE(is);
+        }
+        else
+        {
+            REQUIRE(is);
+            std::ostringstream embedded;
+            embedded << is->rdbuf();
+            zipios::FileCollection::stream_pointer_t zis(zf.getInputStream(entry->getName()));
+            std::ostringstream expected;
+            expected << zis->rdbuf();
+            REQUIRE(embedded.str() == expected.str());
+        }
+
+        // the file name alone can also be searched
+        REQUIRE(ec.getEntry(entry->getFileName(), zipios::FileCollection::MatchPath::IGNORE));
+    }
+
+    REQUIRE_FALSE(ec.getEntry("tree/not-in-there"));
+    REQUIRE_FALSE(ec.getInputStream("tree/not-in-there"));
+    REQUIRE_FALSE(ec.getEntry("not-in-there", zipios::FileCollection::MatchPath::IGNORE));
+
+    // once loaded, the same entries are returned by getEntry()
+    zipios::FileEntry::vector_t const entries(ec.entries());
+    REQUIRE(entries.size() == v.size());
+    for(auto const & entry : entries)
+    {
+        REQUIRE(ec.getEntry(entry->getName()) == entry);
+    }
+
+    zipios::FileCollection::pointer_t copy(ec.clone());
+    REQUIRE(copy->size() == v.size());
+
+    REQUIRE_THROWS_AS(ec.addEntry(*entries[0]), zipios::InvalidStateException);
+
+    ec.close();
+    REQUIRE_FALSE(ec.isValid());
+    REQUIRE_THROWS_AS(ec.size(), zipios::InvalidStateException);
+    REQUIRE_THROWS_AS(ec.getEntry(names[0]), zipios::InvalidStateException);
+    REQUIRE_THROWS_AS(ec.getInputStream(names[0]), zipios::InvalidStateException);
+    REQUIRE(copy->isValid());
+}
+
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,420 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \anchor perf_tests_anchor
+ *
+ * Zipios performance regression tests.
+ *
+ * This program measures one hot path of the library (see the cases
+ * below) and compares the result against a baseline saved in a plain
+ * text file, one "case value" pair per line. When the result is worse
+ * than the baseline by more than the tolerance, the program fails.
+ *
+ * The baseline depends on the machine, so it is not part of the
+ * sources: when the file does not include a value for a case yet,
+ * the measurement gets saved as its baseline. Use --update to save
+ * new baselines after an expected change. The RUN_PERF_TESTS CMake
+ * option registers one CTest test per case.
+ */
+
+#include "zipios/zipfile.hpp"
+#include "zipios/directorycollection.hpp"
+#include "zipios/zipiosexceptions.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+
+#include <sys/stat.h>
+
+
+namespace
+{
+
+
+/** \brief The directory with the files used by the benchmarks.
+ */
+char const * const g_data_directory = "perf_data";
+
+
+/** \brief The archive used by the reading benchmarks.
+ */
+char const * const g_archive = "perf_data.zip";
+
+
+/** \brief The number of small files in the benchmark data.
+ *
+ * Enough files for the central directory to matter when opening the
+ * archive and when searching entries.
+ */
+int const g_small_file_count = 5000;
+
+
+/** \brief The size of the large file of the benchmark data.
+ */
+size_t const g_large_file_size = 16 * 1024 * 1024;
+
+
+/** \brief The number of times each benchmark runs.
+ *
+ * The best result is kept, which filters out most of the noise of
+ * other processes running on the machine.
+ */
+int const g_repeat = 3;
+
+
+struct perf_case_t
+{
+    char const *                m_name;
+    char const *                m_unit;
+    bool                        m_higher_is_better;
+    std::function<double()>     m_run;
+};
+
+
+double elapsed(std::chrono::steady_clock::time_point const & start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+/** \brief Create the benchmark data unless it already exists.
+ *
+ * The files are created with a fixed seed so their content, and thus
+ * the work done by the benchmarks, is the same on each run.
+ */
+void createData()
+{
+    std::string const complete(std::string(g_data_directory) + "/.complete");
+    struct stat st;
+    if(stat(complete.c_str(), &st) == 0)
+    {
+        return;
+    }
+
+    mkdir(g_data_directory, 0777);
+    std::mt19937 random(12345);
+    for(int idx(0); idx < g_small_file_count; ++idx)
+    {
+        std::string const subdirectory(std::string(g_data_directory) + "/d" + std::to_string(idx % 100));
+        mkdir(subdirectory.c_str(), 0777);
+        std::ofstream out(subdirectory + "/file" + std::to_string(idx) + ".txt", std::ios::out | std::ios::binary | std::ios::trunc);
+        size_t const size(random() % 2000 + 100);
+        for(size_t pos(0); pos < size; pos += 16)
+        {
+            out << "word " << (random() % 10000) << " of file\n";
+        }
+    }
+    {
+        std::ofstream out(std::string(g_data_directory) + "/large.txt", std::ios::out | std::ios::binary | std::ios::trunc);
+        size_t size(0);
+        while(size < g_large_file_size)
+        {
+            std::string const line("line " + std::to_string(size) + " with the value " + std::to_string(random() % 100000) + "\n");
+            out << line;
+            size += line.length();
+        }
+    }
+
+    std::ofstream(complete.c_str()) << "1\n";
+}
+
+
+/** \brief Create the archive read by the benchmarks.
+ *
+ * \return The number of bytes of data saved in the archive.
+ */
+size_t createArchive()
+{
+    zipios::DirectoryCollection dc(g_data_directory);
+    dc.setMethod(256, zipios::StorageMethod::STORED, zipios::StorageMethod::DEFLATED);
+    std::ofstream out(g_archive, std::ios::out | std::ios::binary | std::ios::trunc);
+    zipios::ZipFile::saveCollectionToArchive(out, dc);
+    if(!out)
+    {
+        throw zipios::IOException("could not create the benchmark archive.");
+    }
+
+    size_t total(0);
+    zipios::FileEntry::vector_t const entries(dc.entries());
+    for(auto const & entry : entries)
+    {
+        total += entry->getSize();
+    }
+    return total;
+}
+
+
+/** \brief Measure the deflate throughput, in Mb/s of input.
+ */
+double perfDeflate()
+{
+    auto const start(std::chrono::steady_clock::now());
+    size_t const total(createArchive());
+    return static_cast<double>(total) / (1024.0 * 1024.0) / elapsed(start);
+}
+
+
+/** \brief Measure the time it takes to open the archive, in ms.
+ */
+double perfOpen()
+{
+    auto const start(std::chrono::steady_clock::now());
+    zipios::ZipFile zf(g_archive);
+    return elapsed(start) * 1000.0;
+}
+
+
+/** \brief Measure the time it takes to search an entry, in ns.
+ */
+double perfLookup()
+{
+    zipios::ZipFile zf(g_archive);
+    std::vector<std::string> names;
+    zipios::FileEntry::vector_t const entries(zf.entries());
+    for(auto const & entry : entries)
+    {
+        names.push_back(entry->getName());
+    }
+    std::shuffle(names.begin(), names.end(), std::mt19937(54321));
+
+    int const rounds(10);
+    size_t found(0);
+    auto const start(std::chrono::steady_clock::now());
+    for(int round(0); round < rounds; ++round)
+    {
+        for(auto const & name : names)
+        {
+            if(zf.getEntry(name) != nullptr)
+            {
+                ++found;
+            }
+        }
+    }
+    double const seconds(elapsed(start));
+    if(found != names.size() * rounds)
+    {
+        throw zipios::FileCollectionException("an entry of the benchmark archive was not found.");
+    }
+    return seconds * 1e9 / static_cast<double>(found);
+}
+
+
+/** \brief Measure the inflate throughput, in Mb/s of output.
+ */
+double perfInflate()
+{
+    zipios::ZipFile zf(g_archive);
+    zipios::FileEntry::vector_t const entries(zf.entries());
+    std::vector<char> buffer(64 * 1024);
+    size_t total(0);
+    auto const start(std::chrono::steady_clock::now());
+    for(auto const & entry : entries)
+    {
+        if(entry->isDirectory())
+        {
+            continue;
+        }
+        zipios::FileCollection::stream_pointer_t is(zf.getInputStream(entry->getName()));
+        while(is->read(&buffer[0], buffer.size()) || is->gcount() > 0)
+        {
+            total += is->gcount();
+        }
+    }
+    return static_cast<double>(total) / (1024.0 * 1024.0) / elapsed(start);
+}
+
+
+typedef std::map<std::string, double>   baseline_t;
+
+
+baseline_t loadBaseline(std::string const & filename)
+{
+    baseline_t baseline;
+    std::ifstream in(filename);
+    std::string line;
+    while(std::getline(in, line))
+    {
+        if(line.empty()
+        || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string name;
+        double value(0.0);
+        if(fields >> name >> value)
+        {
+            baseline[name] = value;
+        }
+    }
+    return baseline;
+}
+
+
+void saveBaseline(std::string const & filename, baseline_t const & baseline)
+{
+    std::ofstream out(filename, std::ios::out | std::ios::trunc);
+    out << "# zipios performance baseline of this machine, see tests/perf.cpp" << std::endl;
+    for(auto const & b : baseline)
+    {
+        out << b.first << " " << b.second << std::endl;
+    }
+    if(!out)
+    {
+        throw zipios::IOException("could not save the baseline file \"" + filename + "\".");
+    }
+}
+
+
+void usage(char const * progname)
+{
+    std::cout << "Usage: " << progname << " --case <name> [--baseline <file>] [--tolerance <percent>] [--update]" << std::endl
+              << "  --case <name>           one of: deflate, open, lookup, inflate" << std::endl
+              << "  --baseline <file>       the file with the baseline of each case (default: zipios-perf-baseline.txt)" << std::endl
+              << "  --tolerance <percent>   how much worse than the baseline a result can be (default: 25)" << std::endl
+              << "  --update                save the result as the new baseline" << std::endl;
+}
+
+
+} // no name namespace
+
+
+int main(int argc, char * argv[])
+{
+    std::string case_name;
+    std::string baseline_filename("zipios-perf-baseline.txt");
+    double tolerance(25.0);
+    bool update(false);
+    for(int i(1); i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--case") == 0 && i + 1 < argc)
+        {
+            case_name = argv[++i];
+        }
+        else if(strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+        {
+            baseline_filename = argv[++i];
+        }
+        else if(strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+        {
+            tolerance = atof(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--update") == 0)
+        {
+            update = true;
+        }
+        else
+        {
+            usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    perf_case_t const cases[] =
+    {
+        { "deflate", "Mb/s", true,  perfDeflate },
+        { "open",    "ms",   false, perfOpen    },
+        { "lookup",  "ns",   false, perfLookup  },
+        { "inflate", "Mb/s", true,  perfInflate },
+    };
+    perf_case_t const * perf(nullptr);
+    for(auto const & c : cases)
+    {
+        if(case_name == c.m_name)
+        {
+            perf = &c;
+        }
+    }
+    if(perf == nullptr)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        createData();
+        struct stat st;
+        if(stat(g_archive, &st) != 0)
+        {
+            createArchive();
+        }
+
+        double result(0.0);
+        for(int run(0); run < g_repeat; ++run)
+        {
+            double const value(perf->m_run());
+            if(run == 0
+            || (perf->m_higher_is_better ? value > result : value < result))
+            {
+                result = value;
+            }
+        }
+
+        baseline_t baseline(loadBaseline(baseline_filename));
+        auto const it(baseline.find(perf->m_name));
+        if(update
+        || it == baseline.end())
+        {
+            baseline[perf->m_name] = result;
+            saveBaseline(baseline_filename, baseline);
+            std::cout << perf->m_name << ": " << result << " " << perf->m_unit
+                      << " (saved as the baseline in \"" << baseline_filename << "\")" << std::endl;
+            return 0;
+        }
+
+        double const limit(perf->m_higher_is_better
+                                ? it->second * (1.0 - tolerance / 100.0)
+                                : it->second * (1.0 + tolerance / 100.0));
+        bool const regressed(perf->m_higher_is_better
+                                ? result < limit
+                                : result > limit);
+        std::cout << perf->m_name << ": " << result << " " << perf->m_unit
+                  << " (baseline " << it->second << " " << perf->m_unit
+                  << ", limit " << limit << " " << perf->m_unit << ")"
+                  << (regressed ? " -- REGRESSION" : "") << std::endl;
+        return regressed ? 1 : 0;
+    }
+    catch(zipios::Exception const & e)
+    {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 1;
+    }
+}
+
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,199 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ *
+ * Zipios unit tests for the ShardedCollection class.
+ */
+
+#include "tests.hpp"
+
+#include "zipios/directorycollection.hpp"
+#include "zipios/shardedcollection.hpp"
+#include "zipios/zipfile.hpp"
+#include "zipios/zipiosexceptions.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+
+
+
+TEST_CASE("ShardedCollection by name hash", "[ShardedCollection] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree shards*") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_shards("shards.manifest");
+
+    zipios::DirectoryCollection dc("tree");
+    REQUIRE_THROWS_AS(zipios::ShardedCollection::saveCollectionToShards(dc, "shards", zipios::ShardedCollection::ShardMode::NAME_HASH, 0), zipios::InvalidException);
+    REQUIRE_THROWS_AS(zipios::ShardedCollection::saveCollectionToShards(dc, "shards", zipios::ShardedCollection::ShardMode::NAME_HASH, 10001), zipios::InvalidException);
+    REQUIRE_THROWS_AS(zipios::ShardedCollection::saveCollectionToShards(dc, "shards", zipios::ShardedCollection::ShardMode::NAME_HASH, 64 * 1024 * 1024), zipios::InvalidException);
+    std::string const manifest(zipios::ShardedCollection::saveCollectionToShards(dc, "shards", zipios::ShardedCollection::ShardMode::NAME_HASH, 3));
+    REQUIRE(manifest == "shards.manifest");
+
+    zipios::ShardedCollection sc(manifest);
+    REQUIRE(sc.isValid());
+    REQUIRE(sc.getShardCount() == 3);
+
+    zipios::FileEntry::vector_t const v(dc.entries());
+    REQUIRE(sc.size() == v.size());
+    for(auto const & entry : v)
+    {
+        zipios::FileEntry::pointer_t e(sc.getEntry(entry->getName()));
+        REQUIRE(e);
+        REQUIRE(e->getName() == entry->getName());
+        REQUIRE(e->isDirectory() == entry->isDirectory());
+
+        if(!entry->isDirectory())
+        {
+            zipios::FileCollection::stream_pointer_t is(sc.getInputStream(entry->getName()));
+            REQUIRE(is);
+            std::ostringstream sharded;
+            sharded << is->rdbuf();
+            std::ifstream in(entry->getName(), std::ios::in | std::ios::binary);
+            std::ostringstream expected;
+            expected << in.rdbuf();
+            REQUIRE(sharded.str() == expected.str());
+        }
+
+        // without the full path all the shards get searched
+        REQUIRE(sc.getEntry(entry->getFileName(), zipios::FileCollection::MatchPath::IGNORE));
+    }
+    REQUIRE_FALSE(sc.getEntry("tree/not-in-there"));
+    REQUIRE_FALSE(sc.getInputStream("tree/not-in-there"));
+
+    // the same names land in the same shards
+    {
+        zipios::DirectoryCollection again("tree");
+        zipios::ShardedCollection::saveCollectionToShards(again, "shards-again", zipios::ShardedCollection::ShardMode::NAME_HASH, 3);
+        zipios_test::auto_unlink_t remove_again("shards-again.manifest");
+        std::ifstream a("shards.manifest");
+        std::ifstream b("shards-again.manifest");
+        std::string line_a;
+        std::string line_b;
+        for(int skip(0); skip < 5; ++skip)
+        {
+            REQUIRE(std::getline(a, line_a));
+            REQUIRE(std::getline(b, line_b));
+        }
+        while(std::getline(a, line_a))
+        {
+            REQUIRE(std::getline(b, line_b));
+            REQUIRE(line_a == line_b);
+        }
+    }
+
+    zipios::FileCollection::pointer_t copy(sc.clone());
+    sc.close();
+    REQUIRE_FALSE(sc.isValid());
+    REQUIRE_THROWS_AS(sc.getEntry(v[0]->getName()), zipios::InvalidStateException);
+    REQUIRE_THROWS_AS(sc.getInputStream(v[0]->getName()), zipios::InvalidStateException);
+    REQUIRE(copy->isValid());
+    REQUIRE(copy->getEntry(v[0]->getName()));
+
+    REQUIRE(system("rm -f shards-*.zip") == 0);
+}
+
+
+TEST_CASE("ShardedCollection with more shards than threads", "[ShardedCollection] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree shards*") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_shards("shards.manifest");
+
+    // many more shards than cores, most of them empty
+    zipios::DirectoryCollection dc("tree");
+    size_t const shard_count(std::max(std::thread::hardware_concurrency(), 1U) * 16 + 1);
+    std::string const manifest(zipios::ShardedCollection::saveCollectionToShards(dc, "shards", zipios::ShardedCollection::ShardMode::NAME_HASH, shard_count));
+
+    zipios::ShardedCollection sc(manifest);
+    REQUIRE(sc.getShardCount() == shard_count);
+    REQUIRE(sc.size() == dc.size());
+    for(auto const & entry : dc.entries())
+    {
+        REQUIRE(sc.getEntry(entry->getName()));
+    }
+
+    REQUIRE(system("rm -f shards-*.zip") == 0);
+}
+
+
+TEST_CASE("ShardedCollection by size budget", "[ShardedCollection] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree shards*") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_shards("shards.manifest");
+
+    zipios::DirectoryCollection dc("tree");
+    zipios::offset_t const budget(64 * 1024);
+    REQUIRE_THROWS_AS(zipios::ShardedCollection::saveCollectionToShards(dc, "shards", zipios::ShardedCollection::ShardMode::SIZE_BUDGET, 0), zipios::InvalidException);
+    std::string const manifest(zipios::ShardedCollection::saveCollectionToShards(dc, "shards", zipios::ShardedCollection::ShardMode::SIZE_BUDGET, budget));
+
+    zipios::ShardedCollection sc(manifest);
+    REQUIRE(sc.size() == dc.size());
+    for(size_t shard(0); shard < sc.getShardCount(); ++shard)
+    {
+        std::ostringstream name;
+        name << "shards-" << std::setw(4) << std::setfill('0') << shard << ".zip";
+        std::ifstream in(name.str(), std::ios::in | std::ios::binary | std::ios::ate);
+        REQUIRE(in);
+        zipios::ZipFile zf(name.str());
+        if(zf.size() > 1)
+        {
+            REQUIRE(static_cast<zipios::offset_t>(in.tellg()) <= budget);
+        }
+    }
+    for(auto const & entry : dc.entries())
+    {
+        REQUIRE(sc.getEntry(entry->getName()));
+    }
+
+    // invalid manifests
+    {
+        zipios_test::auto_unlink_t remove_bad("bad.manifest");
+        REQUIRE_THROWS_AS(zipios::ShardedCollection("bad.manifest"), zipios::IOException);
+        {
+            std::ofstream bad("bad.manifest");
+            bad << "not a manifest\n";
+        }
+        REQUIRE_THROWS_AS(zipios::ShardedCollection("bad.manifest"), zipios::FileCollectionException);
+        {
+            std::ofstream bad("bad.manifest");
+            bad << "zipios-shards 1\n1\nshards-0000.zip\n5 tree/file\n";
+        }
+        REQUIRE_THROWS_AS(zipios::ShardedCollection("bad.manifest"), zipios::FileCollectionException);
+    }
+
+    REQUIRE(system("rm -f shards-*.zip") == 0);
+}
+
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
@@ -26,6 +26,7 @@
 
 #include "tests.hpp"
 
+#include "zipios/directfileoutputstream.hpp"
 #include "zipios/zipfile.hpp"
 #include "zipios/zipiosexceptions.hpp"
 
@@ -33,6 +34,7 @@
 #include "src/filteroutputstreambuf.hpp"
 
 #include <fstream>
+#include <sstream>
 
 #include <unistd.h>
 #include <string.h>
@@ -82,6 +84,84 @@ TEST_CASE("An output filter", "[Buffer]")
 
 
 
+TEST_CASE("A direct file output stream", "[Buffer]")
+{
+    SECTION("Random writes and seeks give the same file as std::ofstream")
+    {
+        zipios_test::auto_unlink_t auto_unlink_expected("expected.buf");
+        zipios_test::auto_unlink_t auto_unlink_direct("direct.buf");
+
+        // buffer sizes smaller than, equal to, and larger than a block
+        size_t const buffer_sizes[] = { 1, 4096, 4096 * 3 + 17 };
+        for(auto const & buffer_size : buffer_sizes)
+        {
+            for(int repeat(0); repeat < 10; ++repeat)
+            {
+                {
+                    std::ofstream expected("expected.buf", std::ios::out | std::ios::binary | std::ios::trunc);
+                    zipios::DirectFileOutputStream direct("direct.buf", buffer_size);
+                    if(repeat == 0)
+                    {
+                        direct.preallocate(1024 * 1024);
+                    }
+
+                    // write blocks of random sizes and once in a while go
+                    // back and overwrite a few bytes, as done when a Zip
+                    // local header gets rewritten
+                    std::streamoff size(0);
+                    int const count(rand() % 50 + 10);
+                    for(int idx(0); idx < count; ++idx)
+                    {
+                        std::string data(rand() % 20000, static_cast<char>(rand()));
+                        for(auto & c : data)
+                        {
+                            c = static_cast<char>(rand());
+                        }
+                        expected << data;
+                        direct << data;
+                        size += data.length();
+                        REQUIRE(direct.tellp() == size);
+
+                        if(size > 0 && rand() % 3 == 0)
+                        {
+                            std::streamoff const pos(rand() % size);
+                            std::string header(rand() % 50 + 1, 'H');
+                            expected.seekp(pos);
+                            direct.seekp(pos);
+                            expected << header;
+                            direct << header;
+                            size = std::max(size, static_cast<std::streamoff>(pos + header.length()));
+                            expected.seekp(0, std::ios::end);
+                            direct.seekp(0, std::ios::end);
+                            REQUIRE(direct.tellp() == size);
+                        }
+                        if(rand() % 7 == 0)
+                        {
+                            direct.flush();
+                        }
+                    }
+                    direct.close();
+                    REQUIRE(direct);
+                }
+
+                std::ifstream expected("expected.buf", std::ios::in | std::ios::binary);
+                std::ostringstream expected_data;
+                expected_data << expected.rdbuf();
+                std::ifstream direct("direct.buf", std::ios::in | std::ios::binary);
+                std::ostringstream direct_data;
+                direct_data << direct.rdbuf();
+                REQUIRE(direct_data.str() == expected_data.str());
+            }
+        }
+    }
+
+    SECTION("Invalid file name")
+    {
+        REQUIRE_THROWS_AS(new zipios::DirectFileOutputStream("no-such-directory/direct.buf"), zipios::IOException &);
+    }
+}
+
+
 // Local Variables:
 // mode: cpp
 // indent-tabs-mode: nil
@@ -0,0 +1,190 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ *
+ * Zipios unit tests for the zipios tool.
+ *
+ * The tool gets run with system(), ZIPIOS_TOOL is its full path in
+ * the build tree.
+ */
+
+#include "tests.hpp"
+
+#include "zipios/directorycollection.hpp"
+#include "zipios/zipfile.hpp"
+
+#include <fstream>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+
+
+namespace
+{
+
+
+/** \brief Run the zipios tool.
+ *
+ * \param[in] arguments  The command line arguments of the tool.
+ * \param[out] output  The standard output of the tool.
+ *
+ * \return The exit code of the tool.
+ */
+int run_tool(std::string const & arguments, std::string & output)
+{
+    zipios_test::auto_unlink_t remove_output("tool-output.txt");
+    int const r(system((std::string(ZIPIOS_TOOL) + " " + arguments + " >tool-output.txt 2>&1").c_str()));
+    std::ifstream in("tool-output.txt");
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    output = ss.str();
+    return WIFEXITED(r) ? WEXITSTATUS(r) : -1;
+}
+
+
+/** \brief Save a little endian number in a string.
+ *
+ * \param[in,out] data  The string to modify.
+ * \param[in] pos  The position of the number.
+ * \param[in] value  The 32 bit number to save.
+ */
+void set_number(std::string & data, size_t pos, uint32_t value)
+{
+    for(size_t idx(0); idx < 4; ++idx, value >>= 8)
+    {
+        data[pos + idx] = static_cast<char>(value);
+    }
+}
+
+
+} // no name namespace
+
+
+
+
+TEST_CASE("zipios --test reports each failing entry", "[zipios_tool]")
+{
+    REQUIRE(system("rm -rf tool") == 0); // clean up, just in case
+    REQUIRE(mkdir("tool", 0777) == 0);
+    zipios_test::auto_unlink_t remove_zip("tool.zip");
+
+    char const * names[] = { "a", "b", "c", "d", "e" };
+    for(auto const & name : names)
+    {
+        std::ofstream out(std::string("tool/") + name + ".txt", std::ios::out | std::ios::binary);
+        out << "content of " << name << "\n";
+    }
+    std::string archive;
+    {
+        zipios::DirectoryCollection dc("tool");
+        dc.setMethod(1024, zipios::StorageMethod::STORED, zipios::StorageMethod::STORED);
+        std::ostringstream out;
+        zipios::ZipFile::saveCollectionToArchive(out, dc);
+        archive = out.str();
+    }
+
+    // the archive has the "tool" directory and the five files
+    zipios::FileEntry::vector_t entries;
+    {
+        std::ofstream out("tool.zip", std::ios::out | std::ios::binary | std::ios::trunc);
+        out << archive;
+    }
+    {
+        zipios::ZipFile zf("tool.zip");
+        entries = zf.entries();
+    }
+    REQUIRE(entries.size() == 6);
+
+    std::string output;
+    REQUIRE(run_tool("--test tool.zip", output) == 0);
+    REQUIRE(output.find("6 entries, 0 failed") != std::string::npos);
+
+    // the first file has the position of its central directory record
+    // in the archive, the entries being saved in the same order
+    zipios::FileEntry::pointer_t file;
+    size_t file_index(0);
+    for(; file_index < entries.size(); ++file_index)
+    {
+        if(!entries[file_index]->isDirectory())
+        {
+            file = entries[file_index];
+            break;
+        }
+    }
+    REQUIRE(file);
+    size_t central_record(archive.find("PK\x01\x02"));
+    for(size_t idx(0); idx < file_index; ++idx)
+    {
+        central_record = archive.find("PK\x01\x02", central_record + 1);
+    }
+    REQUIRE(central_record != std::string::npos);
+    size_t const local_header(static_cast<size_t>(file->getEntryOffset()));
+
+    SECTION("an entry with sizes going past the end of the archive")
+    {
+        // the same sizes in both headers, the local header check of
+        // the ZipFile does not see anything wrong
+        std::string oversized(archive);
+        set_number(oversized, local_header + 18, 1000000);
+        set_number(oversized, local_header + 22, 1000000);
+        set_number(oversized, central_record + 20, 1000000);
+        set_number(oversized, central_record + 24, 1000000);
+        {
+            std::ofstream out("tool.zip", std::ios::out | std::ios::binary | std::ios::trunc);
+            out << oversized;
+        }
+
+        // with one thread, all the entries are read with the same stream
+        REQUIRE(run_tool("--threads 1 --test tool.zip", output) == 1);
+        REQUIRE(output.find(file->getName() + ": could not read the compressed data") != std::string::npos);
+        REQUIRE(output.find("6 entries, 1 failed") != std::string::npos);
+    }
+
+    SECTION("a local header which differs from the central directory")
+    {
+        std::string changed(archive);
+        changed[local_header + 10] = static_cast<char>(changed[local_header + 10] ^ 0x20);
+        {
+            std::ofstream out("tool.zip", std::ios::out | std::ios::binary | std::ios::trunc);
+            out << changed;
+        }
+
+        REQUIRE(run_tool("--test tool.zip", output) == 1);
+        REQUIRE(output.find(file->getName() + ": local header modification time differs from the central directory") != std::string::npos);
+        REQUIRE(output.find("6 entries, 1 failed") != std::string::npos);
+    }
+
+    REQUIRE(system("rm -rf tool") == 0);
+}
+
+
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
@@ -0,0 +1,125 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ *
+ * Zipios unit tests for the VirtualZipArchive class.
+ */
+
+#include "tests.hpp"
+
+#include "zipios/directorycollection.hpp"
+#include "zipios/virtualziparchive.hpp"
+#include "zipios/zipfile.hpp"
+#include "zipios/zipiosexceptions.hpp"
+
+#include <fstream>
+#include <iterator>
+
+
+
+
+TEST_CASE("VirtualZipArchive matches a saved STORED archive", "[VirtualZipArchive]")
+{
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_zip("tree.zip");
+
+    {
+        zipios::DirectoryCollection dc("tree");
+        dc.setMethod(std::numeric_limits<size_t>::max(), zipios::StorageMethod::STORED, zipios::StorageMethod::STORED);
+        std::ofstream out("tree.zip", std::ios::out | std::ios::binary | std::ios::trunc);
+        zipios::ZipFile::saveCollectionToArchive(out, dc, "virtual archive");
+    }
+    std::ifstream in("tree.zip", std::ios::in | std::ios::binary);
+    std::string const expected((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    // a new collection so the entries do not have a CRC yet
+    zipios::DirectoryCollection dc("tree");
+    zipios::FileEntry::vector_t const entries(dc.entries());
+    zipios::VirtualZipArchive archive(entries, "virtual archive");
+    REQUIRE(archive.size() == entries.size());
+    REQUIRE(archive.getArchiveSize() == static_cast<zipios::offset_t>(expected.length()));
+
+    // the offsets are known without reading any data
+    zipios::ZipFile zf("tree.zip");
+    for(size_t idx(0); idx < entries.size(); ++idx)
+    {
+        zipios::FileEntry::pointer_t saved(zf.getEntry(entries[idx]->getName()));
+        REQUIRE(saved);
+        REQUIRE(archive.getHeaderOffset(idx) == saved->getEntryOffset());
+        REQUIRE(archive.getPayloadOffset(idx) > archive.getHeaderOffset(idx));
+    }
+    REQUIRE_THROWS_AS(archive.getHeaderOffset(entries.size()), zipios::InvalidException);
+    REQUIRE_THROWS_AS(archive.getEntry(entries.size()), zipios::InvalidException);
+
+    // generating bytes requires a data reader
+    char buf[256];
+    REQUIRE_THROWS_AS(archive.read(archive.getCentralDirectoryOffset(), buf, sizeof(buf)), zipios::InvalidStateException);
+
+    size_t reads(0);
+    archive.setDataReader([&entries, &reads](size_t index, zipios::offset_t offset, char * buffer, size_t size)
+        {
+            ++reads;
+            std::ifstream file(entries[index]->getName(), std::ios::in | std::ios::binary);
+            file.seekg(offset);
+            REQUIRE(file.read(buffer, size));
+        });
+
+    // the central directory first, which computes all the CRCs
+    {
+        size_t const size(archive.getArchiveSize() - archive.getCentralDirectoryOffset());
+        std::vector<char> cd(size + 10);
+        REQUIRE(archive.read(archive.getCentralDirectoryOffset(), cd.data(), cd.size()) == size);
+        REQUIRE(std::string(cd.data(), size) == expected.substr(archive.getCentralDirectoryOffset()));
+    }
+
+    // then random ranges, which only read the data they cover
+    for(int count(0); count < 100; ++count)
+    {
+        size_t const offset(rand() % expected.length());
+        size_t const size(rand() % 10000 + 1);
+        std::vector<char> range(size);
+        size_t const expected_size(std::min(size, expected.length() - offset));
+        reads = 0;
+        REQUIRE(archive.read(offset, range.data(), range.size()) == expected_size);
+        REQUIRE(std::string(range.data(), expected_size) == expected.substr(offset, expected_size));
+        REQUIRE(reads <= entries.size());
+    }
+
+    // and the whole archive at once
+    {
+        std::vector<char> whole(expected.length());
+        REQUIRE(archive.read(0, whole.data(), whole.size()) == expected.length());
+        REQUIRE(std::string(whole.data(), whole.size()) == expected);
+        REQUIRE(archive.read(expected.length(), whole.data(), whole.size()) == 0);
+    }
+}
+
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
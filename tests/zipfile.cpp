@@ -27,14 +27,23 @@
 #include "tests.hpp"
 
 #include "zipios/zipfile.hpp"
+#include "zipios/directfileoutputstream.hpp"
 #include "zipios/directorycollection.hpp"
 #include "zipios/zipiosexceptions.hpp"
 #include "zipios/dosdatetime.hpp"
+#include "zipios/filepath.hpp"
+
+#include "src/compressionbudget.hpp"
 
 #include <algorithm>
 #include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
 
 #include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
 #include <string.h>
 #include <zlib.h>
 
@@ -51,6 +60,146 @@ zipios::StorageMethod const g_supported_storage_methods[]
 };
 
 
+/** \brief Read a whole file.
+ *
+ * \param[in] filename  The name of the file to read.
+ *
+ * \return The content of the file.
+ */
+std::string read_file(std::string const & filename)
+{
+    std::ifstream in(filename, std::ios::in | std::ios::binary);
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+
+/** \brief Read the whole data of an entry.
+ *
+ * \param[in] collection  The collection with the entry.
+ * \param[in] name  The name of the entry to read.
+ *
+ * \return The uncompressed data of the entry.
+ */
+std::string read_entry(zipios::FileCollection & collection, std::string const & name)
+{
+    zipios::FileCollection::stream_pointer_t is(collection.getInputStream(name));
+    REQUIRE(is);
+    return std::string((std::istreambuf_iterator<char>(*is)), std::istreambuf_iterator<char>());
+}
+
+
+/** \brief Save the "tree" directory in a Zip archive.
+ *
+ * When \p stored_limit is not zero, the files smaller than that limit
+ * are STORED and the others DEFLATED. Otherwise the default method of
+ * the DirectoryCollection is used.
+ *
+ * \param[in] filename  The name of the archive to create.
+ * \param[in] options  The options used to save the archive.
+ * \param[in] stored_limit  The size under which files are STORED.
+ *
+ * \return The content of the new archive.
+ */
+std::string save_tree(std::string const & filename, zipios::ZipOutputOptions const & options = zipios::ZipOutputOptions(), size_t stored_limit = 0)
+{
+    zipios::DirectoryCollection dc("tree");
+    if(stored_limit != 0)
+    {
+        dc.setMethod(stored_limit, zipios::StorageMethod::STORED, zipios::StorageMethod::DEFLATED);
+    }
+    {
+        std::ofstream out(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+        zipios::ZipFile::saveCollectionToArchive(out, dc, "", options);
+        REQUIRE(out);
+    }
+    return read_file(filename);
+}
+
+
+/** \brief Check that the entries have the data of the original files.
+ *
+ * The entries of the archives created from the "tree" directory have
+ * the names of the files they were created from.
+ *
+ * \param[in] collection  The collection to check.
+ */
+void check_entries(zipios::FileCollection & collection)
+{
+    zipios::FileEntry::vector_t const entries(collection.entries());
+    for(auto const & entry : entries)
+    {
+        if(!entry->isDirectory())
+        {
+            REQUIRE(read_entry(collection, entry->getName()) == read_file(entry->getName()));
+        }
+    }
+}
+
+
+/** \brief A stream buffer which only keeps track of its position.
+ *
+ * This is used to save archives larger than 2Gb without writing them
+ * to disk: the position starts at the specified offset and the data
+ * written to the buffer is discarded.
+ */
+class position_streambuf_t
+    : public std::streambuf
+{
+public:
+    position_streambuf_t(std::streamoff start)
+        : m_position(start)
+    {
+    }
+
+protected:
+    virtual std::streamsize xsputn(char const * s, std::streamsize n) override
+    {
+        static_cast<void>(s);
+        m_position += n;
+        return n;
+    }
+
+    virtual int_type overflow(int_type c) override
+    {
+        if(!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            ++m_position;
+        }
+        return traits_type::not_eof(c);
+    }
+
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+    {
+        static_cast<void>(which);
+        switch(dir)
+        {
+        case std::ios_base::beg:
+            m_position = off;
+            break;
+
+        case std::ios_base::cur:
+            m_position += off;
+            break;
+
+        default:
+            return pos_type(off_type(-1));
+
+        }
+        return pos_type(m_position);
+    }
+
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+    {
+        return seekoff(pos, std::ios_base::beg, which);
+    }
+
+private:
+    std::streamoff      m_position;
+};
+
+
 } // no name namespace
 
 
@@ -1650,6 +1799,1528 @@ TEST_CASE("Valid and Invalid ZipFile Archives", "[ZipFile] [FileCollection]")
 }
 
 
+TEST_CASE("ZipFile with access pattern hints", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_zip("tree.zip");
+    REQUIRE(system("zip -r tree.zip tree >/dev/null") == 0);
+
+    zipios::ZipFile::AccessPattern const patterns[] =
+    {
+        zipios::ZipFile::AccessPattern::NORMAL,
+        zipios::ZipFile::AccessPattern::SEQUENTIAL,
+        zipios::ZipFile::AccessPattern::ONE_PASS
+    };
+
+    for(auto const & pattern : patterns)
+    {
+        zipios::ZipFile zf("tree.zip");
+        zf.setAccessPattern(pattern, rand() % 5);
+
+        zipios::FileEntry::vector_t v(zf.entries());
+        zf.prefetch(v);
+
+        // the hints must not change what we read from the entries
+        check_entries(zf);
+
+        // random accesses search the entries in the index instead
+        for(auto it(v.rbegin()); it != v.rend(); ++it)
+        {
+            if((*it)->isDirectory())
+            {
+                continue;
+            }
+
+            REQUIRE(read_entry(zf, (*it)->getName()).length() == (*it)->getSize());
+        }
+    }
+}
+
+
+TEST_CASE("ZipFile with read-ahead", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_zip("tree.zip");
+    REQUIRE(system("zip -r tree.zip tree >/dev/null") == 0);
+
+    size_t const buffer_sizes[] =
+    {
+        0,
+        64,
+        1024,
+        zipios::getBufferSize(),
+        256 * 1024
+    };
+
+    for(auto const & buffer_size : buffer_sizes)
+    {
+        zipios::ZipFile zf("tree.zip");
+        zf.setReadAhead(buffer_size);
+        check_entries(zf);
+
+        zipios::FileEntry::vector_t v(zf.entries());
+
+        // a stream destroyed before it reached the end must stop its thread
+        for(auto it(v.begin()); it != v.end(); ++it)
+        {
+            if(!(*it)->isDirectory() && (*it)->getSize() > 0)
+            {
+                zipios::FileCollection::stream_pointer_t is(zf.getInputStream((*it)->getName()));
+                REQUIRE(is);
+                char c;
+                is->get(c);
+                REQUIRE(*is);
+            }
+        }
+    }
+}
+
+
+TEST_CASE("Save a ZipFile with a write-behind pipeline", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_zip("tree.zip");
+    zipios_test::auto_unlink_t remove_behind_zip("behind.zip");
+
+    std::string const expected(save_tree("tree.zip"));
+
+    size_t const buffer_sizes[] =
+    {
+        100,
+        zipios::getBufferSize(),
+        64 * 1024
+    };
+
+    for(auto const & buffer_size : buffer_sizes)
+    {
+        for(size_t buffer_count(0); buffer_count <= 4; ++buffer_count)
+        {
+            zipios::ZipOutputOptions options;
+            options.setWriteBehind(buffer_count, buffer_size);
+            REQUIRE(options.getWriteBehindBufferCount() == buffer_count);
+            REQUIRE(options.getWriteBehindBufferSize() == (buffer_count == 0 ? 0 : buffer_size));
+
+            // the pipeline must generate exactly the same archive,
+            // including the headers rewritten once each entry is closed
+            REQUIRE(save_tree("behind.zip", options) == expected);
+        }
+    }
+
+    zipios::ZipFile zf("behind.zip");
+    REQUIRE(zf.isValid());
+    REQUIRE(zf.size() == tree.size());
+}
+
+
+TEST_CASE("Save a ZipFile with direct I/O", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_zip("tree.zip");
+    zipios_test::auto_unlink_t remove_direct_zip("direct.zip");
+
+    zipios::DirectoryCollection dc("tree");
+    std::string const expected(save_tree("tree.zip"));
+
+    size_t const buffer_sizes[] =
+    {
+        4096,
+        64 * 1024,
+        1024 * 1024
+    };
+
+    for(auto const & buffer_size : buffer_sizes)
+    {
+        for(size_t buffer_count(0); buffer_count <= 2; buffer_count += 2)
+        {
+            zipios::ZipOutputOptions options;
+            options.setWriteBehind(buffer_count);
+            {
+                zipios::DirectFileOutputStream out("direct.zip", buffer_size);
+                zipios::ZipFile::saveCollectionToArchive(out, dc, "", options);
+                out.close();
+                REQUIRE(out);
+            }
+
+            // the aligned writes, the header rewrites and the
+            // preallocation must not change the archive
+            REQUIRE(read_file("direct.zip") == expected);
+        }
+    }
+
+    zipios::ZipFile zf("direct.zip");
+    REQUIRE(zf.isValid());
+    REQUIRE(zf.size() == tree.size());
+}
+
+
+TEST_CASE("Save a ZipFile larger than 2Gb", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+
+    zipios::DirectoryCollection dc("tree");
+    dc.setMethod(100, zipios::StorageMethod::STORED, zipios::StorageMethod::DEFLATED);
+
+    // entries saved between 2Gb and 4Gb are still valid
+    {
+        position_streambuf_t buf(0x90000000LL);
+        std::ostream out(&buf);
+        zipios::ZipFile::saveCollectionToArchive(out, dc);
+        REQUIRE(out);
+    }
+
+    // past 4Gb, the offsets do not fit in the headers anymore
+    {
+        position_streambuf_t buf(0x100000000LL);
+        std::ostream out(&buf);
+        REQUIRE_THROWS_AS(zipios::ZipFile::saveCollectionToArchive(out, dc), zipios::InvalidStateException);
+    }
+}
+
+
+TEST_CASE("Rebuild a ZipFile from a previous archive", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_previous_zip("previous.zip");
+    zipios_test::auto_unlink_t remove_rebuilt_zip("rebuilt.zip");
+
+    std::string const previous(save_tree("previous.zip"));
+
+    // nothing changed, the rebuilt archive is exactly the same
+    for(int verify_crc(0); verify_crc < 2; ++verify_crc)
+    {
+        zipios::ZipOutputOptions options;
+        options.setPreviousArchive("previous.zip", verify_crc != 0);
+        REQUIRE(options.getPreviousArchive() == "previous.zip");
+        REQUIRE(options.getVerifyPreviousCrc() == (verify_crc != 0));
+        REQUIRE(save_tree("rebuilt.zip", options) == previous);
+    }
+
+    // the previous archive may have been appended to other data
+    {
+        zipios_test::auto_unlink_t remove_prefixed_zip("prefixed.zip");
+        {
+            std::ofstream out("prefixed.zip", std::ios::out | std::ios::binary | std::ios::trunc);
+            out << std::string(rand() % 5000 + 100, '#') << previous;
+        }
+        zipios::ZipOutputOptions options;
+        options.setPreviousArchive("prefixed.zip");
+        REQUIRE(save_tree("rebuilt.zip", options) == previous);
+    }
+
+    // find a file we can modify
+    std::string name;
+    {
+        zipios::DirectoryCollection dc("tree");
+        zipios::FileEntry::vector_t v(dc.entries());
+        for(auto const & entry : v)
+        {
+            if(!entry->isDirectory()
+            && entry->getSize() > 0)
+            {
+                name = entry->getName();
+                break;
+            }
+        }
+    }
+    REQUIRE(!name.empty());
+
+    std::string const original(read_file(name));
+    std::string modified(original);
+    modified[0] = ~modified[0];
+
+    // change the content but keep the same size and time: without the
+    // CRC verification the entry is viewed as unchanged and copied
+    {
+        struct stat st;
+        REQUIRE(stat(name.c_str(), &st) == 0);
+        {
+            std::ofstream out(name, std::ios::out | std::ios::binary | std::ios::trunc);
+            out << modified;
+        }
+        struct utimbuf times;
+        times.actime = st.st_atime;
+        times.modtime = st.st_mtime;
+        REQUIRE(utime(name.c_str(), &times) == 0);
+    }
+    for(int verify_crc(0); verify_crc < 2; ++verify_crc)
+    {
+        zipios::ZipOutputOptions options;
+        options.setPreviousArchive("previous.zip", verify_crc != 0);
+        save_tree("rebuilt.zip", options);
+        zipios::ZipFile zf("rebuilt.zip");
+        REQUIRE(zf.isValid());
+        REQUIRE(zf.size() == tree.size());
+        REQUIRE(read_entry(zf, name) == (verify_crc != 0 ? modified : original));
+    }
+
+    // change the time and size: the entry gets compressed again
+    // while the other entries are still copied
+    {
+        modified += "more data";
+        std::ofstream out(name, std::ios::out | std::ios::binary | std::ios::app);
+        out << "more data";
+    }
+    {
+        struct stat st;
+        REQUIRE(stat(name.c_str(), &st) == 0);
+        struct utimbuf times;
+        times.actime = st.st_atime;
+        times.modtime = st.st_mtime + 10;
+        REQUIRE(utime(name.c_str(), &times) == 0);
+    }
+    {
+        zipios::ZipOutputOptions options;
+        options.setPreviousArchive("previous.zip");
+        save_tree("rebuilt.zip", options);
+        zipios::ZipFile zf("rebuilt.zip");
+        REQUIRE(zf.isValid());
+        REQUIRE(zf.size() == tree.size());
+        check_entries(zf);
+    }
+
+    // a missing previous archive is an error
+    {
+        zipios::ZipOutputOptions options;
+        options.setPreviousArchive("no-such-file.zip");
+        zipios::DirectoryCollection dc("tree");
+        std::ofstream out("rebuilt.zip", std::ios::out | std::ios::binary | std::ios::trunc);
+        REQUIRE_THROWS_AS(zipios::ZipFile::saveCollectionToArchive(out, dc, "", options), zipios::IOException &);
+    }
+}
+
+
+TEST_CASE("Save a ZipFile with a blob cache", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree blobs") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_zip("tree.zip");
+    zipios_test::auto_unlink_t remove_cached_zip("cached.zip");
+
+    // add a hard link to one of the files
+    std::string linked;
+    {
+        zipios::DirectoryCollection dc("tree");
+        zipios::FileEntry::vector_t v(dc.entries());
+        for(auto const & entry : v)
+        {
+            if(!entry->isDirectory())
+            {
+                linked = entry->getName();
+                break;
+            }
+        }
+    }
+    REQUIRE(!linked.empty());
+    zipios_test::auto_unlink_t remove_link("tree/hard-link");
+    REQUIRE(link(linked.c_str(), "tree/hard-link") == 0);
+    REQUIRE(zipios::FilePath(linked).inodeNumber() == zipios::FilePath("tree/hard-link").inodeNumber());
+    REQUIRE(zipios::FilePath(linked).deviceID() == zipios::FilePath("tree/hard-link").deviceID());
+
+    // only deflated entries are cached, keep the small ones stored
+    save_tree("tree.zip", zipios::ZipOutputOptions(), 100);
+    zipios::ZipFile expected_zf("tree.zip");
+    zipios::FileEntry::vector_t const expected_entries(expected_zf.entries());
+
+    // the cached data must be exactly the data we would otherwise get
+    auto verify = [&expected_entries]()
+    {
+        zipios::ZipFile zf("cached.zip");
+        REQUIRE(zf.isValid());
+        zipios::FileEntry::vector_t const v(zf.entries());
+        REQUIRE(v.size() == expected_entries.size());
+        for(size_t idx(0); idx < v.size(); ++idx)
+        {
+            REQUIRE(v[idx]->getName() == expected_entries[idx]->getName());
+            if(!v[idx]->isDirectory())
+            {
+                REQUIRE(v[idx]->getMethod() == expected_entries[idx]->getMethod());
+                REQUIRE(v[idx]->getCrc() == expected_entries[idx]->getCrc());
+                REQUIRE(v[idx]->getCompressedSize() == expected_entries[idx]->getCompressedSize());
+            }
+        }
+        check_entries(zf);
+    };
+
+    zipios::ZipOutputOptions options;
+    options.setBlobCache("blobs");
+    REQUIRE(options.getBlobCache() == "blobs");
+
+    // the first build fills the cache, the second one only reads it
+    std::string blob_inodes;
+    std::string first_build;
+    for(int build(0); build < 2; ++build)
+    {
+        std::string const archive(save_tree("cached.zip", options, 100));
+        verify();
+        if(build == 0)
+        {
+            first_build = archive;
+        }
+        else
+        {
+            REQUIRE(archive == first_build);
+        }
+
+        // blobs are never rewritten on a hit
+        REQUIRE(system("ls -i -R blobs > blobs.txt") == 0);
+        zipios_test::auto_unlink_t remove_blobs_txt("blobs.txt");
+        if(build == 0)
+        {
+            blob_inodes = read_file("blobs.txt");
+            REQUIRE(blob_inodes.find(".tmp") == std::string::npos);
+        }
+        else
+        {
+            REQUIRE(read_file("blobs.txt") == blob_inodes);
+        }
+    }
+
+    // a damaged blob is viewed as a miss and replaced
+    REQUIRE(system("for f in blobs/*/*; do echo damaged > $f; done") == 0);
+    REQUIRE(save_tree("cached.zip", options, 100) == first_build);
+    verify();
+
+    REQUIRE(system("rm -rf blobs") == 0);
+}
+
+
+TEST_CASE("Save a ZipFile from memory mapped files", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_zip("tree.zip");
+    zipios_test::auto_unlink_t remove_mapped_zip("mapped.zip");
+
+    // make sure some files are much larger than the buffers
+    zipios_test::auto_unlink_t remove_large("tree/large.bin");
+    zipios_test::auto_unlink_t remove_huge("tree/huge.bin");
+    {
+        std::ofstream large("tree/large.bin", std::ios::out | std::ios::binary);
+        for(int idx(0); idx < 200000; ++idx)
+        {
+            large << static_cast<char>(rand() % 26 + 'a');
+        }
+        std::ofstream huge("tree/huge.bin", std::ios::out | std::ios::binary);
+        for(int idx(0); idx < 1000000; ++idx)
+        {
+            huge << static_cast<char>(rand());
+        }
+    }
+
+    for(int deflated(0); deflated < 2; ++deflated)
+    {
+        REQUIRE(!zipios::DirectoryCollection("tree").isMemoryMapped());
+        std::string const expected(save_tree("tree.zip", zipios::ZipOutputOptions(), deflated != 0 ? 100 : 0));
+
+        zipios::DirectoryCollection mapped_dc("tree");
+        if(deflated != 0)
+        {
+            mapped_dc.setMethod(100, zipios::StorageMethod::STORED, zipios::StorageMethod::DEFLATED);
+        }
+        mapped_dc.setMemoryMapped(true, 0);
+        REQUIRE(mapped_dc.isMemoryMapped());
+        REQUIRE(mapped_dc.getMemoryMappedMinimumSize() == 0);
+
+        // the mapped streams read and seek like the file streams
+        {
+            zipios::FileCollection::stream_pointer_t is(mapped_dc.getInputStream("tree/large.bin"));
+            REQUIRE(is);
+            REQUIRE(dynamic_cast<std::ifstream *>(is.get()) == nullptr);
+            is->seekg(0, std::ios::end);
+            REQUIRE(is->tellg() == 200000);
+            is->seekg(100);
+            std::ostringstream ss;
+            ss << is->rdbuf();
+            REQUIRE(ss.str() == read_file("tree/large.bin").substr(100));
+        }
+
+        {
+            std::ofstream out("mapped.zip", std::ios::out | std::ios::binary | std::ios::trunc);
+            zipios::ZipFile::saveCollectionToArchive(out, mapped_dc);
+            REQUIRE(out);
+        }
+
+        // the output must be exactly the same
+        REQUIRE(read_file("mapped.zip") == expected);
+
+        zipios::ZipFile zf("mapped.zip");
+        check_entries(zf);
+    }
+}
+
+
+TEST_CASE("Save a ZipFile in the order of an access profile", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_zip("tree.zip");
+    zipios_test::auto_unlink_t remove_ordered_zip("ordered.zip");
+    zipios_test::auto_unlink_t remove_profile("profile.txt");
+
+    save_tree("tree.zip", zipios::ZipOutputOptions(), 100);
+
+    // record a "workload" which opens a few files from the end
+    std::vector<std::string> workload;
+    {
+        zipios::ZipFile zf("tree.zip");
+        zipios::FileEntry::vector_t const v(zf.entries());
+        for(auto it(v.rbegin()); it != v.rend() && workload.size() < 3; ++it)
+        {
+            if(!(*it)->isDirectory())
+            {
+                workload.push_back((*it)->getName());
+            }
+        }
+        REQUIRE(workload.size() == 3);
+
+        // not recorded
+        zf.getInputStream(workload[2]);
+        REQUIRE(zf.getAccessProfile().empty());
+
+        zf.setAccessRecording(true);
+        for(auto const & name : workload)
+        {
+            zipios::FileCollection::stream_pointer_t is(zf.getInputStream(name));
+            REQUIRE(is);
+        }
+        // opening the same entry again is not recorded again
+        zf.getInputStream(workload[0]);
+        zf.setAccessRecording(false);
+        zf.getInputStream(v[0]->getName());
+
+        REQUIRE(zf.getAccessProfile() == workload);
+        zf.saveAccessProfile("profile.txt");
+    }
+
+    zipios::ZipOutputOptions options;
+    REQUIRE_THROWS_AS(options.loadAccessProfile("no-such-profile.txt"), zipios::IOException);
+    REQUIRE(options.getAccessProfile().empty());
+    options.loadAccessProfile("profile.txt");
+    REQUIRE(options.getAccessProfile() == workload);
+    save_tree("ordered.zip", options, 100);
+
+    zipios::ZipFile expected("tree.zip");
+    zipios::FileEntry::vector_t const expected_entries(expected.entries());
+    zipios::ZipFile zf("ordered.zip");
+    zipios::FileEntry::vector_t const v(zf.entries());
+    REQUIRE(v.size() == expected_entries.size());
+
+    // the profiled entries come first, in order, then the cold entries
+    // in their usual order
+    for(size_t idx(0); idx < workload.size(); ++idx)
+    {
+        REQUIRE(v[idx]->getName() == workload[idx]);
+    }
+    size_t pos(workload.size());
+    for(auto const & e : expected_entries)
+    {
+        if(std::find(workload.begin(), workload.end(), e->getName()) == workload.end())
+        {
+            REQUIRE(v[pos]->getName() == e->getName());
+            ++pos;
+        }
+    }
+    for(size_t idx(1); idx < v.size(); ++idx)
+    {
+        REQUIRE(v[idx - 1]->getEntryOffset() < v[idx]->getEntryOffset());
+    }
+
+    check_entries(zf);
+}
+
+
+TEST_CASE("ZipFile with a large central directory", "[ZipFile] [FileCollection]")
+{
+    // enough entries to get the central directory parsed by several threads
+    size_t const count(50000);
+    zipios_test::auto_unlink_t auto_unlink("file.zip");
+    {
+        std::ofstream os("file.zip", std::ios::out | std::ios::binary);
+
+        std::vector<central_directory_header_t> headers;
+        headers.reserve(count + 1);
+        for(size_t idx(0); idx <= count; ++idx)
+        {
+            local_header_t lh;
+            central_directory_header_t cdh;
+
+            // the last entry is a duplicate of entry 7 with one byte
+            std::string const data(idx == count ? "X" : "");
+            lh.m_filename = "dir/file-" + std::to_string(idx == count ? 7 : idx);
+            lh.m_compressed_size = data.length();
+            lh.m_uncompressed_size = data.length();
+            lh.m_crc32 = crc32(0L, reinterpret_cast<Bytef const *>(data.c_str()), data.length());
+            cdh.m_relative_offset_to_local_header = os.tellp();
+            lh.write(os);
+            os << data;
+
+            cdh.m_time_and_date = lh.m_time_and_date;
+            cdh.m_compressed_size = lh.m_compressed_size;
+            cdh.m_uncompressed_size = lh.m_uncompressed_size;
+            cdh.m_crc32 = lh.m_crc32;
+            cdh.m_filename = lh.m_filename;
+            headers.push_back(cdh);
+        }
+
+        end_of_central_directory_t eocd;
+        eocd.m_central_directory_offset = os.tellp();
+        for(auto & cdh : headers)
+        {
+            cdh.write(os);
+        }
+        eocd.m_file_count = count + 1;
+        eocd.m_total_count = count + 1;
+        eocd.m_central_directory_size = static_cast<uint32_t>(os.tellp()) - eocd.m_central_directory_offset;
+        eocd.write(os);
+    }
+
+    zipios::ZipFile zf("file.zip");
+    REQUIRE(zf.size() == count + 1);
+
+    // the entries are in the order of the central directory
+    zipios::FileEntry::vector_t const v(zf.entries());
+    for(size_t idx(0); idx < count; ++idx)
+    {
+        REQUIRE(v[idx]->getName() == "dir/file-" + std::to_string(idx));
+    }
+    REQUIRE(v[count]->getName() == "dir/file-7");
+    REQUIRE(v[count]->getSize() == 1);
+
+    // the index finds the entries, the first one on duplicates
+    for(size_t idx(0); idx < count; idx += rand() % 100 + 1)
+    {
+        std::string const name("dir/file-" + std::to_string(idx));
+        REQUIRE(zf.getEntry(name) == v[idx]);
+    }
+    REQUIRE(zf.getEntry("dir/file-7") == v[7]);
+    REQUIRE(zf.getEntry("dir/file-7")->getSize() == 0);
+    REQUIRE(zf.getEntry("file-7", zipios::FileCollection::MatchPath::IGNORE) == v[7]);
+    REQUIRE_FALSE(zf.getEntry("dir/file-" + std::to_string(count)));
+    REQUIRE_FALSE(zf.getEntry("file-" + std::to_string(count), zipios::FileCollection::MatchPath::IGNORE));
+    REQUIRE_FALSE(zf.getEntry("dir"));
+
+    zipios::FileCollection::stream_pointer_t is(zf.getInputStream("dir/file-12345"));
+    REQUIRE(is);
+    REQUIRE(is->get() == EOF);
+
+    // a copy keeps a working index
+    zipios::FileCollection::pointer_t copy(zf.clone());
+    REQUIRE(copy->getEntry("dir/file-49999")->getName() == "dir/file-49999");
+}
+
+
+TEST_CASE("A Zip64 archive gets rejected", "[ZipFile] [FileCollection]")
+{
+    zipios_test::auto_unlink_t auto_unlink("file.zip");
+    {
+        std::ofstream os("file.zip", std::ios::out | std::ios::binary);
+
+        auto write = [&os](uint64_t value, int size)
+        {
+            for(int idx(0); idx < size; ++idx, value >>= 8)
+            {
+                os << static_cast<unsigned char>(value);
+            }
+        };
+
+        local_header_t lh;
+        central_directory_header_t cdh;
+        lh.m_filename = "file.txt";
+        lh.write(os);
+
+        uint64_t const cd_offset(os.tellp());
+        cdh.m_time_and_date = lh.m_time_and_date;
+        cdh.m_filename = lh.m_filename;
+        cdh.write(os);
+        uint64_t const cd_size(static_cast<uint64_t>(os.tellp()) - cd_offset);
+
+        // Zip64 End of Central Directory Record
+        uint64_t const zip64_eocd_offset(os.tellp());
+        write(0x06064B50, 4);
+        write(44, 8);
+        write(45, 2);
+        write(45, 2);
+        write(0, 4);
+        write(0, 4);
+        write(1, 8);
+        write(1, 8);
+        write(cd_size, 8);
+        write(cd_offset, 8);
+
+        // Zip64 End of Central Directory Locator
+        write(0x07064B50, 4);
+        write(0, 4);
+        write(zip64_eocd_offset, 8);
+        write(1, 4);
+
+        // a small archive forced to Zip64 (as with `zip -fz`) still has
+        // valid values in the End of Central Directory, only the Zip64
+        // locator tells us apart
+        end_of_central_directory_t eocd;
+        eocd.m_file_count = 1;
+        eocd.m_total_count = 1;
+        eocd.m_central_directory_size = static_cast<uint32_t>(cd_size);
+        eocd.m_central_directory_offset = static_cast<uint32_t>(cd_offset);
+        eocd.write(os);
+    }
+
+    REQUIRE_THROWS_AS(zipios::ZipFile("file.zip"), zipios::FileCollectionException);
+}
+
+
+TEST_CASE("Load ZipFile entries in an arena", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_zip("tree.zip");
+    zipios_test::auto_unlink_t remove_empty("tree/empty.txt");
+    {
+        std::ofstream empty("tree/empty.txt");
+    }
+
+    zipios::DirectoryCollection dc("tree");
+    dc.setMethod(1000, zipios::StorageMethod::STORED, zipios::StorageMethod::DEFLATED);
+    zipios::FileEntry::vector_t const source(dc.entries());
+    REQUIRE(source.size() > 3);
+    source[rand() % source.size()]->setMethod(zipios::StorageMethod::DEFLATED);
+    {
+        std::ofstream out("tree.zip", std::ios::out | std::ios::binary | std::ios::trunc);
+        zipios::ZipFile::saveCollectionToArchive(out, dc);
+    }
+
+    zipios::ZipFile zf("tree.zip");
+    zipios::FileEntry::vector_t const v(zf.entries());
+
+    for(size_t thread_count(0); thread_count < 5; ++thread_count)
+    {
+        // load the small files only
+        size_t const limit(rand() % 5000 + 500);
+        auto small = [limit](zipios::FileEntry const & entry)
+        {
+            return entry.getSize() < limit;
+        };
+        zipios::ZipFile::arena_t const arena(zf.loadArena(small, thread_count));
+
+        size_t expected_size(0);
+        size_t count(0);
+        for(auto const & entry : v)
+        {
+            if(entry->isDirectory() || entry->getSize() >= limit)
+            {
+                REQUIRE(arena.m_offsets.find(entry->getName()) == arena.m_offsets.end());
+                continue;
+            }
+
+            // the entries are saved one after the other
+            auto const it(arena.m_offsets.find(entry->getName()));
+            REQUIRE(it != arena.m_offsets.end());
+            REQUIRE(it->second.first == expected_size);
+            REQUIRE(it->second.second == entry->getSize());
+            expected_size += entry->getSize();
+            ++count;
+
+            REQUIRE(std::string(arena.m_data.get() + it->second.first, it->second.second) == read_entry(zf, entry->getName()));
+        }
+        REQUIRE(arena.m_size == expected_size);
+        REQUIRE(arena.m_offsets.size() == count);
+        REQUIRE(arena.m_offsets.find("tree/empty.txt") != arena.m_offsets.end());
+    }
+
+    // nothing selected
+    zipios::ZipFile::arena_t const empty(zf.loadArena([](zipios::FileEntry const &) { return false; }));
+    REQUIRE(empty.m_size == 0);
+    REQUIRE(empty.m_offsets.empty());
+
+    // a damaged archive fails
+    {
+        std::fstream damage("tree.zip", std::ios::in | std::ios::out | std::ios::binary);
+        for(auto const & entry : v)
+        {
+            if(entry->getMethod() == zipios::StorageMethod::DEFLATED && entry->getCompressedSize() > 10)
+            {
+                zipios::ZipFile::arena_t const one(zf.loadArena([&entry](zipios::FileEntry const & e) { return e.getName() == entry->getName(); }));
+                REQUIRE(one.m_size == entry->getSize());
+
+                // truncate the compressed data by corrupting its size
+                damage.seekp(static_cast<std::streamoff>(entry->getEntryOffset()) + 30 + entry->getName().length());
+                std::string const garbage(entry->getCompressedSize(), '\xFF');
+                damage.write(garbage.c_str(), garbage.length());
+                damage.flush();
+                REQUIRE_THROWS_AS(zf.loadArena([&entry](zipios::FileEntry const & e) { return e.getName() == entry->getName(); }), zipios::IOException);
+                break;
+            }
+        }
+    }
+}
+
+
+TEST_CASE("Save a ZipFile in the rsyncable mode", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(system("rm -rf rsync") == 0); // clean up, just in case
+    REQUIRE(mkdir("rsync", 0777) == 0);
+    zipios_test::auto_unlink_t remove_zip("rsync.zip");
+
+    // compressible text made of random words
+    //
+    // the text does not depend on the seed of the tests since, once in
+    // a while, the normal mode gets back in sync by chance too
+    char const * words[] = { "zip", "archive", "stream", "deflate", "entry", "header", "rsync", "delta", "block", "window" };
+    std::mt19937 generator(2019);
+    std::string text;
+    while(text.length() < 512 * 1024)
+    {
+        text += words[generator() % (sizeof(words) / sizeof(words[0]))];
+        text += generator() % 10 == 0 ? '\n' : ' ';
+    }
+    std::string changed(text);
+    changed.insert(text.length() / 4, "a small change in the middle of the file");
+
+    // save the file and return the raw compressed data of its entry
+    auto compress = [](std::string const & data, bool rsyncable)
+    {
+        {
+            std::ofstream out("rsync/data.txt", std::ios::out | std::ios::binary | std::ios::trunc);
+            out << data;
+        }
+        zipios::DirectoryCollection dc("rsync");
+        dc.setMethod(0, zipios::StorageMethod::DEFLATED, zipios::StorageMethod::DEFLATED);
+        zipios::ZipOutputOptions options;
+        options.setRsyncable(rsyncable);
+        REQUIRE(options.getRsyncable() == rsyncable);
+        {
+            std::ofstream out("rsync.zip", std::ios::out | std::ios::binary | std::ios::trunc);
+            zipios::ZipFile::saveCollectionToArchive(out, dc, "", options);
+        }
+
+        zipios::ZipFile zf("rsync.zip");
+        zipios::FileEntry::pointer_t entry(zf.getEntry("rsync/data.txt"));
+        REQUIRE(entry);
+        REQUIRE(read_entry(zf, "rsync/data.txt") == data);
+
+        return read_file("rsync.zip").substr(static_cast<size_t>(entry->getEntryOffset()) + 30 + entry->getName().length(), entry->getCompressedSize());
+    };
+
+    auto common_suffix = [](std::string const & a, std::string const & b)
+    {
+        size_t size(0);
+        while(size < a.length()
+           && size < b.length()
+           && a[a.length() - size - 1] == b[b.length() - size - 1])
+        {
+            ++size;
+        }
+        return size;
+    };
+
+    // normally, the compressed data after the change is all different
+    std::string const plain(compress(text, false));
+    size_t const plain_suffix(common_suffix(plain, compress(changed, false)));
+
+    // in the rsyncable mode, it gets back in sync after the change
+    std::string const rsyncable(compress(text, true));
+    size_t const rsyncable_suffix(common_suffix(rsyncable, compress(changed, true)));
+    REQUIRE(rsyncable_suffix > rsyncable.length() / 2);
+    REQUIRE(plain_suffix < rsyncable_suffix / 10);
+
+    // the cost in size is highest with such a small vocabulary
+    REQUIRE(rsyncable.length() < plain.length() * 3 / 2);
+
+    REQUIRE(system("rm -rf rsync") == 0);
+}
+
+
+TEST_CASE("Save and read a ZipFile encrypted with WinZip AES", "[ZipFile] [FileCollection] [WinZipAES]")
+{
+    REQUIRE(system("rm -rf aes") == 0); // clean up, just in case
+    REQUIRE(mkdir("aes", 0777) == 0);
+    REQUIRE(mkdir("aes/sub", 0777) == 0);
+    zipios_test::auto_unlink_t remove_zip("aes.zip");
+
+    std::map<std::string, std::string> files;
+    files["aes/empty.txt"] = "";
+    files["aes/tiny.txt"] = "a small file which gets STORED\n";
+    std::string text;
+    while(text.length() < 200 * 1024)
+    {
+        text += "line " + std::to_string(text.length()) + " of a compressible text file\n";
+    }
+    files["aes/sub/text.txt"] = text;
+    std::string random(50 * 1024, '\0');
+    for(auto & c : random)
+    {
+        c = static_cast<char>(rand());
+    }
+    files["aes/random.bin"] = random;
+    for(auto const & f : files)
+    {
+        std::ofstream out(f.first, std::ios::out | std::ios::binary | std::ios::trunc);
+        out << f.second;
+    }
+
+    {
+        zipios::DirectoryCollection dc("aes");
+        dc.setMethod(1024, zipios::StorageMethod::STORED, zipios::StorageMethod::DEFLATED);
+        zipios::ZipOutputOptions options;
+        options.setPassword("open sesame");
+        REQUIRE(options.getPassword() == "open sesame");
+        std::ofstream out("aes.zip", std::ios::out | std::ios::binary | std::ios::trunc);
+        zipios::ZipFile::saveCollectionToArchive(out, dc, "", options);
+    }
+
+    auto read_decrypted = [](zipios::ZipFile & zf, std::string const & name)
+    {
+        zipios::FileCollection::stream_pointer_t is(zf.getInputStream(name));
+        REQUIRE(is);
+        std::string data;
+        char buf[4096];
+        while(is->read(buf, sizeof(buf)) || is->gcount() > 0)
+        {
+            data.append(buf, is->gcount());
+        }
+        REQUIRE_FALSE(is->bad());
+        return data;
+    };
+
+    SECTION("the entries get decrypted with the right password")
+    {
+        zipios::ZipFile zf("aes.zip");
+        zf.setPassword("open sesame");
+        for(auto const & f : files)
+        {
+            zipios::FileEntry::pointer_t entry(zf.getEntry(f.first));
+            REQUIRE(entry);
+            REQUIRE(entry->getMethod() == zipios::StorageMethod::AES);
+            REQUIRE(entry->getSize() == f.second.length());
+            REQUIRE(entry->getCompressedSize() >= 16 + 2 + 10);
+            REQUIRE(read_decrypted(zf, f.first) == f.second);
+        }
+
+        // directories are not encrypted
+        zipios::FileEntry::pointer_t sub(zf.getEntry("aes/sub"));
+        REQUIRE(sub);
+        REQUIRE(sub->isDirectory());
+        REQUIRE(sub->getMethod() == zipios::StorageMethod::STORED);
+
+        // read-ahead also works on encrypted entries
+        zf.setReadAhead(16 * 1024);
+        REQUIRE(read_decrypted(zf, "aes/sub/text.txt") == text);
+    }
+
+    SECTION("the entries cannot be read without the right password")
+    {
+        zipios::ZipFile zf("aes.zip");
+        REQUIRE_THROWS_AS(zf.getInputStream("aes/tiny.txt"), zipios::FileCollectionException);
+        zf.setPassword("open sesame!");
+        REQUIRE_THROWS_AS(zf.getInputStream("aes/tiny.txt"), zipios::FileCollectionException);
+        REQUIRE_THROWS_AS(zf.getInputStream("aes/sub/text.txt"), zipios::FileCollectionException);
+    }
+
+    SECTION("modified data gets detected")
+    {
+        zipios::FileEntry::pointer_t entry;
+        {
+            zipios::ZipFile zf("aes.zip");
+            entry = zf.getEntry("aes/tiny.txt");
+        }
+        {
+            // flip a bit in the middle of the encrypted data
+            std::fstream io("aes.zip", std::ios::in | std::ios::out | std::ios::binary);
+            zipios::offset_t const header(static_cast<zipios::offset_t>(entry->getEntryOffset()));
+            unsigned char lengths[4];
+            io.seekg(header + 26);
+            io.read(reinterpret_cast<char *>(lengths), sizeof(lengths));
+            zipios::offset_t const pos(header + 30
+                                     + (lengths[0] | (lengths[1] << 8))
+                                     + (lengths[2] | (lengths[3] << 8))
+                                     + 16 + 2 + 5);
+            io.seekg(pos);
+            char c(0);
+            io.get(c);
+            io.seekp(pos);
+            io.put(static_cast<char>(c ^ 1));
+        }
+
+        zipios::ZipFile zf("aes.zip");
+        zf.setPassword("open sesame");
+        zipios::FileCollection::stream_pointer_t is(zf.getInputStream("aes/tiny.txt"));
+        char buf[100];
+        is->read(buf, sizeof(buf));
+        REQUIRE(is->bad());
+    }
+
+    SECTION("saving a copy without a password decrypts the entries")
+    {
+        zipios_test::auto_unlink_t remove_copy("aes-copy.zip");
+        {
+            zipios::ZipFile zf("aes.zip");
+            zf.setPassword("open sesame");
+            std::ofstream out("aes-copy.zip", std::ios::out | std::ios::binary | std::ios::trunc);
+            zipios::ZipFile::saveCollectionToArchive(out, zf);
+        }
+
+        zipios::ZipFile copy("aes-copy.zip");
+        for(auto const & f : files)
+        {
+            zipios::FileEntry::pointer_t entry(copy.getEntry(f.first));
+            REQUIRE(entry);
+            REQUIRE(entry->getMethod() != zipios::StorageMethod::AES);
+            REQUIRE(read_decrypted(copy, f.first) == f.second);
+        }
+    }
+
+    REQUIRE(system("rm -rf aes") == 0);
+}
+
+
+TEST_CASE("Compute content digests while saving a ZipFile", "[ZipFile] [FileCollection] [ContentDigest]")
+{
+    REQUIRE(system("rm -rf digest") == 0); // clean up, just in case
+    REQUIRE(mkdir("digest", 0777) == 0);
+    REQUIRE(mkdir("digest/sub", 0777) == 0);
+    zipios_test::auto_unlink_t remove_zip("digest.zip");
+
+    std::map<std::string, std::string> files;
+    files["digest/empty.txt"] = "";
+    files["digest/tiny.txt"] = "a small file which gets STORED\n";
+    std::string text;
+    while(text.length() < 300 * 1024)
+    {
+        text += "line " + std::to_string(text.length()) + " of a compressible text file\n";
+    }
+    files["digest/sub/text.txt"] = text;
+    for(auto const & f : files)
+    {
+        std::ofstream out(f.first, std::ios::out | std::ios::binary | std::ios::trunc);
+        out << f.second;
+    }
+
+    zipios::ContentDigest::algorithm_vector_t const algorithms{ zipios::DigestAlgorithm::SHA256, zipios::DigestAlgorithm::XXH64 };
+    auto expected = [&algorithms](std::string const & data)
+    {
+        zipios::ContentDigest digest(algorithms);
+        digest.update(data.c_str(), data.length());
+        return digest.digests();
+    };
+
+    for(int store(0); store < 2; ++store)
+    {
+        std::map<std::string, zipios::ContentDigest::digest_map_t> reported;
+        {
+            zipios::DirectoryCollection dc("digest");
+            dc.setMethod(1024, zipios::StorageMethod::STORED, zipios::StorageMethod::DEFLATED);
+            zipios::ZipOutputOptions options;
+            options.setDigestAlgorithms(algorithms, store != 0);
+            REQUIRE(options.getDigestAlgorithms() == algorithms);
+            REQUIRE(options.getStoreDigests() == (store != 0));
+            options.setDigestCallback([&reported](zipios::FileEntry::pointer_t entry, zipios::ContentDigest::digest_map_t const & digests)
+                {
+                    REQUIRE_FALSE(entry->isDirectory());
+                    reported[entry->getName()] = digests;
+                });
+            std::ofstream out("digest.zip", std::ios::out | std::ios::binary | std::ios::trunc);
+            zipios::ZipFile::saveCollectionToArchive(out, dc, "", options);
+        }
+
+        // the callback got the digests of each file
+        REQUIRE(reported.size() == files.size());
+        for(auto const & f : files)
+        {
+            REQUIRE(reported[f.first] == expected(f.second));
+        }
+
+        // the archive is still valid and the extra field, if any, can
+        // be used to verify the data
+        zipios::ZipFile zf("digest.zip");
+        for(auto const & f : files)
+        {
+            zipios::FileEntry::pointer_t entry(zf.getEntry(f.first));
+            REQUIRE(entry);
+            REQUIRE(entry->getSize() == f.second.length());
+
+            std::string const data(read_entry(zf, f.first));
+            REQUIRE(data == f.second);
+
+            zipios::ContentDigest::digest_map_t saved;
+            REQUIRE(zipios::ContentDigest::readExtraField(entry->getExtra(), saved) == (store != 0));
+            if(store != 0)
+            {
+                REQUIRE(saved == expected(data));
+            }
+        }
+        REQUIRE(system("unzip -tq digest.zip >/dev/null") == 0);
+    }
+
+    REQUIRE(system("rm -rf digest") == 0);
+}
+
+
+TEST_CASE("Save a ZipFile with several compression threads", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(system("rm -rf parallel") == 0); // clean up, just in case
+    REQUIRE(mkdir("parallel", 0777) == 0);
+    REQUIRE(mkdir("parallel/sub", 0777) == 0);
+    zipios_test::auto_unlink_t remove_zip("parallel.zip");
+
+    // the large file spans several chunks, the last one being partial
+    std::map<std::string, std::string> files;
+    files["parallel/empty.txt"] = "";
+    files["parallel/tiny.txt"] = "a small file which gets STORED\n";
+    std::string text;
+    while(text.length() < 3 * 1024 * 1024 + 12345)
+    {
+        text += "line " + std::to_string(rand()) + " of a large file cut in chunks\n";
+    }
+    files["parallel/sub/large.txt"] = text;
+    for(int idx(0); idx < 20; ++idx)
+    {
+        files["parallel/sub/file" + std::to_string(idx) + ".txt"] = text.substr(rand() % 1000, rand() % 5000 + 1000);
+    }
+    for(auto const & f : files)
+    {
+        std::ofstream out(f.first, std::ios::out | std::ios::binary | std::ios::trunc);
+        out << f.second;
+    }
+
+    size_t single_size(0);
+    for(size_t thread_count(0); thread_count <= 4; ++thread_count)
+    {
+        zipios::DirectoryCollection dc("parallel");
+        dc.setMethod(100, zipios::StorageMethod::STORED, zipios::StorageMethod::DEFLATED);
+        zipios::ZipOutputOptions options;
+        options.setCompressionThreads(thread_count);
+        REQUIRE(options.getCompressionThreads() == thread_count);
+        {
+            std::ofstream out("parallel.zip", std::ios::out | std::ios::binary | std::ios::trunc);
+            zipios::ZipFile::saveCollectionToArchive(out, dc, "", options);
+            REQUIRE(out);
+        }
+
+        zipios::ZipFile zf("parallel.zip");
+        REQUIRE(zf.size() == files.size() + 2);
+        for(auto const & f : files)
+        {
+            zipios::FileEntry::pointer_t entry(zf.getEntry(f.first));
+            REQUIRE(entry);
+            REQUIRE(entry->getSize() == f.second.length());
+            REQUIRE(entry->getMethod() == (f.second.length() > 100 ? zipios::StorageMethod::DEFLATED : zipios::StorageMethod::STORED));
+            REQUIRE(read_entry(zf, f.first) == f.second);
+        }
+        REQUIRE(system("unzip -tq parallel.zip >/dev/null") == 0);
+
+        // the chunks barely change the size of the compressed data
+        std::ifstream in("parallel.zip", std::ios::in | std::ios::binary | std::ios::ate);
+        size_t const size(in.tellg());
+        if(thread_count <= 1)
+        {
+            single_size = size;
+        }
+        else
+        {
+            REQUIRE(size < single_size + single_size / 100);
+        }
+    }
+
+    REQUIRE(system("rm -rf parallel") == 0);
+}
+
+
+TEST_CASE("Align the data of the stored entries", "[ZipFile] [FileCollection]")
+{
+    REQUIRE_THROWS_AS(zipios::ZipOutputOptions().setStoredAlignment(3), zipios::InvalidException);
+    REQUIRE_THROWS_AS(zipios::ZipOutputOptions().setStoredAlignment(65536), zipios::InvalidException);
+
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_zip("tree.zip");
+
+    size_t const alignments[] = { 0, 1, 2, 4, 64, 4096, 32768 };
+    for(auto const alignment : alignments)
+    {
+        for(int method(0); method < 2; ++method)
+        {
+            zipios::DirectoryCollection dc("tree");
+            if(method == 0)
+            {
+                dc.setMethod(1024, zipios::StorageMethod::STORED, zipios::StorageMethod::DEFLATED);
+            }
+            else
+            {
+                dc.setLevel(1024, zipios::FileEntry::COMPRESSION_LEVEL_NONE, zipios::FileEntry::COMPRESSION_LEVEL_DEFAULT);
+            }
+            zipios::ZipOutputOptions options;
+            options.setStoredAlignment(alignment);
+            REQUIRE(options.getStoredAlignment() == (alignment <= 1 ? 0 : alignment));
+            {
+                std::ofstream out("tree.zip", std::ios::out | std::ios::binary | std::ios::trunc);
+                zipios::ZipFile::saveCollectionToArchive(out, dc, "", options);
+                REQUIRE(out);
+            }
+            std::string const archive(read_file("tree.zip"));
+
+            zipios::ZipFile zf("tree.zip");
+            REQUIRE(zf.size() == tree.size());
+            zipios::FileEntry::vector_t const entries(zf.entries());
+            for(auto const & entry : entries)
+            {
+                // the padding is only found in the local header
+                REQUIRE(entry->getExtra().empty());
+                if(entry->isDirectory())
+                {
+                    continue;
+                }
+                REQUIRE(read_entry(zf, entry->getName()).length() == entry->getSize());
+
+                size_t const offset(static_cast<size_t>(entry->getEntryOffset()));
+                size_t const name_length(static_cast<unsigned char>(archive[offset + 26]) | (static_cast<unsigned char>(archive[offset + 27]) << 8));
+                size_t const extra_length(static_cast<unsigned char>(archive[offset + 28]) | (static_cast<unsigned char>(archive[offset + 29]) << 8));
+                size_t const data_offset(offset + 30 + name_length + extra_length);
+                if(entry->getMethod() == zipios::StorageMethod::STORED
+                && alignment > 1)
+                {
+                    REQUIRE(data_offset % alignment == 0);
+                    REQUIRE(extra_length >= 6);
+                }
+                else
+                {
+                    REQUIRE(extra_length == 0);
+                }
+                REQUIRE(archive.substr(data_offset, entry->getCompressedSize()).length() == entry->getCompressedSize());
+            }
+            REQUIRE(system("unzip -tq tree.zip >/dev/null") == 0);
+        }
+    }
+}
+
+
+
+TEST_CASE("Open a ZipFile appended to other data", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_bin("embedded.bin");
+
+    std::string archive;
+    {
+        zipios::DirectoryCollection dc("tree");
+        std::ostringstream out;
+        zipios::ZipFile::saveCollectionToArchive(out, dc);
+        archive = out.str();
+    }
+
+    std::string prefix(rand() % 5000 + 100, '\0');
+    for(auto & c : prefix)
+    {
+        c = static_cast<char>(rand());
+    }
+
+    auto check = [&tree](zipios::FileCollection & zf)
+    {
+        REQUIRE(zf.isValid());
+        REQUIRE(zf.size() == tree.size());
+        check_entries(zf);
+    };
+
+    auto save = [](std::string const & data)
+    {
+        std::ofstream out("embedded.bin", std::ios::out | std::ios::binary | std::ios::trunc);
+        out.write(data.c_str(), data.length());
+        REQUIRE(out);
+    };
+
+    std::string const start(
+            { static_cast<char>(prefix.length())
+            , static_cast<char>(prefix.length() >> 8)
+            , static_cast<char>(prefix.length() >> 16)
+            , static_cast<char>(prefix.length() >> 24) });
+
+    SECTION("the prefix gets detected without a trailer")
+    {
+        save(prefix + archive);
+        zipios::ZipFile zf("embedded.bin");
+        check(zf);
+    }
+
+    SECTION("the 64 bit trailer of appendzip")
+    {
+        save(prefix + archive + start + std::string(4, '\0') + "ZE64");
+        check(*zipios::ZipFile::openEmbeddedZipFile("embedded.bin"));
+
+        zipios::ZipFile zf("embedded.bin");
+        check(zf);
+    }
+
+    SECTION("the legacy 32 bit trailer of appendzip")
+    {
+        save(prefix + archive + start);
+        check(*zipios::ZipFile::openEmbeddedZipFile("embedded.bin"));
+    }
+}
+
+
+
+TEST_CASE("Save a ZipFile with a central directory memory limit", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(zipios::ZipOutputOptions().getCentralDirectoryMemoryLimit() == 0);
+
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_zip("tree.zip");
+
+    std::string const expected(save_tree("tree.zip"));
+
+    size_t const limits[] = { 1, 100, 4096, 1024 * 1024 };
+    for(auto const limit : limits)
+    {
+        zipios::ZipOutputOptions options;
+        options.setCentralDirectoryMemoryLimit(limit);
+        REQUIRE(options.getCentralDirectoryMemoryLimit() == limit);
+
+        // spilling the records does not change the archive
+        REQUIRE(save_tree("tree.zip", options) == expected);
+
+        zipios::ZipFile zf("tree.zip");
+        REQUIRE(zf.size() == tree.size());
+    }
+}
+
+
+
+TEST_CASE("CompressionBudget selects the zlib level", "[ZipFile] [CompressionBudget]")
+{
+    size_t const window(zipios::CompressionBudget::WINDOW_SIZE);
+
+    zipios::CompressionBudget disabled;
+    REQUIRE_FALSE(disabled.isEnabled());
+    REQUIRE_FALSE(disabled.update(window * 2, window, 100.0));
+    REQUIRE(disabled.getLevel() == 6);
+
+    // 1Mb per second of input is the target
+    zipios::CompressionBudget budget(1024.0 * 1024.0);
+    REQUIRE(budget.isEnabled());
+    REQUIRE(budget.getThroughput() == Approx(1024.0 * 1024.0));
+    REQUIRE(budget.getLevel() == 6);
+
+    // nothing changes until the window is full
+    REQUIRE_FALSE(budget.update(window / 2, window / 4, 10.0));
+    REQUIRE(budget.getLevel() == 6);
+
+    // too slow, go down one level per window, down to 1
+    REQUIRE(budget.update(window / 2, window / 4, 10.0));
+    REQUIRE(budget.getLevel() == 5);
+    for(int level(4); level >= 1; --level)
+    {
+        REQUIRE(budget.update(window, window / 4, 10.0));
+        REQUIRE(budget.getLevel() == level);
+    }
+    REQUIRE_FALSE(budget.update(window, window / 4, 10.0));
+    REQUIRE(budget.getLevel() == 1);
+
+    // on target, no change
+    REQUIRE_FALSE(budget.update(window, window / 4, 0.8));
+    REQUIRE(budget.getLevel() == 1);
+
+    // much faster, go up one level per window, up to 9
+    for(int level(2); level <= 9; ++level)
+    {
+        REQUIRE(budget.update(window, window / 4, 0.1));
+        REQUIRE(budget.getLevel() == level);
+    }
+    REQUIRE_FALSE(budget.update(window, window / 4, 0.1));
+    REQUIRE(budget.getLevel() == 9);
+
+    // data which does not compress gets the fastest level
+    for(int level(8); level >= 1; --level)
+    {
+        REQUIRE(budget.update(window, window, 0.1));
+        REQUIRE(budget.getLevel() == level);
+    }
+
+    budget.setThroughput(0.0);
+    REQUIRE_FALSE(budget.isEnabled());
+}
+
+
+TEST_CASE("Save a ZipFile with a compression budget", "[ZipFile] [FileCollection] [CompressionBudget]")
+{
+    zipios::ZipOutputOptions defaults;
+    REQUIRE(defaults.getCompressionBudget() == Approx(0.0));
+    REQUIRE(defaults.getCompressionTimeBudget() == Approx(0.0));
+    REQUIRE_THROWS_AS(defaults.setCompressionBudget(-1.0), zipios::InvalidException);
+    REQUIRE_THROWS_AS(defaults.setCompressionTimeBudget(-1.0), zipios::InvalidException);
+
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_zip("tree.zip");
+
+    // a large compressible file so the level changes within an entry
+    {
+        std::ofstream big("tree/big.txt", std::ios::out | std::ios::binary | std::ios::trunc);
+        for(int line(0); line < 200000; ++line)
+        {
+            big << "line " << line << " of a large file with " << (rand() % 1000) << " words\n";
+        }
+    }
+
+    // a target which cannot be reached ends up using the fastest level,
+    // an easy target the best level, so the large file gets smaller
+    // with the easy target (with threads, all the chunks of the file
+    // are compressed before the first measurement comes back)
+    std::map<size_t, size_t> fast_sizes;
+    double const throughputs[] = { 1e15, 1.0 };
+    for(auto const throughput : throughputs)
+    {
+        for(size_t threads(1); threads <= 3; threads += 2)
+        {
+            zipios::ZipOutputOptions options;
+            options.setCompressionThreads(threads);
+            options.setCompressionBudget(throughput);
+            REQUIRE(options.getCompressionBudget() == Approx(throughput));
+            save_tree("tree.zip", options, 100);
+
+            zipios::ZipFile zf("tree.zip");
+            REQUIRE(zf.size() == tree.size() + 1);
+            size_t const big_size(zf.getEntry("tree/big.txt")->getCompressedSize());
+            if(throughput > 2.0)
+            {
+                fast_sizes[threads] = big_size;
+            }
+            else if(threads == 1)
+            {
+                REQUIRE(big_size < fast_sizes[threads]);
+            }
+            check_entries(zf);
+            REQUIRE(system("unzip -tq tree.zip >/dev/null") == 0);
+        }
+    }
+
+    // a time budget
+    {
+        zipios::ZipOutputOptions options;
+        options.setCompressionTimeBudget(60.0);
+        REQUIRE(options.getCompressionTimeBudget() == Approx(60.0));
+        save_tree("tree.zip", options, 100);
+        REQUIRE(system("unzip -tq tree.zip >/dev/null") == 0);
+    }
+}
+
+
+
+TEST_CASE("Keep many ZipFile entry streams open at once", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_zip("tree.zip");
+    save_tree("tree.zip", zipios::ZipOutputOptions(), 100);
+
+    struct stream_t
+    {
+        zipios::FileCollection::stream_pointer_t    m_stream;
+        std::string                                 m_expected;
+        std::string                                 m_data;
+    };
+
+    // more streams than a process can usually have file descriptors
+    // since they all share the one of the ZipFile
+    std::vector<stream_t> streams;
+    {
+        zipios::ZipFile zf("tree.zip");
+        zipios::FileEntry::vector_t const entries(zf.entries());
+        while(streams.size() < 2000)
+        {
+            for(auto const & entry : entries)
+            {
+                if(entry->isDirectory())
+                {
+                    continue;
+                }
+                stream_t s;
+                s.m_stream = zf.getInputStream(entry->getName());
+                REQUIRE(s.m_stream);
+                s.m_expected = read_file(entry->getName());
+                streams.push_back(s);
+            }
+        }
+
+        // the streams remain valid once the ZipFile is closed
+        zf.close();
+        REQUIRE_FALSE(zf.isValid());
+    }
+
+    // read all the streams a little at a time
+    char buffer[37];
+    for(bool more(true); more; )
+    {
+        more = false;
+        for(auto & s : streams)
+        {
+            s.m_stream->read(buffer, sizeof(buffer));
+            s.m_data.append(buffer, s.m_stream->gcount());
+            more = more || *s.m_stream;
+        }
+    }
+    for(auto const & s : streams)
+    {
+        REQUIRE(s.m_data == s.m_expected);
+        REQUIRE(s.m_stream->eof());
+    }
+}
+
+
+TEST_CASE("Open ZipFile entries at their data offset", "[ZipFile] [FileCollection]")
+{
+    REQUIRE(system("rm -rf tree") == 0); // clean up, just in case
+    zipios_test::file_t tree(zipios_test::file_t::type_t::DIRECTORY, rand() % 10 + 20, "tree");
+    zipios_test::auto_unlink_t remove_zip("tree.zip");
+    save_tree("tree.zip", zipios::ZipOutputOptions(), 100);
+
+    zipios::ZipFile zf("tree.zip");
+    zipios::FileEntry::vector_t const entries(zf.entries());
+    std::map<std::string, std::string> expected;
+    for(auto const & entry : entries)
+    {
+        // the data starts right after the local header
+        REQUIRE(entry->getDataOffset() == entry->getEntryOffset() + static_cast<std::streamoff>(30 + entry->getName().length() + (entry->isDirectory() ? 1 : 0)));
+        if(entry->isDirectory())
+        {
+            continue;
+        }
+
+        expected[entry->getName()] = read_file(entry->getName());
+        if(entry->getMethod() == zipios::StorageMethod::STORED)
+        {
+            std::ifstream in("tree.zip", std::ios::in | std::ios::binary);
+            in.seekg(entry->getDataOffset());
+            std::string data(entry->getSize(), '\0');
+            in.read(&data[0], data.length());
+            REQUIRE(data == expected[entry->getName()]);
+        }
+    }
+
+    // damage the filename of all the local headers; the streams do not
+    // read them anymore so the data can still be read
+    {
+        std::fstream archive("tree.zip", std::ios::in | std::ios::out | std::ios::binary);
+        for(auto const & entry : entries)
+        {
+            archive.seekp(entry->getEntryOffset() + static_cast<std::streamoff>(30));
+            archive << std::string(entry->getName().length(), '?');
+        }
+        REQUIRE(archive);
+    }
+    REQUIRE_THROWS_AS(zipios::ZipFile("tree.zip"), zipios::FileCollectionException);
+
+    for(auto const & e : expected)
+    {
+        REQUIRE(read_entry(zf, e.first) == e.second);
+    }
+}
+
 // Local Variables:
 // mode: cpp
 // indent-tabs-mode: nil
@@ -32,8 +32,21 @@
 #include <cstring>
 #include <iostream>
 #include <fstream>
+#include <vector>
+
 #include <stdint.h>
 
+#if !defined(ZIPIOS_WINDOWS) && (defined(_WINDOWS) || defined(WIN32) || defined(_WIN32) || defined(__WIN32))
+#define ZIPIOS_WINDOWS
+#endif
+
+#ifndef ZIPIOS_WINDOWS
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 
 // static variables
 namespace
@@ -42,15 +55,149 @@ namespace
 char *g_progname;
 
 
+/** \brief Size of the trailer appended after the zip archive.
+ *
+ * The trailer is the 64 bit start offset of the archive followed by
+ * the "ZE64" signature. See ZipFile::openEmbeddedZipFile().
+ */
+size_t const g_trailer_size = 12;
+
+
 void usage()
 {
     // see the ZipFile::openEmbeddedZipFile() function for details...
     std::cout << "Usage:  " << g_progname << " exe-file zipfile" << std::endl;
     std::cout << "This tool appends a zipfile at the end of any other file (most often a .exe under MS-Windows)." << std::endl;
     std::cout << "The openEmbeddedZipFile() function can then be used to read the file." << std::endl;
+    std::cout << "The ZipFile constructor also detects such an archive by itself." << std::endl;
     exit(1);
 }
 
+
+void buildTrailer(uint64_t const zip_start, unsigned char * trailer)
+{
+    for(size_t idx(0); idx < 8; ++idx)
+    {
+        trailer[idx] = static_cast<unsigned char>(zip_start >> (idx * 8));
+    }
+    trailer[8]  = 'Z';
+    trailer[9]  = 'E';
+    trailer[10] = '6';
+    trailer[11] = '4';
+}
+
+
+#ifndef ZIPIOS_WINDOWS
+/** \brief Append the zip file to the exe file with file descriptors.
+ *
+ * The copy is done with copy_file_range() where available so the data
+ * does not go through user space (and on file systems supporting it,
+ * the blocks are shared instead of copied). When the kernel refuses
+ * (different file systems on older kernels, unsupported file types)
+ * the rest of the data is copied with a read/write loop.
+ *
+ * \param[in] exe_name  The file receiving the archive.
+ * \param[in] zip_name  The archive to append.
+ * \param[out] zip_start  The offset of the archive in the exe file.
+ *
+ * \return 0 on success, 1 on errors (an error message was printed).
+ */
+int appendFile(char const * exe_name, char const * zip_name, uint64_t & zip_start)
+{
+    int const zip_fd(open(zip_name, O_RDONLY | O_CLOEXEC));
+    if(zip_fd < 0)
+    {
+        std::cerr << g_progname << ":error: Unable to open " << zip_name << " for reading." << std::endl;
+        return 1;
+    }
+
+    // copy_file_range() does not accept an output opened with O_APPEND
+    // so we use explicit offsets instead
+    //
+    int const exe_fd(open(exe_name, O_WRONLY | O_CREAT | O_CLOEXEC, 0666));
+    if(exe_fd < 0)
+    {
+        std::cerr << g_progname << ":error: Unable to open " << exe_name << " for writing" << std::endl;
+        close(zip_fd);
+        return 1;
+    }
+
+    int result(1);
+    struct stat st;
+    off_t const exe_size(lseek(exe_fd, 0, SEEK_END));
+    if(fstat(zip_fd, &st) != 0 || exe_size < 0)
+    {
+        std::cerr << g_progname << ":error: Unable to determine the file sizes." << std::endl;
+    }
+    else
+    {
+        zip_start = exe_size;
+        off_t in_offset(0);
+        off_t out_offset(exe_size);
+#ifdef __linux__
+        while(in_offset < st.st_size)
+        {
+            ssize_t const r(copy_file_range(zip_fd, &in_offset, exe_fd, &out_offset, st.st_size - in_offset, 0));
+            if(r <= 0)
+            {
+                // EXDEV, ENOSYS, EINVAL... use the fallback
+                break;
+            }
+        }
+#endif
+        std::vector<char> buffer(1024 * 1024);
+        while(in_offset < st.st_size)
+        {
+            ssize_t const r(pread(zip_fd, buffer.data(), buffer.size(), in_offset));
+            if(r < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if(r <= 0)
+            {
+                break;
+            }
+            ssize_t written(0);
+            while(written < r)
+            {
+                ssize_t const w(pwrite(exe_fd, buffer.data() + written, r - written, out_offset));
+                if(w < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if(w <= 0)
+                {
+                    break;
+                }
+                written += w;
+                out_offset += w;
+            }
+            if(written != r)
+            {
+                break;
+            }
+            in_offset += r;
+        }
+
+        unsigned char trailer[g_trailer_size];
+        buildTrailer(zip_start, trailer);
+        if(in_offset != st.st_size
+        || pwrite(exe_fd, trailer, sizeof(trailer), out_offset) != static_cast<ssize_t>(sizeof(trailer)))
+        {
+            std::cerr << g_progname << ":error: An I/O error occurred while appending " << zip_name << " to " << exe_name << "." << std::endl;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    close(exe_fd);
+    close(zip_fd);
+    return result;
+}
+#endif
+
 } // no name namespace
 
 
@@ -73,6 +220,7 @@ int main(int argc, char *argv[])
         usage();
     }
 
+#ifdef ZIPIOS_WINDOWS
     std::ofstream exef(argv[1], std::ios::app | std::ios::binary);
     if(!exef)
     {
@@ -88,18 +236,30 @@ int main(int argc, char *argv[])
     }
 
     // get eof pos (to become zip file starting position).
-    uint32_t const zip_start = exef.tellp();
-    std::cout << "zip start will be at " << zip_start << std::endl;
+    exef.seekp(0, std::ios::end);
+    uint64_t const zip_start = exef.tellp();
 
     // Append zip file to exe file
     exef << zipf.rdbuf();
 
     // write zipfile start offset to file
-    exef << static_cast<unsigned char>(zip_start);
-    exef << static_cast<unsigned char>(zip_start >> 8);
-    exef << static_cast<unsigned char>(zip_start >> 16);
-    exef << static_cast<unsigned char>(zip_start >> 24);
-    //zipios::writeUint32(zip_start, exef); -- TODO: delete once verified
+    unsigned char trailer[g_trailer_size];
+    buildTrailer(zip_start, trailer);
+    exef.write(reinterpret_cast<char const *>(trailer), sizeof(trailer));
+    if(!exef)
+    {
+        std::cerr << g_progname << ":error: An I/O error occurred while appending " << argv[2] << " to " << argv[1] << "." << std::endl;
+        return 1;
+    }
+#else
+    uint64_t zip_start(0);
+    if(appendFile(argv[1], argv[2], zip_start) != 0)
+    {
+        return 1;
+    }
+#endif
+
+    std::cout << "zip start is at " << zip_start << std::endl;
 
     return 0;
 }
@@ -0,0 +1,307 @@
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Tool used to compile a Zip archive in a program.
+ * \anchor zipembed_anchor
+ *
+ * Source code to a small program zipembed that transforms a Zip
+ * archive in a C++ source file. The generated file defines a
+ * zipios::EmbeddedArchive which a zipios::EmbeddedCollection reads
+ * without parsing anything at runtime. Run zipembed without arguments
+ * to get a helpful usage message.
+ */
+
+#include "zipios/embeddedcollection.hpp"
+#include "zipios/zipfile.hpp"
+#include "zipios/zipiosexceptions.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+
+// static variables
+namespace
+{
+
+char *g_progname;
+
+
+void usage()
+{
+    std::cout << "Usage:  " << g_progname << " zipfile symbol output.cpp" << std::endl;
+    std::cout << "This tool transforms a zipfile in a C++ source file defining:" << std::endl;
+    std::cout << "    extern zipios::EmbeddedArchive const symbol;" << std::endl;
+    std::cout << "Compile that file with your program and read the archive with a zipios::EmbeddedCollection." << std::endl;
+    exit(1);
+}
+
+
+/** \brief Transform a string in a C++ string literal.
+ *
+ * \param[in] str  The string to transform.
+ *
+ * \return The string between double quotes and properly escaped.
+ */
+std::string quote(std::string const & str)
+{
+    std::ostringstream out;
+    out << '"';
+    for(auto c : str)
+    {
+        unsigned char const u(static_cast<unsigned char>(c));
+        if(u == '"' || u == '\\')
+        {
+            out << '\\' << c;
+        }
+        else if(u < 0x20 || u >= 0x7F || u == '?')
+        {
+            // octal is never longer than 3 digits, hex would be
+            out << '\\' << std::oct << std::setw(3) << std::setfill('0') << static_cast<int>(u) << std::dec;
+        }
+        else
+        {
+            out << c;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+
+uint32_t readUint16(std::vector<char> const & data, size_t offset)
+{
+    return static_cast<unsigned char>(data[offset])
+         | (static_cast<unsigned char>(data[offset + 1]) << 8);
+}
+
+
+} // no name namespace
+
+
+int main(int argc, char *argv[])
+{
+    g_progname = argv[0];
+    char *e(strrchr(g_progname, '/'));
+    if(e)
+    {
+        g_progname = e + 1;
+    }
+    e = strrchr(g_progname, '\\');
+    if(e)
+    {
+        g_progname = e + 1;
+    }
+
+    if(argc != 4)
+    {
+        usage();
+    }
+
+    std::string const symbol(argv[2]);
+    if(symbol.empty()
+    || isdigit(static_cast<unsigned char>(symbol[0]))
+    || std::find_if(symbol.begin(), symbol.end(), [](char c) { return !isalnum(static_cast<unsigned char>(c)) && c != '_'; }) != symbol.end())
+    {
+        std::cerr << g_progname << ":error: \"" << symbol << "\" is not a valid C++ identifier." << std::endl;
+        usage();
+    }
+
+    std::ifstream zipf(argv[1], std::ios::in | std::ios::binary);
+    if(!zipf)
+    {
+        std::cerr << g_progname << ":error: Unable to open " << argv[1] << " for reading." << std::endl;
+        usage();
+    }
+    std::vector<char> const data((std::istreambuf_iterator<char>(zipf)), std::istreambuf_iterator<char>());
+
+    zipios::FileEntry::vector_t entries;
+    try
+    {
+        zipios::ZipFile zf(argv[1]);
+        entries = zf.entries();
+    }
+    catch(zipios::Exception const & ex)
+    {
+        std::cerr << g_progname << ":error: " << argv[1] << " is not a valid Zip archive: " << ex.what() << std::endl;
+        return 1;
+    }
+
+    // a name can only appear once in the hash table, keep the first one
+    std::vector<std::string> names;
+    zipios::FileEntry::vector_t unique_entries;
+    for(auto const & entry : entries)
+    {
+        std::string const name(entry->getName());
+        if(std::find(names.begin(), names.end(), name) != names.end())
+        {
+            std::cerr << g_progname << ":warning: entry \"" << name << "\" is duplicated, only the first one is embedded." << std::endl;
+            continue;
+        }
+        names.push_back(name);
+        unique_entries.push_back(entry);
+    }
+
+    std::vector<int32_t> displacements;
+    std::vector<size_t> slots;
+    if(!zipios::EmbeddedCollection::computePerfectHash(names, displacements, slots))
+    {
+        std::cerr << g_progname << ":error: could not compute a perfect hash of the entry names." << std::endl; // LCOV_EXCL_LINE
+        return 1; // LCOV_EXCL_LINE
+    }
+
+    // the table is sorted by slot
+    std::vector<std::string> table(names.size());
+    for(size_t idx(0); idx < unique_entries.size(); ++idx)
+    {
+        zipios::FileEntry const & entry(*unique_entries[idx]);
+
+        // the local header may have a different extra field than
+        // the central directory so the offset of the data is computed
+        // from the local header
+        size_t const offset(entry.getEntryOffset());
+        if(offset + 30 > data.size()
+        || data[offset + 0] != 'P'
+        || data[offset + 1] != 'K'
+        || data[offset + 2] != 3
+        || data[offset + 3] != 4)
+        {
+            std::cerr << g_progname << ":error: invalid local header for entry \"" << names[idx] << "\"." << std::endl;
+            return 1;
+        }
+        size_t const data_offset(offset + 30 + readUint16(data, offset + 26) + readUint16(data, offset + 28));
+        if(data_offset + entry.getCompressedSize() > data.size())
+        {
+            std::cerr << g_progname << ":error: the data of entry \"" << names[idx] << "\" is out of bounds." << std::endl;
+            return 1;
+        }
+
+        std::ostringstream line;
+        line << "    { " << quote(names[idx])
+             << ", " << names[idx].length()
+             << ", " << data_offset
+             << ", " << entry.getCompressedSize()
+             << ", " << entry.getSize()
+             << ", 0x" << std::hex << std::setw(8) << std::setfill('0') << entry.getCrc()
+             << ", 0x" << std::setw(8) << entry.getTime() << std::dec
+             << ", " << static_cast<int>(entry.getMethod())
+             << ", " << (entry.isDirectory() ? "true" : "false")
+             << " },";
+        table[slots[idx]] = line.str();
+    }
+
+    std::ofstream out(argv[3], std::ios::out | std::ios::trunc);
+    if(!out)
+    {
+        std::cerr << g_progname << ":error: Unable to open " << argv[3] << " for writing." << std::endl;
+        usage();
+    }
+
+    out << "// Generated by zipembed from " << argv[1] << " -- do not edit." << std::endl
+        << "#include <zipios/embeddedcollection.hpp>" << std::endl
+        << std::endl
+        << "namespace" << std::endl
+        << "{" << std::endl
+        << std::endl
+        << "unsigned char const g_data[] =" << std::endl
+        << "{";
+    for(size_t idx(0); idx < data.size(); ++idx)
+    {
+        if(idx % 16 == 0)
+        {
+            out << std::endl << "   ";
+        }
+        out << " 0x" << std::hex << std::setw(2) << std::setfill('0')
+            << static_cast<int>(static_cast<unsigned char>(data[idx])) << std::dec << ",";
+    }
+    if(data.empty())
+    {
+        out << std::endl << "    0x00,";
+    }
+    out << std::endl << "};" << std::endl
+        << std::endl
+        << "constexpr zipios::EmbeddedArchiveEntry const g_entries[] =" << std::endl
+        << "{" << std::endl;
+    for(auto const & line : table)
+    {
+        out << line << std::endl;
+    }
+    if(table.empty())
+    {
+        // C++ does not support empty arrays
+        out << "    { \"\", 0, 0, 0, 0, 0, 0, 0, false }," << std::endl;
+    }
+    out << "};" << std::endl
+        << std::endl
+        << "constexpr int32_t const g_displacements[] =" << std::endl
+        << "{";
+    for(size_t idx(0); idx < displacements.size(); ++idx)
+    {
+        if(idx % 16 == 0)
+        {
+            out << std::endl << "   ";
+        }
+        out << " " << displacements[idx] << ",";
+    }
+    if(displacements.empty())
+    {
+        out << std::endl << "    0,";
+    }
+    out << std::endl << "};" << std::endl
+        << std::endl
+        << "} // no name namespace" << std::endl
+        << std::endl
+        << "extern zipios::EmbeddedArchive const " << symbol << ";" << std::endl
+        << "zipios::EmbeddedArchive const " << symbol << " =" << std::endl
+        << "{" << std::endl
+        << "    g_data," << std::endl
+        << "    " << data.size() << "," << std::endl
+        << "    g_entries," << std::endl
+        << "    " << table.size() << "," << std::endl
+        << "    g_displacements," << std::endl
+        << "};" << std::endl;
+
+    out.close();
+    if(!out)
+    {
+        std::cerr << g_progname << ":error: could not write " << argv[3] << "." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
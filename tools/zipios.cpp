@@ -30,13 +30,29 @@
  * zip and unzip for example).
  */
 
+#include "zipios/contentdigest.hpp"
+#include "zipios/directorycollection.hpp"
 #include "zipios/zipfile.hpp"
 #include "zipios/zipiosexceptions.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <set>
+#include <thread>
 
+#include <fnmatch.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+#include <zlib.h>
+
 
 /** \brief A few static variables and functions.
  *
@@ -62,11 +78,28 @@ char *g_progname;
 void usage()
 {
     std::cout << "Usage:  " << g_progname << " [-opt] [file]" << std::endl;
+    std::cout << "        " << g_progname << " --create [-opt] <archive> <directory> ..." << std::endl;
     std::cout << "Where -opt is one or more of:" << std::endl;
+    std::cout << "  --align <bytes>         align the data of the stored files (--create)" << std::endl;
     std::cout << "  --count                 count the number of files in a .zip archive" << std::endl;
     std::cout << "  --count-directories     count the number of files in a .zip archive" << std::endl;
     std::cout << "  --count-files           count the number of files in a .zip archive" << std::endl;
+    std::cout << "  --create                create a .zip archive from directories" << std::endl;
+    std::cout << "  --exclude <glob>        do not save the matching files and directories (--create)" << std::endl;
     std::cout << "  --help                  show this help screen" << std::endl;
+    std::cout << "  --include <glob>        only save the matching files (--create)" << std::endl;
+    std::cout << "  --json                  list the entries as JSON objects, one per line (--list)" << std::endl;
+    std::cout << "  --level <level>         1 to 100, default, fastest, smallest, or none (--create)" << std::endl;
+    std::cout << "  --list                  list the entries of a .zip archive" << std::endl;
+    std::cout << "  --max-size <size>       only list or count the entries up to that size" << std::endl;
+    std::cout << "  --method <method>       only list or count the entries using that method (stored, deflated, or a number)" << std::endl;
+    std::cout << "  --min-size <size>       only list or count the entries of at least that size" << std::endl;
+    std::cout << "  --name <glob>           only list or count the entries which name matches" << std::endl;
+    std::cout << "  --sort <key>            sort the list by name, size, compressed, method, time, or offset (--list)" << std::endl;
+    std::cout << "  --store <glob>          save the matching files uncompressed (--create)" << std::endl;
+    std::cout << "  --store-below <size>    save the files up to that size uncompressed (--create)" << std::endl;
+    std::cout << "  --test                  verify the data and headers of all the entries" << std::endl;
+    std::cout << "  --threads <count>       number of threads used by --create and --test (default: one per CPU)" << std::endl;
     std::cout << "  --version               print the library version and exit" << std::endl;
     std::cout << "  --version-tool          print the tool version and exit" << std::endl;
     exit(1);
@@ -107,9 +140,1138 @@ enum class func_t
      * It represents the number of entries representing regular files
      * found in a Zip archive.
      */
-    COUNT_FILES
+    COUNT_FILES,
+
+    /** \brief Create a Zip archive.
+     *
+     * This function is used when the user specify --create. It saves
+     * the content of a set of directories in a new Zip archive.
+     */
+    CREATE,
+
+    /** \brief List the entries of a Zip archive.
+     *
+     * This function is used when the user specify --list. It prints
+     * the metadata of the entries as found in the central directory.
+     */
+    LIST,
+
+    /** \brief Test the integrity of a Zip archive.
+     *
+     * This function is used when the user specify --test. It verifies
+     * the CRC and sizes of all the entries and that their local header
+     * agrees with the central directory.
+     */
+    TEST
+};
+
+
+/** \brief Maximum number of compressed bytes in a batch of entries.
+ *
+ * The --test function sorts the entries by offset and gives the worker
+ * threads batches of consecutive entries so each thread reads its part
+ * of the file sequentially.
+ */
+size_t const g_batch_size = 4 * 1024 * 1024;
+
+
+/** \brief Maximum number of entries in a batch of entries.
+ *
+ * This limit keeps the batches of tiny entries small enough for the
+ * work to be spread between all the threads.
+ */
+size_t const g_batch_entries = 256;
+
+
+/** \brief The result of testing one entry.
+ *
+ * The worker threads each save the result of their entries in their
+ * own slot of a vector so no locking is required.
+ */
+struct entry_result_t
+{
+    std::string         m_error = std::string();
+    bool                m_skipped = false;
+    size_t              m_end = 0;
+    size_t              m_size = 0;
+};
+
+
+/** \brief Read a little endian number from a buffer.
+ *
+ * \param[in] buf  The buffer.
+ * \param[in] size  The size of the number in bytes, 2 or 4.
+ *
+ * \return The number.
+ */
+uint32_t readNumber(unsigned char const * buf, int size)
+{
+    uint32_t result(0);
+    for(int idx(size - 1); idx >= 0; --idx)
+    {
+        result = (result << 8) | buf[idx];
+    }
+    return result;
+}
+
+
+/** \brief The fields of one central directory record.
+ *
+ * The name and the extra field are not copied, they point in the
+ * buffer holding the central directory.
+ */
+struct central_record_t
+{
+    char const *        m_name = nullptr;
+    size_t              m_name_length = 0;
+    unsigned char const * m_extra = nullptr;
+    size_t              m_extra_length = 0;
+    uint32_t            m_method = 0;
+    uint32_t            m_dos_time = 0;
+    uint32_t            m_crc = 0;
+    size_t              m_compressed_size = 0;
+    size_t              m_size = 0;
+    size_t              m_offset = 0;
+    bool                m_directory = false;
+};
+
+
+/** \brief Load the central directory of an archive.
+ *
+ * This function finds the End of Central Directory of \p filename and
+ * reads its central directory in \p buffer, in one read. Nothing else
+ * of the archive is read or verified.
+ *
+ * When the archive is prepended with other data, the offset of the
+ * central directory saved in the End of Central Directory is off by
+ * the size of that data; the central directory is then expected right
+ * before the End of Central Directory. The size of that data is saved
+ * in \p start_offset, since the offsets of the local headers are off
+ * by the same amount.
+ *
+ * \exception zipios::FileCollectionException
+ * This exception is raised if the file is not a Zip archive.
+ *
+ * \param[in] filename  The name of the archive.
+ * \param[out] buffer  The buffer receiving the central directory.
+ * \param[out] start_offset  If not null, receives the offset of the
+ *                           archive in the file.
+ *
+ * \return The number of entries according to the End of Central
+ *         Directory.
+ */
+size_t loadCentralDirectory(std::string const & filename, std::vector<char> & buffer, size_t * start_offset = nullptr)
+{
+    std::ifstream is(filename, std::ios::in | std::ios::binary);
+    if(!is)
+    {
+        throw zipios::IOException("could not open \"" + filename + "\".");
+    }
+    is.seekg(0, std::ios::end);
+    size_t const file_size(is.tellg());
+
+    // the End of Central Directory is 22 bytes followed by a comment
+    // of up to 65535 bytes
+    size_t const tail_size(std::min(file_size, static_cast<size_t>(22 + 65535)));
+    std::vector<unsigned char> tail(tail_size);
+    is.seekg(file_size - tail_size);
+    if(!is.read(reinterpret_cast<char *>(tail.data()), tail_size))
+    {
+        throw zipios::IOException("could not read \"" + filename + "\".");
+    }
+
+    for(size_t pos(tail_size < 22 ? 0 : tail_size - 22 + 1); pos > 0; --pos)
+    {
+        unsigned char const * eocd(tail.data() + pos - 1);
+        if(readNumber(eocd, 4) != 0x06054b50
+        || pos - 1 + 22 + readNumber(eocd + 20, 2) > tail_size)
+        {
+            continue;
+        }
+        size_t const count(readNumber(eocd + 10, 2));
+        size_t const size(readNumber(eocd + 12, 4));
+        size_t const offset(readNumber(eocd + 16, 4));
+        size_t const eocd_offset(file_size - tail_size + pos - 1);
+        if(size > eocd_offset)
+        {
+            continue;
+        }
+
+        // try the offset saved in the End of Central Directory first,
+        // other records (i.e. Zip64) may be found in between
+        buffer.resize(size);
+        size_t const positions[2] = { offset, eocd_offset - size };
+        for(auto const p : positions)
+        {
+            if(p + size > eocd_offset
+            || p < offset)
+            {
+                continue;
+            }
+            is.seekg(p);
+            if(!is.read(buffer.data(), size))
+            {
+                throw zipios::IOException("could not read the central directory of \"" + filename + "\".");
+            }
+            if(size == 0
+            || readNumber(reinterpret_cast<unsigned char const *>(buffer.data()), 4) == 0x02014b50)
+            {
+                if(start_offset != nullptr)
+                {
+                    *start_offset = p - offset;
+                }
+                return count;
+            }
+        }
+        throw zipios::FileCollectionException("could not find the central directory of \"" + filename + "\".");
+    }
+
+    throw zipios::FileCollectionException("\"" + filename + "\" is not a Zip archive.");
+}
+
+
+/** \brief Call a function for each record of a central directory.
+ *
+ * \exception zipios::FileCollectionException
+ * This exception is raised if a record is invalid.
+ *
+ * \param[in] buffer  The central directory.
+ * \param[in] filename  The name of the archive, for errors.
+ * \param[in] f  The function called with each record.
+ */
+template<typename F>
+void forEachCentralRecord(std::vector<char> const & buffer, std::string const & filename, F f)
+{
+    unsigned char const * data(reinterpret_cast<unsigned char const *>(buffer.data()));
+    size_t pos(0);
+    while(pos < buffer.size())
+    {
+        unsigned char const * r(data + pos);
+        if(pos + 46 > buffer.size()
+        || readNumber(r, 4) != 0x02014b50)
+        {
+            throw zipios::FileCollectionException("invalid central directory in \"" + filename + "\".");
+        }
+        central_record_t record;
+        record.m_method = readNumber(r + 10, 2);
+        record.m_dos_time = readNumber(r + 12, 4);
+        record.m_crc = readNumber(r + 16, 4);
+        record.m_compressed_size = readNumber(r + 20, 4);
+        record.m_size = readNumber(r + 24, 4);
+        record.m_name_length = readNumber(r + 28, 2);
+        record.m_extra_length = readNumber(r + 30, 2);
+        record.m_offset = readNumber(r + 42, 4);
+        size_t const record_size(46 + record.m_name_length + record.m_extra_length + readNumber(r + 32, 2));
+        if(pos + record_size > buffer.size())
+        {
+            throw zipios::FileCollectionException("invalid central directory in \"" + filename + "\".");
+        }
+        record.m_name = buffer.data() + pos + 46;
+        record.m_extra = r + 46 + record.m_name_length;
+        record.m_directory = record.m_name_length > 0
+                          && record.m_name[record.m_name_length - 1] == '/';
+        f(record);
+        pos += record_size;
+    }
+}
+
+
+/** \brief Test one entry of a Zip archive.
+ *
+ * This function reads the local header of the entry described by
+ * \p record and verifies that it agrees with the central directory.
+ * Then it decompresses the data and verifies its CRC and sizes. When
+ * the entry has digests saved in its extra field (see
+ * zipios::ContentDigest) they get verified too.
+ *
+ * Encrypted entries and entries using a storage method other than
+ * STORED and DEFLATED only get their headers verified.
+ *
+ * \param[in] is  The stream of the archive.
+ * \param[in] record  The central directory record of the entry, with
+ *                    its offset in the file.
+ * \param[in,out] buffer  A buffer for the compressed data.
+ * \param[in,out] output  A buffer for the decompressed data.
+ * \param[out] result  The result of the test.
+ */
+void testEntry(std::istream & is, central_record_t const & record, std::vector<char> & buffer, std::vector<char> & output, entry_result_t & result)
+{
+    unsigned char header[30];
+    size_t const offset(record.m_offset);
+    is.seekg(offset);
+    if(!is.read(reinterpret_cast<char *>(header), sizeof(header)))
+    {
+        result.m_error = "could not read the local header";
+        return;
+    }
+    if(readNumber(header, 4) != 0x04034b50)
+    {
+        result.m_error = "invalid local header signature";
+        return;
+    }
+
+    uint32_t const flags(readNumber(header + 6, 2));
+    uint32_t const method(readNumber(header + 8, 2));
+    uint32_t const dos_time(readNumber(header + 10, 4));
+    uint32_t const crc(readNumber(header + 14, 4));
+    uint32_t const compressed_size(readNumber(header + 18, 4));
+    uint32_t const size(readNumber(header + 22, 4));
+    size_t const name_length(readNumber(header + 26, 2));
+    size_t const extra_length(readNumber(header + 28, 2));
+
+    std::string name(name_length, '\0');
+    if(!is.read(&name[0], name_length))
+    {
+        result.m_error = "could not read the local header filename";
+        return;
+    }
+    if(name != std::string(record.m_name, record.m_name_length))
+    {
+        result.m_error = "local header filename \"" + name + "\" differs from the central directory";
+        return;
+    }
+    if(method != record.m_method)
+    {
+        result.m_error = "local header storage method differs from the central directory";
+        return;
+    }
+    if(dos_time != record.m_dos_time)
+    {
+        result.m_error = "local header modification time differs from the central directory";
+        return;
+    }
+
+    if(crc != record.m_crc
+    || compressed_size != record.m_compressed_size
+    || size != record.m_size)
+    {
+        result.m_error = "local header CRC or sizes differ from the central directory";
+        return;
+    }
+
+    size_t const data_offset(offset + sizeof(header) + name_length + extra_length);
+    result.m_end = data_offset + record.m_compressed_size;
+
+    uint32_t const stored(static_cast<uint32_t>(zipios::StorageMethod::STORED));
+    uint32_t const deflated_method(static_cast<uint32_t>(zipios::StorageMethod::DEFLATED));
+    if((flags & 0x0001) != 0
+    || (record.m_method != stored
+        && record.m_method != deflated_method))
+    {
+        // encrypted or unsupported, we cannot verify the data
+        result.m_skipped = true;
+        return;
+    }
+
+    is.seekg(data_offset);
+
+    zipios::ContentDigest::digest_map_t expected;
+    zipios::ContentDigest::readExtraField(zipios::FileEntry::buffer_t(record.m_extra, record.m_extra + record.m_extra_length), expected);
+    zipios::ContentDigest::algorithm_vector_t algorithms;
+    for(auto const & d : expected)
+    {
+        algorithms.push_back(d.first);
+    }
+    zipios::ContentDigest digest(algorithms);
+
+    z_stream zs = z_stream();
+    bool const deflated(record.m_method == deflated_method);
+    if(deflated
+    && inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+    {
+        result.m_error = "could not initialize zlib";
+        return;
+    }
+
+    uLong data_crc(crc32(0L, Z_NULL, 0));
+    size_t data_size(0);
+    size_t remaining(record.m_compressed_size);
+    int err(Z_OK);
+    while(remaining > 0 && err == Z_OK)
+    {
+        size_t const amount(std::min(remaining, buffer.size()));
+        if(!is.read(&buffer[0], amount))
+        {
+            result.m_error = "could not read the compressed data";
+            break;
+        }
+        remaining -= amount;
+
+        if(!deflated)
+        {
+            data_crc = crc32(data_crc, reinterpret_cast<Bytef const *>(&buffer[0]), amount);
+            digest.update(&buffer[0], amount);
+            data_size += amount;
+            continue;
+        }
+
+        zs.next_in = reinterpret_cast<Bytef *>(&buffer[0]);
+        zs.avail_in = amount;
+        do
+        {
+            zs.next_out = reinterpret_cast<Bytef *>(&output[0]);
+            zs.avail_out = output.size();
+            err = inflate(&zs, Z_NO_FLUSH);
+            size_t const produced(output.size() - zs.avail_out);
+            data_crc = crc32(data_crc, reinterpret_cast<Bytef const *>(&output[0]), produced);
+            digest.update(&output[0], produced);
+            data_size += produced;
+        }
+        while(err == Z_OK && (zs.avail_in > 0 || zs.avail_out == 0));
+    }
+
+    if(deflated)
+    {
+        if(result.m_error.empty())
+        {
+            if(err != Z_STREAM_END)
+            {
+                result.m_error = err == Z_OK
+                        ? "the compressed data is truncated"
+                        : std::string("invalid compressed data: ") + (zs.msg == nullptr ? zError(err) : zs.msg);
+            }
+            else if(remaining > 0 || zs.avail_in > 0)
+            {
+                result.m_error = "the compressed data is followed by garbage";
+            }
+        }
+        inflateEnd(&zs);
+    }
+    result.m_size = data_size;
+    if(!result.m_error.empty())
+    {
+        return;
+    }
+
+    if(data_crc != record.m_crc)
+    {
+        result.m_error = "CRC mismatch";
+        return;
+    }
+    if(data_size != record.m_size)
+    {
+        result.m_error = "uncompressed size mismatch";
+        return;
+    }
+    if(digest.digests() != expected)
+    {
+        result.m_error = "digest mismatch";
+        return;
+    }
+}
+
+
+/** \brief Test all the entries of a Zip archive.
+ *
+ * The entries are read from the central directory, without opening a
+ * ZipFile, which would throw on the first local header that does not
+ * match the central directory instead of reporting it with the entry.
+ *
+ * The entries get sorted by offset and cut in batches of consecutive
+ * entries. The worker threads take the next batch until none are left,
+ * each with its own handle on the archive.
+ *
+ * Once all the entries were tested, the function verifies that the
+ * data of the entries do not overlap and prints the failing entries
+ * and a summary with the throughput.
+ *
+ * \param[in] filename  The name of the Zip archive.
+ * \param[in] thread_count  The number of threads, 0 for one per CPU.
+ * \param[in] show_filename  Whether to print the archive filename.
+ *
+ * \return true if all the entries are valid.
+ */
+bool testArchive(std::string const & filename, size_t thread_count, bool show_filename)
+{
+    std::chrono::steady_clock::time_point const start(std::chrono::steady_clock::now());
+
+    // the records point in the central directory so it must be kept
+    // until we are done
+    std::vector<char> central_directory;
+    size_t start_offset(0);
+    loadCentralDirectory(filename, central_directory, &start_offset);
+    std::vector<central_record_t> entries;
+    forEachCentralRecord(central_directory, filename, [&](central_record_t const & record)
+        {
+            entries.push_back(record);
+            entries.back().m_offset += start_offset;
+        });
+    std::stable_sort(entries.begin(), entries.end(),
+            [](central_record_t const & a, central_record_t const & b)
+            {
+                return a.m_offset < b.m_offset;
+            });
+
+    std::vector<size_t> batches(1, 0);
+    size_t batch_size(0);
+    for(size_t idx(0); idx < entries.size(); ++idx)
+    {
+        batch_size += entries[idx].m_compressed_size;
+        if(batch_size >= g_batch_size
+        || idx + 1 - batches.back() >= g_batch_entries)
+        {
+            batches.push_back(idx + 1);
+            batch_size = 0;
+        }
+    }
+    if(batches.back() != entries.size())
+    {
+        batches.push_back(entries.size());
+    }
+
+    if(thread_count == 0)
+    {
+        thread_count = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    thread_count = std::max(static_cast<size_t>(1), std::min(thread_count, batches.size() - 1));
+
+    std::vector<entry_result_t> results(entries.size());
+    std::atomic<size_t> next_batch(0);
+    auto worker = [&]()
+        {
+            std::ifstream is(filename, std::ios::in | std::ios::binary);
+            bool const opened(static_cast<bool>(is));
+            std::vector<char> buffer(64 * 1024);
+            std::vector<char> output(256 * 1024);
+            for(;;)
+            {
+                size_t const batch(next_batch++);
+                if(batch + 1 >= batches.size())
+                {
+                    break;
+                }
+                for(size_t idx(batches[batch]); idx < batches[batch + 1]; ++idx)
+                {
+                    if(!opened)
+                    {
+                        results[idx].m_error = "could not open the archive";
+                        continue;
+                    }
+
+                    // a failed read of the previous entry leaves the
+                    // failbit set
+                    is.clear();
+                    testEntry(is, entries[idx], buffer, output, results[idx]);
+                }
+            }
+        };
+    std::vector<std::thread> threads;
+    for(size_t idx(1); idx < thread_count; ++idx)
+    {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for(auto & t : threads)
+    {
+        t.join();
+    }
+
+    // the data of an entry must end before the next local header
+    for(size_t idx(1); idx < entries.size(); ++idx)
+    {
+        if(results[idx - 1].m_error.empty()
+        && results[idx - 1].m_end > entries[idx].m_offset)
+        {
+            results[idx].m_error = "overlaps the data of \"" + std::string(entries[idx - 1].m_name, entries[idx - 1].m_name_length) + "\"";
+        }
+    }
+
+    double const duration(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    std::string const prefix(show_filename ? filename + ": " : std::string());
+    size_t failed(0);
+    size_t skipped(0);
+    size_t compressed(0);
+    size_t uncompressed(0);
+    for(size_t idx(0); idx < entries.size(); ++idx)
+    {
+        compressed += entries[idx].m_compressed_size;
+        uncompressed += results[idx].m_size;
+        if(!results[idx].m_error.empty())
+        {
+            ++failed;
+            std::cout << prefix << std::string(entries[idx].m_name, entries[idx].m_name_length) << ": " << results[idx].m_error << std::endl;
+        }
+        else if(results[idx].m_skipped)
+        {
+            ++skipped;
+        }
+    }
+
+    double const mib(1024.0 * 1024.0);
+    std::cout << prefix
+              << entries.size() << " entries, "
+              << failed << " failed, "
+              << skipped << " not verified, "
+              << std::fixed << std::setprecision(1)
+              << uncompressed / mib << " MiB decompressed from "
+              << compressed / mib << " MiB in "
+              << std::setprecision(3) << duration << " s with "
+              << thread_count << " thread" << (thread_count == 1 ? "" : "s") << ", "
+              << std::setprecision(1) << (duration > 0.0 ? uncompressed / mib / duration : 0.0) << " MiB/s"
+              << std::endl;
+
+    return failed == 0;
+}
+
+
+/** \brief The settings of the --create function.
+ */
+struct create_options_t
+{
+    std::vector<std::string>            m_include = std::vector<std::string>();
+    std::vector<std::string>            m_exclude = std::vector<std::string>();
+    std::vector<std::string>            m_store = std::vector<std::string>();
+    zipios::FileEntry::CompressionLevel m_level = zipios::FileEntry::COMPRESSION_LEVEL_DEFAULT;
+    size_t                              m_store_below = 0;
+    size_t                              m_alignment = 0;
+    size_t                              m_thread_count = 0;
+};
+
+
+/** \brief A collection of the files selected in a set of directories.
+ *
+ * The --create function filters the entries of one DirectoryCollection
+ * per directory and saves the result with this collection, which reads
+ * the data of each entry from the directory it comes from.
+ */
+class SelectedCollection
+    : public zipios::FileCollection
+{
+public:
+    /** \brief Add an entry to the collection.
+     *
+     * \param[in] source  The collection the entry comes from.
+     * \param[in] entry  The entry to add.
+     */
+    void addSelectedEntry(zipios::FileCollection::pointer_t source, zipios::FileEntry::pointer_t entry)
+    {
+        m_entries.push_back(entry);
+        m_sources[entry->getName()] = source;
+    }
+
+    virtual pointer_t clone() const override
+    {
+        return pointer_t(new SelectedCollection(*this));
+    }
+
+    virtual stream_pointer_t getInputStream(std::string const & entry_name, MatchPath matchpath = MatchPath::MATCH) override
+    {
+        auto const it(m_sources.find(entry_name));
+        if(it == m_sources.end())
+        {
+            return stream_pointer_t();
+        }
+        return it->second->getInputStream(entry_name, matchpath);
+    }
+
+private:
+    std::map<std::string, zipios::FileCollection::pointer_t>
+                        m_sources = std::map<std::string, zipios::FileCollection::pointer_t>();
+};
+
+
+/** \brief Check whether a path matches one of a set of globs.
+ *
+ * A glob which includes a slash is matched against the whole \p name.
+ * The others are matched against its last segment, so "*.jpg" matches
+ * the JPEG files of all the directories.
+ *
+ * \param[in] globs  The glob patterns.
+ * \param[in] name  The path to check.
+ *
+ * \return true if one of the \p globs matches \p name.
+ */
+bool matchGlobs(std::vector<std::string> const & globs, std::string const & name)
+{
+    std::string::size_type const slash(name.rfind('/'));
+    std::string const basename(slash == std::string::npos ? name : name.substr(slash + 1));
+    for(auto const & g : globs)
+    {
+        bool const full(g.find('/') != std::string::npos);
+        if(fnmatch(g.c_str(), full ? name.c_str() : basename.c_str(), full ? FNM_PATHNAME : 0) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/** \brief Check whether an entry or one of its parents gets excluded.
+ *
+ * \param[in] globs  The --exclude glob patterns.
+ * \param[in] name  The name of the entry.
+ *
+ * \return true if the entry must not be saved.
+ */
+bool isExcluded(std::vector<std::string> const & globs, std::string const & name)
+{
+    for(std::string::size_type pos(name.find('/')); pos != std::string::npos; pos = name.find('/', pos + 1))
+    {
+        if(matchGlobs(globs, name.substr(0, pos)))
+        {
+            return true;
+        }
+    }
+    return matchGlobs(globs, name);
+}
+
+
+/** \brief Parse a compression level.
+ *
+ * \param[in] level  The level as found on the command line.
+ *
+ * \return The compression level.
+ */
+zipios::FileEntry::CompressionLevel parseLevel(std::string const & level)
+{
+    if(level == "default")
+    {
+        return zipios::FileEntry::COMPRESSION_LEVEL_DEFAULT;
+    }
+    if(level == "fastest")
+    {
+        return zipios::FileEntry::COMPRESSION_LEVEL_FASTEST;
+    }
+    if(level == "smallest")
+    {
+        return zipios::FileEntry::COMPRESSION_LEVEL_SMALLEST;
+    }
+    if(level == "none")
+    {
+        return zipios::FileEntry::COMPRESSION_LEVEL_NONE;
+    }
+    int const value(atoi(level.c_str()));
+    if(value < zipios::FileEntry::COMPRESSION_LEVEL_MINIMUM
+    || value > zipios::FileEntry::COMPRESSION_LEVEL_MAXIMUM)
+    {
+        std::cerr << g_progname << ":error: invalid compression level \"" << level << "\"." << std::endl;
+        usage();
+    }
+    return value;
+}
+
+
+/** \brief Create a Zip archive from a set of directories.
+ *
+ * This function loads the files of the \p directories, keeps those
+ * selected by the --include and --exclude globs, applies the storage
+ * method and compression level policy, and saves the result in
+ * \p filename using the parallel compression of the library.
+ *
+ * With --include, the directories only get saved if some of their
+ * files do.
+ *
+ * \param[in] filename  The name of the archive to create.
+ * \param[in] directories  The directories to save in the archive.
+ * \param[in] options  The settings from the command line.
+ *
+ * \return true if the archive was created.
+ */
+bool createArchive(std::string const & filename, std::vector<std::string> const & directories, create_options_t const & options)
+{
+    std::chrono::steady_clock::time_point const start(std::chrono::steady_clock::now());
+
+    SelectedCollection collection;
+    size_t uncompressed(0);
+    for(auto const & d : directories)
+    {
+        std::shared_ptr<zipios::DirectoryCollection> dc(new zipios::DirectoryCollection(d));
+        dc->setMemoryMapped(true);
+        zipios::FileEntry::vector_t const entries(dc->entries());
+
+        // select the files first, the directories are saved when
+        // one of their files is
+        std::vector<bool> keep(entries.size(), false);
+        std::set<std::string> parents;
+        for(size_t idx(0); idx < entries.size(); ++idx)
+        {
+            zipios::FileEntry::pointer_t entry(entries[idx]);
+            std::string const & name(entry->getName());
+            if(entry->isDirectory()
+            || isExcluded(options.m_exclude, name)
+            || (!options.m_include.empty() && !matchGlobs(options.m_include, name)))
+            {
+                continue;
+            }
+            keep[idx] = true;
+            for(std::string::size_type pos(name.find('/')); pos != std::string::npos; pos = name.find('/', pos + 1))
+            {
+                parents.insert(name.substr(0, pos));
+            }
+
+            if(options.m_level == zipios::FileEntry::COMPRESSION_LEVEL_NONE
+            || entry->getSize() <= options.m_store_below
+            || matchGlobs(options.m_store, name))
+            {
+                entry->setMethod(zipios::StorageMethod::STORED);
+            }
+            else
+            {
+                entry->setMethod(zipios::StorageMethod::DEFLATED);
+                entry->setLevel(options.m_level);
+            }
+            uncompressed += entry->getSize();
+        }
+
+        for(size_t idx(0); idx < entries.size(); ++idx)
+        {
+            zipios::FileEntry::pointer_t entry(entries[idx]);
+            if(keep[idx]
+            || (entry->isDirectory()
+                && !isExcluded(options.m_exclude, entry->getName())
+                && (options.m_include.empty() || parents.find(entry->getName()) != parents.end())))
+            {
+                collection.addSelectedEntry(dc, entry);
+            }
+        }
+    }
+
+    size_t thread_count(options.m_thread_count);
+    if(thread_count == 0)
+    {
+        thread_count = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+
+    zipios::ZipOutputOptions zip_options;
+    zip_options.setCompressionThreads(thread_count);
+    zip_options.setStoredAlignment(options.m_alignment);
+    zip_options.setWriteBehind(4, 1024 * 1024);
+
+    size_t compressed(0);
+    {
+        std::ofstream out(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+        if(!out)
+        {
+            std::cerr << g_progname << ":error: could not create \"" << filename << "\"." << std::endl;
+            return false;
+        }
+        zipios::ZipFile::saveCollectionToArchive(out, collection, "", zip_options);
+        compressed = out.tellp();
+        out.close();
+        if(!out)
+        {
+            std::cerr << g_progname << ":error: could not write \"" << filename << "\"." << std::endl;
+            return false;
+        }
+    }
+
+    double const duration(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    double const mib(1024.0 * 1024.0);
+    std::cout << filename << ": "
+              << collection.size() << " entries, "
+              << std::fixed << std::setprecision(1)
+              << uncompressed / mib << " MiB saved in "
+              << compressed / mib << " MiB in "
+              << std::setprecision(3) << duration << " s with "
+              << thread_count << " thread" << (thread_count == 1 ? "" : "s") << ", "
+              << std::setprecision(1) << (duration > 0.0 ? uncompressed / mib / duration : 0.0) << " MiB/s"
+              << std::endl;
+
+    return true;
+}
+
+
+/** \brief The settings of the --list and --count functions.
+ */
+struct list_options_t
+{
+    std::vector<std::string>    m_names = std::vector<std::string>();
+    size_t                      m_min_size = 0;
+    size_t                      m_max_size = std::numeric_limits<size_t>::max();
+    int                         m_method = -1;
+    std::string                 m_sort = std::string();
+    bool                        m_json = false;
 };
 
+
+/** \brief Check whether a record passes the filters.
+ *
+ * \param[in] record  The record to check.
+ * \param[in] options  The filters.
+ *
+ * \return true if the record was selected.
+ */
+bool selectRecord(central_record_t const & record, list_options_t const & options)
+{
+    return record.m_size >= options.m_min_size
+        && record.m_size <= options.m_max_size
+        && (options.m_method < 0 || record.m_method == static_cast<uint32_t>(options.m_method))
+        && (options.m_names.empty() || matchGlobs(options.m_names, std::string(record.m_name, record.m_name_length)));
+}
+
+
+/** \brief Get the name of a storage method.
+ *
+ * \param[in] method  The method number.
+ *
+ * \return The name of the method or its number.
+ */
+std::string methodName(uint32_t method)
+{
+    switch(method)
+    {
+    case 0:
+        return "stored";
+
+    case 8:
+        return "deflated";
+
+    case 12:
+        return "bzip2";
+
+    case 14:
+        return "lzma";
+
+    case 99:
+        return "aes";
+
+    default:
+        return std::to_string(method);
+
+    }
+}
+
+
+/** \brief Parse a storage method.
+ *
+ * \param[in] method  The method as found on the command line.
+ *
+ * \return The method number.
+ */
+int parseMethod(std::string const & method)
+{
+    if(method == "stored")
+    {
+        return 0;
+    }
+    if(method == "deflated")
+    {
+        return 8;
+    }
+    if(method.empty()
+    || method.find_first_not_of("0123456789") != std::string::npos)
+    {
+        std::cerr << g_progname << ":error: invalid method \"" << method << "\"." << std::endl;
+        usage();
+    }
+    return atoi(method.c_str());
+}
+
+
+/** \brief Write a string as a JSON string.
+ *
+ * \param[in,out] out  The output stream.
+ * \param[in] str  The string to write.
+ * \param[in] length  The length of \p str.
+ */
+void writeJsonString(std::ostream & out, char const * str, size_t length)
+{
+    static char const hex[] = "0123456789abcdef";
+
+    out << '"';
+    for(size_t idx(0); idx < length; ++idx)
+    {
+        unsigned char const c(str[idx]);
+        switch(c)
+        {
+        case '"':
+            out << "\\\"";
+            break;
+
+        case '\\':
+            out << "\\\\";
+            break;
+
+        default:
+            if(c < 0x20)
+            {
+                out << "\\u00" << hex[c >> 4] << hex[c & 15];
+            }
+            else
+            {
+                out << c;
+            }
+            break;
+
+        }
+    }
+    out << '"';
+}
+
+
+/** \brief Format a DOS date and time.
+ *
+ * The fields are converted as is, no time zone is involved.
+ *
+ * \param[in] dos_time  The DOS date and time of an entry.
+ *
+ * \return The date and time as "YYYY-MM-DD HH:MM:SS".
+ */
+std::string formatDosTime(uint32_t dos_time)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%04u-%02u-%02u %02u:%02u:%02u"
+            , (dos_time >> 25) + 1980
+            , (dos_time >> 21) & 15
+            , (dos_time >> 16) & 31
+            , (dos_time >> 11) & 31
+            , (dos_time >> 5) & 63
+            , (dos_time & 31) * 2);
+    return buf;
+}
+
+
+/** \brief Print one record.
+ *
+ * \param[in,out] out  The output stream.
+ * \param[in] filename  The name of the archive.
+ * \param[in] record  The record to print.
+ * \param[in] options  The output settings.
+ * \param[in] show_filename  Whether the archive name gets printed.
+ */
+void printRecord(std::ostream & out, std::string const & filename, central_record_t const & record, list_options_t const & options, bool show_filename)
+{
+    if(options.m_json)
+    {
+        out << "{";
+        if(show_filename)
+        {
+            out << "\"archive\":";
+            writeJsonString(out, filename.c_str(), filename.length());
+            out << ",";
+        }
+        out << "\"name\":";
+        writeJsonString(out, record.m_name, record.m_name_length);
+        out << ",\"directory\":" << (record.m_directory ? "true" : "false")
+            << ",\"size\":" << record.m_size
+            << ",\"compressed_size\":" << record.m_compressed_size
+            << ",\"method\":\"" << methodName(record.m_method) << "\""
+            << ",\"crc32\":\"" << std::hex << std::setw(8) << std::setfill('0') << record.m_crc << std::dec << std::setfill(' ') << "\""
+            << ",\"time\":\"" << formatDosTime(record.m_dos_time) << "\""
+            << ",\"offset\":" << record.m_offset
+            << "}\n";
+        return;
+    }
+
+    if(show_filename)
+    {
+        out << filename << ": ";
+    }
+    out << std::setw(10) << record.m_size << ' '
+        << std::setw(10) << record.m_compressed_size << ' '
+        << std::setw(8) << std::left << methodName(record.m_method) << std::right << ' '
+        << formatDosTime(record.m_dos_time) << ' '
+        << std::hex << std::setw(8) << std::setfill('0') << record.m_crc << std::dec << std::setfill(' ') << ' ';
+    out.write(record.m_name, record.m_name_length);
+    out << '\n';
+}
+
+
+/** \brief List the entries of an archive.
+ *
+ * The entries are read from the central directory and printed as they
+ * are found, unless they have to be sorted. No FileEntry objects get
+ * created and the local headers are not read.
+ *
+ * \param[in] filename  The name of the archive.
+ * \param[in] options  The filters and output settings.
+ * \param[in] show_filename  Whether the archive name gets printed.
+ */
+void listArchive(std::string const & filename, list_options_t const & options, bool show_filename)
+{
+    std::vector<char> buffer;
+    size_t const count(loadCentralDirectory(filename, buffer));
+
+    if(options.m_sort.empty())
+    {
+        forEachCentralRecord(buffer, filename, [&](central_record_t const & record)
+            {
+                if(selectRecord(record, options))
+                {
+                    printRecord(std::cout, filename, record, options, show_filename);
+                }
+            });
+        return;
+    }
+
+    std::vector<central_record_t> records;
+    records.reserve(count);
+    forEachCentralRecord(buffer, filename, [&](central_record_t const & record)
+        {
+            if(selectRecord(record, options))
+            {
+                records.push_back(record);
+            }
+        });
+
+    auto sort_by = [&records](std::function<bool(central_record_t const &, central_record_t const &)> const & less)
+        {
+            std::stable_sort(records.begin(), records.end(), less);
+        };
+    if(options.m_sort == "name")
+    {
+        sort_by([](central_record_t const & a, central_record_t const & b)
+            {
+                int const r(memcmp(a.m_name, b.m_name, std::min(a.m_name_length, b.m_name_length)));
+                return r < 0 || (r == 0 && a.m_name_length < b.m_name_length);
+            });
+    }
+    else if(options.m_sort == "size")
+    {
+        sort_by([](central_record_t const & a, central_record_t const & b) { return a.m_size < b.m_size; });
+    }
+    else if(options.m_sort == "compressed")
+    {
+        sort_by([](central_record_t const & a, central_record_t const & b) { return a.m_compressed_size < b.m_compressed_size; });
+    }
+    else if(options.m_sort == "method")
+    {
+        sort_by([](central_record_t const & a, central_record_t const & b) { return a.m_method < b.m_method; });
+    }
+    else if(options.m_sort == "time")
+    {
+        sort_by([](central_record_t const & a, central_record_t const & b) { return a.m_dos_time < b.m_dos_time; });
+    }
+    else
+    {
+        sort_by([](central_record_t const & a, central_record_t const & b) { return a.m_offset < b.m_offset; });
+    }
+
+    for(auto const & record : records)
+    {
+        printRecord(std::cout, filename, record, options, show_filename);
+    }
+}
+
+
+/** \brief Count the entries of an archive.
+ *
+ * \param[in] filename  The name of the archive.
+ * \param[in] function  One of the COUNT functions.
+ * \param[in] options  The filters.
+ *
+ * \return The number of entries.
+ */
+size_t countEntries(std::string const & filename, func_t function, list_options_t const & options)
+{
+    std::vector<char> buffer;
+    loadCentralDirectory(filename, buffer);
+
+    size_t count(0);
+    forEachCentralRecord(buffer, filename, [&](central_record_t const & record)
+        {
+            if((function == func_t::COUNT
+                || (function == func_t::COUNT_DIRECTORIES) == record.m_directory)
+            && selectRecord(record, options))
+            {
+                ++count;
+            }
+        });
+    return count;
+}
+
 } // no name namespace
 
 
@@ -130,11 +1292,24 @@ int main(int argc, char *argv[])
         }
     }
 
+    int result(0);
     try
     {
         // check the various command line options
         std::vector<std::string> files;
         func_t function(func_t::UNDEFINED);
+        create_options_t create_options;
+        list_options_t list_options;
+        auto next_argument = [argc, argv](int & i, char const * what)
+            {
+                ++i;
+                if(i >= argc)
+                {
+                    std::cerr << g_progname << ":error: " << argv[i - 1] << " must be followed by " << what << "." << std::endl;
+                    usage();
+                }
+                return argv[i];
+            };
         for(int i(1); i < argc; ++i)
         {
             if(argv[i][0] == '-')
@@ -168,6 +1343,85 @@ int main(int argc, char *argv[])
                 {
                     function = func_t::COUNT_FILES;
                 }
+                else if(strcmp(argv[i], "--test") == 0)
+                {
+                    function = func_t::TEST;
+                }
+                else if(strcmp(argv[i], "--create") == 0)
+                {
+                    function = func_t::CREATE;
+                }
+                else if(strcmp(argv[i], "--list") == 0)
+                {
+                    function = func_t::LIST;
+                }
+                else if(strcmp(argv[i], "--json") == 0)
+                {
+                    list_options.m_json = true;
+                }
+                else if(strcmp(argv[i], "--sort") == 0)
+                {
+                    list_options.m_sort = next_argument(i, "a sort key");
+                    if(list_options.m_sort != "name"
+                    && list_options.m_sort != "size"
+                    && list_options.m_sort != "compressed"
+                    && list_options.m_sort != "method"
+                    && list_options.m_sort != "time"
+                    && list_options.m_sort != "offset")
+                    {
+                        std::cerr << g_progname << ":error: invalid sort key \"" << list_options.m_sort << "\"." << std::endl;
+                        usage();
+                    }
+                }
+                else if(strcmp(argv[i], "--name") == 0)
+                {
+                    list_options.m_names.push_back(next_argument(i, "a glob pattern"));
+                }
+                else if(strcmp(argv[i], "--min-size") == 0)
+                {
+                    list_options.m_min_size = atol(next_argument(i, "a size in bytes"));
+                }
+                else if(strcmp(argv[i], "--max-size") == 0)
+                {
+                    list_options.m_max_size = atol(next_argument(i, "a size in bytes"));
+                }
+                else if(strcmp(argv[i], "--method") == 0)
+                {
+                    list_options.m_method = parseMethod(next_argument(i, "a storage method"));
+                }
+                else if(strcmp(argv[i], "--threads") == 0)
+                {
+                    create_options.m_thread_count = atol(next_argument(i, "the number of threads"));
+                }
+                else if(strcmp(argv[i], "--level") == 0)
+                {
+                    create_options.m_level = parseLevel(next_argument(i, "a compression level"));
+                }
+                else if(strcmp(argv[i], "--store-below") == 0)
+                {
+                    create_options.m_store_below = atol(next_argument(i, "a size in bytes"));
+                }
+                else if(strcmp(argv[i], "--store") == 0)
+                {
+                    create_options.m_store.push_back(next_argument(i, "a glob pattern"));
+                }
+                else if(strcmp(argv[i], "--include") == 0)
+                {
+                    create_options.m_include.push_back(next_argument(i, "a glob pattern"));
+                }
+                else if(strcmp(argv[i], "--exclude") == 0)
+                {
+                    create_options.m_exclude.push_back(next_argument(i, "a glob pattern"));
+                }
+                else if(strcmp(argv[i], "--align") == 0)
+                {
+                    create_options.m_alignment = atol(next_argument(i, "an alignment in bytes"));
+                }
+                else
+                {
+                    std::cerr << g_progname << ":error: unknown option \"" << argv[i] << "\"." << std::endl;
+                    usage();
+                }
             }
             else
             {
@@ -178,59 +1432,47 @@ int main(int argc, char *argv[])
         switch(function)
         {
         case func_t::COUNT:
+        case func_t::COUNT_DIRECTORIES:
+        case func_t::COUNT_FILES:
             for(auto it(files.begin()); it != files.end(); ++it)
             {
-                zipios::ZipFile zf(*it);
+                size_t const count(countEntries(*it, function, list_options));
                 if(files.size() > 1)
                 {
                     // write filename in case there is more than one file
                     std::cout << *it << ": ";
                 }
-                std::cout << zf.entries().size() << std::endl;
+                std::cout << count << std::endl;
             }
             break;
 
-        case func_t::COUNT_DIRECTORIES:
+        case func_t::LIST:
             for(auto it(files.begin()); it != files.end(); ++it)
             {
-                zipios::ZipFile zf(*it);
-                if(files.size() > 1)
-                {
-                    // write filename in case there is more than one file
-                    std::cout << *it << ": ";
-                }
-                int count(0);
-                zipios::FileEntry::vector_t entries(zf.entries());
-                for(auto entry(entries.begin()); entry != entries.end(); ++entry)
-                {
-                    if((*entry)->isDirectory())
-                    {
-                        ++count;
-                    }
-                }
-                std::cout << count << std::endl;
+                listArchive(*it, list_options, files.size() > 1);
             }
+            std::cout << std::flush;
             break;
 
-        case func_t::COUNT_FILES:
+        case func_t::CREATE:
+            if(files.size() < 2)
+            {
+                std::cerr << g_progname << ":error: --create expects the name of the archive and at least one directory." << std::endl;
+                usage();
+            }
+            if(!createArchive(files[0], std::vector<std::string>(files.begin() + 1, files.end()), create_options))
+            {
+                result = 1;
+            }
+            break;
+
+        case func_t::TEST:
             for(auto it(files.begin()); it != files.end(); ++it)
             {
-                zipios::ZipFile zf(*it);
-                if(files.size() > 1)
-                {
-                    // write filename in case there is more than one file
-                    std::cout << *it << ": ";
-                }
-                int count(0);
-                zipios::FileEntry::vector_t entries(zf.entries());
-                for(auto entry(entries.begin()); entry != entries.end(); ++entry)
+                if(!testArchive(*it, create_options.m_thread_count, files.size() > 1))
                 {
-                    if(!(*entry)->isDirectory())
-                    {
-                        ++count;
-                    }
+                    result = 1;
                 }
-                std::cout << count << std::endl;
             }
             break;
 
@@ -245,9 +1487,10 @@ int main(int argc, char *argv[])
     {
         std::cerr << g_progname << ":error: an exception occurred: "
                   << e.what() << std::endl;
+        result = 1;
     }
 
-    return 0;
+    return result;
 }
 
 
@@ -0,0 +1,99 @@
+#pragma once
+#ifndef ZIPIOS_CONTENTDIGEST_HPP
+#define ZIPIOS_CONTENTDIGEST_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Define the zipios::ContentDigest class.
+ *
+ * The zipios::ContentDigest class computes a set of digests of the
+ * uncompressed data of an entry while it gets saved in a Zip archive.
+ */
+
+#include "zipios/fileentry.hpp"
+
+#include <map>
+
+
+namespace zipios
+{
+
+
+class SHA256;
+class XXHash64;
+
+
+enum class DigestAlgorithm : uint8_t
+{
+    SHA256      = 1,
+    XXH64       = 2
+};
+
+
+class ContentDigest
+{
+public:
+    typedef std::vector<DigestAlgorithm>                    algorithm_vector_t;
+    typedef std::map<DigestAlgorithm, FileEntry::buffer_t>  digest_map_t;
+
+    static uint16_t const   EXTRA_FIELD_ID = 0x647A;
+
+                            ContentDigest(algorithm_vector_t const & algorithms = algorithm_vector_t());
+                            ContentDigest(ContentDigest const & src) = delete;
+    ContentDigest &         operator = (ContentDigest const & rhs) = delete;
+                            ~ContentDigest();
+
+    algorithm_vector_t const &
+                            getAlgorithms() const;
+    void                    setAlgorithms(algorithm_vector_t const & algorithms);
+    bool                    empty() const;
+    void                    reset();
+    void                    update(void const * data, size_t size);
+    digest_map_t            digests() const;
+
+    static std::string      getName(DigestAlgorithm algorithm);
+    static size_t           getDigestSize(DigestAlgorithm algorithm);
+    static std::string      toHex(FileEntry::buffer_t const & digest);
+    static bool             readExtraField(FileEntry::buffer_t const & extra, digest_map_t & digests);
+    static void             writeExtraField(FileEntry::buffer_t & extra, digest_map_t const & digests);
+    static void             removeExtraField(FileEntry::buffer_t & extra);
+
+private:
+    algorithm_vector_t      m_algorithms = algorithm_vector_t();
+    std::unique_ptr<SHA256> m_sha256;
+    std::unique_ptr<XXHash64>
+                            m_xxh64;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
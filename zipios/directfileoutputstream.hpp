@@ -0,0 +1,74 @@
+#pragma once
+#ifndef ZIPIOS_DIRECTFILEOUTPUTSTREAM_HPP
+#define ZIPIOS_DIRECTFILEOUTPUTSTREAM_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Define the zipios::DirectFileOutputStream class.
+ *
+ * The zipios::DirectFileOutputStream class is an output file stream
+ * which bypasses the page cache. It is used to write very large
+ * Zip archives.
+ */
+
+#include "zipios/zipios-config.hpp"
+
+#include <memory>
+#include <ostream>
+#include <string>
+
+
+namespace zipios
+{
+
+
+class DirectFileStreambuf;
+
+
+class DirectFileOutputStream : public std::ostream
+{
+public:
+                        DirectFileOutputStream(std::string const & filename, size_t buffer_size = 1024 * 1024);
+    virtual             ~DirectFileOutputStream() override;
+
+    bool                isDirect() const;
+    void                preallocate(offset_t size);
+    void                close();
+
+private:
+    std::unique_ptr<DirectFileStreambuf>
+                        m_dfsb;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
@@ -51,12 +51,18 @@ public:
     virtual FileEntry::pointer_t    getEntry(std::string const& name, MatchPath matchpath = MatchPath::MATCH) const override;
     virtual stream_pointer_t        getInputStream(std::string const& entry_name, MatchPath matchpath = MatchPath::MATCH) override;
 
+    bool                            isMemoryMapped() const;
+    size_t                          getMemoryMappedMinimumSize() const;
+    void                            setMemoryMapped(bool memory_mapped, size_t minimum_size = 64 * 1024);
+
 protected:
     void                            loadEntries() const;
     void                            load(FilePath const& subdir);
 
     mutable bool                    m_entries_loaded = false;
     bool                            m_recursive = true;
+    bool                            m_memory_mapped = false;
+    size_t                          m_memory_mapped_minimum_size = 64 * 1024;
     FilePath                        m_filepath;
 };
 
@@ -0,0 +1,117 @@
+#pragma once
+#ifndef ZIPIOS_EMBEDDEDCOLLECTION_HPP
+#define ZIPIOS_EMBEDDEDCOLLECTION_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Define the zipios::EmbeddedCollection class.
+ *
+ * The zipios::EmbeddedCollection class gives access to a Zip archive
+ * which was compiled in the program with the zipembed tool.
+ */
+
+#include "zipios/filecollection.hpp"
+
+#include <cstdint>
+
+
+namespace zipios
+{
+
+
+struct EmbeddedArchiveEntry
+{
+    char const *        m_name;
+    size_t              m_name_length;
+    size_t              m_offset;
+    size_t              m_compressed_size;
+    size_t              m_size;
+    uint32_t            m_crc32;
+    uint32_t            m_dosdatetime;
+    uint16_t            m_method;
+    bool                m_is_directory;
+};
+
+
+struct EmbeddedArchive
+{
+    unsigned char const *           m_data;
+    size_t                          m_data_size;
+    EmbeddedArchiveEntry const *    m_entries;
+    size_t                          m_entry_count;
+    int32_t const *                 m_displacements;
+};
+
+
+constexpr uint32_t embeddedHashStep(char const * name, size_t length, uint32_t hash)
+{
+    return length == 0
+            ? hash
+            : embeddedHashStep(name + 1, length - 1, (hash ^ static_cast<unsigned char>(*name)) * 16777619U);
+}
+
+
+constexpr uint32_t embeddedHash(char const * name, size_t length, uint32_t seed)
+{
+    return embeddedHashStep(name, length, (2166136261U ^ seed) * 16777619U);
+}
+
+
+class EmbeddedCollection : public FileCollection
+{
+public:
+    static size_t const             npos = static_cast<size_t>(-1);
+
+                                    EmbeddedCollection(EmbeddedArchive const & archive, std::string const & name = "embedded");
+    virtual pointer_t               clone() const override;
+    virtual                         ~EmbeddedCollection() override;
+
+    virtual void                    addEntry(FileEntry const & entry) override;
+    virtual void                    close() override;
+    virtual FileEntry::vector_t     entries() const override;
+    virtual FileEntry::pointer_t    getEntry(std::string const & name, MatchPath matchpath = MatchPath::MATCH) const override;
+    virtual stream_pointer_t        getInputStream(std::string const & entry_name, MatchPath matchpath = MatchPath::MATCH) override;
+    virtual size_t                  size() const override;
+
+    static size_t                   findEntry(EmbeddedArchive const & archive, std::string const & name);
+    static bool                     computePerfectHash(std::vector<std::string> const & names, std::vector<int32_t> & displacements, std::vector<size_t> & slots);
+
+private:
+    size_t                          findIndex(std::string const & name, MatchPath matchpath) const;
+    FileEntry::pointer_t            createEntry(size_t index) const;
+
+    EmbeddedArchive const *         m_archive = nullptr;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
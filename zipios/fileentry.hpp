@@ -68,7 +68,8 @@ enum class StorageMethod : uint8_t
     NEW_TERSE   = 18,
     LZ77        = 19,
     WAVPACK     = 97,
-    PPMD_I_1    = 98
+    PPMD_I_1    = 98,
+    AES         = 99
 };
 
 
@@ -98,6 +99,7 @@ public:
     virtual std::string         getComment() const;
     virtual size_t              getCompressedSize() const;
     virtual crc32_t             getCrc() const;
+    std::streampos              getDataOffset() const;
     std::streampos              getEntryOffset() const;
     virtual buffer_t            getExtra() const;
     virtual size_t              getHeaderSize() const;
@@ -116,6 +118,7 @@ public:
     virtual void                setComment(std::string const& comment);
     virtual void                setCompressedSize(size_t size);
     virtual void                setCrc(crc32_t crc);
+    void                        setDataOffset(std::streampos offset);
     void                        setEntryOffset(std::streampos offset);
     virtual void                setExtra(buffer_t const& extra);
     virtual void                setLevel(CompressionLevel level);
@@ -134,6 +137,7 @@ protected:
     size_t                      m_uncompressed_size = 0;
     time_t                      m_unix_time = 0;
     std::streampos              m_entry_offset = 0;
+    std::streampos              m_data_offset = 0;
     StorageMethod               m_compress_method = StorageMethod::STORED;
     CompressionLevel            m_compression_level = COMPRESSION_LEVEL_DEFAULT;
     uint32_t                    m_crc_32 = 0;
@@ -35,6 +35,7 @@
 
 #include "zipios/zipios-config.hpp"
 
+#include <cstdint>
 #include <ctime>
 #include <string>
 
@@ -69,6 +70,8 @@ public:
     bool                isFifo() const;
     size_t              fileSize() const;
     std::time_t         lastModificationTime() const;
+    uint64_t            deviceID() const;
+    uint64_t            inodeNumber() const;
 
 private:
     void                check() const;
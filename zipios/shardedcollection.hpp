@@ -0,0 +1,81 @@
+#pragma once
+#ifndef ZIPIOS_SHARDEDCOLLECTION_HPP
+#define ZIPIOS_SHARDEDCOLLECTION_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Define the zipios::ShardedCollection class.
+ *
+ * The zipios::ShardedCollection class writes a collection in a set of
+ * Zip archives, the shards, and gives access to such a set as one
+ * collection.
+ */
+
+#include "zipios/collectioncollection.hpp"
+#include "zipios/zipoutputoptions.hpp"
+
+#include <unordered_map>
+
+
+namespace zipios
+{
+
+
+class ShardedCollection : public CollectionCollection
+{
+public:
+    enum class ShardMode : uint32_t
+    {
+        NAME_HASH,
+        SIZE_BUDGET
+    };
+
+    explicit                        ShardedCollection(std::string const & manifest_filename);
+    virtual pointer_t               clone() const override;
+    virtual                         ~ShardedCollection() override;
+
+    virtual void                    close() override;
+    virtual FileEntry::pointer_t    getEntry(std::string const & name, MatchPath matchpath = MatchPath::MATCH) const override;
+    virtual stream_pointer_t        getInputStream(std::string const & entry_name, MatchPath matchpath = MatchPath::MATCH) override;
+    size_t                          getShardCount() const;
+
+    static std::string              saveCollectionToShards(FileCollection & collection, std::string const & basename, ShardMode mode, offset_t limit, ZipOutputOptions const & options = ZipOutputOptions());
+
+private:
+    typedef std::unordered_map<std::string, size_t> routes_t;
+
+    routes_t                        m_routes = routes_t();
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef ZIPIOS_VIRTUALZIPARCHIVE_HPP
+#define ZIPIOS_VIRTUALZIPARCHIVE_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Define the zipios::VirtualZipArchive class.
+ *
+ * The zipios::VirtualZipArchive class computes the exact layout of a
+ * Zip archive of STORED entries before it gets written and generates
+ * any range of its bytes on demand.
+ */
+
+#include "zipios/fileentry.hpp"
+
+#include <functional>
+
+
+namespace zipios
+{
+
+
+class VirtualZipArchive
+{
+public:
+    typedef std::function<void(size_t index, offset_t offset, char * buffer, size_t size)>    data_reader_t;
+
+                        VirtualZipArchive(FileEntry::vector_t const & entries, std::string const & zip_comment = "");
+
+    size_t              size() const;
+    FileEntry::pointer_t getEntry(size_t index) const;
+    offset_t            getArchiveSize() const;
+    offset_t            getHeaderOffset(size_t index) const;
+    offset_t            getPayloadOffset(size_t index) const;
+    offset_t            getCentralDirectoryOffset() const;
+    void                setDataReader(data_reader_t const & reader);
+    size_t              read(offset_t offset, char * buffer, size_t size);
+
+private:
+    typedef std::vector<offset_t>   offset_vector_t;
+
+    void                verifyIndex(size_t index) const;
+    void                readData(size_t index, offset_t offset, char * buffer, size_t size);
+    void                computeCrc(size_t index);
+    std::string const & centralDirectory();
+
+    FileEntry::vector_t m_entries = FileEntry::vector_t();
+    offset_vector_t     m_header_offsets = offset_vector_t();
+    std::string         m_zip_comment = std::string();
+    offset_t            m_central_directory_offset = 0;
+    offset_t            m_archive_size = 0;
+    data_reader_t       m_reader = data_reader_t();
+    std::string         m_central_directory = std::string();
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif
@@ -38,15 +38,43 @@
 
 #include "zipios/filecollection.hpp"
 #include "zipios/virtualseeker.hpp"
+#include "zipios/zipoutputoptions.hpp"
+
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
 
 
 namespace zipios
 {
 
 
+class SharedFile;
+class ZipEndOfCentralDirectory;
+
+
 class ZipFile : public FileCollection
 {
 public:
+    enum class AccessPattern : uint32_t
+    {
+        NORMAL,
+        SEQUENTIAL,
+        ONE_PASS
+    };
+
+    struct arena_t
+    {
+        typedef std::pair<size_t, size_t>                   range_t;
+        typedef std::unordered_map<std::string, range_t>    offsets_t;
+
+        std::unique_ptr<char[]>     m_data;
+        size_t                      m_size = 0;
+        offsets_t                   m_offsets;
+    };
+
+    typedef std::function<bool(FileEntry const & entry)>    entry_filter_t;
+
     static pointer_t            openEmbeddedZipFile(std::string const & name);
 
                                 ZipFile();
@@ -54,11 +82,41 @@ public:
     virtual pointer_t           clone() const override;
     virtual                     ~ZipFile() override;
 
+    virtual void                close() override;
+    virtual FileEntry::pointer_t getEntry(std::string const & name, MatchPath matchpath = MatchPath::MATCH) const override;
     virtual stream_pointer_t    getInputStream(std::string const & entry_name, MatchPath matchpath = MatchPath::MATCH) override;
-    static void                 saveCollectionToArchive(std::ostream & os, FileCollection & collection, std::string const & zip_comment = "");
+    arena_t                     loadArena(entry_filter_t const & filter, size_t thread_count = 0) const;
+    void                        prefetch(FileEntry::vector_t const & entries) const;
+    void                        setAccessPattern(AccessPattern pattern, size_t read_ahead_entries = 4);
+    void                        setReadAhead(size_t buffer_size);
+    void                        setPassword(std::string const & password);
+    void                        setAccessRecording(bool record);
+    std::vector<std::string> const &
+                                getAccessProfile() const;
+    void                        saveAccessProfile(std::string const & filename) const;
+    static void                 saveCollectionToArchive(std::ostream & os, FileCollection & collection, std::string const & zip_comment = "", ZipOutputOptions const & options = ZipOutputOptions());
 
 private:
+    typedef std::unordered_multimap<size_t, size_t>
+                                index_shard_t;
+
+    void                        readCentralDirectory(std::istream & zipfile, ZipEndOfCentralDirectory const & eocd);
+    size_t                      getEntryIndex(FileEntry::pointer_t const & entry) const;
+
     VirtualSeeker               m_vs;
+    std::shared_ptr<SharedFile> m_file;
+    AccessPattern               m_access_pattern = AccessPattern::NORMAL;
+    size_t                      m_read_ahead_entries = 0;
+    size_t                      m_advised_entries = 0;
+    size_t                      m_last_index = static_cast<size_t>(-1);
+    size_t                      m_read_ahead_size = 0;
+    bool                        m_record_accesses = false;
+    std::vector<std::string>    m_access_profile;
+    std::unordered_set<std::string>
+                                m_accessed_entries;
+    std::vector<index_shard_t>  m_index;
+    size_t                      m_indexed_entries = 0;
+    std::string                 m_password;
 };
 
 
@@ -0,0 +1,118 @@
+#pragma once
+#ifndef ZIPIOS_ZIPOUTPUTOPTIONS_HPP
+#define ZIPIOS_ZIPOUTPUTOPTIONS_HPP
+
+/*
+  Zipios -- a small C++ library that provides easy access to .zip files.
+
+  Copyright (C) 2000-2007  Thomas Sondergaard
+  Copyright (C) 2015-2019  Made to Order Software Corporation
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/** \file
+ * \brief Define the zipios::ZipOutputOptions class.
+ *
+ * The zipios::ZipOutputOptions class holds the settings used when
+ * a collection gets saved in a Zip archive.
+ */
+
+#include "zipios/contentdigest.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+
+namespace zipios
+{
+
+
+class ZipOutputOptions
+{
+public:
+    typedef std::function<void(FileEntry::pointer_t entry, ContentDigest::digest_map_t const & digests)>
+                        digest_callback_t;
+
+                        ZipOutputOptions();
+
+    size_t              getWriteBehindBufferCount() const;
+    size_t              getWriteBehindBufferSize() const;
+    void                setWriteBehind(size_t buffer_count, size_t buffer_size = 64 * 1024);
+    std::string const & getPreviousArchive() const;
+    bool                getVerifyPreviousCrc() const;
+    void                setPreviousArchive(std::string const & filename, bool verify_crc = false);
+    std::string const & getBlobCache() const;
+    void                setBlobCache(std::string const & directory);
+    std::vector<std::string> const &
+                        getAccessProfile() const;
+    void                setAccessProfile(std::vector<std::string> const & names);
+    void                loadAccessProfile(std::string const & filename);
+    bool                getRsyncable() const;
+    void                setRsyncable(bool rsyncable);
+    std::string const & getPassword() const;
+    void                setPassword(std::string const & password);
+    ContentDigest::algorithm_vector_t const &
+                        getDigestAlgorithms() const;
+    bool                getStoreDigests() const;
+    void                setDigestAlgorithms(ContentDigest::algorithm_vector_t const & algorithms, bool store_digests = false);
+    digest_callback_t const &
+                        getDigestCallback() const;
+    void                setDigestCallback(digest_callback_t const & callback);
+    size_t              getCompressionThreads() const;
+    void                setCompressionThreads(size_t count);
+    size_t              getStoredAlignment() const;
+    void                setStoredAlignment(size_t alignment);
+    size_t              getCentralDirectoryMemoryLimit() const;
+    double              getCompressionBudget() const;
+    void                setCompressionBudget(double throughput);
+    double              getCompressionTimeBudget() const;
+    void                setCompressionTimeBudget(double seconds);
+    void                setCentralDirectoryMemoryLimit(size_t limit);
+
+private:
+    size_t              m_write_behind_buffer_count = 0;
+    size_t              m_write_behind_buffer_size = 0;
+    std::string         m_previous_archive;
+    bool                m_verify_previous_crc = false;
+    std::string         m_blob_cache;
+    std::vector<std::string>
+                        m_access_profile;
+    bool                m_rsyncable = false;
+    std::string         m_password;
+    ContentDigest::algorithm_vector_t
+                        m_digest_algorithms;
+    bool                m_store_digests = false;
+    digest_callback_t   m_digest_callback;
+    size_t              m_compression_threads = 0;
+    size_t              m_stored_alignment = 0;
+    size_t              m_central_directory_memory_limit = 0;
+    double              m_compression_budget = 0.0;
+    double              m_compression_time_budget = 0.0;
+};
+
+
+} // zipios namespace
+
+// Local Variables:
+// mode: cpp
+// indent-tabs-mode: nil
+// c-basic-offset: 4
+// tab-width: 4
+// End:
+
+// vim: ts=4 sw=4 et
+#endif